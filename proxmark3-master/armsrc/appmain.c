@@ -26,6 +26,7 @@
 #include "BigBuf.h"
 #include "mifareutil.h"
 #include "pcf7931.h"
+#include "lfsimpack.h"
 #ifdef WITH_LCD
  #include "LCD.h"
 #endif
@@ -921,6 +922,26 @@ void ListenReaderField(int limit)
 	}
 }
 
+// Encoded sample upload, only the SIM_SAMPLES_SYNC frames are answered
+static void DownloadEncodedSimSamples(UsbCommand *c)
+{
+	static bool isOK = true;
+	uint32_t offset = c->arg[0];
+	uint32_t len = MIN(c->arg[2] >> 16, USB_CMD_DATA_SIZE);
+
+	if (offset == 0)
+		isOK = true;
+
+	int n = -1;
+	if (offset < BIGBUF_SIZE)
+		n = lfsim_decode(c->arg[2] & SIM_SAMPLES_ENCODING, c->d.asBytes, len, BigBuf_get_addr() + offset, BIGBUF_SIZE - offset);
+	if (n < 0)
+		isOK = false;
+
+	if (c->arg[2] & SIM_SAMPLES_SYNC)
+		cmd_send(CMD_ACK,SIM_SAMPLES_ENCODED,isOK,n < 0 ? offset : offset + n,0,0);
+}
+
 void UsbPacketReceived(uint8_t *packet, int len)
 {
 	UsbCommand *c = (UsbCommand *)packet;
@@ -1301,6 +1322,11 @@ void UsbPacketReceived(uint8_t *packet, int len)
 			else
 				FpgaDownloadAndGo(FPGA_BITSTREAM_HF);
 
+			if (c->arg[2] & SIM_SAMPLES_ENCODED) {
+				DownloadEncodedSimSamples(c);
+				break;
+			}
+
 			uint8_t *b = BigBuf_get_addr();
 			memcpy(b+c->arg[0], c->d.asBytes, USB_CMD_DATA_SIZE);
 			cmd_send(CMD_ACK,0,0,0,0,0);
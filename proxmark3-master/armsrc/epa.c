@@ -277,7 +277,46 @@ static void EPA_PACE_Collect_Nonce_Abort(uint8_t step, int func_return)
 }
 
 //-----------------------------------------------------------------------------
-// Acquire one encrypted PACE nonce
+// Acquire encrypted PACE nonces until count were collected or the client stops it,
+// see COLLECT_RECORDS in usb_cmd.h. A failed try is counted and the next one starts
+// with a new field.
+//-----------------------------------------------------------------------------
+static void EPA_PACE_Collect_Nonces(uint8_t requested_size, uint32_t count, uint32_t pause_ms)
+{
+	collect_batch_t batch;
+	pace_version_info_t pace_version_info;
+	bool have_pace_info = false;
+	// holds the CardAccess file first, then the nonces
+	uint8_t buf[256];
+	uint32_t collected = 0;
+
+	CollectStart(&batch);
+	do {
+		if (EPA_Setup() == 0) {
+			// the CardAccess file doesn't change, read it once
+			if (!have_pace_info) {
+				int card_access_length = EPA_Read_CardAccess(buf, sizeof(buf));
+				have_pace_info = card_access_length >= 18
+					&& EPA_Parse_CardAccess(buf, card_access_length, &pace_version_info) == 0
+					&& pace_version_info.version != 0;
+			}
+			if (have_pace_info) {
+				EPA_PACE_MSE_Set_AT(pace_version_info, 2);
+				int nonce_length = EPA_PACE_Get_Nonce(requested_size, buf);
+				if (nonce_length >= 0) {
+					CollectAdd(&batch, buf, nonce_length);
+					collected++;
+				}
+			}
+		}
+		EPA_Finish();
+		if (pause_ms) SpinDelay(pause_ms);
+	} while (CollectTried(&batch) && (count == 0 || collected < count));
+	CollectSend(&batch, true);
+}
+
+//-----------------------------------------------------------------------------
+// Acquire one encrypted PACE nonce, or many with COLLECT_RECORDS
 //-----------------------------------------------------------------------------
 void EPA_PACE_Collect_Nonce(UsbCommand *c)
 {
@@ -292,6 +331,11 @@ void EPA_PACE_Collect_Nonce(UsbCommand *c)
 	 * 		Encrypted nonce
 	 */
 
+	if (c->arg[2] & COLLECT_RECORDS) {
+		EPA_PACE_Collect_Nonces((uint8_t)c->arg[0], c->arg[1], c->arg[2] >> 16);
+		return;
+	}
+
 	// return value of a function
 	int func_return = 0;
 
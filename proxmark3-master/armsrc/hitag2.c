@@ -20,6 +20,7 @@
 #include "apps.h"
 #include "util.h"
 #include "hitag2.h"
+#include "hitag2_crypto.h"
 #include "string.h"
 #include "BigBuf.h"
 
@@ -84,82 +85,6 @@ static byte_t key[8];
 static byte_t writedata[4];
 static uint64_t cipher_state;
 
-/* Following is a modified version of cryptolib.com/ciphers/hitag2/ */
-// Software optimized 48-bit Philips/NXP Mifare Hitag2 PCF7936/46/47/52 stream cipher algorithm by I.C. Wiener 2006-2007.
-// For educational purposes only.
-// No warranties or guarantees of any kind.
-// This code is released into the public domain by its author.
-
-// Basic macros:
-
-#define u8				uint8_t
-#define u32				uint32_t
-#define u64				uint64_t
-#define rev8(x)			((((x)>>7)&1)+((((x)>>6)&1)<<1)+((((x)>>5)&1)<<2)+((((x)>>4)&1)<<3)+((((x)>>3)&1)<<4)+((((x)>>2)&1)<<5)+((((x)>>1)&1)<<6)+(((x)&1)<<7))
-#define rev16(x)		(rev8 (x)+(rev8 (x>> 8)<< 8))
-#define rev32(x)		(rev16(x)+(rev16(x>>16)<<16))
-#define rev64(x)		(rev32(x)+(rev32(x>>32)<<32))
-#define bit(x,n)		(((x)>>(n))&1)
-#define bit32(x,n)		((((x)[(n)>>5])>>((n)))&1)
-#define inv32(x,i,n)	((x)[(i)>>5]^=((u32)(n))<<((i)&31))
-#define rotl64(x, n)	((((u64)(x))<<((n)&63))+(((u64)(x))>>((0-(n))&63)))
-
-// Single bit Hitag2 functions:
-
-#define i4(x,a,b,c,d)	((u32)((((x)>>(a))&1)+(((x)>>(b))&1)*2+(((x)>>(c))&1)*4+(((x)>>(d))&1)*8))
-
-static const u32 ht2_f4a = 0x2C79;		// 0010 1100 0111 1001
-static const u32 ht2_f4b = 0x6671;		// 0110 0110 0111 0001
-static const u32 ht2_f5c = 0x7907287B;	// 0111 1001 0000 0111 0010 1000 0111 1011
-
-static u32 _f20 (const u64 x)
-{
- 	u32					i5;
-	
-	i5 = ((ht2_f4a >> i4 (x, 1, 2, 4, 5)) & 1)* 1
-		+ ((ht2_f4b >> i4 (x, 7,11,13,14)) & 1)* 2
-		+ ((ht2_f4b >> i4 (x,16,20,22,25)) & 1)* 4
-		+ ((ht2_f4b >> i4 (x,27,28,30,32)) & 1)* 8
-		+ ((ht2_f4a >> i4 (x,33,42,43,45)) & 1)*16;
-
-	return (ht2_f5c >> i5) & 1;
-}
-
-static u64 _hitag2_init (const u64 key, const u32 serial, const u32 IV)
-{
-	u32					i;
-	u64					x = ((key & 0xFFFF) << 32) + serial;
-
-	for (i = 0; i < 32; i++)
-	{
-		x >>= 1;
-		x += (u64) (_f20 (x) ^ (((IV >> i) ^ (key >> (i+16))) & 1)) << 47;
-	}
-	return x;
-}
-
-static u64 _hitag2_round (u64 *state)
-{
-	u64					x = *state;
-
-	x = (x >>  1) +
-		((((x >>  0) ^ (x >>  2) ^ (x >>  3) ^ (x >>  6)
-		   ^ (x >>  7) ^ (x >>  8) ^ (x >> 16) ^ (x >> 22)
-		   ^ (x >> 23) ^ (x >> 26) ^ (x >> 30) ^ (x >> 41)
-		   ^ (x >> 42) ^ (x >> 43) ^ (x >> 46) ^ (x >> 47)) & 1) << 47);
-
-	*state = x;
-	return _f20 (x);
-}
-
-static u32 _hitag2_byte (u64 * x)
-{
-	u32					i, c;
-
-	for (i = 0, c = 0; i < 8; i++) c += (u32) _hitag2_round (x) << (i^7);
-	return c;
-}
-
 static int hitag2_reset(void)
 {
 	tag.state = TAG_STATE_RESET;
@@ -18,6 +18,7 @@
 #include "util.h"
 #include "hitagS.h"
 #include "hitag2.h"
+#include "hitag2_crypto.h"
 #include "string.h"
 #include "BigBuf.h"
 
@@ -27,14 +28,6 @@
 #define u8				uint8_t
 #define u32				uint32_t
 #define u64				uint64_t
-#define rev8(x)			((((x)>>7)&1)+((((x)>>6)&1)<<1)+((((x)>>5)&1)<<2)+((((x)>>4)&1)<<3)+((((x)>>3)&1)<<4)+((((x)>>2)&1)<<5)+((((x)>>1)&1)<<6)+(((x)&1)<<7))
-#define rev16(x)		(rev8 (x)+(rev8 (x>> 8)<< 8))
-#define rev32(x)		(rev16(x)+(rev16(x>>16)<<16))
-#define rev64(x)		(rev32(x)+(rev32(x>>32)<<32))
-#define bit(x,n)		(((x)>>(n))&1)
-#define bit32(x,n)		((((x)[(n)>>5])>>((n)))&1)
-#define inv32(x,i,n)	((x)[(i)>>5]^=((u32)(n))<<((i)&31))
-#define rotl64(x, n)	((((u64)(x))<<((n)&63))+(((u64)(x))>>((0-(n))&63)))
 
 static bool bQuiet;
 static bool bSuccessful;
@@ -54,56 +47,6 @@ static int test = 0;
 size_t blocknr;
 bool end=false;
 
-// Single bit Hitag2 functions:
-#define i4(x,a,b,c,d)	((u32)((((x)>>(a))&1)+(((x)>>(b))&1)*2+(((x)>>(c))&1)*4+(((x)>>(d))&1)*8))
-static const u32 ht2_f4a = 0x2C79;			// 0010 1100 0111 1001
-static const u32 ht2_f4b = 0x6671;			// 0110 0110 0111 0001
-static const u32 ht2_f5c = 0x7907287B;			// 0111 1001 0000 0111 0010 1000 0111 1011
-#define ht2bs_4a(a,b,c,d)	(~(((a|b)&c)^(a|d)^b))
-#define ht2bs_4b(a,b,c,d)	(~(((d|c)&(a^b))^(d|a|b)))
-#define ht2bs_5c(a,b,c,d,e)	(~((((((c^e)|d)&a)^b)&(c^b))^(((d^e)|a)&((d^b)|c))))
-#define uf20bs				u32		
-
-static u32 f20(const u64 x) {
-	u32 i5;
-
-	i5 = ((ht2_f4a >> i4(x, 1, 2, 4, 5)) & 1) * 1
-			+ ((ht2_f4b >> i4(x, 7, 11, 13, 14)) & 1) * 2
-			+ ((ht2_f4b >> i4(x, 16, 20, 22, 25)) & 1) * 4
-			+ ((ht2_f4b >> i4(x, 27, 28, 30, 32)) & 1) * 8
-			+ ((ht2_f4a >> i4(x, 33, 42, 43, 45)) & 1) * 16;
-
-	return (ht2_f5c >> i5) & 1;
-}
-static u64 hitag2_round(u64 *state) {
-	u64 x = *state;
-
-	x = (x >> 1)
-			+ ((((x >> 0) ^ (x >> 2) ^ (x >> 3) ^ (x >> 6) ^ (x >> 7) ^ (x >> 8)
-					^ (x >> 16) ^ (x >> 22) ^ (x >> 23) ^ (x >> 26) ^ (x >> 30)
-					^ (x >> 41) ^ (x >> 42) ^ (x >> 43) ^ (x >> 46) ^ (x >> 47))
-					& 1) << 47);
-
-	*state = x;
-	return f20(x);
-}
-static u64 hitag2_init(const u64 key, const u32 serial, const u32 IV) {
-	u32 i;
-	u64 x = ((key & 0xFFFF) << 32) + serial;
-	for (i = 0; i < 32; i++) {
-		x >>= 1;
-		x += (u64) (f20(x) ^ (((IV >> i) ^ (key >> (i + 16))) & 1)) << 47;
-	}
-	return x;
-}
-static u32 hitag2_byte(u64 *x) {
-	u32 i, c;
-
-	for (i = 0, c = 0; i < 8; i++)
-		c += (u32) hitag2_round(x) << (i ^ 7);
-	return c;
-}
-
 // Sam7s has several timers, we will use the source TIMER_CLOCK1 (aka AT91C_TC_CLKS_TIMER_DIV1_CLOCK)
 // TIMER_CLOCK1 = MCK/2, MCK is running at 48 MHz, Timer is running at 48/2 = 24 MHz
 // Hitag units (T0) have duration of 8 microseconds (us), which is 1/125000 per second (carrier)
@@ -453,7 +396,7 @@ static void hitagS_handle_reader_command(byte_t* rx, const size_t rxlen,
 		Dbprintf("Challenge for UID: %X", temp_uid);
 		temp2++;
 		*txlen = 32;
-		state = hitag2_init(rev64(tag.key), rev32(tag.pages[0][0]),
+		state = _hitag2_init(rev64(tag.key), rev32(tag.pages[0][0]),
 				rev32(((rx[3] << 24) + (rx[2] << 16) + (rx[1] << 8) + rx[0])));
 		Dbprintf(
 				",{0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X}",
@@ -476,12 +419,12 @@ static void hitagS_handle_reader_command(byte_t* rx, const size_t rxlen,
 		}
 
 		for (i = 0; i < 4; i++)
-			hitag2_byte(&state);
+			_hitag2_byte(&state);
 		//send con2,pwdh0,pwdl0,pwdl1 encrypted as a response
-		tx[0] = hitag2_byte(&state) ^ ((tag.pages[0][1] >> 16) & 0xff);
-		tx[1] = hitag2_byte(&state) ^ tag.pwdh0;
-		tx[2] = hitag2_byte(&state) ^ tag.pwdl0;
-		tx[3] = hitag2_byte(&state) ^ tag.pwdl1;
+		tx[0] = _hitag2_byte(&state) ^ ((tag.pages[0][1] >> 16) & 0xff);
+		tx[1] = _hitag2_byte(&state) ^ tag.pwdh0;
+		tx[2] = _hitag2_byte(&state) ^ tag.pwdl0;
+		tx[3] = _hitag2_byte(&state) ^ tag.pwdl1;
 		if (tag.mode != STANDARD) {
 			//add crc8
 			*txlen = 40;
@@ -490,7 +433,7 @@ static void hitagS_handle_reader_command(byte_t* rx, const size_t rxlen,
 			calc_crc(&crc, tag.pwdh0, 8);
 			calc_crc(&crc, tag.pwdl0, 8);
 			calc_crc(&crc, tag.pwdl1, 8);
-			tx[4] = (crc ^ hitag2_byte(&state));
+			tx[4] = (crc ^ _hitag2_byte(&state));
 		}
 		/*
 		 * some readers do not allow to authenticate multiple times in a row with the same tag.
@@ -859,11 +802,11 @@ static int hitagS_handle_tag_auth(hitag_function htf,uint64_t key, uint64_t NrAr
 			*txlen = 64;
 			if(end!=true){
 				if(htf==02||htf==04){ //RHTS_KEY //WHTS_KEY
-					state = hitag2_init(rev64(key), rev32(tag.uid),
+					state = _hitag2_init(rev64(key), rev32(tag.uid),
 							rev32(rnd));
 
 					for (i = 0; i < 4; i++) {
-						auth_ks[i] = hitag2_byte(&state) ^ 0xff;
+						auth_ks[i] = _hitag2_byte(&state) ^ 0xff;
 					}
 					*txlen = 64;
 					tx[0] = rnd & 0xff;
@@ -911,15 +854,15 @@ static int hitagS_handle_tag_auth(hitag_function htf,uint64_t key, uint64_t NrAr
 		pwdl1=0;
 		if(htf==02 || htf==04){ //RHTS_KEY //WHTS_KEY
 		{
-			state = hitag2_init(rev64(key), rev32(tag.uid), rev32(rnd));
+			state = _hitag2_init(rev64(key), rev32(tag.uid), rev32(rnd));
 			for (i = 0; i < 5; i++)
-				hitag2_byte(&state);
+				_hitag2_byte(&state);
 			pwdh0 = ((rx[1] & 0x0f) * 16 + ((rx[2] & 0xf0) / 16))
-					^ hitag2_byte(&state);
+					^ _hitag2_byte(&state);
 			pwdl0 = ((rx[2] & 0x0f) * 16 + ((rx[3] & 0xf0) / 16))
-					^ hitag2_byte(&state);
+					^ _hitag2_byte(&state);
 			pwdl1 = ((rx[3] & 0x0f) * 16 + ((rx[4] & 0xf0) / 16))
-					^ hitag2_byte(&state);
+					^ _hitag2_byte(&state);
 		}
 
 		if (DEBUG)
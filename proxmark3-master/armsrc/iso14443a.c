@@ -25,6 +25,7 @@
 #include "BigBuf.h"
 #include "protocols.h"
 #include "parity.h"
+#include "usb_cdc.h" // for usb_poll_validate_length
 
 typedef struct {
 	enum {
@@ -2000,6 +2001,78 @@ int iso14_apdu(uint8_t *cmd, uint16_t cmd_len, void *data) {
 }
 
 
+//-----------------------------------------------------------------------------
+// Batches of collected UIDs or nonces, see COLLECT_RECORDS in usb_cmd.h
+//-----------------------------------------------------------------------------
+// a batch is sent when it is full or this old
+#define COLLECT_BATCH_MS	250
+
+void CollectStart(collect_batch_t *batch)
+{
+	batch->len = 0;
+	batch->records = 0;
+	batch->tries = 0;
+	batch->start = GetTickCount();
+}
+
+void CollectSend(collect_batch_t *batch, bool last)
+{
+	LED_B_ON();
+	cmd_send(CMD_ACK, batch->records, batch->tries, COLLECT_RECORDS | (last ? COLLECT_LAST : 0), batch->data, batch->len);
+	LED_B_OFF();
+	CollectStart(batch);
+}
+
+// add a record, after sending the batch if it doesn't fit any more
+void CollectAdd(collect_batch_t *batch, const uint8_t *data, uint8_t len)
+{
+	if (batch->len + 1 + len > sizeof(batch->data)) {
+		CollectSend(batch, false);
+	}
+	batch->data[batch->len++] = len;
+	memcpy(batch->data + batch->len, data, len);
+	batch->len += len;
+	batch->records++;
+}
+
+// count a try and send the batch when it is old enough. Returns false when the
+// button was pressed or a command arrived, to stop collecting.
+bool CollectTried(collect_batch_t *batch)
+{
+	batch->tries++;
+	if (GetTickCount() - batch->start >= COLLECT_BATCH_MS) {
+		CollectSend(batch, false);
+	}
+	return !BUTTON_PRESS() && !usb_poll_validate_length();
+}
+
+//-----------------------------------------------------------------------------
+// Repeat the anticollision with a field reset in between, see ISO14A_COLLECT_UIDS
+// in usb_cmd.h
+//-----------------------------------------------------------------------------
+static void ReaderIso14443a_CollectUIDs(uint32_t count, uint32_t field_off_ms)
+{
+	collect_batch_t batch;
+	iso14a_card_select_t card;
+	uint32_t collected = 0;
+
+	set_tracing(false);
+	LED_A_ON();
+	CollectStart(&batch);
+	do {
+		iso14443a_setup(FPGA_HF_ISO14443A_READER_LISTEN);
+		int res = iso14443a_select_card(NULL, &card, NULL, true, 0, true);
+		FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF);
+		if (res == 1 || res == 2) {
+			CollectAdd(&batch, card.uid, card.uidlen);
+			collected++;
+		}
+		if (field_off_ms) SpinDelay(field_off_ms);
+	} while (CollectTried(&batch) && (count == 0 || collected < count));
+	CollectSend(&batch, true);
+	LEDsoff();
+}
+
 //-----------------------------------------------------------------------------
 // Read an ISO 14443a tag. Send out commands and store answers.
 //
@@ -2015,6 +2088,11 @@ void ReaderIso14443a(UsbCommand *c)
 	byte_t buf[USB_CMD_DATA_SIZE] = {0};
 	uint8_t par[MAX_PARITY_SIZE];
 	bool cantSELECT = false;
+
+	if(param & ISO14A_COLLECT_UIDS) {
+		ReaderIso14443a_CollectUIDs(c->arg[1], c->arg[2] >> 16);
+		return;
+	}
   
 	set_tracing(true);
 	
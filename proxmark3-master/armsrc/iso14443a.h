@@ -27,6 +27,15 @@ typedef struct {
   uint8_t  par; // enough for precalculated parity of 8 Byte responses
 } tag_response_info_t;
 
+// a batch of collected UIDs or nonces, see COLLECT_RECORDS in usb_cmd.h
+typedef struct {
+  uint8_t  data[USB_CMD_DATA_SIZE];
+  uint16_t len;
+  uint16_t records;
+  uint32_t tries;
+  uint32_t start;
+} collect_batch_t;
+
 extern void GetParity(const uint8_t *pbtCmd, uint16_t len, uint8_t *par);
 extern void AppendCrc14443a(uint8_t *data, int len);
 
@@ -53,4 +62,9 @@ extern int iso14_apdu(uint8_t *cmd, uint16_t cmd_len, void *data);
 extern int iso14443a_select_card(uint8_t *uid_ptr, iso14a_card_select_t *resp_data, uint32_t *cuid_ptr, bool anticollision, uint8_t num_cascades, bool no_rats);
 extern void iso14a_set_trigger(bool enable);
 extern void iso14a_set_timeout(uint32_t timeout);
+
+extern void CollectStart(collect_batch_t *batch);
+extern void CollectAdd(collect_batch_t *batch, const uint8_t *data, uint8_t len);
+extern bool CollectTried(collect_batch_t *batch);
+extern void CollectSend(collect_batch_t *batch, bool last);
 #endif /* __ISO14443A_H */
@@ -1297,10 +1297,11 @@ void T55xxWriteBlock(uint32_t Data, uint32_t Block, uint32_t Pwd, uint8_t arg) {
 }
 
 // Read one card block in page [page]
-void T55xxReadBlock(uint16_t arg0, uint8_t Block, uint32_t Pwd) {
+void T55xxReadBlock(uint32_t arg0, uint8_t Block, uint32_t Pwd) {
 	LED_A_ON();
 	bool PwdMode = arg0 & 0x1;
 	uint8_t Page = (arg0 & 0x2) >> 1;
+	uint32_t samples = arg0 >> T55XX_READ_SAMPLES_SHIFT;
 	uint32_t i = 0;
 	bool RegReadMode = (Block == 0xFF);//regular read mode
 
@@ -1342,8 +1343,10 @@ void T55xxReadBlock(uint16_t arg0, uint8_t Block, uint32_t Pwd) {
 	TurnReadLFOn(210*8); 
 
 	// Acquisition
-	// Now do the acquisition
-	DoPartialAcquisition(0, true, 12000, 0);
+	// Now do the acquisition, only as many samples as the client needs
+	if (samples == 0 || samples > T55XX_READ_SAMPLES)
+		samples = T55XX_READ_SAMPLES;
+	DoPartialAcquisition(0, true, samples, 0);
 
 	// Turn the field off
 	FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF); // field off
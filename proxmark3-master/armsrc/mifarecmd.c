@@ -19,6 +19,7 @@
 #include "util.h"
 #include "parity.h"
 #include "crc.h"
+#include "crc16.h"
 
 #define HARDNESTED_AUTHENTICATION_TIMEOUT 848			// card times out 1ms after wrong authentication (according to NXP documentation)
 #define HARDNESTED_PRE_AUTHENTICATION_LEADTIME 400		// some (non standard) cards need a pause after select before they are ready for first authentication 
@@ -190,16 +191,27 @@ void MifareUReadBlock(uint8_t arg0, uint8_t arg1, uint8_t *datain)
 // Select, Authenticate, Read a MIFARE tag.
 // read sector (data = 4 x 16 bytes = 64 bytes, or 16 x 16 bytes = 256 bytes)
 //-----------------------------------------------------------------------------
+// C1C2C3 access bits of a data area (0..2) or the sector trailer (3)
+static uint8_t AccessConditions(uint8_t *trailer, uint8_t area)
+{
+	return ((trailer[7] >> (4 + area)) & 0x01) << 2 | ((trailer[8] >> area) & 0x01) << 1 | ((trailer[8] >> (4 + area)) & 0x01);
+}
+
 void MifareReadSector(uint8_t arg0, uint8_t arg1, uint8_t arg2, uint8_t *datain)
 {
   // params
 	uint8_t sectorNo = arg0;
 	uint8_t keyType = arg1;
+	bool keyAB = arg2 & MF_SECTOR_KEY_AB;
 	uint64_t ui64Key = 0;
 	ui64Key = bytes_to_num(datain, 6);
+	uint64_t ui64KeyB = bytes_to_num(datain + 6, 6);
 
 	// variables
 	byte_t isOK = 0;
+	uint16_t blocksRead = 0;
+	uint16_t keyBBlocks = 0;
+	uint8_t trailerNo = NumBlocksPerSector(sectorNo) - 1;
 	byte_t dataoutbuf[16 * 16];
 	uint8_t uid[10];
 	uint32_t cuid;
@@ -222,16 +234,56 @@ void MifareReadSector(uint8_t arg0, uint8_t arg1, uint8_t arg2, uint8_t *datain)
 	}
 
 
-	if(isOK && mifare_classic_auth(pcs, cuid, FirstBlockOfSector(sectorNo), keyType, ui64Key, AUTH_FIRST)) {
+	if(isOK && mifare_classic_auth(pcs, cuid, FirstBlockOfSector(sectorNo), keyAB ? 0 : keyType, ui64Key, AUTH_FIRST)) {
 		isOK = 0;
 		if (MF_DBGLEVEL >= 1)	Dbprintf("Auth error");
 	}
 
-	for (uint8_t blockNo = 0; isOK && blockNo < NumBlocksPerSector(sectorNo); blockNo++) {
-		if(mifare_classic_readblock(pcs, cuid, FirstBlockOfSector(sectorNo) + blockNo, dataoutbuf + 16 * blockNo)) {
+	if (keyAB) {
+		// the sector trailer first, key A can always read the access bits
+		if (isOK && mifare_classic_readblock(pcs, cuid, FirstBlockOfSector(sectorNo) + trailerNo, dataoutbuf + 16 * trailerNo)) {
 			isOK = 0;
-			if (MF_DBGLEVEL >= 1)	Dbprintf("Read sector %2d block %2d error", sectorNo, blockNo);
-			break;
+			if (MF_DBGLEVEL >= 1)	Dbprintf("Read sector %2d block %2d error", sectorNo, trailerNo);
+		}
+		if (isOK) {
+			blocksRead |= 1 << trailerNo;
+			for (uint8_t blockNo = 0; blockNo < trailerNo; blockNo++) {
+				uint8_t rights = AccessConditions(dataoutbuf + 16 * trailerNo, sectorNo < 32 ? blockNo : blockNo / 5);
+				if (rights == 0x07) continue;				// no key would work
+				if (rights == 0x03 || rights == 0x05) {		// only key B would work
+					keyBBlocks |= 1 << blockNo;
+					continue;
+				}
+				if(mifare_classic_readblock(pcs, cuid, FirstBlockOfSector(sectorNo) + blockNo, dataoutbuf + 16 * blockNo)) {
+					isOK = 0;
+					if (MF_DBGLEVEL >= 1)	Dbprintf("Read sector %2d block %2d error", sectorNo, blockNo);
+					break;
+				}
+				blocksRead |= 1 << blockNo;
+			}
+		}
+		if (isOK && keyBBlocks) {
+			if(mifare_classic_auth(pcs, cuid, FirstBlockOfSector(sectorNo), 1, ui64KeyB, AUTH_NESTED)) {
+				isOK = 0;
+				if (MF_DBGLEVEL >= 1)	Dbprintf("Auth error");
+			}
+			for (uint8_t blockNo = 0; isOK && blockNo < trailerNo; blockNo++) {
+				if (!(keyBBlocks & (1 << blockNo))) continue;
+				if(mifare_classic_readblock(pcs, cuid, FirstBlockOfSector(sectorNo) + blockNo, dataoutbuf + 16 * blockNo)) {
+					isOK = 0;
+					if (MF_DBGLEVEL >= 1)	Dbprintf("Read sector %2d block %2d error", sectorNo, blockNo);
+					break;
+				}
+				blocksRead |= 1 << blockNo;
+			}
+		}
+	} else {
+		for (uint8_t blockNo = 0; isOK && blockNo < NumBlocksPerSector(sectorNo); blockNo++) {
+			if(mifare_classic_readblock(pcs, cuid, FirstBlockOfSector(sectorNo) + blockNo, dataoutbuf + 16 * blockNo)) {
+				isOK = 0;
+				if (MF_DBGLEVEL >= 1)	Dbprintf("Read sector %2d block %2d error", sectorNo, blockNo);
+				break;
+			}
 		}
 	}
 
@@ -245,7 +297,7 @@ void MifareReadSector(uint8_t arg0, uint8_t arg1, uint8_t arg2, uint8_t *datain)
 	if (MF_DBGLEVEL >= 2) DbpString("READ SECTOR FINISHED");
 
 	LED_B_ON();
-	cmd_send(CMD_ACK,isOK,0,0,dataoutbuf,16*NumBlocksPerSector(sectorNo));
+	cmd_send(CMD_ACK,isOK,blocksRead,keyAB ? MF_SECTOR_KEY_AB : 0,dataoutbuf,16*NumBlocksPerSector(sectorNo));
 	LED_B_OFF();
 
 	// Thats it...
@@ -360,13 +412,16 @@ void MifareWriteBlock(uint8_t arg0, uint8_t arg1, uint8_t arg2, uint8_t *datain)
 	uint8_t blockNo = arg0;
 	uint8_t keyType = arg1;
 	uint64_t ui64Key = 0;
-	byte_t blockdata[16];
+	// number of blocks in datain + 10, all of them in the sector of blockNo
+	uint16_t sectorEnd = blockNo < 128 ? (blockNo | 0x03) + 1 : (blockNo | 0x0f) + 1;
+	uint32_t blockCount = arg2 ? arg2 : 1;
+	if (blockNo + blockCount > sectorEnd) blockCount = sectorEnd - blockNo;
 
 	ui64Key = bytes_to_num(datain, 6);
-	memcpy(blockdata, datain + 10, 16);
 
 	// variables
 	byte_t isOK = 0;
+	uint32_t blocksWritten = 0;
 	uint8_t uid[10];
 	uint32_t cuid;
 	struct Crypto1State mpcs = {0, 0};
@@ -392,10 +447,13 @@ void MifareWriteBlock(uint8_t arg0, uint8_t arg1, uint8_t arg2, uint8_t *datain)
 			break;
 		};
 
-		if(mifare_classic_writeblock(pcs, cuid, blockNo, blockdata)) {
-			if (MF_DBGLEVEL >= 1)	Dbprintf("Write block error");
-			break;
-		};
+		for (blocksWritten = 0; blocksWritten < blockCount; blocksWritten++) {
+			if(mifare_classic_writeblock(pcs, cuid, blockNo + blocksWritten, datain + 10 + blocksWritten * 16)) {
+				if (MF_DBGLEVEL >= 1)	Dbprintf("Write block error");
+				break;
+			};
+		}
+		if (blocksWritten < blockCount) break;
 
 		if(mifare_classic_halt(pcs, cuid)) {
 			if (MF_DBGLEVEL >= 1)	Dbprintf("Halt error");
@@ -412,7 +470,7 @@ void MifareWriteBlock(uint8_t arg0, uint8_t arg1, uint8_t arg2, uint8_t *datain)
 	if (MF_DBGLEVEL >= 2)	DbpString("WRITE BLOCK FINISHED");
 
 	LED_B_ON();
-	cmd_send(CMD_ACK,isOK,0,0,0,0);
+	cmd_send(CMD_ACK,isOK,blocksWritten,0,0,0);
 	LED_B_OFF();
 
 
@@ -1041,16 +1099,34 @@ void MifareEMemClr(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain)
 
 void MifareEMemSet(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain){
 	FpgaDownloadAndGo(FPGA_BITSTREAM_HF);
-	emlSetMem(datain, arg0, arg1); // data, block num, blocks count
+	if (!(arg2 & EML_MEM_CHECKSUM)) {
+		emlSetMem(datain, arg0, arg1); // data, block num, blocks count
+		return;
+	}
+
+	// checked write, acknowledged with the checksum of what is in the emulator memory now
+	byte_t isOK = 0;
+	uint16_t crc = 0;
+	if (arg1 <= USB_CMD_DATA_SIZE / 16 && arg0 + arg1 <= CARD_MEMORY_SIZE / 16
+		&& update_crc16_bytes(0xffff, datain, arg1 * 16) == (arg2 & 0xffff)) {
+		emlSetMem(datain, arg0, arg1);
+		crc = update_crc16_bytes(0xffff, BigBuf_get_EM_addr() + arg0 * 16, arg1 * 16);
+		isOK = 1;
+	}
+
+	LED_B_ON();
+	cmd_send(CMD_ACK,isOK,crc,0,0,0);
+	LED_B_OFF();
 }
 
 void MifareEMemGet(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain){
 	FpgaDownloadAndGo(FPGA_BITSTREAM_HF);
 	byte_t buf[USB_CMD_DATA_SIZE];
-	emlGetMem(buf, arg0, arg1); // data, block num, blocks count (max 4)
+	if (arg1 > USB_CMD_DATA_SIZE / 16) arg1 = USB_CMD_DATA_SIZE / 16;
+	emlGetMem(buf, arg0, arg1); // data, block num, blocks count (max USB_CMD_DATA_SIZE/16)
 
 	LED_B_ON();
-	cmd_send(CMD_ACK,arg0,arg1,0,buf,USB_CMD_DATA_SIZE);
+	cmd_send(CMD_ACK,arg0,arg1,EML_MEM_CHECKSUM | update_crc16_bytes(0xffff, buf, arg1 * 16),buf,USB_CMD_DATA_SIZE);
 	LED_B_OFF();
 }
 
@@ -1290,6 +1366,11 @@ void MifareCSetBlock(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datai
 	// bit 6 - gen1b backdoor type
 	uint8_t workFlags = arg1;
 	uint8_t blockNo = arg2;
+	// number of blocks in datain
+	uint32_t blockCount = arg2 >> CSETBLOCK_COUNT_SHIFT;
+	if (blockCount == 0) blockCount = 1;
+	if (blockCount > USB_CMD_DATA_SIZE / 16) blockCount = USB_CMD_DATA_SIZE / 16;
+	if (blockNo + blockCount > 256) blockCount = 256 - blockNo;
 
 	// card commands
 	uint8_t wupC1[]       = { 0x40 };
@@ -1298,6 +1379,7 @@ void MifareCSetBlock(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datai
 
 	// variables
 	byte_t isOK = 0;
+	uint32_t blocksWritten = 0;
 	uint8_t uid[10] = {0x00};
 	uint8_t d_block[18] = {0x00};
 	uint32_t cuid;
@@ -1375,19 +1457,22 @@ void MifareCSetBlock(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datai
 			}
 		}
 
-		if ((mifare_sendcmd_short(NULL, 0, 0xA0, blockNo, receivedAnswer, receivedAnswerPar, NULL) != 1) || (receivedAnswer[0] != 0x0a)) {
-			if (MF_DBGLEVEL >= 1)	Dbprintf("write block send command error");
-			break;
-		};
+		for (blocksWritten = 0; blocksWritten < blockCount; blocksWritten++) {
+			if ((mifare_sendcmd_short(NULL, 0, 0xA0, blockNo + blocksWritten, receivedAnswer, receivedAnswerPar, NULL) != 1) || (receivedAnswer[0] != 0x0a)) {
+				if (MF_DBGLEVEL >= 1)	Dbprintf("write block send command error");
+				break;
+			};
 
-		memcpy(d_block, datain, 16);
-		AppendCrc14443a(d_block, 16);
+			memcpy(d_block, datain + blocksWritten * 16, 16);
+			AppendCrc14443a(d_block, 16);
 
-		ReaderTransmit(d_block, sizeof(d_block), NULL);
-		if ((ReaderReceive(receivedAnswer, receivedAnswerPar) != 1) || (receivedAnswer[0] != 0x0a)) {
-			if (MF_DBGLEVEL >= 1)	Dbprintf("write block send data error");
-			break;
-		};
+			ReaderTransmit(d_block, sizeof(d_block), NULL);
+			if ((ReaderReceive(receivedAnswer, receivedAnswerPar) != 1) || (receivedAnswer[0] != 0x0a)) {
+				if (MF_DBGLEVEL >= 1)	Dbprintf("write block send data error");
+				break;
+			};
+		}
+		if (blocksWritten < blockCount) break;
 
 		if (workFlags & 0x04) {
 			// do no issue halt command for gen1b magic tag (#db# halt error. response len: 1)
@@ -1405,7 +1490,7 @@ void MifareCSetBlock(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datai
 	}
 
 	LED_B_ON();
-	cmd_send(CMD_ACK,isOK,0,0,uid,4);
+	cmd_send(CMD_ACK,isOK,blocksWritten,0,uid,4);
 	LED_B_OFF();
 
 	if ((workFlags & 0x10) || (!isOK)) {
@@ -12,6 +12,8 @@
 #include <string.h>   // also included in util.h
 #include <inttypes.h>
 #include <limits.h>   // for CmdNorm INT_MIN && INT_MAX
+#include <stdlib.h>
+#include <dirent.h>   // for the trace directories of demodbench
 #include "data.h"     // also included in util.h
 #include "cmddata.h"
 #include "util.h"
@@ -24,6 +26,10 @@
 #include "lfdemod.h"  // for demod code
 #include "loclass/cipherutils.h" // for decimating samples in getsamples
 #include "cmdlfem4x.h"// for em410x demod
+#include "graphenvelope.h" // for the plot envelope test
+#include "tracefile.h"
+#include "graphdsp.h"
+#include "util_posix.h"
 
 uint8_t DemodBuffer[MAX_DEMOD_BUF_LEN];
 uint8_t g_debugMode=0;
@@ -190,6 +196,7 @@ int CmdGetBitStream(const char *Cmd)
 			GraphBuffer[i] = 0;
 		}
 	}
+	GraphBufferChanged();
 	RepaintGraphWindow();
 	return 0;
 }
@@ -551,6 +558,7 @@ int AutoCorrelate(const int *in, int *out, size_t len, int window, bool SaveGrph
 	if (SaveGrph) {
 		//GraphTraceLen = GraphTraceLen - window;
 		memcpy(out, CorrelBuffer, len * sizeof(int));
+		if (out == GraphBuffer) GraphBufferChanged();
 		RepaintGraphWindow();  
 	}
 	return Correlation;
@@ -604,6 +612,7 @@ int CmdBitsamples(const char *Cmd)
 			}
 	}
 	GraphTraceLen = cnt;
+	GraphBufferChanged();
 	RepaintGraphWindow();
 	return 0;
 }
@@ -618,9 +627,8 @@ int CmdBuffClear(const char *Cmd)
 
 int CmdDec(const char *Cmd)
 {
-	for (int i = 0; i < (GraphTraceLen / 2); ++i)
-		GraphBuffer[i] = GraphBuffer[i * 2];
-	GraphTraceLen /= 2;
+	GraphTraceLen = dsp_decimate(GraphBuffer, GraphTraceLen);
+	GraphBufferChanged();
 	PrintAndLog("decimated by 2");
 	RepaintGraphWindow();
 	return 0;
@@ -661,6 +669,7 @@ int CmdUndec(const char *Cmd)
 
 	memcpy(GraphBuffer, swap, s_index * sizeof(int));
 	GraphTraceLen = s_index;
+	GraphBufferChanged();
 	RepaintGraphWindow();
 	return 0;
 }
@@ -673,28 +682,14 @@ int CmdGraphShiftZero(const char *Cmd)
 	int shift=0;
 	//set options from parameters entered with the command
 	sscanf(Cmd, "%i", &shift);
-	int shiftedVal=0;
-	for(int i = 0; i<GraphTraceLen; i++){
-		shiftedVal=GraphBuffer[i]+shift;
-		if (shiftedVal>127) 
-			shiftedVal=127;
-		else if (shiftedVal<-127) 
-			shiftedVal=-127;
-		GraphBuffer[i]= shiftedVal;
-	}
-	CmdNorm("");
+	dsp_shift_zero(GraphBuffer, GraphTraceLen, shift);
+	GraphBufferChanged();
+	RepaintGraphWindow();
 	return 0;
 }
 
 int AskEdgeDetect(const int *in, int *out, int len, int threshold) {
-	int Last = 0;
-	for(int i = 1; i<len; i++) {
-		if (in[i]-in[i-1] >= threshold) //large jump up
-			Last = 127;
-		else if(in[i]-in[i-1] <= -1 * threshold) //large jump down
-			Last = -127;
-		out[i-1] = Last;
-	}
+	dsp_ask_edge_detect(in, out, len, threshold);
 	return 0;
 }
 
@@ -709,6 +704,7 @@ int CmdAskEdgeDetect(const char *Cmd)
 	sscanf(Cmd, "%i", &thresLen); 
 
 	ans = AskEdgeDetect(GraphBuffer, GraphBuffer, GraphTraceLen, thresLen);
+	GraphBufferChanged();
 	RepaintGraphWindow();
 	return ans;
 }
@@ -1163,14 +1159,8 @@ int CmdHide(const char *Cmd)
 //zero mean GraphBuffer
 int CmdHpf(const char *Cmd)
 {
-	int i;
-	int accum = 0;
-
-	for (i = 10; i < GraphTraceLen; ++i)
-		accum += GraphBuffer[i];
-	accum /= (GraphTraceLen - 10);
-	for (i = 0; i < GraphTraceLen; ++i)
-		GraphBuffer[i] -= accum;
+	dsp_hpf(GraphBuffer, GraphTraceLen);
+	GraphBufferChanged();
 
 	RepaintGraphWindow();
 	return 0;
@@ -1213,6 +1203,7 @@ int getSamples(int n, bool silent)
 		if (!silent) PrintAndLog("Samples @ %d bits/smpl, decimation 1:%d ", sc->bits_per_sample
 		    , sc->decimation);
 		bits_per_sample = sc->bits_per_sample;
+		trace_set_sample_config(sc);
 	}
 	if(bits_per_sample < 8)
 	{
@@ -1227,11 +1218,10 @@ int getSamples(int n, bool silent)
 		PrintAndLog("Unpacked %d samples" , j );
 	}else
 	{
-		for (int j = 0; j < n; j++) {
-			GraphBuffer[j] = ((int)got[j]) - 128;
-		}
+		dsp_samples_from_u8(got, GraphBuffer, n);
 		GraphTraceLen = n;
 	}
+	GraphBufferChanged();
 
 	setClockGrid(0,0);
 	DemodBufferLen = 0;
@@ -1317,6 +1307,7 @@ int CmdTuneSamples(const char *Cmd)
 		PrintAndLog("Displaying LF tuning graph. Divisor 89 is 134khz, 95 is 125khz.\n");
 		PrintAndLog("\n");
 		GraphTraceLen = 256;
+		GraphBufferChanged();
 		ShowGraphWindow();
 		RepaintGraphWindow();
 	}
@@ -1325,29 +1316,55 @@ int CmdTuneSamples(const char *Cmd)
 }
 
 
+int usage_data_load(void)
+{
+	PrintAndLog("Usage: data load <filename> [start [count]]");
+	PrintAndLog("       data load t");
+	PrintAndLog("Load a trace to the graph window, count samples from sample start on if given.");
+	PrintAndLog("The format is chosen by the extension:");
+	PrintAndLog("       .raw  : one signed byte per sample");
+	PrintAndLog("       .wav  : 8 bit mono PCM, with the sampling config");
+	PrintAndLog("       .pm3z : compressed, with the sampling config");
+	PrintAndLog("       other : text, one sample per line");
+	PrintAndLog("       t     : round trip test of all formats");
+	return 0;
+}
+
 int CmdLoad(const char *Cmd)
 {
 	char filename[FILE_PATH_SIZE] = {0x00};
 	int len = 0;
+	int start = 0;
+	int count = -1;
 
+	if (!strcmp(Cmd, "t")) return trace_selftest();
 	len = strlen(Cmd);
-	if (len > FILE_PATH_SIZE) len = FILE_PATH_SIZE;
+	if (len == 0 || !strcmp(Cmd, "h")) return usage_data_load();
+	if (len > FILE_PATH_SIZE - 1) len = FILE_PATH_SIZE - 1;
 	memcpy(filename, Cmd, len);
-	
-	FILE *f = fopen(filename, "r");
-	if (!f) {
-		 PrintAndLog("couldn't open '%s'", filename);
-		return 0;
-	}
 
-	GraphTraceLen = 0;
-	char line[80];
-	while (fgets(line, sizeof (line), f)) {
-		GraphBuffer[GraphTraceLen] = atoi(line);
-		GraphTraceLen++;
-	}
-	fclose(f);
+	// the whole argument is the file name, unless there is no such file
+	FILE *f = fopen(filename, "r");
+	if (f) {
+		fclose(f);
+	} else if (param_getlength(Cmd, 1) > 0) {
+		param_getstr(Cmd, 0, filename, sizeof(filename));
+		start = param_get32ex(Cmd, 1, 0, 10);
+		count = param_getlength(Cmd, 2) > 0 ? param_get32ex(Cmd, 2, 0, 10) : -1;
+	}
+
+	sample_config config;
+	bool has_config;
+	int n = trace_load(filename, GraphBuffer, MAX_GRAPH_TRACE_LEN, start, count, &config, &has_config);
+	if (n < 0) return 0;
+	GraphTraceLen = n;
+	GraphBufferChanged();
 	PrintAndLog("loaded %d samples", GraphTraceLen);
+	if (has_config) {
+		trace_set_sample_config(&config);
+		PrintAndLog("Samples @ %d bits/smpl, decimation 1:%d, divisor %d (%d kHz)", config.bits_per_sample,
+			config.decimation, config.divisor, 12000 / (config.divisor + 1));
+	}
 	setClockGrid(0,0);
 	DemodBufferLen = 0;
 	RepaintGraphWindow();
@@ -1358,9 +1375,10 @@ int CmdLtrim(const char *Cmd)
 {
 	int ds = atoi(Cmd);
 	if (GraphTraceLen<=0) return 0;
-	for (int i = ds; i < GraphTraceLen; ++i)
-		GraphBuffer[i-ds] = GraphBuffer[i];
+	if (ds > 0 && ds < GraphTraceLen)
+		memmove(GraphBuffer, GraphBuffer + ds, (GraphTraceLen - ds) * sizeof(int));
 	GraphTraceLen -= ds;
+	GraphBufferChanged();
 
 	RepaintGraphWindow();
 	return 0;
@@ -1372,6 +1390,7 @@ int CmdRtrim(const char *Cmd)
 	int ds = atoi(Cmd);
 
 	GraphTraceLen = ds;
+	GraphBufferChanged();
 
 	RepaintGraphWindow();
 	return 0;
@@ -1389,34 +1408,28 @@ int CmdMtrim(const char *Cmd) {
 	for (int i = 0; i < GraphTraceLen; i++) {
 		GraphBuffer[i] = GraphBuffer[start+i];
 	}
+	GraphBufferChanged();
 	return 0;
 }
 
 
 int CmdNorm(const char *Cmd)
 {
-	int i;
-	int max = INT_MIN, min = INT_MAX;
-
-	for (i = 10; i < GraphTraceLen; ++i) {
-		if (GraphBuffer[i] > max)
-			max = GraphBuffer[i];
-		if (GraphBuffer[i] < min)
-			min = GraphBuffer[i];
-	}
-
-	if (max != min) {
-		for (i = 0; i < GraphTraceLen; ++i) {
-			GraphBuffer[i] = ((long)(GraphBuffer[i] - ((max + min) / 2)) * 256) / (max - min);
-				//marshmelow: adjusted *1000 to *256 to make +/- 128 so demod commands still work
-		}
-	}
+	//marshmelow: adjusted *1000 to *256 to make +/- 128 so demod commands still work
+	dsp_norm(GraphBuffer, GraphTraceLen);
+	GraphBufferChanged();
 	RepaintGraphWindow();
 	return 0;
 }
 
 int CmdPlot(const char *Cmd)
 {
+	char cmdp = param_getchar(Cmd, 0);
+	if (cmdp == 't' || cmdp == 'T') {
+		// headless check and render benchmark of the plot envelope
+		return envelope_selftest();
+	}
+
 	ShowGraphWindow();
 	return 0;
 }
@@ -1431,17 +1444,8 @@ int CmdSave(const char *Cmd)
 	memcpy(filename, Cmd, len);
 	 
 
-	FILE *f = fopen(filename, "w");
-	if(!f) {
-		PrintAndLog("couldn't open '%s'", filename);
-		return 0;
-	}
-	int i;
-	for (i = 0; i < GraphTraceLen; i++) {
-		fprintf(f, "%d\n", GraphBuffer[i]);
-	}
-	fclose(f);
-	PrintAndLog("saved to '%s'", Cmd);
+	if (trace_save(filename, GraphBuffer, GraphTraceLen, trace_get_sample_config()) < 0) return 0;
+	PrintAndLog("saved %d samples to '%s' (%s)", GraphTraceLen, filename, trace_format_name(trace_format(filename)));
 	return 0;
 }
 
@@ -1458,29 +1462,8 @@ int CmdScale(const char *Cmd)
 
 int directionalThreshold(const int* in, int *out, size_t len, int8_t up, int8_t down)
 {
-	int lastValue = in[0];
-	out[0] = 0; // Will be changed at the end, but init 0 as we adjust to last samples value if no threshold kicks in.
-
-	for (int i = 1; i < len; ++i) {
-		// Apply first threshold to samples heading up
-		if (in[i] >= up && in[i] > lastValue)
-		{
-			lastValue = out[i]; // Buffer last value as we overwrite it.
-			out[i] = 1;
-		}
-		// Apply second threshold to samples heading down
-		else if (in[i] <= down && in[i] < lastValue)
-		{
-			lastValue = out[i]; // Buffer last value as we overwrite it.
-			out[i] = -1;
-		}
-		else
-		{
-			lastValue = out[i]; // Buffer last value as we overwrite it.
-			out[i] = out[i-1];
-		}
-	}
-	out[0] = out[1]; // Align with first edited sample.
+	// samples heading up to up or above become 1, heading down to down or below -1, others hold
+	dsp_directional_threshold(in, out, len, up, down);
 	return 0;
 }
 
@@ -1492,35 +1475,198 @@ int CmdDirectionalThreshold(const char *Cmd)
 	printf("Applying Up Threshold: %d, Down Threshold: %d\n", upThres, downThres);
 
 	directionalThreshold(GraphBuffer, GraphBuffer,GraphTraceLen, upThres, downThres);
+	GraphBufferChanged();
 	RepaintGraphWindow();
 	return 0;
 }
 
-int CmdZerocrossings(const char *Cmd)
+int CmdDspTest(const char *Cmd)
 {
-	// Zero-crossings aren't meaningful unless the signal is zero-mean.
-	CmdHpf("");
+	return graphdsp_selftest();
+}
 
-	int sign = 1;
-	int zc = 0;
-	int lastZc = 0;
+int usage_data_demodbench(void)
+{
+	PrintAndLog("Usage: data demodbench <trace file or directory> [...]");
+	PrintAndLog("Run the FSK and PSK demods over recorded traces and time them. Directories are");
+	PrintAndLog("searched for .pm3, .pm3z, .wav and .raw files. The fingerprint of each trace covers");
+	PrintAndLog("everything the demods returned and wrote, for comparing builds.");
+	PrintAndLog("Sample: data demodbench ../traces");
+	return 0;
+}
 
-	for (int i = 0; i < GraphTraceLen; ++i) {
-		if (GraphBuffer[i] * sign >= 0) {
-			// No change in sign, reproduce the previous sample count.
-			zc++;
-			GraphBuffer[i] = lastZc;
-		} else {
-			// Change in sign, reset the sample count.
-			sign = -sign;
-			GraphBuffer[i] = lastZc;
-			if (sign > 0) {
-				lastZc = zc;
-				zc = 0;
+typedef enum {
+	BENCH_COUNTFC,
+	BENCH_FSK,
+	BENCH_HID,
+	BENCH_IO,
+	BENCH_AWID,
+	BENCH_PARADOX,
+	BENCH_PYRAMID,
+	BENCH_PSK,
+	BENCH_COUNT
+} demod_bench_t;
+
+static const char *demod_bench_names[BENCH_COUNT] = {"countFC", "fsk", "HID", "IO", "AWID", "Paradox", "Pyramid", "psk"};
+
+// run one demod on buf in place, returns what it found
+static int run_demod_bench(demod_bench_t op, uint8_t *buf, size_t len)
+{
+	uint32_t hi2 = 0, hi = 0, lo = 0;
+	int start = 0, clk = 0, invert = 0;
+	size_t size = len;
+	int ret = 0;
+
+	switch (op) {
+		case BENCH_COUNTFC: return countFC(buf, len, 1);
+		case BENCH_FSK: return fskdemod(buf, len, 50, 1, 10, 8, &start);
+		case BENCH_HID: ret = HIDdemodFSK(buf, &size, &hi2, &hi, &lo, &start); break;
+		case BENCH_IO: return IOdemodFSK(buf, len, &start);
+		case BENCH_AWID: return AWIDdemodFSK(buf, &size, &start);
+		case BENCH_PARADOX: ret = ParadoxdemodFSK(buf, &size, &hi2, &hi, &lo, &start); break;
+		case BENCH_PYRAMID: return PyramiddemodFSK(buf, &size, &start);
+		case BENCH_PSK:
+			ret = pskRawDemod_ext(buf, &size, &clk, &invert, &start);
+			return ret ^ (clk << 8) ^ ((int)size << 16);
+		default: break;
+	}
+	return ret ^ (int)(hi2 ^ hi ^ lo ^ size);
+}
+
+static uint32_t fingerprint(uint32_t hash, const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		hash = hash * 31 + data[i];
+	}
+	return hash;
+}
+
+// best time in microseconds of rounds runs of op, after copying the trace to buf
+static double bench_demod(int op, const uint8_t *trace, uint8_t *buf, size_t len, int rounds)
+{
+	uint64_t best = UINT64_MAX;
+
+	for (int b = 0; b < 3; b++) {
+		uint64_t t = msclock();
+		for (int r = 0; r < rounds; r++) {
+			memcpy(buf, trace, len);
+			if (op >= 0) run_demod_bench(op, buf, len);
+		}
+		t = msclock() - t;
+		if (t < best) best = t;
+	}
+	return best * 1000.0 / rounds;
+}
+
+static int cmp_names(const void *a, const void *b)
+{
+	return strcmp(*(const char **)a, *(const char **)b);
+}
+
+// the trace files in path, sorted, or path itself if it isn't a directory
+static int list_traces(const char *path, char ***names)
+{
+	int n = 0;
+	DIR *dp = opendir(path);
+
+	if (dp == NULL) {
+		*names = malloc(sizeof(char *));
+		char *name = malloc(strlen(path) + 1);
+		strcpy(name, path);
+		(*names)[n++] = name;
+		return n;
+	}
+	*names = NULL;
+	struct dirent *ep;
+	while ((ep = readdir(dp)) != NULL) {
+		const char *ext = strrchr(ep->d_name, '.');
+		if (ext == NULL) continue;
+		if (strcmp(ext, ".pm3") && strcmp(ext, ".pm3z") && strcmp(ext, ".wav") && strcmp(ext, ".raw")) continue;
+		char *name = malloc(strlen(path) + strlen(ep->d_name) + 2);
+		sprintf(name, "%s/%s", path, ep->d_name);
+		*names = realloc(*names, (n + 1) * sizeof(char *));
+		(*names)[n++] = name;
+	}
+	closedir(dp);
+	if (n) qsort(*names, n, sizeof(char *), cmp_names);
+	return n;
+}
+
+int CmdDemodBench(const char *Cmd)
+{
+	char path[FILE_PATH_SIZE];
+	char line[256];
+	double total[BENCH_COUNT] = {0};
+	int traces = 0;
+	size_t samples = 0;
+
+	if (param_getlength(Cmd, 0) == 0 || !strcmp(Cmd, "h")) return usage_data_demodbench();
+
+	int *trace = malloc(MAX_GRAPH_TRACE_LEN * sizeof(int));
+	uint8_t *bytes = malloc(MAX_GRAPH_TRACE_LEN);
+	uint8_t *buf = malloc(MAX_GRAPH_TRACE_LEN);
+
+	int pos = sprintf(line, "%-28s %7s %8s", "trace", "samples", "fingerp.");
+	for (int op = 0; op < BENCH_COUNT; op++) pos += sprintf(line + pos, " %7s", demod_bench_names[op]);
+	PrintAndLog("%s", line);
+	PrintAndLog("%-45s %s", "", "microseconds per trace");
+
+	for (int p = 0; param_getstr(Cmd, p, path, sizeof(path)) > 0; p++) {
+		char **names;
+		int n = list_traces(path, &names);
+		for (int t = 0; t < n; t++) {
+			sample_config config;
+			bool has_config;
+			int len = trace_load(names[t], trace, MAX_GRAPH_TRACE_LEN, 0, -1, &config, &has_config);
+			if (len > 0) {
+				// the samples the demods get from the graph (see getFromGraphBuf)
+				for (int i = 0; i < len; i++) {
+					int v = trace[i];
+					if (v > 127) v = 127;
+					if (v < -127) v = -127;
+					bytes[i] = (uint8_t)(v + 128);
+				}
+				uint32_t hash = 0;
+				for (int op = 0; op < BENCH_COUNT; op++) {
+					memcpy(buf, bytes, len);
+					hash = fingerprint(hash * 31 + run_demod_bench(op, buf, len), buf, len);
+				}
+				int rounds = 1 + 10000000 / len;
+				double copy_us = bench_demod(-1, bytes, buf, len, rounds);
+				const char *base = strrchr(names[t], '/');
+				pos = sprintf(line, "%-28.28s %7d %08x", base ? base + 1 : names[t], len, hash);
+				for (int op = 0; op < BENCH_COUNT; op++) {
+					double us = bench_demod(op, bytes, buf, len, rounds) - copy_us;
+					if (us < 0) us = 0;
+					total[op] += us;
+					pos += sprintf(line + pos, " %7.1f", us);
+				}
+				PrintAndLog("%s", line);
+				traces++;
+				samples += len;
 			}
+			free(names[t]);
 		}
+		free(names);
 	}
 
+	pos = sprintf(line, "%-28s %7zu %8s", "total", samples, "");
+	for (int op = 0; op < BENCH_COUNT; op++) pos += sprintf(line + pos, " %7.0f", total[op]);
+	PrintAndLog("%s", line);
+	PrintAndLog("%d traces", traces);
+
+	free(trace); free(bytes); free(buf);
+	return 0;
+}
+
+int CmdZerocrossings(const char *Cmd)
+{
+	// Zero-crossings aren't meaningful unless the signal is zero-mean.
+	CmdHpf("");
+
+	dsp_zero_crossings(GraphBuffer, GraphTraceLen);
+	GraphBufferChanged();
+
 	RepaintGraphWindow();
 	return 0;
 }
@@ -1810,6 +1956,7 @@ int CmdFSKToNRZ(const char *Cmd) {
 	setClockGrid(0,0);
 	DemodBufferLen = 0;
 	int ans = FSKToNRZ(GraphBuffer, &GraphTraceLen, clk, fc_low, fc_high);
+	GraphBufferChanged();
 	CmdNorm("");
 	RepaintGraphWindow();
 	return ans;
@@ -1834,22 +1981,24 @@ static command_t CommandTable[] =
 	{"hex2bin",         Cmdhex2bin,         1, "hex2bin <hexadecimal> -- Converts hexadecimal to binary"},
 	{"hide",            CmdHide,            1, "Hide graph window"},
 	{"hpf",             CmdHpf,             1, "Remove DC offset from trace"},
-	{"load",            CmdLoad,            1, "<filename> -- Load trace (to graph window"},
+	{"load",            CmdLoad,            1, "<filename> [start [count]] -- Load trace (to graph window), .raw, .wav, .pm3z or text, t: test"},
 	{"ltrim",           CmdLtrim,           1, "<samples> -- Trim samples from left of trace"},
 	{"rtrim",           CmdRtrim,           1, "<location to end trace> -- Trim samples from right of trace"},
 	{"mtrim",           CmdMtrim,           1, "<start> <stop> -- Trim out samples from the specified start to the specified stop"},
 	{"manrawdecode",    Cmdmandecoderaw,    1, "[invert] [maxErr] -- Manchester decode binary stream in DemodBuffer"},
 	{"norm",            CmdNorm,            1, "Normalize max/min to +/-128"},
-	{"plot",            CmdPlot,            1, "Show graph window (hit 'h' in window for keystroke help)"},
+	{"plot",            CmdPlot,            1, "[t] Show graph window (hit 'h' in window for keystroke help), t: plot envelope test"},
 	{"printdemodbuffer",CmdPrintDemodBuff,  1, "[x] [o] <offset> [l] <length> -- print the data in the DemodBuffer - 'x' for hex output"},
 	{"rawdemod",        CmdRawDemod,        1, "[modulation] ... <options> -see help (h option) -- Demodulate the data in the GraphBuffer and output binary"},  
 	{"samples",         CmdSamples,         0, "[512 - 40000] -- Get raw samples for graph window (GraphBuffer)"},
-	{"save",            CmdSave,            1, "<filename> -- Save trace (from graph window)"},
+	{"save",            CmdSave,            1, "<filename> -- Save trace (from graph window), .raw, .wav, .pm3z or text"},
 	{"setgraphmarkers", CmdSetGraphMarkers, 1, "[orange_marker] [blue_marker] (in graph window)"},
 	{"scale",           CmdScale,           1, "<int> -- Set cursor display scale"},
 	{"setdebugmode",    CmdSetDebugMode,    1, "<0|1|2> -- Turn on or off Debugging Level for lf demods"},
 	{"shiftgraphzero",  CmdGraphShiftZero,  1, "<shift> -- Shift 0 for Graphed wave + or - shift value"},
 	{"dirthreshold",    CmdDirectionalThreshold,   1, "<thres up> <thres down> -- Max rising higher up-thres/ Min falling lower down-thres, keep rest as prev."},
+	{"dsptest",         CmdDspTest,         1, "Check the sample transforms against the scalar code and time them per instruction set"},
+	{"demodbench",      CmdDemodBench,      1, "<trace files or directories> -- Time the FSK and PSK demods over recorded traces"},
 	{"tune",            CmdTuneSamples,     0, "Get hw tune samples for graph window"},
 	{"undec",           CmdUndec,           1, "Un-decimate samples by 2"},
 	{"zerocrossings",   CmdZerocrossings,   1, "Count time between zero-crossings"},
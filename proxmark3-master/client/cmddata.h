@@ -56,6 +56,8 @@ int CmdTuneSamples(const char *Cmd);
 int CmdSave(const char *Cmd);
 int CmdScale(const char *Cmd);
 int CmdDirectionalThreshold(const char *Cmd);
+int CmdDspTest(const char *Cmd);
+int CmdDemodBench(const char *Cmd);
 int CmdZerocrossings(const char *Cmd);
 int ASKbiphaseDemod(const char *Cmd, bool verbose);
 int ASKDemod(const char *Cmd, bool verbose, bool emSearch, uint8_t askType);
@@ -31,6 +31,7 @@
 #include "mifarehost.h"
 #include "emv/apduinfo.h"
 #include "emv/emvcore.h"
+#include "collect.h"
 
 static int CmdHelp(const char *Cmd);
 static int waitCmd(uint8_t iLen);
@@ -505,15 +506,12 @@ int CmdHF14AInfo(const char *Cmd)
 	return select_status;
 }
 
-// Collect ISO14443 Type A UIDs
-int CmdHF14ACUIDs(const char *Cmd)
-{
-	// requested number of UIDs
-	int n = atoi(Cmd);
-	// collect at least 1 (e.g. if no parameter was given)
-	n = n > 0 ? n : 1;
+// field reset between two anticollisions of hf 14a cuids, ISO 14443-3 asks for at least 5.1ms
+#define CUIDS_FIELD_OFF_MS	6
 
-	PrintAndLog("Collecting %d UIDs", n);
+// hf 14a cuids for firmware without ISO14A_COLLECT_UIDS, one command per UID
+static void CollectUIDsOneByOne(int n)
+{
 	PrintAndLog("Start: %" PRIu64, msclock()/1000);
 	// repeat n times
 	for (int i = 0; i < n; i++) {
@@ -538,6 +536,35 @@ int CmdHF14ACUIDs(const char *Cmd)
 		}
 	}
 	PrintAndLog("End: %" PRIu64, msclock()/1000);
+}
+
+// Collect ISO14443 Type A UIDs
+int CmdHF14ACUIDs(const char *Cmd)
+{
+	char filename[FILE_PATH_SIZE] = {0};
+
+	char ctmp = param_getchar(Cmd, 0);
+	if (ctmp == 'h' || ctmp == 'H') {
+		PrintAndLog("Usage: hf 14a cuids <n> [<filename>]");
+		PrintAndLog("Collect n UIDs, stop early with any key. The device repeats the anticollision");
+		PrintAndLog("with a field reset in between and sends the UIDs in batches. The unique UIDs");
+		PrintAndLog("are printed, or written to the file as a length byte followed by the UID.");
+		PrintAndLog("sample: hf 14a cuids 10000 uids.bin");
+		return 0;
+	}
+
+	// requested number of UIDs
+	int n = atoi(Cmd);
+	// collect at least 1 (e.g. if no parameter was given)
+	n = n > 0 ? n : 1;
+	param_getstr(Cmd, 1, filename, sizeof(filename));
+
+	PrintAndLog("Collecting %d UIDs", n);
+	UsbCommand c = {CMD_READER_ISO_14443a, {ISO14A_CONNECT | ISO14A_NO_RATS | ISO14A_COLLECT_UIDS, n, CUIDS_FIELD_OFF_MS << 16}};
+	if (collect_records(&c, "UID", filename[0] ? filename : NULL, CUIDS_FIELD_OFF_MS) == COLLECT_NOT_SUPPORTED) {
+		PrintAndLog("The firmware doesn't stream UIDs, collecting one per command%s", filename[0] ? " without a file" : "");
+		CollectUIDsOneByOne(n);
+	}
 
 	return 1;
 }
@@ -1024,7 +1051,7 @@ static command_t CommandTable[] =
   {"list",   CmdHF14AList,         0, "[Deprecated] List ISO 14443a history"},
   {"reader", CmdHF14AReader,       0, "Start acting like an ISO14443 Type A reader"},
   {"info",   CmdHF14AInfo,         0, "Reads card and shows information about it"},
-  {"cuids",  CmdHF14ACUIDs,        0, "<n> Collect n>0 ISO14443 Type A UIDs in one go"},
+  {"cuids",  CmdHF14ACUIDs,        0, "<n> [<filename>] Collect n>0 ISO14443 Type A UIDs in one go"},
   {"sim",    CmdHF14ASim,          0, "<UID> -- Simulate ISO 14443a tag"},
   {"snoop",  CmdHF14ASnoop,        0, "Eavesdrop ISO 14443 Type A"},
   {"apdu",   CmdHF14AAPDU,         0, "Send an ISO 7816-4 APDU via ISO 14443-4 block transmission protocol"},
@@ -22,26 +22,17 @@
 #include "cmdparser.h"
 #include "common.h"
 #include "cmdmain.h"
+#include "data.h"
+#include "collect.h"
 
 static int CmdHelp(const char *Cmd);
 
-// Perform (part of) the PACE protocol
-int CmdHFEPACollectPACENonces(const char *Cmd)
-{
-	// requested nonce size
-	unsigned int m = 0;
-	// requested number of Nonces
-	unsigned int n = 0;
-	// delay between requests
-	unsigned int d = 0;
+// the longest pause between two nonce requests the device can wait (arg[2] >> 16)
+#define MAX_DEVICE_PAUSE_MS	0xffff
 
-	sscanf(Cmd, "%u %u %u", &m, &n, &d);
-
-	// values are expected to be > 0
-	m = m > 0 ? m : 1;
-	n = n > 0 ? n : 1;
-
-	PrintAndLog("Collecting %u %u-byte nonces", n, m);
+// hf epa cnonces for firmware without COLLECT_RECORDS or long pauses, one command per nonce
+static void CollectNoncesOneByOne(unsigned int m, unsigned int n, unsigned int d)
+{
 	PrintAndLog("Start: %" PRIu64 , msclock()/1000);
 	// repeat n times
 	for (unsigned int i = 0; i < n; i++) {
@@ -70,6 +61,36 @@ int CmdHFEPACollectPACENonces(const char *Cmd)
 		}
 	}
 	PrintAndLog("End: %" PRIu64, msclock()/1000);
+}
+
+// Perform (part of) the PACE protocol
+int CmdHFEPACollectPACENonces(const char *Cmd)
+{
+	// requested nonce size
+	unsigned int m = 0;
+	// requested number of Nonces
+	unsigned int n = 0;
+	// delay between requests
+	unsigned int d = 0;
+	// where to write the nonces
+	char filename[FILE_PATH_SIZE] = {0};
+
+	sscanf(Cmd, "%u %u %u", &m, &n, &d);
+	param_getstr(Cmd, 3, filename, sizeof(filename));
+
+	// values are expected to be > 0
+	m = m > 0 ? m : 1;
+	n = n > 0 ? n : 1;
+
+	PrintAndLog("Collecting %u %u-byte nonces", n, m);
+	if (d <= MAX_DEVICE_PAUSE_MS / 1000) {
+		// the device loops over the requests and sends the nonces in batches
+		UsbCommand c = {CMD_EPA_PACE_COLLECT_NONCE, {m, n, COLLECT_RECORDS | (d * 1000) << 16}};
+		if (collect_records(&c, "nonce", filename[0] ? filename : NULL, d * 1000) != COLLECT_NOT_SUPPORTED)
+			return 1;
+		PrintAndLog("The firmware doesn't stream nonces, collecting one per command%s", filename[0] ? " without a file" : "");
+	}
+	CollectNoncesOneByOne(m, n, d);
 
 	return 1;
 }
@@ -188,7 +209,7 @@ static const command_t CommandTable[] =
 {
   {"help",    CmdHelp,                   1, "This help"},
   {"cnonces", CmdHFEPACollectPACENonces, 0,
-              "<m> <n> <d> Acquire n>0 encrypted PACE nonces of size m>0 with d sec pauses"},
+              "<m> <n> <d> [<filename>] Acquire n>0 encrypted PACE nonces of size m>0 with d sec pauses"},
   {"preplay", CmdHFEPAPACEReplay,        0,
    "<mse> <get> <map> <pka> <ma> Perform PACE protocol by replaying given APDUs"},
   {NULL, NULL, 0, NULL}
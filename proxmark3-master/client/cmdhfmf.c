@@ -246,21 +246,73 @@ static int ParamCardSizeBlocks(const char c) {
 	return numBlocks;
 }
 
+// One CMD_MIFARE_READBL per block, for firmware without the key aware CMD_MIFARE_READSC
+static bool mf_dump_sector_blockwise(uint8_t sectorNo, uint8_t *keyA, uint8_t *keyB, uint8_t *data)
+{
+	uint8_t trailerNo = NumBlocksPerSector(sectorNo) - 1;
+	uint8_t trailer[16] = {0x00};
+	UsbCommand resp;
+
+	// the sector trailer first. At least the Access Conditions can always be read with key A.
+	trailer[6] = 0xff; trailer[7] = 0x07; trailer[8] = 0x80;		// transport configuration, if the trailer can't be read
+	for (int tries = 0; tries < 3; tries++) {
+		UsbCommand c = {CMD_MIFARE_READBL, {FirstBlockOfSector(sectorNo) + trailerNo, 0, 0}};
+		memcpy(c.d.asBytes, keyA, 6);
+		SendCommand(&c);
+		if (WaitForResponseTimeout(CMD_ACK, &resp, 1500) && (resp.arg[0] & 0xff)) {
+			memcpy(trailer, resp.d.asBytes, 16);
+			break;
+		} else if (tries == 2) {
+			PrintAndLog("Could not get access rights for sector %2d. Trying with defaults...", sectorNo);
+		}
+	}
+
+	for (uint8_t blockNo = 0; blockNo <= trailerNo; blockNo++) {
+		uint8_t keyType = 0;
+		if (blockNo < trailerNo) {
+			uint8_t rights = mfAccessConditions(trailer, sectorNo < 32 ? blockNo : blockNo / 5);
+			if (rights == 0x07) {											// no key would work
+				PrintAndLog("Access rights do not allow reading of sector %2d block %3d", sectorNo, blockNo);
+				return false;
+			}
+			if (rights == 0x03 || rights == 0x05)							// only key B would work
+				keyType = 1;
+		}
+
+		bool received = false;
+		for (int tries = 0; tries < 3; tries++) {
+			UsbCommand c = {CMD_MIFARE_READBL, {FirstBlockOfSector(sectorNo) + blockNo, keyType, 0}};
+			memcpy(c.d.asBytes, keyType ? keyB : keyA, 6);
+			SendCommand(&c);
+			received = WaitForResponseTimeout(CMD_ACK, &resp, 1500);
+			if (received && (resp.arg[0] & 0xff)) break;
+		}
+		if (!received) {
+			PrintAndLog("Command execute timeout when trying to read block %2d of sector %2d.", blockNo, sectorNo);
+			return false;
+		}
+		if (!(resp.arg[0] & 0xff)) {
+			PrintAndLog("Could not read block %2d of sector %2d", blockNo, sectorNo);
+			return false;
+		}
+		memcpy(data + 16 * blockNo, resp.d.asBytes, 16);
+	}
+
+	return true;
+}
+
 int CmdHF14AMfDump(const char *Cmd)
 {
 	uint8_t sectorNo, blockNo;
 
 	uint8_t keyA[40][6];
 	uint8_t keyB[40][6];
-	uint8_t rights[40][4];
 	uint8_t carddata[256][16];
 	uint8_t numSectors = 16;
 
 	FILE *fin;
 	FILE *fout;
 
-	UsbCommand resp;
-
 	char cmdp = param_getchar(Cmd, 0);
 	numSectors = ParamCardSizeSectors(cmdp);
 
@@ -300,108 +352,55 @@ int CmdHF14AMfDump(const char *Cmd)
 
 	fclose(fin);
 
-	PrintAndLog("|-----------------------------------------|");
-	PrintAndLog("|------ Reading sector access bits...-----|");
-	PrintAndLog("|-----------------------------------------|");
-	uint8_t tries = 0;
-	for (sectorNo = 0; sectorNo < numSectors; sectorNo++) {
-		for (tries = 0; tries < 3; tries++) {
-			UsbCommand c = {CMD_MIFARE_READBL, {FirstBlockOfSector(sectorNo) + NumBlocksPerSector(sectorNo) - 1, 0, 0}};
-			memcpy(c.d.asBytes, keyA[sectorNo], 6);
-			SendCommand(&c);
-
-			if (WaitForResponseTimeout(CMD_ACK,&resp,1500)) {
-				uint8_t isOK  = resp.arg[0] & 0xff;
-				uint8_t *data  = resp.d.asBytes;
-				if (isOK){
-					rights[sectorNo][0] = ((data[7] & 0x10)>>2) | ((data[8] & 0x1)<<1) | ((data[8] & 0x10)>>4); // C1C2C3 for data area 0
-					rights[sectorNo][1] = ((data[7] & 0x20)>>3) | ((data[8] & 0x2)<<0) | ((data[8] & 0x20)>>5); // C1C2C3 for data area 1
-					rights[sectorNo][2] = ((data[7] & 0x40)>>4) | ((data[8] & 0x4)>>1) | ((data[8] & 0x40)>>6); // C1C2C3 for data area 2
-					rights[sectorNo][3] = ((data[7] & 0x80)>>5) | ((data[8] & 0x8)>>2) | ((data[8] & 0x80)>>7); // C1C2C3 for sector trailer
-					break;
-				} else if (tries == 2) { // on last try set defaults
-					PrintAndLog("Could not get access rights for sector %2d. Trying with defaults...", sectorNo);
-					rights[sectorNo][0] = rights[sectorNo][1] = rights[sectorNo][2] = 0x00;
-					rights[sectorNo][3] = 0x01;
-				}
-			} else {
-				PrintAndLog("Command execute timeout when trying to read access rights for sector %2d. Trying with defaults...", sectorNo);
-				rights[sectorNo][0] = rights[sectorNo][1] = rights[sectorNo][2] = 0x00;
-				rights[sectorNo][3] = 0x01;
-			}
-		}
-	}
-
 	PrintAndLog("|-----------------------------------------|");
 	PrintAndLog("|----- Dumping all blocks to file... -----|");
 	PrintAndLog("|-----------------------------------------|");
 
+	// one command per sector, the firmware picks key A or B for every block from the access bits
+	uint64_t start_time = msclock();
 	bool isOK = true;
 	for (sectorNo = 0; isOK && sectorNo < numSectors; sectorNo++) {
-		for (blockNo = 0; isOK && blockNo < NumBlocksPerSector(sectorNo); blockNo++) {
-			bool received = false;
-			for (tries = 0; tries < 3; tries++) {
-				if (blockNo == NumBlocksPerSector(sectorNo) - 1) {		// sector trailer. At least the Access Conditions can always be read with key A.
-					UsbCommand c = {CMD_MIFARE_READBL, {FirstBlockOfSector(sectorNo) + blockNo, 0, 0}};
-					memcpy(c.d.asBytes, keyA[sectorNo], 6);
-					SendCommand(&c);
-					received = WaitForResponseTimeout(CMD_ACK,&resp,1500);
-				} else {												// data block. Check if it can be read with key A or key B
-					uint8_t data_area = sectorNo<32?blockNo:blockNo/5;
-					if ((rights[sectorNo][data_area] == 0x03) || (rights[sectorNo][data_area] == 0x05)) {	// only key B would work
-						UsbCommand c = {CMD_MIFARE_READBL, {FirstBlockOfSector(sectorNo) + blockNo, 1, 0}};
-						memcpy(c.d.asBytes, keyB[sectorNo], 6);
-						SendCommand(&c);
-						received = WaitForResponseTimeout(CMD_ACK,&resp,1500);
-					} else if (rights[sectorNo][data_area] == 0x07) {										// no key would work
-						isOK = false;
-						PrintAndLog("Access rights do not allow reading of sector %2d block %3d", sectorNo, blockNo);
-						tries = 2;
-					} else {																				// key A would work
-						UsbCommand c = {CMD_MIFARE_READBL, {FirstBlockOfSector(sectorNo) + blockNo, 0, 0}};
-						memcpy(c.d.asBytes, keyA[sectorNo], 6);
-						SendCommand(&c);
-						received = WaitForResponseTimeout(CMD_ACK,&resp,1500);
-					}
-				}
-				if (received) {
-					isOK  = resp.arg[0] & 0xff;
-					if (isOK) break;
-				}
+		uint8_t data[16 * 16];
+		uint16_t allBlocks = (1 << NumBlocksPerSector(sectorNo)) - 1;
+		uint16_t blocksRead = 0;
+		int res = 0;
+		for (int tries = 0; tries < 3; tries++) {
+			res = mfReadSector(sectorNo, keyA[sectorNo], keyB[sectorNo], data, &blocksRead);
+			if (res == 0) break;
+		}
+
+		if (res == 1) {
+			isOK = false;
+			PrintAndLog("Command execute timeout when trying to read sector %2d.", sectorNo);
+			break;
+		}
+		if (res == 2) {
+			// older firmware reads the whole sector with key A only
+			if (!mf_dump_sector_blockwise(sectorNo, keyA[sectorNo], keyB[sectorNo], data)) {
+				isOK = false;
+				break;
 			}
+			blocksRead = allBlocks;
+		}
 
-			if (received) {
-				isOK  = resp.arg[0] & 0xff;
-				uint8_t *data  = resp.d.asBytes;
-				if (blockNo == NumBlocksPerSector(sectorNo) - 1) {		// sector trailer. Fill in the keys.
-					data[0]  = (keyA[sectorNo][0]);
-					data[1]  = (keyA[sectorNo][1]);
-					data[2]  = (keyA[sectorNo][2]);
-					data[3]  = (keyA[sectorNo][3]);
-					data[4]  = (keyA[sectorNo][4]);
-					data[5]  = (keyA[sectorNo][5]);
-					data[10] = (keyB[sectorNo][0]);
-					data[11] = (keyB[sectorNo][1]);
-					data[12] = (keyB[sectorNo][2]);
-					data[13] = (keyB[sectorNo][3]);
-					data[14] = (keyB[sectorNo][4]);
-					data[15] = (keyB[sectorNo][5]);
-				}
-				if (isOK) {
-					memcpy(carddata[FirstBlockOfSector(sectorNo) + blockNo], data, 16);
-                    PrintAndLog("Successfully read block %2d of sector %2d.", blockNo, sectorNo);
-				} else {
-					PrintAndLog("Could not read block %2d of sector %2d", blockNo, sectorNo);
-					break;
-				}
-			}
-			else {
+		blocksRead &= allBlocks;
+		for (blockNo = 0; blockNo < NumBlocksPerSector(sectorNo); blockNo++) {
+			if (!(blocksRead & (1 << blockNo))) {
 				isOK = false;
-				PrintAndLog("Command execute timeout when trying to read block %2d of sector %2d.", blockNo, sectorNo);
-				break;
+				PrintAndLog("Access rights do not allow reading of sector %2d block %3d", sectorNo, blockNo);
 			}
 		}
+		if (!isOK)
+			break;
+
+		// sector trailer. Fill in the keys.
+		uint8_t *trailer = data + 16 * (NumBlocksPerSector(sectorNo) - 1);
+		memcpy(trailer, keyA[sectorNo], 6);
+		memcpy(trailer + 10, keyB[sectorNo], 6);
+		memcpy(carddata[FirstBlockOfSector(sectorNo)], data, 16 * NumBlocksPerSector(sectorNo));
+		PrintAndLog("Successfully read sector %2d.", sectorNo);
 	}
+	uint64_t read_time = msclock() - start_time;
 
 	if (isOK) {
 		if ((fout = fopen("dumpdata.bin","wb")) == NULL) {
@@ -412,17 +411,44 @@ int CmdHF14AMfDump(const char *Cmd)
 		fwrite(carddata, 1, 16*numblocks, fout);
 		fclose(fout);
 		PrintAndLog("Dumped %d blocks (%d bytes) to file dumpdata.bin", numblocks, 16*numblocks);
+		PrintAndLog("Card read in %" PRIu64 " ms", read_time);
 	}
 
 	return 0;
 }
 
+// Key type the access bits of a sector trailer allow writing a block with, key A if neither
+static uint8_t mf_write_key_type(uint8_t *trailer, uint8_t sectorNo, uint8_t blockNo)
+{
+	if (blockNo == NumBlocksPerSector(sectorNo) - 1) {
+		uint8_t rights = mfAccessConditions(trailer, 3);
+		return rights == 0x03 || rights == 0x04 || rights == 0x05;
+	}
+	uint8_t rights = mfAccessConditions(trailer, sectorNo < 32 ? blockNo : blockNo / 5);
+	return rights == 0x03 || rights == 0x04 || rights == 0x06;
+}
+
+// Write the blocks of a sector, one block per command for older firmware
+static bool mf_write_sector_blocks(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t *data, int blocksCount)
+{
+	int frameBlocks = blocksCount;
+	for (int i = 0; i < blocksCount; ) {
+		int n = blocksCount - i < frameBlocks ? blocksCount - i : frameBlocks;
+		int written = mfWriteBlocks(blockNo + i, keyType, key, data + i * 16, n);
+		if (written < 1)
+			return false;
+		if (written < n)
+			frameBlocks = 1;
+		i += written;
+	}
+	return true;
+}
+
 int CmdHF14AMfRestore(const char *Cmd)
 {
 	uint8_t sectorNo,blockNo;
-	uint8_t keyType = 0;
 	uint8_t key[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
-	uint8_t bldata[16] = {0x00};
+	uint8_t carddata[256][16];
 	uint8_t keyA[40][6];
 	uint8_t keyB[40][6];
 	uint8_t numSectors;
@@ -478,51 +504,46 @@ int CmdHF14AMfRestore(const char *Cmd)
 		PrintAndLog("Could not find file dumpdata.bin");
 		return 1;
 	}
+	uint16_t numBlocks = FirstBlockOfSector(numSectors - 1) + NumBlocksPerSector(numSectors - 1);
+	size_t bytes_read = fread(carddata, 1, 16 * numBlocks, fdump);
+	fclose(fdump);
+	if (bytes_read != 16 * numBlocks) {
+		PrintAndLog("File reading error (dumpdata.bin).");
+		return 2;
+	}
 	PrintAndLog("Restoring dumpdata.bin to card");
 
+	// one command per sector
+	uint64_t start_time = msclock();
 	for (sectorNo = 0; sectorNo < numSectors; sectorNo++) {
-		for(blockNo = 0; blockNo < NumBlocksPerSector(sectorNo); blockNo++) {
-			UsbCommand c = {CMD_MIFARE_WRITEBL, {FirstBlockOfSector(sectorNo) + blockNo, keyType, 0}};
-			memcpy(c.d.asBytes, key, 6);
-
-			size_t bytes_read = fread(bldata, 1, 16, fdump);
-			if (bytes_read != 16) {
-				PrintAndLog("File reading error (dumpdata.bin).");
-				fclose(fdump);
-				return 2;
-			}
-
-			if (blockNo == NumBlocksPerSector(sectorNo) - 1) {	// sector trailer
-				bldata[0]  = (keyA[sectorNo][0]);
-				bldata[1]  = (keyA[sectorNo][1]);
-				bldata[2]  = (keyA[sectorNo][2]);
-				bldata[3]  = (keyA[sectorNo][3]);
-				bldata[4]  = (keyA[sectorNo][4]);
-				bldata[5]  = (keyA[sectorNo][5]);
-				bldata[10] = (keyB[sectorNo][0]);
-				bldata[11] = (keyB[sectorNo][1]);
-				bldata[12] = (keyB[sectorNo][2]);
-				bldata[13] = (keyB[sectorNo][3]);
-				bldata[14] = (keyB[sectorNo][4]);
-				bldata[15] = (keyB[sectorNo][5]);
-			}
-
-			PrintAndLog("Writing to block %3d: %s", FirstBlockOfSector(sectorNo) + blockNo, sprint_hex(bldata, 16));
-
-			memcpy(c.d.asBytes + 10, bldata, 16);
-			SendCommand(&c);
-
-			UsbCommand resp;
-			if (WaitForResponseTimeout(CMD_ACK,&resp,1500)) {
-				uint8_t isOK  = resp.arg[0] & 0xff;
-				PrintAndLog("isOk:%02x", isOK);
-			} else {
-				PrintAndLog("Command execute timeout");
-			}
+		uint8_t firstBlock = FirstBlockOfSector(sectorNo);
+		uint8_t trailerNo = NumBlocksPerSector(sectorNo) - 1;
+		uint8_t *trailer = carddata[firstBlock + trailerNo];
+
+		// sector trailer
+		memcpy(trailer, keyA[sectorNo], 6);
+		memcpy(trailer + 10, keyB[sectorNo], 6);
+
+		for (blockNo = 0; blockNo <= trailerNo; blockNo++)
+			PrintAndLog("Writing to block %3d: %s", firstBlock + blockNo, sprint_hex(carddata[firstBlock + blockNo], 16));
+
+		// blank cards have the transport key A. Otherwise the card has the keys of dumpkeys.bin and
+		// the access bits of the dump, the blocks are written with the key they allow.
+		bool isOK = mf_write_sector_blocks(firstBlock, 0, key, carddata[firstBlock], trailerNo + 1);
+		for (blockNo = 0; !isOK && blockNo <= trailerNo; ) {
+			uint8_t keyType = mf_write_key_type(trailer, sectorNo, blockNo);
+			uint8_t n = 1;
+			while (blockNo + n <= trailerNo && mf_write_key_type(trailer, sectorNo, blockNo + n) == keyType)
+				n++;
+			if (!mf_write_sector_blocks(firstBlock + blockNo, keyType, keyType ? keyB[sectorNo] : keyA[sectorNo], carddata[firstBlock + blockNo], n))
+				break;
+			blockNo += n;
+			isOK = blockNo > trailerNo;
 		}
+		PrintAndLog("Sector %2d isOk:%02x", sectorNo, isOK);
 	}
+	PrintAndLog("Card written in %" PRIu64 " ms", msclock() - start_time);
 
-	fclose(fdump);
 	return 0;
 }
 
@@ -854,16 +875,21 @@ int CmdHF14AMfNestedHard(const char *Cmd)
 	char ctmp;
 	ctmp = param_getchar(Cmd, 0);
 
-	if (ctmp != 'R' && ctmp != 'r' && ctmp != 'T' && ctmp != 't' && strlen(Cmd) < 20) {
+	if (ctmp != 'R' && ctmp != 'r' && ctmp != 'T' && ctmp != 't' && ctmp != 'B' && ctmp != 'b' && strlen(Cmd) < 20) {
 		PrintAndLog("Usage:");
 		PrintAndLog("      hf mf hardnested <block number> <key A|B> <key (12 hex symbols)>");
 		PrintAndLog("                       <target block number> <target key A|B> [known target key (12 hex symbols)] [w] [s]");
 		PrintAndLog("  or  hf mf hardnested r [known target key]");
+		PrintAndLog("  or  hf mf hardnested b <number of tests> <seed> [known target key] [<nonces> [<max nonces> [<step>]]]");
 		PrintAndLog(" ");
 		PrintAndLog("Options: ");
 		PrintAndLog("      w: Acquire nonces and write them to binary file nonces.bin");
 		PrintAndLog("      s: Slower acquisition (required by some non standard cards)");
 		PrintAndLog("      r: Read nonces.bin and start attack");
+		PrintAndLog("      b: Benchmark. Run simulated attacks with random keys derived from <seed> and");
+		PrintAndLog("         append the time spent in each stage to hardnested_bench.txt.");
+		PrintAndLog("         With <nonces> the acquisition stops at that many nonces instead of the estimated");
+		PrintAndLog("         brute force time, the tests are repeated up to <max nonces> in steps of <step> (250)");
 		PrintAndLog("      iX: set type of SIMD instructions. Without this flag programs autodetect it.");
 		PrintAndLog("        i5: AVX512");
 		PrintAndLog("        i2: AVX2");
@@ -876,9 +902,11 @@ int CmdHF14AMfNestedHard(const char *Cmd)
 		PrintAndLog("      sample2: hf mf hardnested 0 A FFFFFFFFFFFF 4 A w");
 		PrintAndLog("      sample3: hf mf hardnested 0 A FFFFFFFFFFFF 4 A w s");
 		PrintAndLog("      sample4: hf mf hardnested r");
+		PrintAndLog("      sample5: hf mf hardnested b 10 1");
+		PrintAndLog("      sample6: hf mf hardnested b 10 1 1500 3000 500");
 		PrintAndLog(" ");
 		PrintAndLog("Add the known target key to check if it is present in the remaining key space:");
-		PrintAndLog("      sample5: hf mf hardnested 0 A A0A1A2A3A4A5 4 A FFFFFFFFFFFF");
+		PrintAndLog("      sample7: hf mf hardnested 0 A A0A1A2A3A4A5 4 A FFFFFFFFFFFF");
 		return 0;
 	}
 
@@ -887,6 +915,9 @@ int CmdHF14AMfNestedHard(const char *Cmd)
 	bool nonce_file_write = false;
 	bool slow = false;
 	int tests = 0;
+	bool benchmark = false;
+	uint32_t seed = 0;
+	uint32_t nonces_sweep[3] = {0, 0, 250};		// from, to, step
 
 
 	uint16_t iindx = 0;
@@ -904,6 +935,25 @@ int CmdHF14AMfNestedHard(const char *Cmd)
 			know_target_key = true;
 			iindx = 3;
 		}
+	} else if (ctmp == 'B' || ctmp == 'b') {
+		benchmark = true;
+		tests = param_get32ex(Cmd, 1, 10, 10);
+		seed = param_get32ex(Cmd, 2, 1, 10);
+		iindx = 3;
+		if (!param_gethex(Cmd, 3, trgkey, 12)) {
+			know_target_key = true;
+			iindx = 4;
+		}
+		for (int j = 0; j < 3 && isdigit((unsigned char)param_getchar(Cmd, iindx)); j++, iindx++) {
+			nonces_sweep[j] = param_get32ex(Cmd, iindx, 0, 10);
+		}
+		if (nonces_sweep[1] < nonces_sweep[0]) {
+			nonces_sweep[1] = nonces_sweep[0];
+		}
+		if (nonces_sweep[2] == 0) {
+			PrintAndLog("The step of the nonce count must not be 0");
+			return 1;
+		}
 	} else {
 		blockNo = param_get8(Cmd, 0);
 		ctmp = param_getchar(Cmd, 1);
@@ -994,7 +1044,7 @@ int CmdHF14AMfNestedHard(const char *Cmd)
 			slow?"Yes":"No",
 			tests);
 
-	int16_t isOK = mfnestedhard(blockNo, keyType, key, trgBlockNo, trgKeyType, know_target_key?trgkey:NULL, nonce_file_read, nonce_file_write, slow, tests);
+	int16_t isOK = mfnestedhard(blockNo, keyType, key, trgBlockNo, trgKeyType, know_target_key?trgkey:NULL, nonce_file_read, nonce_file_write, slow, tests, benchmark, seed, nonces_sweep[0], nonces_sweep[1], nonces_sweep[2]);
 
 	if (isOK) {
 		switch (isOK) {
@@ -1690,25 +1740,116 @@ int CmdHF14AMfESet(const char *Cmd)
 }
 
 
+// Card images are `.eml` files with 32 hex symbols per block and line, or binary dumps like
+// dumpdata.bin if the file name ends with `.bin`
+static bool mf_dump_is_binary(const char *filename)
+{
+	size_t len = strlen(filename);
+	return len >= 4 && !strcmp(filename + len - 4, ".bin");
+}
+
+// filename has len characters, add `.eml` unless it's a binary dump
+static void mf_dump_add_extension(char *filename, int len)
+{
+	if (len > FILE_PATH_SIZE - 5) len = FILE_PATH_SIZE - 5;
+	filename[len] = 0x00;
+	if (!mf_dump_is_binary(filename))
+		sprintf(filename + len, ".eml");
+}
+
+static int hex_nibble(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+// Read up to maxBlocks blocks. Returns the number of blocks read, -1 if the file can't be opened
+// or -2 for a broken file.
+static int mf_load_dump(const char *filename, uint8_t *data, int maxBlocks)
+{
+	int blockNum = 0;
+	bool binary = mf_dump_is_binary(filename);
+
+	FILE *f = fopen(filename, binary ? "rb" : "r");
+	if (f == NULL) {
+		PrintAndLog("File %s not found or locked", filename);
+		return -1;
+	}
+
+	if (binary) {
+		blockNum = fread(data, 16, maxBlocks, f);
+		fclose(f);
+		return blockNum;
+	}
+
+	char buf[256];
+	while (blockNum < maxBlocks && fgets(buf, sizeof(buf), f) != NULL) {
+		if (strlen(buf) < 32) {
+			if (feof(f))
+				break;
+			PrintAndLog("File content error. Block data must include 32 HEX symbols");
+			fclose(f);
+			return -2;
+		}
+		for (int i = 0; i < 16; i++) {
+			int hi = hex_nibble(buf[2 * i]);
+			int lo = hex_nibble(buf[2 * i + 1]);
+			if (hi < 0 || lo < 0) {
+				PrintAndLog("File content error. Block data must include 32 HEX symbols");
+				fclose(f);
+				return -2;
+			}
+			data[blockNum * 16 + i] = hi << 4 | lo;
+		}
+		blockNum++;
+	}
+	fclose(f);
+	return blockNum;
+}
+
+static int mf_save_dump(const char *filename, uint8_t *data, int numBlocks, bool uppercase)
+{
+	bool binary = mf_dump_is_binary(filename);
+
+	FILE *f = fopen(filename, binary ? "wb" : "w+");
+	if (f == NULL) {
+		PrintAndLog("Can't open file %s ", filename);
+		return 1;
+	}
+
+	if (binary) {
+		fwrite(data, 16, numBlocks, f);
+	} else {
+		char line[34];
+		for (int i = 0; i < numBlocks; i++) {
+			hex_to_buffer((uint8_t *)line, data + i * 16, 16, 32, 0, 0, uppercase);
+			fprintf(f, "%s\n", line);
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+
 int CmdHF14AMfELoad(const char *Cmd)
 {
-	FILE * f;
 	char filename[FILE_PATH_SIZE];
-	char *fnameptr = filename;
-	char buf[64] = {0x00};
-	uint8_t buf8[64] = {0x00};
-	int i, len, blockNum, numBlocks;
+	uint8_t data[256 * 16];
+	int len, blockNum, numBlocks;
 	int nameParamNo = 1;
 
 	char ctmp = param_getchar(Cmd, 0);
 
 	if ( ctmp == 'h' || ctmp == 0x00) {
-		PrintAndLog("It loads emul dump from the file `filename.eml`");
+		PrintAndLog("It loads emul dump from the file `filename.eml` or the binary dump `filename.bin`");
 		PrintAndLog("Usage:  hf mf eload [card memory] <file name w/o `.eml`>");
 		PrintAndLog("  [card memory]: 0 = 320 bytes (Mifare Mini), 1 = 1K (default), 2 = 2K, 4 = 4K");
 		PrintAndLog("");
 		PrintAndLog(" sample: hf mf eload filename");
 		PrintAndLog("         hf mf eload 4 filename");
+		PrintAndLog("         hf mf eload 4 dumpdata.bin");
 		return 0;
 	}
 
@@ -1725,62 +1866,23 @@ int CmdHF14AMfELoad(const char *Cmd)
 	}
 
 	len = param_getstr(Cmd,nameParamNo,filename,sizeof(filename));
+	mf_dump_add_extension(filename, len);
 
-	if (len > FILE_PATH_SIZE - 5) len = FILE_PATH_SIZE - 5;
-
-	fnameptr += len;
-
-	sprintf(fnameptr, ".eml");
-
-	// open file
-	f = fopen(filename, "r");
-	if (f == NULL) {
-		PrintAndLog("File %s not found or locked", filename);
-		return 1;
-	}
-
-	blockNum = 0;
-	while(!feof(f)){
-		memset(buf, 0, sizeof(buf));
-
-		if (fgets(buf, sizeof(buf), f) == NULL) {
-
-			if (blockNum >= numBlocks) break;
-
-			PrintAndLog("File reading error.");
-			fclose(f);
-			return 2;
-		}
-
-		if (strlen(buf) < 32){
-			if(strlen(buf) && feof(f))
-				break;
-			PrintAndLog("File content error. Block data must include 32 HEX symbols");
-			fclose(f);
-			return 2;
-		}
-
-		for (i = 0; i < 32; i += 2) {
-			sscanf(&buf[i], "%02x", (unsigned int *)&buf8[i / 2]);
-		}
-
-		if (mfEmlSetMem(buf8, blockNum, 1)) {
-			PrintAndLog("Cant set emul block: %3d", blockNum);
-			fclose(f);
-			return 3;
-		}
-		printf(".");
-		blockNum++;
-
-		if (blockNum >= numBlocks) break;
-	}
-	fclose(f);
-	printf("\n");
+	blockNum = mf_load_dump(filename, data, numBlocks);
+	if (blockNum < 0)
+		return -blockNum;
 
 	if ((blockNum != numBlocks)) {
 		PrintAndLog("File content error. Got %d must be %d blocks.",blockNum, numBlocks);
 		return 4;
 	}
+
+	// whole USB frames, each acknowledged
+	if (mfEmlSetMemChecked(data, 0, numBlocks)) {
+		PrintAndLog("Cant set emul blocks");
+		return 3;
+	}
+
 	PrintAndLog("Loaded %d blocks from file: %s", blockNum, filename);
 	return 0;
 }
@@ -1788,26 +1890,25 @@ int CmdHF14AMfELoad(const char *Cmd)
 
 int CmdHF14AMfESave(const char *Cmd)
 {
-	FILE * f;
 	char filename[FILE_PATH_SIZE];
-	char * fnameptr = filename;
-	uint8_t buf[64];
-	int i, j, len, numBlocks;
+	uint8_t data[256 * 16];
+	int len, numBlocks;
 	int nameParamNo = 1;
 
 	memset(filename, 0, sizeof(filename));
-	memset(buf, 0, sizeof(buf));
 
 	char ctmp = param_getchar(Cmd, 0);
 
 	if ( ctmp == 'h' || ctmp == 'H') {
 		PrintAndLog("It saves emul dump into the file `filename.eml` or `cardID.eml`");
+		PrintAndLog("or into the binary dump `filename.bin`");
 		PrintAndLog(" Usage:  hf mf esave [card memory] [file name w/o `.eml`]");
 		PrintAndLog("  [card memory]: 0 = 320 bytes (Mifare Mini), 1 = 1K (default), 2 = 2K, 4 = 4K");
 		PrintAndLog("");
 		PrintAndLog(" sample: hf mf esave ");
 		PrintAndLog("         hf mf esave 4");
 		PrintAndLog("         hf mf esave 4 filename");
+		PrintAndLog("         hf mf esave 4 filename.bin");
 		return 0;
 	}
 
@@ -1823,48 +1924,24 @@ int CmdHF14AMfESave(const char *Cmd)
 		}
 	}
 
-	len = param_getstr(Cmd,nameParamNo,filename,sizeof(filename));
+	if (mfEmlGetMem(data, 0, numBlocks)) {
+		PrintAndLog("Cant get emul blocks");
+		return 2;
+	}
 
-	if (len > FILE_PATH_SIZE - 5) len = FILE_PATH_SIZE - 5;
+	len = param_getstr(Cmd,nameParamNo,filename,sizeof(filename));
 
 	// user supplied filename?
 	if (len < 1) {
 		// get filename (UID from memory)
-		if (mfEmlGetMem(buf, 0, 1)) {
-			PrintAndLog("Can\'t get UID from block: %d", 0);
-			len = sprintf(fnameptr, "dump");
-			fnameptr += len;
-		}
-		else {
-			for (j = 0; j < 7; j++, fnameptr += 2)
-				sprintf(fnameptr, "%02X", buf[j]);
-		}
-	} else {
-		fnameptr += len;
+		for (int j = 0; j < 7; j++)
+			sprintf(filename + 2 * j, "%02X", data[j]);
+		len = 14;
 	}
+	mf_dump_add_extension(filename, len);
 
-	// add file extension
-	sprintf(fnameptr, ".eml");
-
-	// open file
-	f = fopen(filename, "w+");
-
-	if ( !f ) {
-		PrintAndLog("Can't open file %s ", filename);
+	if (mf_save_dump(filename, data, numBlocks, true))
 		return 1;
-	}
-
-	// put hex
-	for (i = 0; i < numBlocks; i++) {
-		if (mfEmlGetMem(buf, i, 1)) {
-			PrintAndLog("Cant get block: %d", i);
-			break;
-		}
-		for (j = 0; j < 16; j++)
-			fprintf(f, "%02X", buf[j]);
-		fprintf(f,"\n");
-	}
-	fclose(f);
 
 	PrintAndLog("Saved %d blocks to file: %s", numBlocks, filename);
 
@@ -2139,21 +2216,19 @@ int CmdHF14AMfCSetBlk(const char *Cmd)
 
 int CmdHF14AMfCLoad(const char *Cmd)
 {
-	FILE * f;
 	char filename[FILE_PATH_SIZE] = {0x00};
-	char * fnameptr = filename;
-	char buf[256] = {0x00};
-	uint8_t buf8[256] = {0x00};
+	uint8_t data[256 * 16];
 	uint8_t fillFromEmulator = 0;
-	int i, len, blockNum, flags = 0, gen = 0, numblock = 64;
+	int blockNum, flags = 0, gen = 0, numblock = 64;
 
 	if (param_getchar(Cmd, 0) == 'h' || param_getchar(Cmd, 0)== 0x00) {
-		PrintAndLog("It loads magic Chinese card from the file `filename.eml`");
+		PrintAndLog("It loads magic Chinese card from the file `filename.eml`, the binary dump `filename.bin`");
 		PrintAndLog("or from emulator memory (option `e`). 4K card: (option `4`)");
 		PrintAndLog("Usage:  hf mf cload [file name w/o `.eml`][e][4]");
 		PrintAndLog("   or:  hf mf cload e [4]");
 		PrintAndLog("Sample: hf mf cload filename");
 		PrintAndLog("        hf mf cload filname 4");
+		PrintAndLog("        hf mf cload dumpdata.bin");
 		PrintAndLog("        hf mf cload e");
 		PrintAndLog("        hf mf cload e 4");
 		return 0;
@@ -2164,93 +2239,55 @@ int CmdHF14AMfCLoad(const char *Cmd)
 	ctmp = param_getchar(Cmd, 1);
 	if (ctmp == '4') numblock = 256;
 
-	gen = mfCIdentify();
-	PrintAndLog("Loading magic mifare %dK", numblock == 256 ? 4:1);
-
 	if (fillFromEmulator) {
-		for (blockNum = 0; blockNum < numblock; blockNum += 1) {
-			if (mfEmlGetMem(buf8, blockNum, 1)) {
-				PrintAndLog("Cant get block: %d", blockNum);
-				return 2;
-			}
-			if (blockNum == 0) flags = CSETBLOCK_INIT_FIELD + CSETBLOCK_WUPC;				// switch on field and send magic sequence
-			if (blockNum == 1) flags = 0;													// just write
-			if (blockNum == numblock - 1) flags = CSETBLOCK_HALT + CSETBLOCK_RESET_FIELD;		// Done. Magic Halt and switch off field.
-
-			if (gen == 2)
-				/* generation 1b magic card */
-				flags |= CSETBLOCK_MAGIC_1B;
-			if (mfCSetBlock(blockNum, buf8, NULL, 0, flags)) {
-				PrintAndLog("Cant set magic card block: %d", blockNum);
-				return 3;
-			}
+		if (mfEmlGetMem(data, 0, numblock)) {
+			PrintAndLog("Cant get emul blocks");
+			return 2;
 		}
-		return 0;
 	} else {
-		param_getstr(Cmd, 0, filename, sizeof(filename));
+		int len = param_getstr(Cmd, 0, filename, sizeof(filename));
+		mf_dump_add_extension(filename, len);
 
-		len = strlen(filename);
-		if (len > FILE_PATH_SIZE - 5) len = FILE_PATH_SIZE - 5;
-
-		//memcpy(filename, Cmd, len);
-		fnameptr += len;
-
-		sprintf(fnameptr, ".eml");
-
-		// open file
-		f = fopen(filename, "r");
-		if (f == NULL) {
-			PrintAndLog("File not found or locked.");
+		blockNum = mf_load_dump(filename, data, numblock);
+		if (blockNum == -1)
 			return 1;
-		}
-
-		blockNum = 0;
-		while(!feof(f)){
+		if (blockNum < 0)
+			return 2;
 
-			memset(buf, 0, sizeof(buf));
+		if (blockNum != numblock){
+			PrintAndLog("File content error. There must be %d blocks", numblock);
+			return 4;
+		}
+	}
 
-			if (fgets(buf, sizeof(buf), f) == NULL) {
-				fclose(f);
-				PrintAndLog("File reading error.");
-				return 2;
-			}
+	gen = mfCIdentify();
+	PrintAndLog("Loading magic mifare %dK", numblock == 256 ? 4:1);
 
-			if (strlen(buf) < 32) {
-				if(strlen(buf) && feof(f))
-					break;
-				PrintAndLog("File content error. Block data must include 32 HEX symbols");
-				fclose(f);
-				return 2;
-			}
-			for (i = 0; i < 32; i += 2)
-				sscanf(&buf[i], "%02x", (unsigned int *)&buf8[i / 2]);
+	// as many blocks per command as fit into a USB frame, one block at a time for older firmware
+	int frameBlocks = MF_FRAME_BLOCKS;
+	for (blockNum = 0; blockNum < numblock; ) {
+		int n = numblock - blockNum < frameBlocks ? numblock - blockNum : frameBlocks;
 
-			if (blockNum == 0) flags = CSETBLOCK_INIT_FIELD + CSETBLOCK_WUPC;				// switch on field and send magic sequence
-			if (blockNum == 1) flags = 0;													// just write
-			if (blockNum == numblock - 1) flags = CSETBLOCK_HALT + CSETBLOCK_RESET_FIELD;		// Done. Switch off field.
+		flags = 0;																			// just write
+		if (blockNum == 0) flags |= CSETBLOCK_INIT_FIELD + CSETBLOCK_WUPC;					// switch on field and send magic sequence
+		if (blockNum + n == numblock) flags |= CSETBLOCK_HALT + CSETBLOCK_RESET_FIELD;		// Done. Magic Halt and switch off field.
 
-			if (gen == 2)
-				/* generation 1b magic card */
-				flags |= CSETBLOCK_MAGIC_1B;
-			if (mfCSetBlock(blockNum, buf8, NULL, 0, flags)) {
-				PrintAndLog("Can't set magic card block: %d", blockNum);
-				fclose(f);
-				return 3;
-			}
-			blockNum++;
+		if (gen == 2)
+			/* generation 1b magic card */
+			flags |= CSETBLOCK_MAGIC_1B;
 
-			if (blockNum >= numblock) break;  // magic card type - mifare 1K 64 blocks, mifare 4k 256 blocks
+		int written = mfCSetBlocks(blockNum, data + blockNum * 16, n, flags);
+		if (written < 1) {
+			PrintAndLog("Can't set magic card block: %d", blockNum);
+			return 3;
 		}
-		fclose(f);
+		if (written < n)
+			frameBlocks = 1;
+		blockNum += written;
+	}
 
-		//if (blockNum != 16 * 4 && blockNum != 32 * 4 + 8 * 16){
-		if (blockNum != numblock){
-			PrintAndLog("File content error. There must be %d blocks", numblock);
-			return 4;
-		}
+	if (!fillFromEmulator)
 		PrintAndLog("Loaded from file: %s", filename);
-		return 0;
-	}
 	return 0;
 }
 
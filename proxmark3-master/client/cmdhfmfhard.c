@@ -46,6 +46,7 @@
 
 #define DEBUG_KEY_ELIMINATION
 // #define DEBUG_REDUCTION
+// #define DEBUG_NONCE_STORE
 
 static uint16_t sums[NUM_SUMS] = {0, 32, 56, 64, 80, 96, 104, 112, 120, 128, 136, 144, 152, 160, 176, 192, 200, 224, 256}; // possible sum property values
 
@@ -505,13 +506,34 @@ static const float *p_K;
 	
 static uint32_t cuid;
 static noncelist_t nonces[256];
-static uint8_t best_first_bytes[256];
+static uint8_t best_first_bytes[256];		// only the first NUM_BEST_FIRST_BYTES are sorted, see sort_best_first_bytes()
 static uint64_t maximum_states = 0;
 static uint8_t best_first_byte_smallest_bitarray = 0;
 static uint16_t first_byte_Sum = 0;
 static uint16_t first_byte_num = 0;
 static bool write_stats = false;
 static FILE *fstats = NULL;
+
+// stage timing for the benchmark mode (hf mf hardnested b ...)
+typedef enum {
+	BENCH_TABLES = 0,
+	BENCH_ACQUIRE,
+	BENCH_REDUCE,
+	BENCH_CANDIDATES,
+	BENCH_BRUTE_FORCE,
+	NUM_BENCH_STAGES
+} bench_stage_t;
+
+static const char *bench_stage_names[NUM_BENCH_STAGES] = {"tables_ms", "acquire_ms", "reduce_ms", "candidates_ms", "bruteforce_ms"};
+static uint64_t bench_time[NUM_BENCH_STAGES];
+static FILE *fbench = NULL;
+static float bench_brute_force_per_second;
+// number of nonces after which the simulated acquisition stops, 0: stop depending on the brute force rate
+static uint32_t bench_num_nonces = 0;
+
+// the simulated acquisition stops depending on the brute force rate. Use a fixed rate in benchmark mode
+// to get the same nonces (and candidates) for the same seed on any machine.
+#define BENCH_NOMINAL_BRUTE_FORCE_PER_SECOND	(float)(1LL<<28)
 static uint32_t *all_bitflips_bitarray[2];
 static uint32_t num_all_bitflips_bitarray[2];
 static bool all_bitflips_bitarray_dirty[2];
@@ -519,44 +541,40 @@ static uint64_t last_sample_clock = 0;
 static uint64_t sample_period = 0;
 static uint64_t num_keys_tested = 0;
 static statelist_t *candidates = NULL;
+static noncelistentry_t *nonce_arena = NULL;		// one record slot for each possible 1st and 2nd byte
+#if defined (DEBUG_NONCE_STORE)
+static uint32_t num_nonce_store_inserts = 0;
+static uint32_t num_nonce_store_duplicates = 0;
+#endif
 
 
 static int add_nonce(uint32_t nonce_enc, uint8_t par_enc) 
 {
 	uint8_t first_byte = nonce_enc >> 24;
-	noncelistentry_t *p1 = nonces[first_byte].first;
-	noncelistentry_t *p2 = NULL;
+	uint8_t second_byte = nonce_enc >> 16;
+	uint32_t *present = &nonces[first_byte].second_byte_present[second_byte / 32];
+	uint32_t mask = 1u << (second_byte % 32);
 
-	if (p1 == NULL) {			// first nonce with this 1st byte
-		first_byte_num++;
-		first_byte_Sum += evenparity32((nonce_enc & 0xff000000) | (par_enc & 0x08));
-	}
+#if defined (DEBUG_NONCE_STORE)
+	num_nonce_store_inserts++;
+#endif
 
-	while (p1 != NULL && (p1->nonce_enc & 0x00ff0000) < (nonce_enc & 0x00ff0000)) {
-		p2 = p1;
-		p1 = p1->next;
-	}
-	
-	if (p1 == NULL) { 																	// need to add at the end of the list
-		if (p2 == NULL) { 			// list is empty yet. Add first entry.
-			p2 = nonces[first_byte].first = malloc(sizeof(noncelistentry_t));
-		} else {					// add new entry at end of existing list.
-			p2 = p2->next = malloc(sizeof(noncelistentry_t));
-		}
-	} else if ((p1->nonce_enc & 0x00ff0000) != (nonce_enc & 0x00ff0000)) {				// found distinct 2nd byte. Need to insert.
-		if (p2 == NULL) {			// need to insert at start of list
-			p2 = nonces[first_byte].first = malloc(sizeof(noncelistentry_t));
-		} else {
-			p2 = p2->next = malloc(sizeof(noncelistentry_t));
-		}
-	} else {																			// we have seen this 2nd byte before. Nothing to add or insert. 
+	if (*present & mask) {																// we have seen this 2nd byte before. Nothing to add.
+#if defined (DEBUG_NONCE_STORE)
+		num_nonce_store_duplicates++;
+#endif
 		return (0);
 	}
 
-	// add or insert new data
-	p2->next = p1;
-	p2->nonce_enc = nonce_enc;
-	p2->par_enc = par_enc;
+	if (nonces[first_byte].num == 0) {			// first nonce with this 1st byte
+		first_byte_num++;
+		first_byte_Sum += evenparity32((nonce_enc & 0xff000000) | (par_enc & 0x08));
+	}
+
+	// add new data into its arena slot
+	*present |= mask;
+	nonces[first_byte].entry[second_byte].nonce_enc = nonce_enc;
+	nonces[first_byte].entry[second_byte].par_enc = par_enc;
 
 	nonces[first_byte].num++;
 	nonces[first_byte].Sum += evenparity32((nonce_enc & 0x00ff0000) | (par_enc & 0x04));
@@ -567,10 +585,20 @@ static int add_nonce(uint32_t nonce_enc, uint8_t par_enc)
 
 static void init_nonce_memory(void)
 {
+	nonce_arena = (noncelistentry_t *)malloc(sizeof(noncelistentry_t) * 256 * 256);
+	if (nonce_arena == NULL) {
+		printf("Out of memory error in init_nonce_memory(). Aborting...\n");
+		exit(4);
+	}
+#if defined (DEBUG_NONCE_STORE)
+	num_nonce_store_inserts = 0;
+	num_nonce_store_duplicates = 0;
+#endif
 	for (uint16_t i = 0; i < 256; i++) {
 		nonces[i].num = 0;
 		nonces[i].Sum = 0;
-		nonces[i].first = NULL;
+		memset(nonces[i].second_byte_present, 0, sizeof(nonces[i].second_byte_present));
+		nonces[i].entry = &nonce_arena[i * 256];
 		for (uint16_t j = 0; j < NUM_SUMS; j++) {
 			nonces[i].sum_a8_guess[j].sum_a8_idx = j;
 			nonces[i].sum_a8_guess[j].prob = 0.0;
@@ -601,22 +629,14 @@ static void init_nonce_memory(void)
 }
 
 
-static void free_nonce_list(noncelistentry_t *p)
-{
-	if (p == NULL) {
-		return;
-	} else {
-		free_nonce_list(p->next);
-		free(p);
-	}
-}
-
-
 static void free_nonces_memory(void)
 {
-	for (uint16_t i = 0; i < 256; i++) {
-		free_nonce_list(nonces[i].first);
-	}
+#if defined (DEBUG_NONCE_STORE)
+	printf("Nonce store: %" PRIu32 " inserts, %" PRIu32 " duplicates, %" PRIu32 " distinct nonces in a %zu byte arena (no further allocations)\n",
+		num_nonce_store_inserts, num_nonce_store_duplicates, num_nonce_store_inserts - num_nonce_store_duplicates, sizeof(noncelistentry_t) * 256 * 256);
+#endif
+	free(nonce_arena);
+	nonce_arena = NULL;
 	for (int i = 255; i >= 0; i--) {
 		free_bitarray(nonces[i].states_bitarray[ODD_STATE]);
 		free_bitarray(nonces[i].states_bitarray[EVEN_STATE]);
@@ -624,81 +644,61 @@ static void free_nonces_memory(void)
 }
 
 
-// static double p_hypergeometric_cache[257][NUM_SUMS][257];
+static double log_factorial[257];		// log(n!), memoized for p_hypergeometric()
+static bool log_factorial_valid = false;
 
-// #define CACHE_INVALID -1.0
-// static void init_p_hypergeometric_cache(void)
-// {
-	// for (uint16_t n = 0; n <= 256; n++) {
-		// for (uint16_t i_K = 0; i_K < NUM_SUMS; i_K++) {
-			// for (uint16_t k = 0; k <= 256; k++) {
-				// p_hypergeometric_cache[n][i_K][k] = CACHE_INVALID;
-			// }
-		// }
-	// }
-// }
+static void init_log_factorial(void)
+{
+	// use logarithms to avoid overflow with huge factorials (double type can only hold 170!)
+	log_factorial[0] = 0.0;
+	for (uint16_t i = 1; i <= 256; i++) {
+		log_factorial[i] = log_factorial[i-1] + log(i);
+	}
+	log_factorial_valid = true;
+}
+
+
+static inline double log_binomial(uint16_t n, uint16_t k)
+{
+	return log_factorial[n] - log_factorial[k] - log_factorial[n-k];
+}
 
 
 static double p_hypergeometric(uint16_t i_K, uint16_t n, uint16_t k) 
 {
-	// for efficient computation we are using the recursive definition
-	//						(K-k+1) * (n-k+1)
-	// P(X=k) = P(X=k-1) * --------------------
-	//						   k * (N-K-n+k)
-	// and
-	//           (N-K)*(N-K-1)*...*(N-K-n+1)
-	// P(X=0) = -----------------------------
-	//               N*(N-1)*...*(N-n+1)
+	//             (K over k) * (N-K over n-k)
+	// P(X=k) = -------------------------------
+	//                    (N over n)
+	// evaluated in the log domain from the memoized log_factorial[] table
 
-	
 	uint16_t const N = 256;
 	uint16_t K = sums[i_K];
 
-	// if (p_hypergeometric_cache[n][i_K][k] != CACHE_INVALID) {
-		// return p_hypergeometric_cache[n][i_K][k];
-	// }
-	
-	if (n-k > N-K || k > K) return 0.0;	// avoids log(x<=0) in calculation below
-	if (k == 0) {
-		// use logarithms to avoid overflow with huge factorials (double type can only hold 170!)
-		double log_result = 0.0;
-		for (int16_t i = N-K; i >= N-K-n+1; i--) {
-			log_result += log(i);
-		} 
-		for (int16_t i = N; i >= N-n+1; i--) {
-			log_result -= log(i);
-		}
-		// p_hypergeometric_cache[n][i_K][k] = exp(log_result);
-		return exp(log_result);
-	} else {
-		if (n-k == N-K) {	// special case. The published recursion below would fail with a divide by zero exception
-			double log_result = 0.0;
-			for (int16_t i = k+1; i <= n; i++) {
-				log_result += log(i);
-			}
-			for (int16_t i = K+1; i <= N; i++) {
-				log_result -= log(i);
-			}
-			// p_hypergeometric_cache[n][i_K][k] = exp(log_result);
-			return exp(log_result);
-		} else { 			// recursion
-			return (p_hypergeometric(i_K, n, k-1) * (K-k+1) * (n-k+1) / (k * (N-K-n+k)));
-		}
+	if (n-k > N-K || k > K) return 0.0;
+	if (!log_factorial_valid) {
+		init_log_factorial();
 	}
+	return exp(log_binomial(K, k) + log_binomial(N-K, n-k) - log_binomial(N, n));
 }
 	
 	
-static float sum_probability(uint16_t i_K, uint16_t n, uint16_t k)
+static void sum_probabilities(uint16_t n, uint16_t k, float *prob)
 {
-	if (k > sums[i_K]) return 0.0;
-
-	double p_T_is_k_when_S_is_K = p_hypergeometric(i_K, n, k);
-	double p_S_is_K = p_K[i_K];
+	// the hypergeometric terms for all possible Sum(a8) are needed for the common denominator anyway.
+	// Calculate them once and derive all probabilities from them.
+	double p_T_is_k_when_S_is_K[NUM_SUMS];
 	double p_T_is_k = 0;
 	for (uint16_t i = 0; i < NUM_SUMS; i++) {
-		p_T_is_k += p_K[i] * p_hypergeometric(i, n, k);
+		p_T_is_k_when_S_is_K[i] = p_hypergeometric(i, n, k);
+		p_T_is_k += p_K[i] * p_T_is_k_when_S_is_K[i];
+	}
+	for (uint16_t i_K = 0; i_K < NUM_SUMS; i_K++) {
+		if (k > sums[i_K]) {
+			prob[i_K] = 0.0;
+		} else {
+			prob[i_K] = p_T_is_k_when_S_is_K[i_K] * p_K[i_K] / p_T_is_k;
+		}
 	}
-	return(p_T_is_k_when_S_is_K * p_S_is_K / p_T_is_k);
 }
 
 
@@ -809,18 +809,44 @@ static uint64_t estimated_num_states_coarse(uint16_t sum_a0, uint16_t sum_a8)
 }
 
 
-static void update_p_K(void)
+static uint64_t num_states_coarse[NUM_SUMS];		// estimated_num_states_coarse(sums[first_byte_Sum], sums[sum_a8_idx]), same for all first bytes
+static uint16_t num_states_coarse_sum_a0_idx = 0;
+static bool num_states_coarse_dirty = true;
+static uint32_t num_states_coarse_generation = 0;	// incremented whenever num_states_coarse[] is recalculated
+
+// Returns the generation of num_states_coarse[]. Each user remembers the generation it last
+// used and compares it to this one, a single dirty flag would be consumed by the first caller.
+static uint32_t update_num_states_coarse(void)
 {
-	if (hardnested_stage & CHECK_2ND_BYTES) {
-		uint64_t total_count = 0;
+	// the coarse estimates only depend on part_sum_count[] and Sum(a0). Recalculate only if one of them changed.
+	if (num_states_coarse_dirty || num_states_coarse_sum_a0_idx != first_byte_Sum) {
 		uint16_t sum_a0 = sums[first_byte_Sum];
 		for (uint8_t sum_a8_idx = 0; sum_a8_idx < NUM_SUMS; sum_a8_idx++) {
-			uint16_t sum_a8 = sums[sum_a8_idx];
-			total_count += estimated_num_states_coarse(sum_a0, sum_a8);
+			num_states_coarse[sum_a8_idx] = estimated_num_states_coarse(sum_a0, sums[sum_a8_idx]);
 		}
-		for (uint8_t sum_a8_idx = 0; sum_a8_idx < NUM_SUMS; sum_a8_idx++) {
-			uint16_t sum_a8 = sums[sum_a8_idx];
-			my_p_K[sum_a8_idx] = (float)estimated_num_states_coarse(sum_a0, sum_a8) / total_count;
+		num_states_coarse_sum_a0_idx = first_byte_Sum;
+		num_states_coarse_dirty = false;
+		num_states_coarse_generation++;
+	}
+	return num_states_coarse_generation;
+}
+
+
+static uint32_t p_K_generation = 0;
+
+static void update_p_K(void)
+{
+	if (hardnested_stage & CHECK_2ND_BYTES) {
+		uint32_t generation = update_num_states_coarse();
+		if (generation != p_K_generation || p_K != my_p_K) {
+			p_K_generation = generation;
+			uint64_t total_count = 0;
+			for (uint8_t sum_a8_idx = 0; sum_a8_idx < NUM_SUMS; sum_a8_idx++) {
+				total_count += num_states_coarse[sum_a8_idx];
+			}
+			for (uint8_t sum_a8_idx = 0; sum_a8_idx < NUM_SUMS; sum_a8_idx++) {
+				my_p_K[sum_a8_idx] = (float)num_states_coarse[sum_a8_idx] / total_count;
+			}
 		}
 		// printf("my_p_K = [");
 		// for (uint8_t sum_a8_idx = 0; sum_a8_idx < NUM_SUMS; sum_a8_idx++) {
@@ -847,18 +873,87 @@ static void update_sum_bitarrays(odd_even_t odd_even)
 				    += count_bitarray_AND2(part_sum_a0_bitarrays[odd_even][part_sum_a0], part_sum_a8_bitarrays[odd_even][part_sum_a8]);
 			}
 		}
+		num_states_coarse_dirty = true;
 		all_bitflips_bitarray_dirty[odd_even] = false;
 	}
 }
 
 
-static int compare_expected_num_brute_force(const void *b1, const void *b2)
+// the first bytes are kept in a binary min-heap ordered by their coarse expected number of brute forces.
+// Only first bytes with changed statistics need to be moved within the heap, and only the best
+// NUM_BEST_FIRST_BYTES are taken from it.
+#define NUM_BEST_FIRST_BYTES	10
+static uint8_t best_first_bytes_heap[256];
+static uint16_t heap_pos[256];
+static float coarse_expected_num_brute_force[256];
+static bool expected_num_brute_force_dirty[256];
+static int16_t refined_first_byte = -1;
+static uint32_t heap_generation = 0;		// generation of num_states_coarse[] the heap was built from
+
+static inline void heap_swap(uint16_t pos1, uint16_t pos2)
+{
+	uint8_t tmp = best_first_bytes_heap[pos1];
+	best_first_bytes_heap[pos1] = best_first_bytes_heap[pos2];
+	best_first_bytes_heap[pos2] = tmp;
+	heap_pos[best_first_bytes_heap[pos1]] = pos1;
+	heap_pos[best_first_bytes_heap[pos2]] = pos2;
+}
+
+
+static void heap_sift_down(uint8_t *heap, uint16_t heap_size, uint16_t pos, bool track_pos)
+{
+	while (2*pos + 1 < heap_size) {
+		uint16_t child = 2*pos + 1;
+		if (child + 1 < heap_size && coarse_expected_num_brute_force[heap[child+1]] < coarse_expected_num_brute_force[heap[child]]) {
+			child++;
+		}
+		if (coarse_expected_num_brute_force[heap[child]] >= coarse_expected_num_brute_force[heap[pos]]) {
+			break;
+		}
+		if (track_pos) {
+			heap_swap(pos, child);
+		} else {
+			uint8_t tmp = heap[pos];
+			heap[pos] = heap[child];
+			heap[child] = tmp;
+		}
+		pos = child;
+	}
+}
+
+
+static void heap_update(uint8_t first_byte)
 {
-	uint8_t index1 = *(uint8_t *)b1;
-	uint8_t index2 = *(uint8_t *)b2;
-	float score1 = nonces[index1].expected_num_brute_force;
-	float score2 = nonces[index2].expected_num_brute_force;
-	return (score1 > score2) - (score1 < score2);
+	uint16_t pos = heap_pos[first_byte];
+	while (pos > 0 && coarse_expected_num_brute_force[best_first_bytes_heap[(pos-1)/2]] > coarse_expected_num_brute_force[first_byte]) {
+		heap_swap(pos, (pos-1)/2);
+		pos = (pos-1)/2;
+	}
+	heap_sift_down(best_first_bytes_heap, 256, pos, true);
+}
+
+
+static void heap_build(void)
+{
+	for (uint16_t i = 0; i < 256; i++) {
+		best_first_bytes_heap[i] = i;
+		heap_pos[i] = i;
+	}
+	for (int16_t pos = 127; pos >= 0; pos--) {
+		heap_sift_down(best_first_bytes_heap, 256, pos, true);
+	}
+}
+
+
+static void init_best_first_bytes_heap(void)
+{
+	for (uint16_t i = 0; i < 256; i++) {
+		expected_num_brute_force_dirty[i] = true;
+		coarse_expected_num_brute_force[i] = 0.0;
+	}
+	num_states_coarse_dirty = true;
+	refined_first_byte = -1;
+	heap_build();
 }
 
 
@@ -918,22 +1013,54 @@ static void update_expected_brute_force(uint8_t best_byte) {
 static float sort_best_first_bytes(void)
 {
 	
-	// initialize best_first_bytes, do a rough estimation on remaining states for each Sum_a8 property
-	// and the expected number of states to brute force
+	// do a rough estimation on remaining states for each Sum_a8 property and the expected number of states
+	// to brute force. This needs to be redone for all first bytes only if the coarse estimates changed.
+	uint32_t generation = update_num_states_coarse();
+	bool update_all = (generation != heap_generation);
+	heap_generation = generation;
+	if (refined_first_byte >= 0) {		// the refined byte's num_states need to be reset to the coarse estimates
+		expected_num_brute_force_dirty[refined_first_byte] = true;
+	}
+#if defined (DEBUG_REDUCTION)
+	uint16_t num_updated = 0;
+#endif
 	for (uint16_t i = 0; i < 256; i++) {
-		best_first_bytes[i] = i;
-		float prob_all_failed = 1.0;
-		nonces[i].expected_num_brute_force = 0.0;
-		for (uint8_t j = 0; j < NUM_SUMS; j++) {
-			nonces[i].sum_a8_guess[j].num_states = estimated_num_states_coarse(sums[first_byte_Sum], sums[nonces[i].sum_a8_guess[j].sum_a8_idx]);
-			nonces[i].expected_num_brute_force += nonces[i].sum_a8_guess[j].prob * (float)nonces[i].sum_a8_guess[j].num_states / 2.0;
-			prob_all_failed -= nonces[i].sum_a8_guess[j].prob;
-			nonces[i].expected_num_brute_force += prob_all_failed * (float)nonces[i].sum_a8_guess[j].num_states / 2.0;
+		if (update_all || expected_num_brute_force_dirty[i]) {
+			float prob_all_failed = 1.0;
+			nonces[i].expected_num_brute_force = 0.0;
+			for (uint8_t j = 0; j < NUM_SUMS; j++) {
+				nonces[i].sum_a8_guess[j].num_states = num_states_coarse[nonces[i].sum_a8_guess[j].sum_a8_idx];
+				nonces[i].expected_num_brute_force += nonces[i].sum_a8_guess[j].prob * (float)nonces[i].sum_a8_guess[j].num_states / 2.0;
+				prob_all_failed -= nonces[i].sum_a8_guess[j].prob;
+				nonces[i].expected_num_brute_force += prob_all_failed * (float)nonces[i].sum_a8_guess[j].num_states / 2.0;
+			}
+			coarse_expected_num_brute_force[i] = nonces[i].expected_num_brute_force;
+			expected_num_brute_force_dirty[i] = false;
+			if (!update_all) {
+				heap_update(i);
+			}
+#if defined (DEBUG_REDUCTION)
+			num_updated++;
+#endif
 		}
 	}
-	
-	// sort based on expected number of states to brute force
-	qsort(best_first_bytes, 256, 1, compare_expected_num_brute_force);
+	if (update_all) {
+		heap_build();
+	}
+#if defined (DEBUG_REDUCTION)
+	printf("sort_best_first_bytes(): updated %d first bytes\n", num_updated);
+#endif
+
+	// the heap is ordered by the expected number of states to brute force. Pop the best first bytes
+	// from a copy of it into best_first_bytes[], the refinement below only looks at these.
+	uint8_t heap[256];
+	memcpy(heap, best_first_bytes_heap, sizeof(heap));
+	uint16_t heap_size = 256;
+	for (uint16_t i = 0; i < NUM_BEST_FIRST_BYTES; i++) {
+		best_first_bytes[i] = heap[0];
+		heap[0] = heap[--heap_size];
+		heap_sift_down(heap, heap_size, 0, false);
+	}
 
 	// printf("refine estimations: ");
 	#define NUM_REFINES	1
@@ -941,6 +1068,7 @@ static float sort_best_first_bytes(void)
 	for (uint16_t i = 0; i < NUM_REFINES; i++) {
 		// printf("%d...", i);
 		uint16_t first_byte = best_first_bytes[i];
+		refined_first_byte = first_byte;
 		for (uint8_t j = 0; j < NUM_SUMS && nonces[first_byte].sum_a8_guess[j].prob > 0.05; j++) {
 			nonces[first_byte].sum_a8_guess[j].num_states = estimated_num_states(first_byte, sums[first_byte_Sum], sums[nonces[first_byte].sum_a8_guess[j].sum_a8_idx]);
 		}
@@ -987,7 +1115,7 @@ static float sort_best_first_bytes(void)
 	// copy best byte to front:
 	float least_expected_brute_force = (1LL << 48);
 	uint8_t best_byte = 0;
-	for (uint16_t i = 0; i < 10; i++) {
+	for (uint16_t i = 0; i < NUM_BEST_FIRST_BYTES; i++) {
 		uint16_t first_byte = best_first_bytes[i];
 		if (nonces[first_byte].expected_num_brute_force < least_expected_brute_force) {
 			least_expected_brute_force = nonces[first_byte].expected_num_brute_force;
@@ -1071,12 +1199,14 @@ static void estimate_sum_a8(void)
 	if (first_byte_num == 256) {
 		for (uint16_t i = 0; i < 256; i++) {
 			if (nonces[i].sum_a8_guess_dirty) {
+				float prob[NUM_SUMS];
+				sum_probabilities(nonces[i].num, nonces[i].Sum, prob);
 				for (uint16_t j = 0; j < NUM_SUMS; j++ ) {
-					uint16_t sum_a8_idx = nonces[i].sum_a8_guess[j].sum_a8_idx;
-					nonces[i].sum_a8_guess[j].prob = sum_probability(sum_a8_idx, nonces[i].num, nonces[i].Sum);
+					nonces[i].sum_a8_guess[j].prob = prob[nonces[i].sum_a8_guess[j].sum_a8_idx];
 				}
 				qsort(nonces[i].sum_a8_guess, NUM_SUMS, sizeof(guess_sum_a8_t), compare_sum_a8_guess);
 				nonces[i].sum_a8_guess_dirty = false;
+				expected_num_brute_force_dirty[i] = true;
 			}
 		}
 	}
@@ -1141,12 +1271,8 @@ static int read_nonce_file(void)
 
 noncelistentry_t *SearchFor2ndByte(uint8_t b1, uint8_t b2)
 {
-	noncelistentry_t *p = nonces[b1].first;
-	while (p != NULL) {
-		if ((p->nonce_enc >> 16 & 0xff) == b2) {
-			return p;
-		}
-		p = p->next;
+	if (nonces[b1].second_byte_present[b2 / 32] & (1u << (b2 % 32))) {
+		return &nonces[b1].entry[b2];
 	}
 	return NULL;
 }
@@ -1182,9 +1308,9 @@ __attribute__((force_align_arg_pointer))
 			}
 			for (uint16_t i = first_byte; i <= last_byte; i++) {
 				if (nonces[i].BitFlips[bitflip] == 0 && nonces[i].BitFlips[bitflip ^ 0x100] == 0
-					&& nonces[i].first != NULL && nonces[i^(bitflip&0xff)].first != NULL) {
-					uint8_t parity1 = (nonces[i].first->par_enc) >> 3;					// parity of first byte
-					uint8_t parity2 = (nonces[i^(bitflip&0xff)].first->par_enc) >> 3; 	// parity of nonce with bits flipped
+					&& nonces[i].num != 0 && nonces[i^(bitflip&0xff)].num != 0) {
+					uint8_t parity1 = (first_nonce(&nonces[i])->par_enc) >> 3;					// parity of first byte
+					uint8_t parity2 = (first_nonce(&nonces[i^(bitflip&0xff)])->par_enc) >> 3; 	// parity of nonce with bits flipped
 					if ((parity1 == parity2 && !(bitflip & 0x100)) 			// bitflip
 						|| (parity1 != parity2 && (bitflip & 0x100))) {		// not bitflip
 						nonces[i].BitFlips[bitflip] = 1;
@@ -1375,6 +1501,7 @@ static void simulate_acquire_nonces()
 		}
 
 		last_sample_clock = msclock();
+		uint64_t reduce_start = last_sample_clock;
 	
 		if (first_byte_num == 256 ) {
 			if (hardnested_stage == CHECK_1ST_BYTES) {
@@ -1402,6 +1529,11 @@ static void simulate_acquire_nonces()
 			acquisition_completed = shrink_key_space(&brute_force);
 			hardnested_print_progress(num_acquired_nonces, "Apply bit flip properties", brute_force, 0);
 		}
+		if (bench_num_nonces > 0) {
+			// nonce count sweep. Sum(a0) is needed for the attack, i.e. all first bytes must have been seen
+			acquisition_completed = (hardnested_stage & CHECK_2ND_BYTES) && num_acquired_nonces >= bench_num_nonces;
+		}
+		bench_time[BENCH_REDUCE] += msclock() - reduce_start;
 	} while (!acquisition_completed);
 
 	time_t end_time = time(NULL);
@@ -2136,14 +2268,12 @@ static void pre_XOR_nonces(void)
 	
 	// XOR the cryptoUID and its parity
 	for (uint16_t i = 0; i < 256; i++) {
-		noncelistentry_t *test_nonce = nonces[i].first;
-		while (test_nonce != NULL) {
+		for (noncelistentry_t *test_nonce = first_nonce(&nonces[i]); test_nonce != NULL; test_nonce = next_nonce(&nonces[i], test_nonce)) {
 			test_nonce->nonce_enc ^= cuid;
 			test_nonce->par_enc ^= oddparity8(cuid >>  0 & 0xff) << 0;
 			test_nonce->par_enc ^= oddparity8(cuid >>  8 & 0xff) << 1;
 			test_nonce->par_enc ^= oddparity8(cuid >> 16 & 0xff) << 2;
 			test_nonce->par_enc ^= oddparity8(cuid >> 24 & 0xff) << 3;
-			test_nonce = test_nonce->next;
 		}
 	}
 }
@@ -2503,7 +2633,36 @@ static void set_test_state(uint8_t byte)
 }
 
 
-int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, int tests) 
+static void write_bench_header(void)
+{
+	fseek(fbench, 0, SEEK_END);
+	if (ftell(fbench) == 0) {
+		fprintf(fbench, "seed;test;simd;threads;bf_keys_per_s;key;cuid;nonce_limit;nonces;keys_tested;key_found");
+		for (bench_stage_t stage = 0; stage < NUM_BENCH_STAGES; stage++) {
+			fprintf(fbench, ";%s", bench_stage_names[stage]);
+		}
+		fprintf(fbench, "\n");
+	}
+}
+
+
+static void write_bench_result(uint32_t seed, uint32_t test, bool key_found)
+{
+	char instr_set[12] = {0};
+	get_SIMD_instruction_set(instr_set);
+	fprintf(fbench, "%" PRIu32 ";%" PRIu32 ";%s;%d;%1.0f;%012" PRIx64 ";%08" PRIx32 ";%" PRIu32 ";%" PRIu32 ";%" PRIu64 ";%d", 
+		seed, test, instr_set, num_CPUs(), bench_brute_force_per_second, known_target_key, cuid, bench_num_nonces, num_acquired_nonces, num_keys_tested, key_found);
+	PrintAndLog("Benchmark seed %" PRIu32 ", test #%" PRIu32 ":", seed, test);
+	for (bench_stage_t stage = 0; stage < NUM_BENCH_STAGES; stage++) {
+		fprintf(fbench, ";%" PRIu64, bench_time[stage]);
+		PrintAndLog("    %-14s %8" PRIu64, bench_stage_names[stage], bench_time[stage]);
+	}
+	fprintf(fbench, "\n");
+	fflush(fbench);
+}
+
+
+int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, int tests, bool benchmark, uint32_t seed, uint32_t nonces_from, uint32_t nonces_to, uint32_t nonces_step) 
 {
 	char progress_text[80];
 	
@@ -2523,12 +2682,38 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
 			PrintAndLog("Could not create/open file hardnested_stats.txt");
 			return 3;
 		}
-		for (uint32_t i = 0; i < tests; i++) {
+		if (benchmark) {
+			if ((fbench = fopen("hardnested_bench.txt","a")) == NULL) { 
+				PrintAndLog("Could not create/open file hardnested_bench.txt");
+				fclose(fstats);
+				return 3;
+			}
+			write_bench_header();
+			bench_brute_force_per_second = brute_force_per_second;
+			brute_force_per_second = BENCH_NOMINAL_BRUTE_FORCE_PER_SECOND;
+		}
+		// with a nonce count sweep all tests are run for each nonce count
+		uint32_t num_sweeps = 1;
+		if (benchmark && nonces_from > 0) {
+			num_sweeps = (nonces_to - nonces_from) / nonces_step + 1;
+		}
+		for (uint32_t run = 0; run < tests * num_sweeps; run++) {
+			uint32_t i = run % tests;
+			if (benchmark) {
+				// each test is reproducible on its own, independent of the number of tests run before
+				srand(seed + i);
+				bench_num_nonces = nonces_from > 0 ? nonces_from + run / tests * nonces_step : 0;
+			}
+			memset(bench_time, 0, sizeof(bench_time));
 			start_time = msclock();
 			print_progress_header();
 			sprintf(progress_text, "Brute force benchmark: %1.0f million (2^%1.1f) keys/s", brute_force_per_second/1000000, log(brute_force_per_second)/log(2.0));
 			hardnested_print_progress(0, progress_text, (float)(1LL<<47), 0);
-			sprintf(progress_text, "Starting Test #%" PRIu32 " ...", i+1);
+			if (bench_num_nonces > 0) {
+				sprintf(progress_text, "Starting Test #%" PRIu32 " with %" PRIu32 " nonces ...", i+1, bench_num_nonces);
+			} else {
+				sprintf(progress_text, "Starting Test #%" PRIu32 " ...", i+1);
+			}
 			hardnested_print_progress(0, progress_text, (float)(1LL<<47), 0);
 			if (trgkey != NULL) {
 				known_target_key = bytes_to_num(trgkey, 6);
@@ -2536,14 +2721,19 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
 				known_target_key = -1;
 			}
 
+			uint64_t stage_start = msclock();
 			init_bitflip_bitarrays();
 			init_part_sum_bitarrays();
 			init_sum_bitarrays();
 			init_allbitflips_array();
 			init_nonce_memory();
+			init_best_first_bytes_heap();
 			update_reduction_rate(0.0, true);
+			bench_time[BENCH_TABLES] = msclock() - stage_start;
 			
+			stage_start = msclock();
 			simulate_acquire_nonces();
+			bench_time[BENCH_ACQUIRE] = msclock() - stage_start - bench_time[BENCH_REDUCE];
 
 			set_test_state(best_first_bytes[0]);
 
@@ -2567,6 +2757,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
 			if (expected_brute_force1 < expected_brute_force2) {
 				hardnested_print_progress(num_acquired_nonces, "(Ignoring Sum(a8) properties)", expected_brute_force1, 0);
 				set_test_state(best_first_byte_smallest_bitarray);
+				stage_start = msclock();
 				add_bitflip_candidates(best_first_byte_smallest_bitarray);
 				Tests2();
 				maximum_states = 0;
@@ -2578,15 +2769,20 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
 				best_first_bytes[0] = best_first_byte_smallest_bitarray;
 				pre_XOR_nonces();
 				prepare_bf_test_nonces(nonces, best_first_bytes[0]);
+				bench_time[BENCH_CANDIDATES] += msclock() - stage_start;
 				hardnested_print_progress(num_acquired_nonces, "Starting brute force...", expected_brute_force1, 0);
+				stage_start = msclock();
 				key_found = brute_force();
+				bench_time[BENCH_BRUTE_FORCE] += msclock() - stage_start;
 				free(candidates->states[ODD_STATE]);
 				free(candidates->states[EVEN_STATE]);
 				free_candidates_memory(candidates);
 				candidates = NULL;
 			} else {
+				stage_start = msclock();
 				pre_XOR_nonces();
 				prepare_bf_test_nonces(nonces, best_first_bytes[0]);
+				bench_time[BENCH_CANDIDATES] += msclock() - stage_start;
 				for (uint8_t j = 0; j < NUM_SUMS && !key_found; j++) {
 					float expected_brute_force = nonces[best_first_bytes[0]].expected_num_brute_force;
 					sprintf(progress_text, "(%d. guess: Sum(a8) = %" PRIu16 ")", j+1, sums[nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx]);
@@ -2596,10 +2792,14 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
 						hardnested_print_progress(num_acquired_nonces, progress_text, expected_brute_force, 0);
 					}
 					// printf("Estimated remaining states: %" PRIu64 " (2^%1.1f)\n", nonces[best_first_bytes[0]].sum_a8_guess[j].num_states, log(nonces[best_first_bytes[0]].sum_a8_guess[j].num_states)/log(2.0));
+					stage_start = msclock();
 					generate_candidates(first_byte_Sum, nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx);
+					bench_time[BENCH_CANDIDATES] += msclock() - stage_start;
 					// printf("Time for generating key candidates list: %1.0f sec (%1.1f sec CPU)\n", difftime(time(NULL), start_time), (float)(msclock() - start_clock)/1000.0);
 					hardnested_print_progress(num_acquired_nonces, "Starting brute force...", expected_brute_force, 0);
+					stage_start = msclock();
 					key_found = brute_force();
+					bench_time[BENCH_BRUTE_FORCE] += msclock() - stage_start;
 					free_statelist_cache();
 					free_candidates_memory(candidates);
 					candidates = NULL;
@@ -2617,6 +2817,9 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
 			#else
 			fprintf(fstats, "%1.0f;%d\n", log(num_keys_tested)/log(2.0), (float)num_keys_tested/brute_force_per_second, key_found);
 			#endif
+			if (benchmark) {
+				write_bench_result(seed, i, key_found);
+			}
 			
 			free_nonces_memory();
 			free_bitarray(all_bitflips_bitarray[ODD_STATE]);
@@ -2625,6 +2828,11 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
 			free_part_sum_bitarrays();
 		}
 		fclose(fstats);
+		if (benchmark) {
+			fclose(fbench);
+			fbench = NULL;
+			bench_num_nonces = 0;
+		}
 	} else {
 		start_time = msclock();
 		print_progress_header();
@@ -2635,6 +2843,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
 		init_sum_bitarrays();
 		init_allbitflips_array();
 		init_nonce_memory();
+		init_best_first_bytes_heap();
 		update_reduction_rate(0.0, true);
 
 		if (nonce_file_read) {  	// use pre-acquired data from file nonces.bin
@@ -13,6 +13,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #define NUM_SUMS 						19		// number of possible sum property values
 
@@ -25,7 +26,6 @@ typedef struct guess_sum_a8 {
 typedef struct noncelistentry {
 	uint32_t nonce_enc;
 	uint8_t par_enc;
-	void *next;
 } noncelistentry_t;
 
 typedef struct noncelist {
@@ -38,10 +38,30 @@ typedef struct noncelist {
 	uint32_t *states_bitarray[2];
 	uint32_t num_states_bitarray[2];
 	bool all_bitflips_dirty[2];
-	noncelistentry_t *first;
+	uint32_t second_byte_present[8];	// bitmap of the 2nd bytes acquired for this 1st byte
+	noncelistentry_t *entry;			// 256 slots in the nonce arena, indexed by 2nd byte
 } noncelist_t;
 
-int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, int tests);
+// return the acquired nonce with the smallest 2nd byte >= second_byte, or NULL if there is none
+static inline noncelistentry_t *nonce_from(noncelist_t *list, uint16_t second_byte)
+{
+	for (uint16_t word = second_byte / 32; word < 8; word++) {
+		uint32_t bits = list->second_byte_present[word];
+		if (word == second_byte / 32) {
+			bits &= 0xffffffff << (second_byte % 32);
+		}
+		if (bits) {
+			return &list->entry[word * 32 + __builtin_ctz(bits)];
+		}
+	}
+	return NULL;
+}
+
+// iterate over a first byte's nonces in ascending order of their 2nd byte
+#define first_nonce(list)			nonce_from((list), 0)
+#define next_nonce(list, p)			nonce_from((list), (p) - (list)->entry + 1)
+
+int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, int tests, bool benchmark, uint32_t seed, uint32_t nonces_from, uint32_t nonces_to, uint32_t nonces_step);
 void hardnested_print_progress(uint32_t nonces, char *activity, float brute_force, uint64_t min_diff_print_time);
 
 #endif
@@ -19,6 +19,7 @@
 #include "cmdmain.h"
 #include "cmddata.h"
 #include "data.h"
+#include "session.h"
 
 /* low-level hardware control */
 
@@ -409,6 +410,13 @@ int CmdVersion(const char *Cmd)
 	clearCommandBuffer();
 	UsbCommand c = {CMD_VERSION};
 	static UsbCommand resp = {0, {0, 0, 0}};
+	static int resp_session = -1;
+
+	// the cached information is the one of the current device
+	if (resp_session != session_current()) {
+		memset(&resp, 0, sizeof(resp));
+		resp_session = session_current();
+	}
 
 	if (resp.arg[0] == 0 && resp.arg[1] == 0) { // no cached information available
 		SendCommand(&c);
@@ -430,7 +438,7 @@ int CmdVersion(const char *Cmd)
 int CmdStatus(const char *Cmd)
 {
 	uint8_t speed_test_buffer[USB_CMD_DATA_SIZE];
-	sample_buf = speed_test_buffer;
+	session_set_download(session_current(), speed_test_buffer, sizeof(speed_test_buffer));
 
 	clearCommandBuffer();
 	UsbCommand c = {CMD_STATUS};
@@ -438,6 +446,7 @@ int CmdStatus(const char *Cmd)
 	if (!WaitForResponseTimeout(CMD_ACK,&c,1900)) {
 		PrintAndLog("Status command failed. USB Speed Test timed out");
 	}
+	session_set_download(session_current(), NULL, 0);
 	return 0;
 }
 
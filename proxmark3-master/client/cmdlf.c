@@ -17,6 +17,8 @@
 #include "proxmark3.h"
 #include "cmdlf.h"
 #include "lfdemod.h"     // for psk2TOpsk1
+#include "lfsimpack.h"   // for the sim sample upload
+#include "util_posix.h"  // for msclock
 #include "util.h"        // for parsing cli command utils
 #include "ui.h"          // for show graph controls
 #include "graph.h"       // for graph data
@@ -131,6 +133,7 @@ int CmdFlexdemod(const char *Cmd)
 			GraphBuffer[i] = 1;
 		}
 	}
+	GraphBufferChanged();
 
  #define LONG_WAIT 100
 	int start;
@@ -152,6 +155,7 @@ int CmdFlexdemod(const char *Cmd)
 
 	GraphBuffer[start] = 2;
 	GraphBuffer[start+1] = -2;
+	GraphBufferChanged();
 	uint8_t bits[64] = {0x00};
 
 	int bit, sum;
@@ -195,6 +199,7 @@ int CmdFlexdemod(const char *Cmd)
 			phase = !phase;
 		}
 	}
+	GraphBufferChanged();
 
 	RepaintGraphWindow();
 	return 0;
@@ -393,6 +398,118 @@ static void ChkBitstream(const char *str)
 		}
 	}
 }
+// frames sent before waiting for an ACK
+#define SIM_UPLOAD_WINDOW	8
+
+// Encode the next frame of samples, packed or run length encoded, whichever takes more samples
+static size_t lf_sim_encode_frame(const uint8_t *samples, size_t count, uint8_t *dest, uint8_t *encoding, size_t *consumed)
+{
+	uint8_t rle[USB_CMD_DATA_SIZE];
+	size_t packed_n, rle_n;
+
+	size_t packed_len = lfsim_encode(LFSIM_ENC_PACKED, samples, count, dest, USB_CMD_DATA_SIZE, &packed_n);
+	size_t rle_len = lfsim_encode(LFSIM_ENC_RLE, samples, count, rle, sizeof(rle), &rle_n);
+	if (rle_n > packed_n || (rle_n == packed_n && rle_len < packed_len)) {
+		memcpy(dest, rle, rle_len);
+		*encoding = LFSIM_ENC_RLE;
+		*consumed = rle_n;
+		return rle_len;
+	}
+	*encoding = LFSIM_ENC_PACKED;
+	*consumed = packed_n;
+	return packed_len;
+}
+
+// Upload the samples encoded, waiting for an ACK every SIM_UPLOAD_WINDOW frames only.
+// Returns 0 if done, 1 for firmware without the encoded upload, 2 on errors.
+static int lf_sim_upload_encoded(const uint8_t *samples, size_t count, int *frames)
+{
+	UsbCommand resp;
+	size_t offset = 0;
+
+	*frames = 0;
+	clearCommandBuffer();
+	while (offset < count) {
+		UsbCommand c = {CMD_DOWNLOADED_SIM_SAMPLES_125K, {offset, 0, 0}};
+		uint8_t encoding;
+		size_t n;
+		size_t len = lf_sim_encode_frame(samples + offset, count - offset, c.d.asBytes, &encoding, &n);
+		offset += n;
+		(*frames)++;
+
+		// the first ACK tells if the firmware knows the encoding
+		bool sync = *frames == 1 || *frames % SIM_UPLOAD_WINDOW == 0 || offset == count;
+		c.arg[2] = encoding | SIM_SAMPLES_ENCODED | (sync ? SIM_SAMPLES_SYNC : 0) | len << 16;
+		SendCommand(&c);
+		if (!sync)
+			continue;
+
+		if (!WaitForResponseTimeout(CMD_ACK, &resp, 2500)) {
+			PrintAndLog("Command execute timeout");
+			return 2;
+		}
+		if (!(resp.arg[0] & SIM_SAMPLES_ENCODED))
+			return 1;
+		if (!resp.arg[1] || resp.arg[2] < offset) {
+			PrintAndLog("Upload error, the samples don't fit into the device memory");
+			return 2;
+		}
+		printf(".");
+		fflush(stdout);
+	}
+
+	return 0;
+}
+
+// Encode and decode a few typical sample streams in frames, as the upload does
+static int lf_sim_selftest(void)
+{
+	static uint8_t samples[40000], decoded[40000 + 8];
+	const char *names[] = {"Manchester rf/64", "FSK2 fc/8 fc/10 rf/50", "random samples"};
+	uint32_t x = 0x12345678;
+
+	for (int t = 0; t < 3; t++) {
+		size_t count = sizeof(samples);
+		for (size_t i = 0; i < count; ) {
+			x = x * 1103515245 + 12345;
+			uint8_t bit = (x >> 16) & 1;
+			if (t == 0) {
+				for (int j = 0; j < 64 && i < count; j++, i++)
+					samples[i] = bit ^ (j >= 32);
+			} else if (t == 1) {
+				int fc = bit ? 10 : 8;
+				for (int j = 0; j < 50 && i < count; j++, i++)
+					samples[i] = (j % fc) < fc / 2;
+			} else {
+				samples[i++] = bit;
+			}
+		}
+
+		int frames = 0;
+		size_t offset = 0, bytes = 0;
+		uint64_t t0 = msclock();
+		while (offset < count) {
+			uint8_t frame[USB_CMD_DATA_SIZE];
+			uint8_t encoding;
+			size_t n;
+			size_t len = lf_sim_encode_frame(samples + offset, count - offset, frame, &encoding, &n);
+			int m = lfsim_decode(encoding, frame, len, decoded + offset, sizeof(decoded) - offset);
+			if (m < (int)n || memcmp(samples + offset, decoded + offset, n)) {
+				PrintAndLog("LF sim encoding test: %s differ at sample %u", names[t], (unsigned int)offset);
+				return 1;
+			}
+			offset += n;
+			bytes += len;
+			frames++;
+		}
+		PrintAndLog("%-22s: %u bytes in %d frames instead of %d, %u ms", names[t], (unsigned int)bytes, frames,
+			(int)((count + USB_CMD_DATA_SIZE - 1) / USB_CMD_DATA_SIZE), (unsigned int)(msclock() - t0));
+	}
+
+	PrintAndLog("LF sim encoding test: passed");
+	return 0;
+}
+
 //Attempt to simulate any wave in buffer (one bit per output sample)
 // converts GraphBuffer to bitstream (based on zero crossings) if needed.
 int CmdLFSim(const char *Cmd)
@@ -400,25 +517,53 @@ int CmdLFSim(const char *Cmd)
 	int i,j;
 	static int gap;
 
+	if (param_getchar(Cmd, 0) == 't')
+		return lf_sim_selftest();
+	if (offline) {
+		PrintAndLog("Simulation needs a device, 'lf sim t' tests the upload offline");
+		return 0;
+	}
+
 	sscanf(Cmd, "%i", &gap);
 
 	// convert to bitstream if necessary
 	ChkBitstream(Cmd);
 
-	//can send only 512 bits at a time (1 byte sent per bit...)
-	printf("Sending [%d bytes]", GraphTraceLen);
-	for (i = 0; i < GraphTraceLen; i += USB_CMD_DATA_SIZE) {
-		UsbCommand c = {CMD_DOWNLOADED_SIM_SAMPLES_125K, {i, 0, 0}};
+	uint8_t *samples = malloc(GraphTraceLen + 1);
+	if (samples == NULL) {
+		PrintAndLog("Cannot allocate memory");
+		return 1;
+	}
+	for (i = 0; i < GraphTraceLen; i++)
+		samples[i] = GraphBuffer[i];
+
+	// packed or run length encoded, streamed
+	int frames;
+	uint64_t start_time = msclock();
+	printf("Sending [%d samples]", GraphTraceLen);
+	int res = lf_sim_upload_encoded(samples, GraphTraceLen, &frames);
+	free(samples);
+	if (res == 2) {
+		printf("\n");
+		return 1;
+	}
+
+	if (res == 1) {
+		//older firmware, can send only 512 bits at a time (1 byte sent per bit...)
+		for (i = 0, frames = 0; i < GraphTraceLen; i += USB_CMD_DATA_SIZE, frames++) {
+			UsbCommand c = {CMD_DOWNLOADED_SIM_SAMPLES_125K, {i, 0, 0}};
 
-		for (j = 0; j < USB_CMD_DATA_SIZE; j++) {
-			c.d.asBytes[j] = GraphBuffer[i+j];
+			for (j = 0; j < USB_CMD_DATA_SIZE; j++) {
+				c.d.asBytes[j] = GraphBuffer[i+j];
+			}
+			SendCommand(&c);
+			WaitForResponse(CMD_ACK,NULL);
+			printf(".");
 		}
-		SendCommand(&c);
-		WaitForResponse(CMD_ACK,NULL);
-		printf(".");
 	}
 
 	printf("\n");
+	PrintAndLog("Sent in %d frames, %u ms", frames, (unsigned int)(msclock() - start_time));
 	PrintAndLog("Starting to simulate");
 	UsbCommand c = {CMD_SIMULATE_TAG_125K, {GraphTraceLen, gap, 0}};
 	clearCommandBuffer();
@@ -860,6 +1005,7 @@ int CmdVchDemod(const char *Cmd)
 				GraphBuffer[GraphTraceLen++] = (*s == '1') ? 1 : 0;
 			}
 		}
+		GraphBufferChanged();
 		RepaintGraphWindow();
 	}
 	return 0;
@@ -1119,7 +1265,7 @@ static command_t CommandTable[] =
 	{"flexdemod",   CmdFlexdemod,       1, "Demodulate samples for FlexPass"},
 	{"read",        CmdLFRead,          0, "['s' silent] Read 125/134 kHz LF ID-only tag. Do 'lf read h' for help"},
 	{"search",      CmdLFfind,          1, "[offline] ['u'] Read and Search for valid known tag (in offline mode it you can load first then search) - 'u' to search for unknown tags"},
-	{"sim",         CmdLFSim,           0, "[GAP] -- Simulate LF tag from buffer with optional GAP (in microseconds)"},
+	{"sim",         CmdLFSim,           1, "[GAP] -- Simulate LF tag from buffer with optional GAP (in microseconds), 't' tests the upload"},
 	{"simask",      CmdLFaskSim,        0, "[clock] [invert <1|0>] [biphase/manchester/raw <'b'|'m'|'r'>] [msg separator 's'] [d <hexdata>] -- Simulate LF ASK tag from demodbuffer or input"},
 	{"simfsk",      CmdLFfskSim,        0, "[c <clock>] [i] [H <fcHigh>] [L <fcLow>] [d <hexdata>] -- Simulate LF FSK tag from demodbuffer or input"},
 	{"simpsk",      CmdLFpskSim,        0, "[1|2|3] [c <clock>] [i] [r <carrier>] [d <raw hex to sim>] -- Simulate LF PSK tag from demodbuffer or input"},
@@ -612,12 +612,9 @@ int EM4x50Read(const char *Cmd, bool verbose)
 	sscanf(Cmd, "%i %i", &clk, &invert);
 
 	// first get high and low values
-	for (i = 0; i < GraphTraceLen; i++) {
-		if (GraphBuffer[i] > high)
-			high = GraphBuffer[i];
-		else if (GraphBuffer[i] < low)
-			low = GraphBuffer[i];
-	}
+	GetGraphHighLow(&high, &low);
+	if (high < 0) high = 0;
+	if (low > 0) low = 0;
 
 	i = 0;
 	j = 0;
@@ -11,6 +11,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include "data.h"
 #include "proxmark3.h"
 #include "ui.h"
@@ -21,6 +24,8 @@
 #include "hitag2.h"
 #include "hitagS.h"
 #include "cmdmain.h"
+#include "util_posix.h"
+#include "hitag2_crypto.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -384,6 +389,273 @@ int CmdLFHitagWP(const char *Cmd) {
   return 0;
 }
 
+// Offline Hitag2 key recovery from sniffed authentications. The reader sends the encrypted nonce {nR}
+// and the authenticator aR, which is the inverted first 32 keystream bits. All keys in a range are
+// tried 64 at a time with the bitsliced cipher, distributed over all CPUs.
+
+#define HITAG2_CRACK_MAX_PAIRS		8
+#define HITAG2_CRACK_CHUNK_SIZE		(1 << 20)		// keys per work unit
+#define HITAG2_CRACK_MAX_CANDIDATES	32				// stop printing candidates when there is only one nR/aR pair
+
+typedef struct {
+	uint32_t uid;
+	uint32_t IV[HITAG2_CRACK_MAX_PAIRS];			// first transmitted bit in bit 0, like the cipher expects it
+	uint32_t keystream[HITAG2_CRACK_MAX_PAIRS];
+	int num_pairs;
+	uint64_t first_key;
+	uint64_t last_key;
+	uint64_t next_chunk;
+	uint64_t keys_tested;
+	uint32_t num_candidates;
+	bool found;						// found, found_key and num_candidates are written with the mutex held,
+	bool stop;						// found, stop and keys_tested are read with __atomic_load_n()
+	uint64_t found_key;
+} hitag2_crack_t;
+
+static pthread_mutex_t hitag2_crack_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// keys are given in transmission order (first bit is the msb of the first byte), the cipher wants the first bit in bit 0
+static uint64_t hitag2_crack_key_to_cipher(uint64_t key)
+{
+	return ((uint64_t)SwapBits(key & 0xffffff, 24) << 24) | SwapBits(key >> 24, 24);
+}
+
+static bool hitag2_crack_verify(hitag2_crack_t *crack, uint64_t key, int num_pairs)
+{
+	uint64_t cipher_key = hitag2_crack_key_to_cipher(key);
+	for (int i = 0; i < num_pairs; i++) {
+		uint64_t state = _hitag2_init(cipher_key, crack->uid, crack->IV[i]);
+		for (int j = 0; j < 32; j++) {
+			if (_hitag2_round(&state) != ((crack->keystream[i] >> j) & 1)) return false;
+		}
+	}
+	return true;
+}
+
+// the 6 lsbs of the key enter the cipher last (as cipher key bits 42..47) and are enumerated by the 64 bitslices
+static void hitag2_crack_init_slices(ht2_bitslice_t key_slices[48])
+{
+	for (int i = 0; i < 6; i++) {
+		uint64_t slice = 0;
+		for (int j = 0; j < 64; j++) {
+			slice |= (uint64_t)((j >> i) & 1) << j;
+		}
+		key_slices[47-i] = slice;
+	}
+}
+
+// the other 42 key bits are the same for the 64 keys from base on
+static void hitag2_crack_set_slices(ht2_bitslice_t key_slices[48], uint64_t base)
+{
+	uint64_t cipher_key = hitag2_crack_key_to_cipher(base);
+	for (int i = 0; i < 42; i++) {
+		key_slices[i] = -((cipher_key >> i) & 1);
+	}
+}
+
+static bool hitag2_crack_done(hitag2_crack_t *crack)
+{
+	return __atomic_load_n(&crack->found, __ATOMIC_RELAXED) || __atomic_load_n(&crack->stop, __ATOMIC_RELAXED);
+}
+
+static void *hitag2_crack_thread(void *arg)
+{
+	hitag2_crack_t *crack = (hitag2_crack_t *)arg;
+	ht2_bitslice_t key_slices[48];
+
+	hitag2_crack_init_slices(key_slices);
+
+	while (!hitag2_crack_done(crack)) {
+		uint64_t chunk_start = __sync_fetch_and_add(&crack->next_chunk, HITAG2_CRACK_CHUNK_SIZE);
+		if (chunk_start > crack->last_key) break;
+		uint64_t chunk_end = chunk_start + HITAG2_CRACK_CHUNK_SIZE - 1;
+		if (chunk_end > crack->last_key) chunk_end = crack->last_key;
+
+		for (uint64_t base = chunk_start & ~0x3fULL; base <= chunk_end && !__atomic_load_n(&crack->found, __ATOMIC_RELAXED); base += 64) {
+			hitag2_crack_set_slices(key_slices, base);
+			uint64_t matches = hitag2_bs_match(key_slices, crack->uid, crack->IV[0], crack->keystream[0]);
+			while (matches) {
+				int j = __builtin_ctzll(matches);
+				matches &= matches - 1;
+				uint64_t key = base + j;
+				if (key < chunk_start || key > chunk_end) continue;
+				if (!hitag2_crack_verify(crack, key, crack->num_pairs)) continue;
+				pthread_mutex_lock(&hitag2_crack_mutex);
+				if (crack->num_pairs > 1) {
+					if (!crack->found) {
+						crack->found_key = key;
+						__atomic_store_n(&crack->found, true, __ATOMIC_RELEASE);
+					}
+				} else if (crack->num_candidates++ < HITAG2_CRACK_MAX_CANDIDATES) {
+					PrintAndLog("Candidate key: %012" PRIx64, key);
+				}
+				pthread_mutex_unlock(&hitag2_crack_mutex);
+			}
+		}
+		__sync_fetch_and_add(&crack->keys_tested, chunk_end - chunk_start + 1);
+	}
+
+	return NULL;
+}
+
+// Compute reader authentications the way armsrc/hitag2.c does (key byte order of the crypto reader,
+// UID and nR byte order of hitag2_cipher_reset(), aR from _hitag2_byte() like hitag2_cipher_authenticate())
+// and make sure that the bitsliced cipher agrees with the scalar one for all 64 keys around the right
+// one, and that the key search accepts it.
+#define HITAG2_CRACK_TESTS	1000
+
+static int hitag2_crack_test(void)
+{
+	ht2_bitslice_t key_slices[48], keystream[32];
+	hitag2_crack_t crack;
+
+	memset(&crack, 0, sizeof(crack));
+	crack.num_pairs = 1;
+	hitag2_crack_init_slices(key_slices);
+
+	for (int test = 0; test < HITAG2_CRACK_TESTS; test++) {
+		// key, UID and nR in transmission order
+		uint8_t k[6], u[4], n[4], a[4];
+		for (int i = 0; i < 6; i++) k[i] = rand();
+		for (int i = 0; i < 4; i++) u[i] = rand();
+		for (int i = 0; i < 4; i++) n[i] = rand();
+
+		uint64_t fw_key = (uint64_t)k[0] | (uint64_t)k[1] << 8 | (uint64_t)k[2] << 16
+			| (uint64_t)k[3] << 24 | (uint64_t)k[4] << 32 | (uint64_t)k[5] << 40;
+		uint32_t fw_uid = (uint32_t)u[0] | (uint32_t)u[1] << 8 | (uint32_t)u[2] << 16 | (uint32_t)u[3] << 24;
+		uint32_t fw_iv = (uint32_t)n[0] | (uint32_t)n[1] << 8 | (uint32_t)n[2] << 16 | (uint32_t)n[3] << 24;
+		uint64_t cs = _hitag2_init(rev64(fw_key), rev32(fw_uid), rev32(fw_iv));
+		for (int i = 0; i < 4; i++) a[i] = ~_hitag2_byte(&cs);
+
+		// the same as 'lf hitag crack <uid> <nR aR>' parses them
+		uint64_t key = bytes_to_num(k, 6);
+		crack.uid = SwapBits(bytes_to_num(u, 4), 32);
+		crack.IV[0] = SwapBits(bytes_to_num(n, 4), 32);
+		crack.keystream[0] = ~SwapBits(bytes_to_num(a, 4), 32);
+
+		uint64_t base = key & ~0x3fULL;
+		hitag2_crack_set_slices(key_slices, base);
+		hitag2_bs_keystream(keystream, 32, key_slices, crack.uid, crack.IV[0]);
+		uint64_t expected_matches = 0;
+		for (int j = 0; j < 64; j++) {
+			uint64_t state = _hitag2_init(hitag2_crack_key_to_cipher(base + j), crack.uid, crack.IV[0]);
+			bool match = true;
+			for (int i = 0; i < 32; i++) {
+				uint32_t bit = _hitag2_round(&state);
+				if (((keystream[i] >> j) & 1) != bit) {
+					PrintAndLog("Hitag2 crack test: bitsliced keystream differs for key %012" PRIx64, base + j);
+					return 1;
+				}
+				if (bit != ((crack.keystream[0] >> i) & 1)) match = false;
+			}
+			if (match) expected_matches |= 1ULL << j;
+		}
+		if (!(expected_matches & (1ULL << (key & 0x3f)))
+			|| hitag2_bs_match(key_slices, crack.uid, crack.IV[0], crack.keystream[0]) != expected_matches
+			|| !hitag2_crack_verify(&crack, key, 1)) {
+			PrintAndLog("Hitag2 crack test: key %012" PRIx64 " not found", key);
+			return 1;
+		}
+	}
+
+	PrintAndLog("Hitag2 crack test: passed");
+	return 0;
+}
+
+static int usage_hitag_crack(void)
+{
+	PrintAndLog("Recover a Hitag2 key from sniffed authentications by trying all keys in a range.");
+	PrintAndLog("Usage:  lf hitag crack <uid> <nR aR> [<nR aR> ...] [r <first key> <last key>]");
+	PrintAndLog("        lf hitag crack t");
+	PrintAndLog("     <uid>           : tag UID, 4 hex bytes");
+	PrintAndLog("     <nR aR>         : encrypted reader nonce and reader answer as sent by the reader, 8 hex bytes");
+	PrintAndLog("                       (up to %d pairs, with only one pair there will be many false positives)", HITAG2_CRACK_MAX_PAIRS);
+	PrintAndLog("     r               : only try keys from <first key> to <last key>, 6 hex bytes each");
+	PrintAndLog("     t               : check the bitsliced cipher against the one of the firmware");
+	PrintAndLog("");
+	PrintAndLog("Samples:");
+	PrintAndLog("     lf hitag crack 0123a5f1 4a3ba2418f106dac 91dc1e3ae5c96b31 r 4d494b000000 4d494bffffff");
+	return 0;
+}
+
+int CmdLFHitagCrack(const char *Cmd)
+{
+	hitag2_crack_t crack;
+	memset(&crack, 0, sizeof(crack));
+	crack.last_key = 0xffffffffffffULL;
+
+	if (tolower(param_getchar(Cmd, 0)) == 't' && param_getlength(Cmd, 0) == 1) return hitag2_crack_test();
+	if (param_getchar(Cmd, 0) == 'h' || param_getchar(Cmd, 0) == 0x00 || param_getlength(Cmd, 0) != 8) return usage_hitag_crack();
+	crack.uid = SwapBits(param_get32ex(Cmd, 0, 0, 16), 32);
+
+	int cmdp = 1;
+	while (param_getchar(Cmd, cmdp) != 0x00) {
+		if (tolower(param_getchar(Cmd, cmdp)) == 'r' && param_getlength(Cmd, cmdp) == 1) {
+			if (param_getlength(Cmd, cmdp+1) != 12 || param_getlength(Cmd, cmdp+2) != 12) return usage_hitag_crack();
+			crack.first_key = param_get64ex(Cmd, cmdp+1, 0, 16);
+			crack.last_key = param_get64ex(Cmd, cmdp+2, 0, 16);
+			cmdp += 3;
+		} else {
+			if (param_getlength(Cmd, cmdp) != 16 || crack.num_pairs == HITAG2_CRACK_MAX_PAIRS) return usage_hitag_crack();
+			uint64_t NrAr = param_get64ex(Cmd, cmdp, 0, 16);
+			crack.IV[crack.num_pairs] = SwapBits(NrAr >> 32, 32);
+			crack.keystream[crack.num_pairs] = ~SwapBits(NrAr & 0xffffffff, 32);
+			crack.num_pairs++;
+			cmdp++;
+		}
+	}
+	if (crack.num_pairs == 0 || crack.first_key > crack.last_key) return usage_hitag_crack();
+
+	int num_threads = num_CPUs();
+	uint64_t num_keys = crack.last_key - crack.first_key + 1;
+	crack.next_chunk = crack.first_key;
+	PrintAndLog("Trying %" PRIu64 " keys (%012" PRIx64 "..%012" PRIx64 ") with %d nR/aR pair%s on %d thread%s. Press a key to abort.",
+		num_keys, crack.first_key, crack.last_key, crack.num_pairs, crack.num_pairs == 1 ? "" : "s", num_threads, num_threads == 1 ? "" : "s");
+
+	pthread_t thread_id[num_threads];
+	for (int i = 0; i < num_threads; i++) {
+		pthread_create(&thread_id[i], NULL, hitag2_crack_thread, &crack);
+	}
+
+	uint64_t start_time = msclock();
+	uint64_t last_print_time = start_time;
+	while (!__atomic_load_n(&crack.found, __ATOMIC_RELAXED) && __atomic_load_n(&crack.keys_tested, __ATOMIC_RELAXED) < num_keys) {
+		msleep(100);
+		if (ukbhit() > 0) {			// ukbhit() is -1 if stdin is not a terminal, e.g. when running a script
+			getchar();
+			__atomic_store_n(&crack.stop, true, __ATOMIC_RELAXED);
+			printf("\nAborted via keyboard!\n");
+			break;
+		}
+		if (msclock() - last_print_time >= 10000) {
+			last_print_time = msclock();
+			uint64_t keys_tested = __atomic_load_n(&crack.keys_tested, __ATOMIC_RELAXED);
+			float elapsed = (last_print_time - start_time) / 1000.0;
+			float keys_per_second = keys_tested / elapsed;
+			PrintAndLog("%5.1f%% tested, %.1f Mkeys/s, ETA %.0f s", 100.0 * keys_tested / num_keys, keys_per_second / 1e6,
+				keys_per_second > 0 ? (num_keys - keys_tested) / keys_per_second : 0.0);
+		}
+	}
+
+	for (int i = 0; i < num_threads; i++) {
+		pthread_join(thread_id[i], NULL);
+	}
+
+	float elapsed = (msclock() - start_time) / 1000.0;
+	PrintAndLog("Tested %" PRIu64 " keys in %.1f s (%.1f Mkeys/s)", crack.keys_tested, elapsed, elapsed > 0 ? crack.keys_tested / elapsed / 1e6 : 0.0);
+
+	if (crack.found) {
+		PrintAndLog("Key found: %012" PRIx64, crack.found_key);
+		return 0;
+	}
+	if (crack.num_pairs == 1 && crack.num_candidates > 0) {
+		PrintAndLog("%u candidate keys found, add a second nR/aR pair to find the right one", crack.num_candidates);
+		return 0;
+	}
+	PrintAndLog("Key not found");
+	return 1;
+}
+
 
 static command_t CommandTable[] = 
 {
@@ -394,7 +666,8 @@ static command_t CommandTable[] =
   {"snoop",   		CmdLFHitagSnoop,   1, "Eavesdrop Hitag communication"},
   {"writer",   		CmdLFHitagWP,      1, "Act like a Hitag Writer" },
   {"simS",   		CmdLFHitagSimS,    1, "<hitagS.hts> Simulate HitagS transponder" }, 
-  {"checkChallenges",	CmdLFHitagCheckChallenges,   1, "<challenges.cc> test all challenges" }, {
+  {"checkChallenges",	CmdLFHitagCheckChallenges,   1, "<challenges.cc> test all challenges" },
+  {"crack",   		CmdLFHitagCrack,   1, "<uid> <nR aR> ... Recover a Hitag2 key from sniffed authentications" }, {
 				NULL,NULL, 0, NULL }
 };
 
@@ -280,6 +280,7 @@ int CmdIndalaDemod(const char *Cmd) {
 			phase = !phase;
 		}
 	}
+	GraphBufferChanged();
 
 	RepaintGraphWindow();
 	return 1;
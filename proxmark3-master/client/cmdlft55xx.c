@@ -21,6 +21,7 @@
 #include "cmdlf.h"
 #include "cmdlft55xx.h"
 #include "util.h"
+#include "util_posix.h"
 #include "data.h"
 #include "lfdemod.h"
 #include "cmdhf14a.h" //for getTagInfo
@@ -168,16 +169,20 @@ int usage_t55xx_wakup(){
 int usage_t55xx_bruteforce(){
 	PrintAndLog("This command uses A) bruteforce to scan a number range");
 	PrintAndLog("                  B) a dictionary attack");
-	PrintAndLog("Usage: lf t55xx bruteforce <start password> <end password> [i <*.dic>]");
+	PrintAndLog("Usage: lf t55xx bruteforce <start password> <end password> [c]");
+	PrintAndLog("       lf t55xx bruteforce [c] i <*.dic>");
 	PrintAndLog("       password must be 4 bytes (8 hex symbols)");
 	PrintAndLog("Options:");
 	PrintAndLog("     h           - this help");
 	PrintAndLog("     <start_pwd> - 4 byte hex value to start pwd search at");
 	PrintAndLog("     <end_pwd>   - 4 byte hex value to end pwd search at");
+	PrintAndLog("     c           - use the current configuration (lf t55xx config) instead of detecting the");
+	PrintAndLog("                   modulation for every password. Much faster, reads only the samples needed.");
 	PrintAndLog("     i <*.dic>   - loads a default keys dictionary file <*.dic>");
 	PrintAndLog("");
 	PrintAndLog("Examples:");
 	PrintAndLog("       lf t55xx bruteforce aaaaaaaa bbbbbbbb");
+	PrintAndLog("       lf t55xx bruteforce aaaaaaaa bbbbbbbb c");
 	PrintAndLog("       lf t55xx bruteforce i default_pwd.dic");
 	PrintAndLog("");
 	return 0;
@@ -1221,23 +1226,31 @@ int CmdT55xxDump(const char *Cmd){
 	return 1;
 }
 
-int AquireData( uint8_t page, uint8_t block, bool pwdmode, uint32_t password ){
+static void SendReadBlock( uint8_t page, uint8_t block, bool pwdmode, uint32_t password, int samples ){
 	// arg0 bitmodes:
 	// bit0 = pwdmode
 	// bit1 = page to read from
-	uint8_t arg0 = (page<<1) | pwdmode;
+	// bit16-31 = number of samples to acquire
+	uint32_t arg0 = (samples << T55XX_READ_SAMPLES_SHIFT) | (page<<1) | pwdmode;
 	UsbCommand c = {CMD_T55XX_READ_BLOCK, {arg0, block, password}};
-
-	clearCommandBuffer();
 	SendCommand(&c);
+}
+
+static int ReceiveReadBlock( int samples ){
 	if ( !WaitForResponseTimeout(CMD_ACK,NULL,2500) ) {
 		PrintAndLog("command execution time out");
 		return 0;
 	}
-	getSamples(12000,true);
+	getSamples(samples,true);
 	return 1;
 }
 
+int AquireData( uint8_t page, uint8_t block, bool pwdmode, uint32_t password ){
+	clearCommandBuffer();
+	SendReadBlock(page, block, pwdmode, password, T55XX_READ_SAMPLES);
+	return ReceiveReadBlock(T55XX_READ_SAMPLES);
+}
+
 char * GetBitRateStr(uint32_t id, bool xmode) {
 	static char buf[25];
 
@@ -1392,22 +1405,127 @@ int CmdT55xxWipe(const char *Cmd) {
 	return 0;
 }
 
+// number of samples needed to demodulate block 0 with the current configuration:
+// some lead in and three repetitions of the 32 bit block. The device acquires only these,
+// which shortens every try as well as the download.
+static int BruteForceSamples(bool useConfig) {
+	uint8_t bitRate[8] = {8,16,32,40,50,64,100,128};
+	if (!useConfig) return T55XX_READ_SAMPLES;
+	int samples = 1024 + 3 * 32 * bitRate[config.bitrate];
+	return (samples > T55XX_READ_SAMPLES) ? T55XX_READ_SAMPLES : samples;
+}
+
+// check if the acquired samples contain a valid configuration block for the current configuration
+static bool BruteForceCheckConfig(void) {
+	uint8_t bitRate[8] = {8,16,32,40,50,64,100,128};
+	uint8_t offset = 0;
+	int fndBitRate = 0;
+	bool Q5 = false;
+	uint8_t mode = config.modulation;
+
+	if (mode >= DEMOD_FSK1 && mode <= DEMOD_FSK2a) mode = DEMOD_FSK;
+
+	if (!DecodeT55xxBlock()) return false;
+	return test(mode, &offset, &fndBitRate, bitRate[config.bitrate], &Q5);
+}
+
+// Try to read block 0 with each password. The read with the next password is started before the
+// samples of the previous one are evaluated, i.e. the device acquires while we demodulate.
+// Passwords are taken from keyBlock if it is not NULL, else from the range start..end.
+// *pwd is set to the password found, or else to the last one tried.
+// returns 1 if found, 0 if not found or aborted, -1 on communication errors
+static int BruteForce(uint8_t *keyBlock, uint32_t keycnt, uint32_t start, uint32_t end, bool useConfig, uint32_t *pwdOut) {
+	uint64_t count = (keyBlock != NULL) ? keycnt : (uint64_t)end - start + 1;
+	int samples = BruteForceSamples(useConfig);
+	uint64_t startTime = msclock();
+	uint64_t lastReport = startTime;
+	int ans = 0;
+	uint64_t i;
+
+	#define BRUTEFORCE_PWD(i)	((keyBlock != NULL) ? (uint32_t)bytes_to_num(keyBlock + 4*(i), 4) : start + (uint32_t)(i))
+
+	clearCommandBuffer();
+	SendReadBlock(T55x7_PAGE0, T55x7_CONFIGURATION_BLOCK, true, BRUTEFORCE_PWD(0), samples);
+
+	for (i = 0; i < count; ++i) {
+		uint32_t pwd = BRUTEFORCE_PWD(i);
+		bool pending = false;
+
+		if (!ReceiveReadBlock(samples)) {
+			PrintAndLog("Aquireing data from device failed. Quitting");
+			ans = -1;
+			break;
+		}
+		*pwdOut = pwd;
+
+		if (i + 1 < count) {
+			SendReadBlock(T55x7_PAGE0, T55x7_CONFIGURATION_BLOCK, true, BRUTEFORCE_PWD(i+1), samples);
+			pending = true;
+		}
+
+		if (keyBlock != NULL) {
+			PrintAndLog("Testing %08X", pwd);
+		} else {
+			printf(".");
+			fflush(stdout);
+		}
+
+		bool found = useConfig ? BruteForceCheckConfig() : tryDetectModulation();
+		bool aborted = false;
+		if (!found && ukbhit() > 0) {
+			int ch = getchar();
+			(void)ch;
+			printf("\naborted via keyboard!\n");
+			aborted = true;
+		}
+
+		if (found || aborted) {
+			// let the pending read finish, it must not disturb the next command
+			if (pending) WaitForResponseTimeout(CMD_ACK, NULL, 2500);
+			if (found) {
+				// the samples of the found password are still in the GraphBuffer
+				if (useConfig) printConfiguration(config);
+				ans = 1;
+			}
+			++i;
+			break;
+		}
+
+		if (msclock() - lastReport > 10000) {
+			lastReport = msclock();
+			PrintAndLog("\n%" PRIu64 " passwords tested, %.1f passwords/s", i + 1, (float)(i + 1) * 1000.0 / (lastReport - startTime));
+		}
+	}
+
+	#undef BRUTEFORCE_PWD
+
+	uint64_t elapsed = msclock() - startTime;
+	PrintAndLog("\n%" PRIu64 " passwords tested in %.1f seconds (%.1f passwords/s)", i, elapsed / 1000.0, (elapsed > 0) ? (float)i * 1000.0 / elapsed : 0.0);
+	return ans;
+}
+
 int CmdT55xxBruteForce(const char *Cmd) {
 
 	// load a default pwd file.
 	char buf[9];
 	char filename[FILE_PATH_SIZE]={0};
 	int keycnt = 0;
-	int ch;
 	uint8_t stKeyBlock = 20;
 	uint8_t *keyBlock = NULL, *p = NULL;
 	uint32_t start_password = 0x00000000; //start password
 	uint32_t end_password   = 0xFFFFFFFF; //end   password
-	bool found = false;
+	uint32_t found_password = 0;
+	bool useConfig = false;
 
 	char cmdp = param_getchar(Cmd, 0);
 	if (cmdp == 'h' || cmdp == 'H') return usage_t55xx_bruteforce();
 
+	if ((cmdp == 'c' || cmdp == 'C') && param_getlength(Cmd, 0) == 1) {
+		useConfig = true;
+		Cmd += 2;
+		cmdp = param_getchar(Cmd, 0);
+	}
+
 	keyBlock = calloc(stKeyBlock, 6);
 	if (keyBlock == NULL) return 1;
 
@@ -1465,37 +1583,12 @@ int CmdT55xxBruteForce(const char *Cmd) {
 		}
 		PrintAndLog("Loaded %d keys", keycnt);
 		
-		// loop
-		uint64_t testpwd = 0x00;
-		for (uint16_t c = 0; c < keycnt; ++c ) {
-
-			if (ukbhit()) {
-				ch = getchar();
-				(void)ch;
-				printf("\naborted via keyboard!\n");
-				free(keyBlock);
-				return 0;
-			}
-
-			testpwd = bytes_to_num(keyBlock + 4*c, 4);
-
-			PrintAndLog("Testing %08X", testpwd);
-
-			if ( !AquireData(T55x7_PAGE0, T55x7_CONFIGURATION_BLOCK, true, testpwd)) {
-				PrintAndLog("Aquireing data from device failed. Quitting");
-				free(keyBlock);
-				return 0;
-			}
-
-			found = tryDetectModulation();
-
-			if ( found ) {
-				PrintAndLog("Found valid password: [%08X]", testpwd);
-				free(keyBlock);
-				return 0;
-			}
+		int ans = BruteForce(keyBlock, keycnt, 0, 0, useConfig, &found_password);
+		if (ans == 1) {
+			PrintAndLog("Found valid password: [%08X]", found_password);
+		} else if (ans == 0) {
+			PrintAndLog("Password NOT found. Last tried: [%08X]", found_password);
 		}
-		PrintAndLog("Password NOT found.");
 		free(keyBlock);
 		return 0;
 	}
@@ -1505,44 +1598,25 @@ int CmdT55xxBruteForce(const char *Cmd) {
 	// incremental pwd range search
 	start_password = param_get32ex(Cmd, 0, 0, 16);
 	end_password = param_get32ex(Cmd, 1, 0, 16);
+	cmdp = param_getchar(Cmd, 2);
+	if (cmdp == 'c' || cmdp == 'C') useConfig = true;
 
 	if ( start_password >= end_password ) {
 		free(keyBlock);
 		return usage_t55xx_bruteforce();
 	}
 	PrintAndLog("Search password range [%08X -> %08X]", start_password, end_password);
-
-	uint32_t i = start_password;
-
-	while ((!found) && (i <= end_password)) {
-
-		printf(".");
-		fflush(stdout);
-		if (ukbhit()) {
-			ch = getchar();
-			(void)ch;
-			printf("\naborted via keyboard!\n");
-			free(keyBlock);
-			return 0;
-		}
-
-		if (!AquireData(T55x7_PAGE0, T55x7_CONFIGURATION_BLOCK, true, i)) {
-			PrintAndLog("Aquireing data from device failed. Quitting");
-			free(keyBlock);
-			return 0;
-		}
-		found = tryDetectModulation();
-
-		if (found) break;
-		i++;
+	if (useConfig) {
+		PrintAndLog("Using the current configuration:");
+		printConfiguration(config);
 	}
 
-	PrintAndLog("");
+	int ans = BruteForce(NULL, 0, start_password, end_password, useConfig, &found_password);
 
-	if (found)
-		PrintAndLog("Found valid password: [%08x]", i);
-	else
-		PrintAndLog("Password NOT found. Last tried: [%08x]", --i);
+	if (ans == 1)
+		PrintAndLog("Found valid password: [%08x]", found_password);
+	else if (ans == 0)
+		PrintAndLog("Password NOT found. Last tried: [%08x]", found_password);
 
 	free(keyBlock);
 	return 0;
@@ -117,6 +117,7 @@ int CmdTIDemod(const char *Cmd)
   }
 
   GraphTraceLen -= (convLen + 16);
+  GraphBufferChanged();
 
   RepaintGraphWindow();
 
@@ -205,6 +206,7 @@ int CmdTIDemod(const char *Cmd)
     GraphBuffer[maxPos] = 800;
     GraphBuffer[maxPos+1] = -800;
   }
+  GraphBufferChanged();
   PrintAndLog("Info: raw tag bits = %s", bits);
 
   TagType = (shift3>>8)&0xff;
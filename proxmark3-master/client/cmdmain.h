@@ -13,10 +13,11 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include "usb_cmd.h"
 #include "cmdparser.h"
 
-extern void UsbCommandReceived(UsbCommand *UC);
+extern bool UsbCommandReceived(UsbCommand *UC);
 extern int CommandReceived(char *Cmd);
 extern bool WaitForResponseTimeoutW(uint32_t cmd, UsbCommand* response, size_t ms_timeout, bool show_warning);
 extern bool WaitForResponseTimeout(uint32_t cmd, UsbCommand* response, size_t ms_timeout);
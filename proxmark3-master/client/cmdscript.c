@@ -24,6 +24,7 @@
 #include "cmdmain.h"
 #include "cmdscript.h"
 #include "cmdhfmf.h"
+#include "util.h"
 #include "pm3_binlib.h"
 #include "pm3_bitlib.h"
 #include <lua.h>
@@ -33,15 +34,34 @@
 static int CmdHelp(const char *Cmd);
 static int CmdList(const char *Cmd);
 static int CmdRun(const char *Cmd);
+static int CmdPersistent(const char *Cmd);
 
 command_t CommandTable[] =
 {
   {"help",  CmdHelp, 1, "This help"},
   {"list",  CmdList, 1, "List available scripts"},
   {"run",   CmdRun,  1, "<name> -- Execute a script"},
+  {"persistent", CmdPersistent, 1, "<on|off> -- Keep the interpreter and the loaded libraries between runs"},
   {NULL, NULL, 0, NULL}
 };
 
+// Compiled scripts and libraries, valid as long as the file has the same contents
+typedef struct lua_chunk_s {
+	struct lua_chunk_s *next;
+	char *path;
+	bool valid;
+	uint64_t hash;			// of the source the code was compiled from
+	size_t source_len;
+	size_t len;
+	char *code;
+} lua_chunk_t;
+
+static lua_chunk_t *chunk_cache = NULL;
+
+// interpreter shared by the runs in persistent mode
+static lua_State *persistent_state = NULL;
+static bool persistent = false;
+
 int str_ends_with(const char * str, const char * suffix) {
 
   if( str == NULL || suffix == NULL )
@@ -117,13 +137,117 @@ bool endsWith (char* base, char* str) {
     return (blen >= slen) && (0 == strcmp(base + blen - slen, str));
 }
 
+static int chunk_writer(lua_State *L, const void *p, size_t sz, void *ud)
+{
+	lua_chunk_t *chunk = ud;
+	char *code = realloc(chunk->code, chunk->len + sz);
+	if (code == NULL)
+		return 1;
+	memcpy(code + chunk->len, p, sz);
+	chunk->code = code;
+	chunk->len += sz;
+	return 0;
+}
+
+// FNV-1a of the file contents, *len is set to the file size. false if it can't be read
+static bool hash_file(const char *path, uint64_t *hash, size_t *len)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+		return false;
+
+	uint8_t buf[4096];
+	size_t n;
+	*hash = 14695981039346656037ULL;
+	*len = 0;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+		for (size_t i = 0; i < n; i++) {
+			*hash = (*hash ^ buf[i]) * 1099511628211ULL;
+		}
+		*len += n;
+	}
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
 /**
- * @brief CmdRun - executes a script file.
- * @param argc
- * @param argv
- * @return
+ * @brief Loads a lua file as a function on top of the stack, like luaL_loadfile(). The bytecode
+ * is kept, so the file is only parsed again when its contents have changed.
  */
-int CmdRun(const char *Cmd)
+static int load_cached_file(lua_State *L, const char *path)
+{
+	uint64_t hash;
+	size_t source_len;
+	if (!hash_file(path, &hash, &source_len))
+		return luaL_loadfile(L, path);
+
+	lua_chunk_t *chunk;
+	for (chunk = chunk_cache; chunk; chunk = chunk->next) {
+		if (strcmp(chunk->path, path) == 0)
+			break;
+	}
+
+	char chunkname[strlen(path) + 2];
+	chunkname[0] = '@';
+	strcpy(chunkname + 1, path);
+
+	if (chunk && chunk->valid && chunk->hash == hash && chunk->source_len == source_len)
+		return luaL_loadbuffer(L, chunk->code, chunk->len, chunkname);
+
+	int error = luaL_loadfile(L, path);
+	if (error)
+		return error;
+
+	if (chunk == NULL) {
+		chunk = calloc(1, sizeof(lua_chunk_t));
+		if (chunk == NULL)
+			return error;
+		chunk->path = malloc(strlen(path) + 1);
+		if (chunk->path == NULL) {
+			free(chunk);
+			return error;
+		}
+		strcpy(chunk->path, path);
+		chunk->next = chunk_cache;
+		chunk_cache = chunk;
+	}
+	free(chunk->code);
+	chunk->code = NULL;
+	chunk->len = 0;
+	// an invalid entry makes the next load parse the file again
+	chunk->valid = (lua_dump(L, chunk_writer, chunk) == 0);
+	chunk->hash = hash;
+	chunk->source_len = source_len;
+
+	return error;
+}
+
+/**
+ * @brief Searcher for require(), replaces the one for lua files in package.searchers to load
+ * the libraries through the bytecode cache.
+ */
+static int cached_searcher(lua_State *L)
+{
+	const char *name = luaL_checkstring(L, 1);
+
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "searchpath");
+	lua_pushstring(L, name);
+	lua_getfield(L, -3, "path");
+	lua_call(L, 2, 2);
+	if (lua_isnil(L, -2))
+		return 1; // error message from searchpath
+
+	const char *filename = lua_tostring(L, -2);
+	if (load_cached_file(L, filename) != LUA_OK)
+		return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name, filename, lua_tostring(L, -1));
+
+	lua_pushstring(L, filename);
+	return 2;
+}
+
+static lua_State *new_lua_state(void)
 {
     // create new Lua state
     lua_State *lua_state;
@@ -141,6 +265,85 @@ int CmdRun(const char *Cmd)
 	//Add the 'bit' library
 	set_bit_library(lua_state);
 
+	//Load the lua libraries through the bytecode cache, package.searchers[2] is the lua file searcher
+	lua_getglobal(lua_state, "package");
+	lua_getfield(lua_state, -1, "searchers");
+	lua_pushcfunction(lua_state, cached_searcher);
+	lua_rawseti(lua_state, -2, 2);
+	lua_pop(lua_state, 2);
+
+	return lua_state;
+}
+
+static void close_persistent_state(void)
+{
+	if (persistent_state) {
+		lua_close(persistent_state);
+		persistent_state = NULL;
+	}
+}
+
+void ScriptCleanup(void)
+{
+	close_persistent_state();
+	while (chunk_cache) {
+		lua_chunk_t *next = chunk_cache->next;
+		free(chunk_cache->path);
+		free(chunk_cache->code);
+		free(chunk_cache);
+		chunk_cache = next;
+	}
+}
+
+/**
+ * @brief CmdPersistent - keep one interpreter for all script runs. Libraries loaded with require()
+ * stay loaded and the scripts share their globals.
+ */
+int CmdPersistent(const char *Cmd)
+{
+	char ctmp = param_getchar(Cmd, 0);
+	if (ctmp == 'h' || ctmp == 'H') {
+		PrintAndLog("Usage:  script persistent [on|off]");
+		PrintAndLog("     on  : keep the interpreter between 'script run' calls, the loaded libraries and the globals stay");
+		PrintAndLog("     off : a fresh interpreter for every run (default)");
+		return 0;
+	}
+
+	if (ctmp != 0) {
+		char mode[4] = {0};
+		param_getstr(Cmd, 0, mode, sizeof(mode));
+		if (strcmp(mode, "on") == 0) {
+			persistent = true;
+		} else if (strcmp(mode, "off") == 0) {
+			persistent = false;
+			close_persistent_state();
+		} else {
+			PrintAndLog("Usage:  script persistent [on|off]");
+			return 1;
+		}
+	}
+
+	PrintAndLog("Persistent interpreter: %s", persistent ? "on" : "off");
+	return 0;
+}
+
+/**
+ * @brief CmdRun - executes a script file.
+ * @param argc
+ * @param argv
+ * @return
+ */
+int CmdRun(const char *Cmd)
+{
+    lua_State *lua_state;
+    if (persistent) {
+        if (persistent_state == NULL)
+            persistent_state = new_lua_state();
+        lua_state = persistent_state;
+    } else {
+        lua_state = new_lua_state();
+    }
+
     char script_name[128] = {0};
     char arguments[256] = {0};
 
@@ -166,7 +369,7 @@ int CmdRun(const char *Cmd)
 
     // run the Lua script
 
-    int error = luaL_loadfile(lua_state, script_path);
+    int error = load_cached_file(lua_state, script_path);
     if(!error)
     {
 
@@ -190,7 +393,12 @@ int CmdRun(const char *Cmd)
 
     //luaL_dofile(lua_state, buf);
     // close the Lua state
-    lua_close(lua_state);
+    if (persistent) {
+        lua_settop(lua_state, 0);
+        lua_gc(lua_state, LUA_GCCOLLECT, 0);
+    } else {
+        lua_close(lua_state);
+    }
     printf("\n-----Finished\n");
     return 0;
 }
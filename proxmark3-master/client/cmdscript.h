@@ -14,5 +14,7 @@
 
 
 int CmdScript(const char *Cmd);
+// free the bytecode cache and the persistent interpreter
+void ScriptCleanup(void);
 
 #endif
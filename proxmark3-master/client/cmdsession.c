@@ -0,0 +1,199 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Session commands, several Proxmarks connected to one client
+//-----------------------------------------------------------------------------
+
+#include "cmdsession.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "cmdparser.h"
+#include "data.h"
+#include "session.h"
+#include "usb_cmd.h"
+#include "ui.h"
+#include "util.h"
+#include "util_posix.h"
+
+static int CmdHelp(const char *Cmd);
+
+static int CmdSessionList(const char *Cmd)
+{
+	if (session_count() == 0) {
+		PrintAndLog("No device connected");
+		return 0;
+	}
+
+	PrintAndLog("  id | port                 |   tx cmds |   rx cmds |    rx bytes |  time (s)");
+	PrintAndLog("-----+----------------------+-----------+-----------+-------------+----------");
+	for (int id = 0; id < SESSION_MAX; id++) {
+		session_stats_t stats;
+		if (!session_get_stats(id, &stats))
+			continue;
+		PrintAndLog("%c %2d | %-20s | %9"PRIu64" | %9"PRIu64" | %11"PRIu64" | %8.1f",
+			id == session_current() ? '*' : ' ', id, session_port(id),
+			stats.tx_cmds, stats.rx_cmds, stats.rx_bytes, (msclock() - stats.start_time) / 1000.0);
+	}
+	return 0;
+}
+
+static int CmdSessionOpen(const char *Cmd)
+{
+	char port[FILE_PATH_SIZE] = {0};
+	if (param_getchar(Cmd, 0) == 'h' || param_getstr(Cmd, 0, port, sizeof(port)) == 0) {
+		PrintAndLog("Usage:  session open <port>");
+		PrintAndLog("        connect one more Proxmark, the first one connected becomes the current device");
+		PrintAndLog("sample: session open /dev/ttyACM1");
+		return 0;
+	}
+
+	int id = session_open(port);
+	if (id < 0)
+		return 1;
+	PrintAndLog("Session %d: %s%s", id, port, id == session_current() ? " (current)" : "");
+	return 0;
+}
+
+static int CmdSessionClose(const char *Cmd)
+{
+	if (param_getchar(Cmd, 0) == 'h' || param_getchar(Cmd, 0) == 0) {
+		PrintAndLog("Usage:  session close <id>");
+		return 0;
+	}
+
+	int id = param_get32ex(Cmd, 0, -1, 10);
+	if (!session_valid(id)) {
+		PrintAndLog("No session %d", id);
+		return 1;
+	}
+	session_close(id);
+	if (session_current() >= 0)
+		PrintAndLog("Current device: %d %s", session_current(), session_port(session_current()));
+	else
+		PrintAndLog("No device connected, offline");
+	return 0;
+}
+
+static int CmdSessionUse(const char *Cmd)
+{
+	if (param_getchar(Cmd, 0) == 'h' || param_getchar(Cmd, 0) == 0) {
+		PrintAndLog("Usage:  session use <id>");
+		PrintAndLog("        the following commands talk to the device of session <id>");
+		return 0;
+	}
+
+	int id = param_get32ex(Cmd, 0, -1, 10);
+	if (!session_select(id)) {
+		PrintAndLog("No session %d", id);
+		return 1;
+	}
+	PrintAndLog("Current device: %d %s", id, session_port(id));
+	return 0;
+}
+
+typedef struct {
+	int id;
+	uint32_t count;
+	uint32_t ok;
+	uint64_t time;
+} ping_job_t;
+
+static void
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+*ping_thread(void *arg) {
+	ping_job_t *job = (ping_job_t *)arg;
+	UsbCommand c = {CMD_PING};
+	UsbCommand resp;
+
+	uint64_t start = msclock();
+	for (uint32_t i = 0; i < job->count; i++) {
+		session_clear(job->id);
+		session_send(job->id, &c);
+		if (session_wait(job->id, CMD_ACK, &resp, 1000, false))
+			job->ok++;
+	}
+	job->time = msclock() - start;
+	return NULL;
+}
+
+static int CmdSessionPing(const char *Cmd)
+{
+	if (param_getchar(Cmd, 0) == 'h') {
+		PrintAndLog("Usage:  session ping [count]");
+		PrintAndLog("        ping all the connected devices at the same time, <count> times each (default 100)");
+		return 0;
+	}
+
+	uint32_t count = param_get32ex(Cmd, 0, 100, 10);
+	ping_job_t jobs[SESSION_MAX];
+	pthread_t threads[SESSION_MAX];
+	int n = 0;
+
+	uint64_t start = msclock();
+	for (int id = 0; id < SESSION_MAX; id++) {
+		if (!session_valid(id))
+			continue;
+		jobs[n].id = id;
+		jobs[n].count = count;
+		jobs[n].ok = 0;
+		jobs[n].time = 0;
+		if (pthread_create(&threads[n], NULL, &ping_thread, &jobs[n])) {
+			PrintAndLog("Can't start a thread for session %d", id);
+			continue;
+		}
+		n++;
+	}
+	if (n == 0) {
+		PrintAndLog("No device connected");
+		return 1;
+	}
+
+	uint64_t total = 0;
+	for (int i = 0; i < n; i++) {
+		pthread_join(threads[i], NULL);
+		total += jobs[i].ok;
+	}
+	uint64_t elapsed = msclock() - start;
+
+	for (int i = 0; i < n; i++) {
+		PrintAndLog("%2d %-20s %u/%u answered, %.2f ms per ping", jobs[i].id, session_port(jobs[i].id),
+			jobs[i].ok, jobs[i].count, jobs[i].ok ? (double)jobs[i].time / jobs[i].ok : 0.0);
+	}
+	PrintAndLog("%d devices, %"PRIu64" pings in %"PRIu64" ms, %.1f commands/s, %.1f kB/s",
+		n, total, elapsed, elapsed ? total * 1000.0 / elapsed : 0.0,
+		elapsed ? total * 2 * sizeof(UsbCommand) / 1.024 / elapsed : 0.0);
+	return 0;
+}
+
+static command_t CommandTable[] =
+{
+	{"help",  CmdHelp,         1, "This help"},
+	{"list",  CmdSessionList,  1, "List the connected devices and their traffic"},
+	{"open",  CmdSessionOpen,  1, "<port> -- Connect one more device"},
+	{"close", CmdSessionClose, 1, "<id> -- Disconnect a device"},
+	{"use",   CmdSessionUse,   1, "<id> -- Make a device the current one"},
+	{"ping",  CmdSessionPing,  1, "[count] -- Ping all the devices at the same time and show the throughput"},
+	{NULL, NULL, 0, NULL}
+};
+
+int CmdSession(const char *Cmd)
+{
+	CmdsParse(CommandTable, Cmd);
+	return 0;
+}
+
+int CmdHelp(const char *Cmd)
+{
+	CmdsHelp(CommandTable);
+	return 0;
+}
@@ -0,0 +1,14 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Session commands, several Proxmarks connected to one client
+//-----------------------------------------------------------------------------
+
+#ifndef CMDSESSION_H__
+#define CMDSESSION_H__
+
+int CmdSession(const char *Cmd);
+
+#endif
@@ -0,0 +1,203 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Receive UIDs or nonces the device collects without a round trip for each one
+//
+// The device loops over the anticollision or the nonce request and sends what it
+// found in batches. Here the batches are unpacked, the records are checked against
+// all records seen so far and the new ones go to a file or the screen.
+//-----------------------------------------------------------------------------
+
+#include "collect.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "proxmark3.h"
+#include "cmdmain.h"
+#include "ui.h"
+#include "util.h"
+#include "util_posix.h"
+
+// the device sends a batch at least every 250ms and after every try that takes longer
+#define COLLECT_TIMEOUT		2500
+// statistics interval when writing to a file
+#define STATS_INTERVAL		1000
+
+// The records seen so far: the records (length byte and data) one after the other
+// in an arena, and an open addressing hash table of their offsets + 1 (0 is a free
+// slot), at most half full.
+typedef struct {
+	uint8_t *arena;
+	size_t arena_len;
+	size_t arena_size;
+	size_t *slots;
+	size_t slot_count;
+	size_t used;
+} record_set_t;
+
+// FNV-1a of the length byte and the data
+static uint32_t record_hash(const uint8_t *record)
+{
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i <= record[0]; i++) {
+		hash = (hash ^ record[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static bool record_set_grow(record_set_t *set)
+{
+	size_t count = set->slot_count ? set->slot_count * 2 : 1024;
+	size_t *slots = calloc(count, sizeof(size_t));
+	if (slots == NULL)
+		return false;
+	for (size_t i = 0; i < set->slot_count; i++) {
+		if (set->slots[i] == 0)
+			continue;
+		size_t j = record_hash(set->arena + set->slots[i] - 1) & (count - 1);
+		while (slots[j])
+			j = (j + 1) & (count - 1);
+		slots[j] = set->slots[i];
+	}
+	free(set->slots);
+	set->slots = slots;
+	set->slot_count = count;
+	return true;
+}
+
+// 1 if the record was added, 0 if it was seen before, -1 if out of memory
+static int record_set_add(record_set_t *set, const uint8_t *record)
+{
+	size_t len = record[0] + 1;
+
+	if (set->used * 2 >= set->slot_count && !record_set_grow(set))
+		return -1;
+	size_t mask = set->slot_count - 1;
+	size_t i = record_hash(record) & mask;
+	for (; set->slots[i]; i = (i + 1) & mask) {
+		const uint8_t *r = set->arena + set->slots[i] - 1;
+		if (!memcmp(r, record, len))
+			return 0;
+	}
+
+	if (set->arena_len + len > set->arena_size) {
+		size_t size = set->arena_size ? set->arena_size * 2 : 65536;
+		uint8_t *arena = realloc(set->arena, size);
+		if (arena == NULL)
+			return -1;
+		set->arena = arena;
+		set->arena_size = size;
+	}
+	memcpy(set->arena + set->arena_len, record, len);
+	set->slots[i] = set->arena_len + 1;
+	set->arena_len += len;
+	set->used++;
+	return 1;
+}
+
+static void print_stats(const char *what, uint64_t elapsed, uint64_t received, size_t unique, uint64_t tries)
+{
+	double seconds = elapsed / 1000.0;
+	PrintAndLog("%7.1f s: %8" PRIu64 " %ss, %6.0f/s, %8zu unique, %8" PRIu64 " tries, %5.1f%% found",
+		seconds, received, what, seconds > 0 ? received / seconds : 0.0, unique, tries,
+		tries ? 100.0 * received / tries : 0.0);
+}
+
+int collect_records(UsbCommand *c, const char *what, const char *filename, uint32_t pause_ms)
+{
+	record_set_t set = {0};
+	FILE *f = NULL;
+	UsbCommand resp;
+	uint64_t received = 0, tries = 0;
+	bool first = true, stopping = false;
+	int res = -1;
+
+	if (filename) {
+		f = fopen(filename, "wb");
+		if (f == NULL) {
+			PrintAndLog("Could not create file %s", filename);
+			return -1;
+		}
+	}
+
+	clearCommandBuffer();
+	SendCommand(c);
+	uint64_t start = msclock();
+	uint64_t last_stats = start;
+	PrintAndLog("Press any key to stop");
+
+	while (true) {
+		if (!stopping && ukbhit() > 0) {
+			getchar();
+			// any command ends the collection on the device
+			UsbCommand stop = {CMD_PING};
+			SendCommand(&stop);
+			stopping = true;
+		}
+		if (!WaitForResponseTimeoutW(CMD_ACK, &resp, COLLECT_TIMEOUT + pause_ms, false)) {
+			PrintAndLog("No answer from the device");
+			goto out;
+		}
+		if (!(resp.arg[2] & COLLECT_RECORDS)) {
+			if (first) {
+				res = COLLECT_NOT_SUPPORTED;
+				goto out;
+			}
+			continue;
+		}
+		first = false;
+
+		const uint8_t *batch = resp.d.asBytes;
+		size_t pos = 0;
+		for (uint64_t i = 0; i < resp.arg[0]; i++) {
+			if (pos >= USB_CMD_DATA_SIZE || pos + 1 + batch[pos] > USB_CMD_DATA_SIZE) {
+				PrintAndLog("Broken batch of %" PRIu64 " %ss", resp.arg[0], what);
+				break;
+			}
+			int added = record_set_add(&set, batch + pos);
+			if (added < 0) {
+				PrintAndLog("Out of memory after %zu unique %ss", set.used, what);
+				goto out;
+			}
+			received++;
+			if (added && f) {
+				fwrite(batch + pos, 1, batch[pos] + 1, f);
+			} else if (added) {
+				PrintAndLog("%s", sprint_hex_inrow(batch + pos + 1, batch[pos]));
+			}
+			pos += batch[pos] + 1;
+		}
+		tries += resp.arg[1];
+
+		if (resp.arg[2] & COLLECT_LAST)
+			break;
+		if (f && msclock() - last_stats >= STATS_INTERVAL) {
+			last_stats = msclock();
+			print_stats(what, last_stats - start, received, set.used, tries);
+		}
+	}
+
+	// the answer to the command that stopped it
+	if (stopping)
+		WaitForResponseTimeoutW(CMD_ACK, NULL, 1000, false);
+	print_stats(what, msclock() - start, received, set.used, tries);
+	PrintAndLog("%" PRIu64 " duplicates", received - set.used);
+	if (f)
+		PrintAndLog("Wrote %zu unique %ss to %s", set.used, what, filename);
+	res = received;
+
+out:
+	if (f) {
+		fclose(f);
+		if (res == COLLECT_NOT_SUPPORTED)
+			remove(filename);
+	}
+	free(set.slots);
+	free(set.arena);
+	return res;
+}
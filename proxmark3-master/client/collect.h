@@ -0,0 +1,26 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Receive UIDs or nonces the device collects without a round trip for each one
+//-----------------------------------------------------------------------------
+
+#ifndef COLLECT_H__
+#define COLLECT_H__
+
+#include <stdint.h>
+#include "usb_cmd.h"
+
+// the device answered with a single result, its firmware doesn't stream
+#define COLLECT_NOT_SUPPORTED	-2
+
+// Send c, which starts a collection on the device (see COLLECT_RECORDS in usb_cmd.h), and
+// receive the records until it is done or a key is pressed. The unique records are written
+// to filename, each as a length byte followed by the record, with statistics every second,
+// or printed in hex without a file. what names a record in the messages, pause_ms is the
+// wait of the device between two tries. Returns the number of records received, -1 on
+// errors or COLLECT_NOT_SUPPORTED.
+extern int collect_records(UsbCommand *c, const char *what, const char *filename, uint32_t pause_ms);
+
+#endif
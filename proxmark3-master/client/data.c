@@ -14,12 +14,11 @@
 #include "ui.h"
 #include "proxmark3.h"
 #include "cmdmain.h"
-
-uint8_t* sample_buf;
+#include "session.h"
 
 void GetFromBigBuf(uint8_t *dest, int bytes, int start_index)
 {
-  sample_buf = dest;
+  session_set_download(session_current(), dest, bytes);
   UsbCommand c = {CMD_DOWNLOAD_RAW_ADC_SAMPLES_125K, {start_index, bytes, 0}};
   SendCommand(&c);
 }
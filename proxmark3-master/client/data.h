@@ -15,7 +15,6 @@
 
 #define FILE_PATH_SIZE 1000
 
-extern uint8_t* sample_buf;
 #define arraylen(x) (sizeof(x)/sizeof((x)[0]))
 
 void GetFromBigBuf(uint8_t *dest, int bytes, int start_index);
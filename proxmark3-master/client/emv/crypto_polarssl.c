@@ -86,6 +86,82 @@ struct crypto_pk_polarssl {
 	rsa_context ctx;
 };
 
+// R^2 mod N of the recently used public keys. A handful of CA and issuer keys
+// serve all the cards of a bank, so the Montgomery setup is done once per key.
+#define RSA_RN_CACHE_SIZE	16
+
+static struct {
+	mpi N;
+	mpi RN;
+	unsigned int last_used;
+} rsa_rn_cache[RSA_RN_CACHE_SIZE];
+static unsigned int rsa_rn_cache_time;
+
+static void rsa_rn_cache_get(rsa_context *ctx)
+{
+	for (int i = 0; i < RSA_RN_CACHE_SIZE; i++) {
+		if (rsa_rn_cache[i].N.p && !mpi_cmp_mpi(&rsa_rn_cache[i].N, &ctx->N)) {
+			if (!mpi_copy(&ctx->RN, &rsa_rn_cache[i].RN))
+				rsa_rn_cache[i].last_used = ++rsa_rn_cache_time;
+			return;
+		}
+	}
+}
+
+static void rsa_rn_cache_put(const rsa_context *ctx)
+{
+	int slot = 0;
+
+	if (!ctx->RN.p)
+		return;
+
+	for (int i = 0; i < RSA_RN_CACHE_SIZE; i++) {
+		if (rsa_rn_cache[i].N.p && !mpi_cmp_mpi(&rsa_rn_cache[i].N, &ctx->N))
+			return;
+	}
+
+	for (int i = 0; i < RSA_RN_CACHE_SIZE; i++) {
+		if (!rsa_rn_cache[i].N.p) {
+			slot = i;
+			break;
+		}
+		if (rsa_rn_cache[i].last_used < rsa_rn_cache[slot].last_used)
+			slot = i;
+	}
+
+	if (mpi_copy(&rsa_rn_cache[slot].N, &ctx->N) || mpi_copy(&rsa_rn_cache[slot].RN, &ctx->RN)) {
+		mpi_free(&rsa_rn_cache[slot].N);
+		mpi_free(&rsa_rn_cache[slot].RN);
+		return;
+	}
+	rsa_rn_cache[slot].last_used = ++rsa_rn_cache_time;
+}
+
+// rsa_public() with a short exponentiation for the usual public exponents 3 and 65537
+static int rsa_public_fast(rsa_context *ctx, const unsigned char *input, unsigned char *output)
+{
+	t_uint e;
+	mpi T;
+	int ret;
+
+	if (!mpi_cmp_int(&ctx->E, 3))
+		e = 3;
+	else if (!mpi_cmp_int(&ctx->E, 65537))
+		e = 65537;
+	else
+		return rsa_public(ctx, input, output);
+
+	mpi_init(&T);
+	ret = mpi_read_binary(&T, input, ctx->len);
+	if (!ret)
+		ret = mpi_exp_mod_small(&T, &T, e, &ctx->N, &ctx->RN);
+	if (!ret)
+		ret = mpi_write_binary(&T, output, ctx->len);
+	mpi_free(&T);
+
+	return ret ? POLARSSL_ERR_RSA_PUBLIC_FAILED + ret : 0;
+}
+
 static struct crypto_pk *crypto_pk_polarssl_open_rsa(va_list vl)
 {
 	struct crypto_pk_polarssl *cp = malloc(sizeof(*cp));
@@ -109,6 +185,8 @@ static struct crypto_pk *crypto_pk_polarssl_open_rsa(va_list vl)
 		return NULL;
 	}
 
+	rsa_rn_cache_get(&cp->ctx);
+
 	return &cp->cp;
 }
 
@@ -213,11 +291,14 @@ static unsigned char *crypto_pk_polarssl_encrypt(const struct crypto_pk *_cp, co
 		return NULL;
 	}
 
-	res = rsa_public(&cp->ctx, buf, result);
+	bool rn_known = cp->ctx.RN.p != NULL;
+	res = rsa_public_fast(&cp->ctx, buf, result);
 	if(res) {
 		printf("RSA encrypt failed. Error: %x data len: %zd key len: %zd\n", res * -1, len, keylen);
 		return NULL;
 	}
+	if (!rn_known)
+		rsa_rn_cache_put(&cp->ctx);
 	
 	*clen = keylen;
 	
@@ -32,6 +32,17 @@ static const struct tlv empty_tlv = {.tag = 0x0, .len = 0, .value = empty_tlv_va
 
 static size_t emv_pki_hash_psn[256] = { 0, 0, 11, 2, 17, 2, };
 
+// Recently recovered issuer and ICC keys. The key of an entry is the hash of all
+// the inputs of the recovery, so a hit gives the same result without the RSA work.
+#define EMV_PKI_CACHE_SIZE	8
+
+static struct {
+	unsigned char hash[20];
+	struct emv_pk *pk;
+	unsigned int last_used;
+} emv_pki_cache[EMV_PKI_CACHE_SIZE];
+static unsigned int emv_pki_cache_time;
+
 static unsigned char *emv_pki_decode_message(const struct emv_pk *enc_pk,
 		uint8_t msgtype,
 		size_t *len,
@@ -261,6 +272,67 @@ static struct emv_pk *emv_pki_decode_key_ex(const struct emv_pk *enc_pk,
 	return pk;
 }
 
+static struct emv_pk *emv_pk_dup(const struct emv_pk *pk)
+{
+	struct emv_pk *copy = emv_pk_new(pk->mlen, pk->elen);
+	if (!copy)
+		return NULL;
+
+	unsigned char *modulus = copy->modulus;
+	memcpy(copy, pk, sizeof(*copy));
+	copy->modulus = modulus;
+	memcpy(copy->modulus, pk->modulus, pk->mlen);
+
+	return copy;
+}
+
+static void emv_pki_cache_hash_tlv(struct crypto_hash *ch, const struct tlv *tlv)
+{
+	unsigned char len[2] = {0xff, 0xff};
+
+	// length prefix keeps the fields apart, an absent field differs from an empty one
+	if (tlv) {
+		len[0] = tlv->len >> 8;
+		len[1] = tlv->len;
+	}
+	crypto_hash_write(ch, len, sizeof(len));
+	if (tlv)
+		crypto_hash_write(ch, tlv->value, tlv->len);
+}
+
+static bool emv_pki_cache_hash(unsigned char *hash,
+		const struct emv_pk *enc_pk,
+		unsigned char msgtype,
+		const struct tlv *pan_tlv,
+		const struct tlv *cert_tlv,
+		const struct tlv *exp_tlv,
+		const struct tlv *rem_tlv,
+		const struct tlv *add_tlv)
+{
+	struct crypto_hash *ch = crypto_hash_open(HASH_SHA_1);
+	if (!ch)
+		return false;
+
+	struct tlv enc_modulus = { .len = enc_pk->mlen, .value = enc_pk->modulus };
+	struct tlv enc_exp = { .len = enc_pk->elen, .value = enc_pk->exp };
+
+	crypto_hash_write(ch, enc_pk->rid, sizeof(enc_pk->rid));
+	crypto_hash_write(ch, &enc_pk->index, 1);
+	crypto_hash_write(ch, &msgtype, 1);
+	emv_pki_cache_hash_tlv(ch, &enc_modulus);
+	emv_pki_cache_hash_tlv(ch, &enc_exp);
+	emv_pki_cache_hash_tlv(ch, pan_tlv);
+	emv_pki_cache_hash_tlv(ch, cert_tlv);
+	emv_pki_cache_hash_tlv(ch, exp_tlv);
+	emv_pki_cache_hash_tlv(ch, rem_tlv);
+	emv_pki_cache_hash_tlv(ch, add_tlv);
+
+	memcpy(hash, crypto_hash_read(ch), 20);
+	crypto_hash_close(ch);
+
+	return true;
+}
+
 static struct emv_pk *emv_pki_decode_key(const struct emv_pk *enc_pk,
 		unsigned char msgtype,
 		const struct tlv *pan_tlv,
@@ -269,7 +341,36 @@ static struct emv_pk *emv_pki_decode_key(const struct emv_pk *enc_pk,
 		const struct tlv *rem_tlv,
 		const struct tlv *add_tlv
 		) {
-	return emv_pki_decode_key_ex(enc_pk, msgtype, pan_tlv, cert_tlv, exp_tlv, rem_tlv, add_tlv, false);
+	unsigned char hash[20];
+	int slot = 0;
+
+	if (!enc_pk || !cert_tlv || !exp_tlv || !pan_tlv ||
+	    !emv_pki_cache_hash(hash, enc_pk, msgtype, pan_tlv, cert_tlv, exp_tlv, rem_tlv, add_tlv))
+		return emv_pki_decode_key_ex(enc_pk, msgtype, pan_tlv, cert_tlv, exp_tlv, rem_tlv, add_tlv, false);
+
+	for (int i = 0; i < EMV_PKI_CACHE_SIZE; i++) {
+		if (emv_pki_cache[i].pk && !memcmp(emv_pki_cache[i].hash, hash, sizeof(hash))) {
+			emv_pki_cache[i].last_used = ++emv_pki_cache_time;
+			return emv_pk_dup(emv_pki_cache[i].pk);
+		}
+		if (emv_pki_cache[i].last_used < emv_pki_cache[slot].last_used)
+			slot = i;
+	}
+
+	struct emv_pk *pk = emv_pki_decode_key_ex(enc_pk, msgtype, pan_tlv, cert_tlv, exp_tlv, rem_tlv, add_tlv, false);
+	if (!pk)
+		return NULL;
+
+	// the caller owns pk, the cache keeps its own copy
+	struct emv_pk *copy = emv_pk_dup(pk);
+	if (copy) {
+		emv_pk_free(emv_pki_cache[slot].pk);
+		memcpy(emv_pki_cache[slot].hash, hash, sizeof(hash));
+		emv_pki_cache[slot].pk = copy;
+		emv_pki_cache[slot].last_used = ++emv_pki_cache_time;
+	}
+
+	return pk;
 }
 
 struct emv_pk *emv_pki_recover_issuer_cert(const struct emv_pk *pk, struct tlvdb *db)
@@ -722,13 +722,11 @@ int trDDA(bool decodeTLV, struct tlvdb *tlv) {
 		free(ddol_data_tlv);
 		if (!idn_db) {
 			PrintAndLog("ERROR: Can't recover IDN (ICC Dynamic Number)");
-			tlvdb_free(dda_db);
 			emv_pk_free(pk);
 			emv_pk_free(issuer_pk);
 			emv_pk_free(icc_pk);
 			return 8;
 		}
-		tlvdb_free(dda_db);
 
 		// 9f4c ICC Dynamic Number
 		const struct tlv *idn_tlv = tlvdb_get(idn_db, 0x9f4c, NULL);
@@ -736,7 +734,6 @@ int trDDA(bool decodeTLV, struct tlvdb *tlv) {
 			PrintAndLog("\nIDN (ICC Dynamic Number) [%zu] %s", idn_tlv->len, sprint_hex_inrow(idn_tlv->value, idn_tlv->len));
 			PrintAndLog("DDA verified OK.");
 			tlvdb_add(tlv, idn_db);
-			tlvdb_free(idn_db);
 		} else {
 			PrintAndLog("\nERROR: DDA verify error");
 			tlvdb_free(idn_db);
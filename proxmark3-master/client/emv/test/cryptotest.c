@@ -22,6 +22,7 @@
 #include "sda_test.h"
 #include "dda_test.h"
 #include "cda_test.h"
+#include "tlv_test.h"
 
 int ExecuteCryptoTests(bool verbose) {
 	int res;
@@ -54,6 +55,9 @@ int ExecuteCryptoTests(bool verbose) {
 	res = exec_crypto_test(verbose);
 	if (res) TestFail = true;
 
+	res = exec_tlv_test(verbose);
+	if (res) TestFail = true;
+
 	PrintAndLog("\n--------------------------");
 	if (TestFail)
 		PrintAndLog("Test(s) [ERROR].");
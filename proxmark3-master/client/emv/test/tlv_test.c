@@ -0,0 +1,308 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// TLV database test and benchmark. The card records are built from the
+// SDA, DDA and CDA test vectors.
+//-----------------------------------------------------------------------------
+
+#include "tlv_test.h"
+
+#include "../tlv.h"
+#include "util_posix.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+// test vectors from sda_test.c, dda_test.c and cda_test.c
+extern const unsigned char issuer_cert[128], issuer_rem[36], issuer_exp[1], ssd1[51];
+extern const unsigned char d_issuer_cert[176], d_issuer_rem[36], d_issuer_exp[1], d_icc_cert[176], d_icc_exp[1], d_ssd1[129], d_pan[8];
+extern const unsigned char c_issuer_cert[176], c_issuer_rem[36], c_issuer_exp[1], c_icc_cert[176], c_icc_exp[1], c_ssd1[129], c_pan[8], c_dd2[30];
+
+#define TLV_TEST_MAX_RECORDS	16
+#define TLV_TEST_PARSE_LOOPS	100000
+#define TLV_TEST_LOOKUP_LOOPS	100000
+
+struct tlv_test_record {
+	unsigned char data[256];
+	size_t len;
+};
+
+static struct tlv_test_record records[TLV_TEST_MAX_RECORDS];
+static int records_count;
+
+// tags looked up by the ODA functions, some of them are not present in the records
+static const tlv_tag_t lookup_tags[] = {
+	0x5a, 0x82, 0x8f, 0x90, 0x92, 0x93, 0x9f32, 0x9f46, 0x9f47, 0x9f48, 0x9f4a, 0x9f4b, 0x9f36, 0x9f37, 0x9f2d, 0x21
+};
+
+static bool add_tlv(struct tlv_test_record *rec, tlv_tag_t tag, size_t len, const unsigned char *value)
+{
+	struct tlv tlv = { .tag = tag, .len = len, .value = value };
+	size_t enc_len;
+	unsigned char *enc = tlv_encode(&tlv, &enc_len);
+
+	if (!enc)
+		return false;
+	if (rec->len + enc_len > sizeof(rec->data)) {
+		free(enc);
+		return false;
+	}
+	memcpy(rec->data + rec->len, enc, enc_len);
+	rec->len += enc_len;
+	free(enc);
+
+	return true;
+}
+
+// wrap the content of rec into a READ RECORD response template (tag 70)
+static bool add_record(struct tlv_test_record *rec)
+{
+	if (records_count == TLV_TEST_MAX_RECORDS)
+		return false;
+
+	records[records_count].len = 0;
+	if (!add_tlv(&records[records_count], 0x70, rec->len, rec->data))
+		return false;
+	records_count++;
+	rec->len = 0;
+
+	return true;
+}
+
+static bool add_raw_record(const unsigned char *data, size_t len)
+{
+	if (records_count == TLV_TEST_MAX_RECORDS || len > sizeof(records[0].data))
+		return false;
+
+	memcpy(records[records_count].data, data, len);
+	records[records_count].len = len;
+	records_count++;
+
+	return true;
+}
+
+static bool build_records(void)
+{
+	struct tlv_test_record rec = { .len = 0 };
+	const unsigned char gpo_sda[] = { 0x82, 0x02, 0x40, 0x00, 0x94, 0x04, 0x08, 0x01, 0x01, 0x01 };
+	const unsigned char gpo_dda[] = { 0x77, 0x0e, 0x82, 0x02, 0x20, 0x00, 0x94, 0x08, 0x08, 0x01, 0x02, 0x01, 0x10, 0x01, 0x01, 0x00 };
+
+	records_count = 0;
+
+	// SDA card
+	if (!add_raw_record(gpo_sda, sizeof(gpo_sda)))
+		return false;
+	memcpy(rec.data, ssd1, sizeof(ssd1));
+	rec.len = sizeof(ssd1);
+	if (!add_record(&rec))
+		return false;
+	if (!add_tlv(&rec, 0x8f, 1, (const unsigned char *)"\x01") ||
+		!add_tlv(&rec, 0x90, sizeof(issuer_cert), issuer_cert) ||
+		!add_tlv(&rec, 0x9f32, sizeof(issuer_exp), issuer_exp) ||
+		!add_tlv(&rec, 0x92, sizeof(issuer_rem), issuer_rem) ||
+		!add_record(&rec))
+		return false;
+
+	// DDA card
+	if (!add_raw_record(gpo_dda, sizeof(gpo_dda)))
+		return false;
+	memcpy(rec.data, d_ssd1, sizeof(d_ssd1));
+	rec.len = sizeof(d_ssd1);
+	if (!add_record(&rec))
+		return false;
+	if (!add_tlv(&rec, 0x90, sizeof(d_issuer_cert), d_issuer_cert) ||
+		!add_tlv(&rec, 0x9f32, sizeof(d_issuer_exp), d_issuer_exp) ||
+		!add_tlv(&rec, 0x92, sizeof(d_issuer_rem), d_issuer_rem) ||
+		!add_record(&rec))
+		return false;
+	if (!add_tlv(&rec, 0x9f46, sizeof(d_icc_cert), d_icc_cert) ||
+		!add_tlv(&rec, 0x9f47, sizeof(d_icc_exp), d_icc_exp) ||
+		!add_record(&rec))
+		return false;
+
+	// CDA card, with the GENERATE AC response
+	memcpy(rec.data, c_ssd1, sizeof(c_ssd1));
+	rec.len = sizeof(c_ssd1);
+	if (!add_record(&rec))
+		return false;
+	if (!add_tlv(&rec, 0x90, sizeof(c_issuer_cert), c_issuer_cert) ||
+		!add_tlv(&rec, 0x9f32, sizeof(c_issuer_exp), c_issuer_exp) ||
+		!add_tlv(&rec, 0x92, sizeof(c_issuer_rem), c_issuer_rem) ||
+		!add_record(&rec))
+		return false;
+	if (!add_tlv(&rec, 0x9f46, sizeof(c_icc_cert), c_icc_cert) ||
+		!add_tlv(&rec, 0x9f47, sizeof(c_icc_exp), c_icc_exp) ||
+		!add_record(&rec))
+		return false;
+	if (!add_raw_record(c_dd2, sizeof(c_dd2)))
+		return false;
+
+	return true;
+}
+
+// parse all records and link them together, like the EMV transaction does
+static struct tlvdb *parse_records(void)
+{
+	struct tlvdb *db = NULL;
+
+	for (int i = 0; i < records_count; i++) {
+		struct tlvdb *t = tlvdb_parse_multi(records[i].data, records[i].len);
+		if (!t) {
+			tlvdb_free(db);
+			return NULL;
+		}
+		if (db)
+			tlvdb_add(db, t);
+		else
+			db = t;
+	}
+
+	return db;
+}
+
+static bool check_value(const struct tlv *tlv, const unsigned char *value, size_t len)
+{
+	return tlv && tlv->len == len && !memcmp(tlv->value, value, len);
+}
+
+static int tlv_test_lookup(struct tlvdb *db, bool verbose)
+{
+	const struct tlv *tlv;
+	struct tlvdb *tdb;
+
+	// first occurence of a tag in the whole chain, and the following ones
+	tlv = tlvdb_get(db, 0x90, NULL);
+	if (!check_value(tlv, issuer_cert, sizeof(issuer_cert)))
+		return 1;
+	tlv = tlvdb_get(db, 0x90, tlv);
+	if (!check_value(tlv, d_issuer_cert, sizeof(d_issuer_cert)))
+		return 1;
+	tlv = tlvdb_get(db, 0x90, tlv);
+	if (!check_value(tlv, c_issuer_cert, sizeof(c_issuer_cert)))
+		return 1;
+	if (tlvdb_get(db, 0x90, tlv))
+		return 1;
+
+	// tags in nested templates and at the top level
+	if (!check_value(tlvdb_get(db, 0x5a, NULL), &ssd1[8], 8))
+		return 1;
+	if (!check_value(tlvdb_get(db, 0x9f46, NULL), d_icc_cert, sizeof(d_icc_cert)))
+		return 1;
+	if (!check_value(tlvdb_get(db, 0x9f36, NULL), (const unsigned char *)"\x00\x10", 2))
+		return 1;
+	if (!check_value(tlvdb_get(db, 0x82, NULL), (const unsigned char *)"\x40\x00", 2))
+		return 1;
+	if (tlvdb_get(db, 0x9f4b, NULL))
+		return 1;
+
+	// tlvdb_find() only looks at the elements of the same level
+	int count = 0;
+	for (tdb = tlvdb_find(db, 0x70); tdb; tdb = tlvdb_find_next(tdb, 0x70))
+		count++;
+	if (count != records_count - 3)
+		return 1;
+	if (tlvdb_find(db, 0x5a))
+		return 1;
+
+	tlv_tag_t path[] = { 0x77, 0x94, 0x00 };
+	tdb = tlvdb_find_path(db, path);
+	if (!tdb || !check_value(tlvdb_get(tdb, 0x94, NULL), (const unsigned char *)"\x08\x01\x02\x01\x10\x01\x01\x00", 8))
+		return 1;
+
+	// only the root element of an arena can be linked behind another database, adding an element
+	// from the middle of one is ignored. Otherwise the chain would run into a loop here.
+	tlvdb_add(db, tdb);
+	count = 0;
+	for (tlv = tlvdb_get(db, 0x90, NULL); tlv && count < 4; tlv = tlvdb_get(db, 0x90, tlv))
+		count++;
+	if (count != 3)
+		return 1;
+
+	tdb = tlvdb_find(db, 0x70);
+	if (!check_value(tlvdb_get_inchild(tdb, 0x5a, NULL), &ssd1[8], 8))
+		return 1;
+
+	if (verbose)
+		printf("TLV lookup: %d records checked\n", records_count);
+
+	return 0;
+}
+
+static int tlv_test_bench(bool verbose)
+{
+	size_t total_len = 0;
+	for (int i = 0; i < records_count; i++)
+		total_len += records[i].len;
+
+	uint64_t start_time = msclock();
+	for (int i = 0; i < TLV_TEST_PARSE_LOOPS; i++) {
+		struct tlvdb *db = parse_records();
+		if (!db)
+			return 1;
+		tlvdb_free(db);
+	}
+	uint64_t parse_time = msclock() - start_time;
+
+	struct tlvdb *db = parse_records();
+	if (!db)
+		return 1;
+
+	size_t found = 0;
+	start_time = msclock();
+	for (int i = 0; i < TLV_TEST_LOOKUP_LOOPS; i++) {
+		for (int j = 0; j < sizeof(lookup_tags) / sizeof(lookup_tags[0]); j++) {
+			if (tlvdb_get(db, lookup_tags[j], NULL))
+				found++;
+		}
+	}
+	uint64_t lookup_time = msclock() - start_time;
+	tlvdb_free(db);
+
+	if (found != TLV_TEST_LOOKUP_LOOPS * 10)
+		return 1;
+
+	printf("TLV parse: %d records (%zu bytes) in %.2f us, lookup: %.1f ns per tag\n",
+		records_count, total_len,
+		1000.0 * parse_time / TLV_TEST_PARSE_LOOPS,
+		1e6 * lookup_time / (TLV_TEST_LOOKUP_LOOPS * (sizeof(lookup_tags) / sizeof(lookup_tags[0]))));
+
+	return 0;
+}
+
+int exec_tlv_test(bool verbose)
+{
+	int ret;
+	fprintf(stdout, "\n");
+
+	if (!build_records()) {
+		fprintf(stderr, "TLV test: can't build records\n");
+		return 1;
+	}
+
+	struct tlvdb *db = parse_records();
+	if (!db) {
+		fprintf(stderr, "TLV parse test: failed\n");
+		return 1;
+	}
+	fprintf(stdout, "TLV parse test: passed\n");
+
+	ret = tlv_test_lookup(db, verbose);
+	tlvdb_free(db);
+	if (ret) {
+		fprintf(stderr, "TLV lookup test: failed\n");
+		return ret;
+	}
+	fprintf(stdout, "TLV lookup test: passed\n");
+
+	ret = tlv_test_bench(verbose);
+	if (ret) {
+		fprintf(stderr, "TLV benchmark: failed\n");
+		return ret;
+	}
+
+	return 0;
+}
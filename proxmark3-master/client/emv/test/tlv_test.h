@@ -0,0 +1,11 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// TLV database test and benchmark
+//-----------------------------------------------------------------------------
+
+#include <stdbool.h>
+
+extern int exec_tlv_test(bool verbose);
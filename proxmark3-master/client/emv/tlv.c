@@ -46,10 +46,22 @@ struct tlvdb {
 	struct tlvdb *next;
 	struct tlvdb *parent;
 	struct tlvdb *children;
+	struct tlvdb *next_same_tag;	// next element with this tag in the same arena, in tlvdb_get() order
+	struct tlvdb_root *root;	// arena the element was allocated from
+	size_t seq;			// position of the element in the arena, in tlvdb_get() order
 };
 
+// Every parsed buffer lives in one allocation (an arena): the root element, the elements below it,
+// a tag hash index and a copy of the buffer. The elements are allocated in tlvdb_get() order, so
+// searching from an element on is searching the elements with a higher sequence number.
 struct tlvdb_root {
 	struct tlvdb db;
+	struct tlvdb *last;		// last top level element, tlvdb_add() links the next arena to it
+	size_t count;			// number of elements, including db
+	size_t max_count;
+	struct tlvdb *nodes;		// elements 1..max_count-1
+	size_t index_mask;
+	struct tlvdb **index;		// first element of each tag, NULL for tlvdb_fixed() and tlvdb_external()
 	size_t len;
 	unsigned char buf[0];
 };
@@ -123,6 +135,20 @@ bool tlv_parse_tl(const unsigned char **buf, size_t *len, struct tlv *tlv)
 
 static struct tlvdb *tlvdb_parse_children(struct tlvdb *parent);
 
+static struct tlvdb *tlvdb_alloc(struct tlvdb_root *root)
+{
+	struct tlvdb *tlvdb;
+
+	if (root->count == root->max_count)
+		return NULL;
+
+	tlvdb = &root->nodes[root->count - 1];
+	tlvdb->root = root;
+	tlvdb->seq = root->count++;
+
+	return tlvdb;
+}
+
 static bool tlvdb_parse_one(struct tlvdb *tlvdb,
 		struct tlvdb *parent,
 		const unsigned char **tmp,
@@ -168,7 +194,9 @@ static struct tlvdb *tlvdb_parse_children(struct tlvdb *parent)
 	struct tlvdb *tlvdb, *first = NULL, *prev = NULL;
 
 	while (left != 0) {
-		tlvdb = malloc(sizeof(*tlvdb));
+		tlvdb = tlvdb_alloc(parent->root);
+		if (!tlvdb)
+			return NULL;
 		if (prev)
 			prev->next = tlvdb;
 		else
@@ -176,17 +204,81 @@ static struct tlvdb *tlvdb_parse_children(struct tlvdb *parent)
 		prev = tlvdb;
 
 		if (!tlvdb_parse_one(tlvdb, parent, &tmp, &left))
-			goto err;
-
-		tlvdb->parent = parent;
+			return NULL;
 	}
 
 	return first;
+}
 
-err:
-	tlvdb_free(first);
+static inline size_t tlvdb_hash(const struct tlvdb_root *root, tlv_tag_t tag)
+{
+	return ((tag * 0x9e37U) >> 8) & root->index_mask;
+}
 
-	return NULL;
+static struct tlvdb_root *tlvdb_root_alloc(size_t len, size_t max_count, size_t index_size)
+{
+	struct tlvdb_root *root;
+	// the elements and the index follow the buffer copy
+	size_t buf_size = (len + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	size_t nodes_size = (max_count - 1) * sizeof(struct tlvdb);
+
+	root = malloc(sizeof(*root) + buf_size + nodes_size + index_size * sizeof(struct tlvdb *));
+	if (!root)
+		return NULL;
+
+	root->db.parent = root->db.next = root->db.children = root->db.next_same_tag = NULL;
+	root->db.root = root;
+	root->db.seq = 0;
+	root->last = &root->db;
+	root->count = 1;
+	root->max_count = max_count;
+	root->nodes = (struct tlvdb *)(root->buf + buf_size);
+	root->index = index_size ? (struct tlvdb **)(root->nodes + max_count - 1) : NULL;
+	root->index_mask = 0;
+	root->len = len;
+
+	return root;
+}
+
+static struct tlvdb_root *tlvdb_parse_alloc(const unsigned char *buf, size_t len)
+{
+	// every element takes at least two bytes (tag and length)
+	size_t max_count = len / 2 + 1;
+	size_t index_size = 8;
+
+	while (index_size < 2 * max_count)
+		index_size <<= 1;
+
+	struct tlvdb_root *root = tlvdb_root_alloc(len, max_count, index_size);
+	if (!root)
+		return NULL;
+
+	memcpy(root->buf, buf, len);
+
+	return root;
+}
+
+// build the tag index, sized for the elements actually parsed. Going backwards keeps the
+// next_same_tag lists in element order.
+static void tlvdb_index(struct tlvdb_root *root)
+{
+	size_t index_size = 8;
+
+	while (index_size < 2 * root->count)
+		index_size <<= 1;
+	root->index_mask = index_size - 1;
+	memset(root->index, 0, index_size * sizeof(struct tlvdb *));
+
+	for (size_t i = root->count; i > 0; i--) {
+		struct tlvdb *tlvdb = (i == 1) ? &root->db : &root->nodes[i - 2];
+		size_t h = tlvdb_hash(root, tlvdb->tag.tag);
+
+		while (root->index[h] && root->index[h]->tag.tag != tlvdb->tag.tag)
+			h = (h + 1) & root->index_mask;
+
+		tlvdb->next_same_tag = root->index[h];
+		root->index[h] = tlvdb;
+	}
 }
 
 struct tlvdb *tlvdb_parse(const unsigned char *buf, size_t len)
@@ -198,9 +290,9 @@ struct tlvdb *tlvdb_parse(const unsigned char *buf, size_t len)
 	if (!len || !buf)
 		return NULL;
 
-	root = malloc(sizeof(*root) + len);
-	root->len = len;
-	memcpy(root->buf, buf, len);
+	root = tlvdb_parse_alloc(buf, len);
+	if (!root)
+		return NULL;
 
 	tmp = root->buf;
 	left = len;
@@ -211,10 +303,12 @@ struct tlvdb *tlvdb_parse(const unsigned char *buf, size_t len)
 	if (left)
 		goto err;
 
+	tlvdb_index(root);
+
 	return &root->db;
 
 err:
-	tlvdb_free(&root->db);
+	free(root);
 
 	return NULL;
 }
@@ -228,9 +322,9 @@ struct tlvdb *tlvdb_parse_multi(const unsigned char *buf, size_t len)
 	if (!len || !buf)
 		return NULL;
 
-	root = malloc(sizeof(*root) + len);
-	root->len = len;
-	memcpy(root->buf, buf, len);
+	root = tlvdb_parse_alloc(buf, len);
+	if (!root)
+		return NULL;
 
 	tmp = root->buf;
 	left = len;
@@ -239,31 +333,30 @@ struct tlvdb *tlvdb_parse_multi(const unsigned char *buf, size_t len)
 		goto err;
 
 	while (left != 0) {
-		struct tlvdb *db = malloc(sizeof(*db));
-		if (!tlvdb_parse_one(db, NULL, &tmp, &left)) {
-			free (db);
+		struct tlvdb *db = tlvdb_alloc(root);
+		if (!db || !tlvdb_parse_one(db, NULL, &tmp, &left))
 			goto err;
-		}
 
-		tlvdb_add(&root->db, db);
+		root->last->next = db;
+		root->last = db;
 	}
 
+	tlvdb_index(root);
+
 	return &root->db;
 
 err:
-	tlvdb_free(&root->db);
+	free(root);
 
 	return NULL;
 }
 
 struct tlvdb *tlvdb_fixed(tlv_tag_t tag, size_t len, const unsigned char *value)
 {
-	struct tlvdb_root *root = malloc(sizeof(*root) + len);
+	struct tlvdb_root *root = tlvdb_root_alloc(len, 1, 0);
 
-	root->len = len;
 	memcpy(root->buf, value, len);
 
-	root->db.parent = root->db.next = root->db.children = NULL;
 	root->db.tag.tag = tag;
 	root->db.tag.len = len;
 	root->db.tag.value = root->buf;
@@ -273,11 +366,8 @@ struct tlvdb *tlvdb_fixed(tlv_tag_t tag, size_t len, const unsigned char *value)
 
 struct tlvdb *tlvdb_external(tlv_tag_t tag, size_t len, const unsigned char *value)
 {
-	struct tlvdb_root *root = malloc(sizeof(*root));
-
-	root->len = 0;
+	struct tlvdb_root *root = tlvdb_root_alloc(0, 1, 0);
 
-	root->db.parent = root->db.next = root->db.children = NULL;
 	root->db.tag.tag = tag;
 	root->db.tag.len = len;
 	root->db.tag.value = value;
@@ -285,20 +375,48 @@ struct tlvdb *tlvdb_external(tlv_tag_t tag, size_t len, const unsigned char *val
 	return &root->db;
 }
 
+// arena linked behind root by tlvdb_add()
+static inline struct tlvdb_root *tlvdb_next_root(const struct tlvdb_root *root)
+{
+	return root->last->next ? root->last->next->root : NULL;
+}
+
 void tlvdb_free(struct tlvdb *tlvdb)
 {
-	struct tlvdb *next = NULL;
+	struct tlvdb_root *root, *next;
 
 	if (!tlvdb)
 		return;
 
-	for (; tlvdb; tlvdb = next) {
-		next = tlvdb->next;
-		tlvdb_free(tlvdb->children);
-		free(tlvdb);
+	for (root = tlvdb->root; root; root = next) {
+		next = tlvdb_next_root(root);
+		free(root);
 	}
 }
 
+// first element of the arena with this tag at or after position seq
+static struct tlvdb *tlvdb_root_get(const struct tlvdb_root *root, tlv_tag_t tag, size_t seq)
+{
+	struct tlvdb *tlvdb;
+
+	if (!root->index) {
+		if (seq == 0 && root->db.tag.tag == tag)
+			return (struct tlvdb *)&root->db;
+		return NULL;
+	}
+
+	size_t h = tlvdb_hash(root, tag);
+	while ((tlvdb = root->index[h]) && tlvdb->tag.tag != tag)
+		h = (h + 1) & root->index_mask;
+
+	for (; tlvdb; tlvdb = tlvdb->next_same_tag) {
+		if (tlvdb->seq >= seq)
+			return tlvdb;
+	}
+
+	return NULL;
+}
+
 struct tlvdb *tlvdb_find_next(struct tlvdb *tlvdb, tlv_tag_t tag) {
 	if (!tlvdb)
 		return NULL;
@@ -309,10 +427,20 @@ struct tlvdb *tlvdb_find_next(struct tlvdb *tlvdb, tlv_tag_t tag) {
 struct tlvdb *tlvdb_find(struct tlvdb *tlvdb, tlv_tag_t tag) {
 	if (!tlvdb)
 		return NULL;
-	
-	for (; tlvdb; tlvdb = tlvdb->next) {
-		if (tlvdb->tag.tag == tag)
-			return tlvdb;
+
+	// the elements following tlvdb on the same level are the ones with the same parent
+	struct tlvdb *parent = tlvdb->parent;
+	const struct tlvdb_root *root = tlvdb->root;
+	size_t seq = tlvdb->seq;
+
+	for (; root; root = tlvdb_next_root(root), seq = 0) {
+		for (tlvdb = tlvdb_root_get(root, tag, seq); tlvdb; tlvdb = tlvdb->next_same_tag) {
+			if (tlvdb->parent == parent)
+				return tlvdb;
+		}
+		// only the top level continues in the next arena
+		if (parent)
+			break;
 	}
 
 	return NULL;
@@ -333,13 +461,23 @@ struct tlvdb *tlvdb_find_path(struct tlvdb *tlvdb, tlv_tag_t tag[]) {
 	return tnext;
 }
 
+// Link the database other behind the last top level element of tlvdb. Every element lives in an
+// arena, so other has to be the root element of its arena (as returned by tlvdb_parse(),
+// tlvdb_fixed() etc.): tlvdb_find(), tlvdb_get() and tlvdb_free() continue in the next arena
+// behind the last element of an arena, not behind arbitrary elements. tlvdb_free() of the first
+// database frees all arenas added to it.
 void tlvdb_add(struct tlvdb *tlvdb, struct tlvdb *other)
 {
-	while (tlvdb->next) {
-		tlvdb = tlvdb->next;
+	if (!tlvdb || !other || other != &other->root->db)
+		return;
+
+	struct tlvdb_root *root = tlvdb->root;
+
+	while (root->last->next) {
+		root = root->last->next->root;
 	}
 
-	tlvdb->next = other;
+	root->last->next = other;
 }
 
 void tlvdb_visit(const struct tlvdb *tlvdb, tlv_cb cb, void *data, int level)
@@ -356,34 +494,26 @@ void tlvdb_visit(const struct tlvdb *tlvdb, tlv_cb cb, void *data, int level)
 	}
 }
 
-static const struct tlvdb *tlvdb_next(const struct tlvdb *tlvdb)
-{
-	if (tlvdb->children)
-		return tlvdb->children;
-
-	while (tlvdb) {
-		if (tlvdb->next)
-			return tlvdb->next;
-
-		tlvdb = tlvdb->parent;
-	}
-
-	return NULL;
-}
-
 const struct tlv *tlvdb_get(const struct tlvdb *tlvdb, tlv_tag_t tag, const struct tlv *prev)
 {
+	const struct tlvdb_root *root;
+	size_t seq;
+
+	// search everything behind prev (or from tlvdb on) in depth first order: the rest of
+	// its arena, then the arenas linked to it
 	if (prev) {
-//		tlvdb = tlvdb_next(container_of(prev, struct tlvdb, tag));
-		tlvdb = tlvdb_next((struct tlvdb *)prev);
+		tlvdb = (const struct tlvdb *)prev;
+		seq = tlvdb->seq + 1;
+	} else {
+		if (!tlvdb)
+			return NULL;
+		seq = tlvdb->seq;
 	}
 
-
-	while (tlvdb) {
-		if (tlvdb->tag.tag == tag)
-			return &tlvdb->tag;
-
-		tlvdb = tlvdb_next(tlvdb);
+	for (root = tlvdb->root; root; root = tlvdb_next_root(root), seq = 0) {
+		const struct tlvdb *found = tlvdb_root_get(root, tag, seq);
+		if (found)
+			return &found->tag;
 	}
 
 	return NULL;
@@ -20,6 +20,7 @@
 #include "elf.h"
 #include "proxendian.h"
 #include "usb_cmd.h"
+#include "crc32.h"
 
 void SendCommand(UsbCommand* txcmd);
 void ReceiveCommand(UsbCommand* rxcmd);
@@ -37,6 +38,23 @@ unsigned int current_command = CMD_UNKNOWN;
 
 #define BLOCK_SIZE             0x200
 
+// Windowed writes: an ACK is requested every WINDOW_SYNC_BLOCKS blocks and at most
+// WINDOW_SYNCS of them are outstanding, so up to 16 blocks are in flight.
+#define WINDOW_SYNC_BLOCKS     8
+#define WINDOW_SYNCS           2
+
+typedef struct {
+	uint32_t address;
+	uint32_t crc;
+	uint32_t blocks;
+} window_sync_t;
+
+static int windowed_write = 0;
+static uint32_t window_crc;         // running CRC of the windowed writes, as the bootrom computes it
+static uint32_t window_blocks;
+static window_sync_t window_syncs[WINDOW_SYNCS];
+static int window_sync_head, window_sync_count;
+
 static const uint8_t elf_ident[] = {
 	0x7f, 'E', 'L', 'F',
 	ELFCLASS32,
@@ -392,7 +410,14 @@ int flash_start_flashing(int enable_bl_writes,char *serial_port_name)
 			c.arg[2] = 0;
 		}
 		SendCommand(&c);
-		return wait_for_ack();
+		if (wait_for_ack() < 0)
+			return -1;
+
+		windowed_write = (state & DEVICE_INFO_FLAG_UNDERSTANDS_WINDOWED_WRITE) != 0;
+		window_crc = CRC32_PRESET;
+		window_blocks = 0;
+		window_sync_head = window_sync_count = 0;
+		return 0;
 	} else {
 		fprintf(stderr, "Note: Your bootloader does not understand the new START_FLASH command\n");
 		fprintf(stderr, "      It is recommended that you update your bootloader\n\n");
@@ -408,17 +433,171 @@ static int write_block(uint32_t address, uint8_t *data, uint32_t length)
 	memset(block_buf, 0xFF, BLOCK_SIZE);
 	memcpy(block_buf, data, length);
   UsbCommand c;
+	memset(&c, 0, sizeof(c));
 	c.cmd = CMD_FINISH_WRITE;
 	c.arg[0] = address;
-	memcpy(c.d.asBytes, block_buf, length);
+	memcpy(c.d.asBytes, block_buf, BLOCK_SIZE);
   SendCommand(&c);
   return wait_for_ack();
 }
 
+// Wait for the oldest outstanding sync and check the CRC of everything written up to it
+static int wait_for_window_sync(void)
+{
+	window_sync_t *sync = &window_syncs[(window_sync_head + WINDOW_SYNCS - window_sync_count) % WINDOW_SYNCS];
+	window_sync_count--;
+
+	UsbCommand ack;
+	ReceiveCommand(&ack);
+	if (ack.cmd == CMD_NACK) {
+		fprintf(stderr, "Error: Write of block 0x%08x failed\n", (uint32_t)ack.arg[0]);
+		return -1;
+	}
+	if (ack.cmd != CMD_ACK) {
+		fprintf(stderr, "Error: Unexpected reply 0x%04" PRIx64 " (expected ACK)\n", ack.cmd);
+		return -1;
+	}
+	if (ack.arg[0] != sync->address || ack.arg[1] != sync->crc || ack.arg[2] != sync->blocks) {
+		fprintf(stderr, "Error: Verify failed, the flash up to block 0x%08x does not have the contents written\n", sync->address);
+		return -1;
+	}
+	return 0;
+}
+
+static int write_block_windowed(uint32_t address, uint8_t *data, uint32_t length, int sync)
+{
+	UsbCommand c;
+	memset(&c, 0, sizeof(c));
+	c.cmd = CMD_FINISH_WRITE_WINDOWED;
+	c.arg[0] = address;
+	c.arg[1] = sync ? FINISH_WRITE_FLAG_SYNC : 0;
+	memset(c.d.asBytes, 0xFF, BLOCK_SIZE);
+	memcpy(c.d.asBytes, data, length);
+
+	window_crc = crc32_update(window_crc, c.d.asBytes, BLOCK_SIZE);
+	window_blocks++;
+
+	if (sync) {
+		if (window_sync_count == WINDOW_SYNCS && wait_for_window_sync() < 0)
+			return -1;
+		window_sync_t *s = &window_syncs[window_sync_head];
+		s->address = address;
+		s->crc = window_crc;
+		s->blocks = window_blocks;
+		window_sync_head = (window_sync_head + 1) % WINDOW_SYNCS;
+		window_sync_count++;
+	}
+
+	SendCommand(&c);
+	return 0;
+}
+
+// Ask the bootrom for the CRCs of the blocks, to skip the ones which already have the right contents
+static int read_block_crcs(uint32_t address, uint32_t blocks, uint32_t *crcs)
+{
+	while (blocks) {
+		uint32_t n = blocks;
+		if (n > USB_CMD_DATA_SIZE / 4)
+			n = USB_CMD_DATA_SIZE / 4;
+
+		UsbCommand c = {CMD_FLASH_BLOCK_CRCS, {address, n, 0}};
+		SendCommand(&c);
+		UsbCommand resp;
+		ReceiveCommand(&resp);
+		if (resp.cmd != CMD_ACK || resp.arg[0] != address || resp.arg[1] != n)
+			return -1;
+		for (uint32_t i = 0; i < n; i++)
+			crcs[i] = le32(resp.d.asDwords[i]);
+
+		crcs += n;
+		address += n * BLOCK_SIZE;
+		blocks -= n;
+	}
+	return 0;
+}
+
+static int flash_write_windowed(flash_file_t *ctx)
+{
+	for (int i = 0; i < ctx->num_segs; i++) {
+		flash_seg_t *seg = &ctx->segments[i];
+
+		uint32_t length = seg->length;
+		uint32_t blocks = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		uint32_t end = seg->start + length;
+
+		fprintf(stderr, " 0x%08x..0x%08x [0x%x / %d blocks]",
+		        seg->start, end - 1, length, blocks);
+
+		// blocks with the same CRC are not written again
+		uint8_t *changed = calloc(blocks, 1);
+		uint32_t *crcs = malloc(blocks * sizeof(uint32_t));
+		if (!changed || !crcs) {
+			fprintf(stderr, " ERROR\nOut of memory\n");
+			free(changed);
+			free(crcs);
+			return -1;
+		}
+		int have_crcs = read_block_crcs(seg->start, blocks, crcs) == 0;
+		uint32_t last_changed = 0, num_changed = 0;
+		for (uint32_t block = 0; block < blocks; block++) {
+			uint8_t block_buf[BLOCK_SIZE];
+			uint32_t block_size = length - block * BLOCK_SIZE;
+			if (block_size > BLOCK_SIZE)
+				block_size = BLOCK_SIZE;
+			memset(block_buf, 0xFF, BLOCK_SIZE);
+			memcpy(block_buf, (uint8_t *)seg->data + block * BLOCK_SIZE, block_size);
+			if (!have_crcs || crcs[block] != crc32_update(CRC32_PRESET, block_buf, BLOCK_SIZE)) {
+				changed[block] = 1;
+				last_changed = block;
+				num_changed++;
+			}
+		}
+		free(crcs);
+
+		uint32_t sent = 0;
+		for (uint32_t block = 0; block < blocks; block++) {
+			if (!changed[block]) {
+				fprintf(stderr, "-");
+				continue;
+			}
+			uint32_t offset = block * BLOCK_SIZE;
+			uint32_t block_size = length - offset;
+			if (block_size > BLOCK_SIZE)
+				block_size = BLOCK_SIZE;
+
+			sent++;
+			int sync = (sent % WINDOW_SYNC_BLOCKS) == 0 || block == last_changed;
+			if (write_block_windowed(seg->start + offset, (uint8_t *)seg->data + offset, block_size, sync) < 0) {
+				fprintf(stderr, " ERROR\n");
+				free(changed);
+				return -1;
+			}
+			fprintf(stderr, ".");
+		}
+		free(changed);
+
+		// the segment is only done when the last of its blocks is verified
+		while (window_sync_count) {
+			if (wait_for_window_sync() < 0) {
+				fprintf(stderr, " ERROR\n");
+				return -1;
+			}
+		}
+		if (num_changed < blocks)
+			fprintf(stderr, " OK, %d blocks unchanged\n", blocks - num_changed);
+		else
+			fprintf(stderr, " OK\n");
+	}
+	return 0;
+}
+
 // Write a file's segments to Flash
 int flash_write(flash_file_t *ctx)
 {
 	fprintf(stderr, "Writing segments for file: %s\n", ctx->filename);
+	if (windowed_write)
+		return flash_write_windowed(ctx);
+
 	for (int i = 0; i < ctx->num_segs; i++) {
 		flash_seg_t *seg = &ctx->segments[i];
 
@@ -21,6 +21,67 @@ int GraphTraceLen;
 
 int s_Buff[MAX_GRAPH_TRACE_LEN];
 
+// GraphBuffer and GraphTraceLen get a new version number on every change. The 8 bit
+// view of the samples, their high and low levels and the clock detection results are
+// kept with the version they were computed for, so detecting the clock again on an
+// unchanged trace (lf search, t55xx detect and the demod commands all do) costs nothing.
+// Version numbers are never reused, save_restoreGB() brings back the saved one.
+static uint32_t GraphVersion = 1;
+static uint32_t GraphVersionCounter = 1;
+
+static struct {
+	uint32_t version;
+	size_t size;
+	uint8_t samples[MAX_GRAPH_TRACE_LEN];
+} graphView;
+
+static struct {
+	uint32_t version;
+	int high;
+	int low;
+} graphHighLow;
+
+static struct {
+	uint32_t version;
+	int clock;
+	int start;
+} askClock;
+
+static struct {
+	uint32_t version;
+	int clock;
+	size_t firstPhaseShift;
+} pskClock;
+
+static struct {
+	uint32_t version;
+	int clock;
+	size_t clockStart;
+} nrzClock;
+
+// countFC() without and with the fsk adjustment
+static struct {
+	uint32_t version;
+	uint16_t fc;
+} fieldClocks[2];
+
+static struct {
+	uint32_t version;
+	uint8_t rf;
+	int firstClockEdge;
+} fskClock;
+
+// call after writing GraphBuffer or GraphTraceLen
+void GraphBufferChanged(void)
+{
+	GraphVersion = ++GraphVersionCounter;
+}
+
+uint32_t GetGraphVersion(void)
+{
+	return GraphVersion;
+}
+
 /* write a manchester bit to the graph */
 void AppendGraph(int redraw, int clock, int bit)
 {
@@ -31,6 +92,7 @@ void AppendGraph(int redraw, int clock, int bit)
   //set second half of the clock bit (all 0's or 1's for a 0 or 1 bit)
   for (i = (int)(clock / 2); i < clock; ++i)
     GraphBuffer[GraphTraceLen++] = bit ^ 1;
+  GraphBufferChanged();
 
   if (redraw)
     RepaintGraphWindow();
@@ -43,6 +105,7 @@ int ClearGraph(int redraw)
   memset(GraphBuffer, 0x00, GraphTraceLen);
 
   GraphTraceLen = 0;
+  GraphBufferChanged();
 
   if (redraw)
     RepaintGraphWindow();
@@ -56,15 +119,18 @@ void save_restoreGB(uint8_t saveOpt)
 	static int SavedGBlen=0;
 	static bool GB_Saved = false;
 	static int SavedGridOffsetAdj=0;
+	static uint32_t SavedVersion = 0;
 
 	if (saveOpt == GRAPH_SAVE) { //save
 		memcpy(SavedGB, GraphBuffer, sizeof(GraphBuffer));
 		SavedGBlen = GraphTraceLen;
 		GB_Saved=true;
 		SavedGridOffsetAdj = GridOffset;
+		SavedVersion = GraphVersion;
 	} else if (GB_Saved) { //restore
 		memcpy(GraphBuffer, SavedGB, sizeof(GraphBuffer));
 		GraphTraceLen = SavedGBlen;
+		GraphVersion = SavedVersion;
 		GridOffset = SavedGridOffsetAdj;
 		RepaintGraphWindow();
 	}
@@ -85,19 +151,43 @@ void setGraphBuf(uint8_t *buff, size_t size)
 		GraphBuffer[i]=buff[i]-128;
 	}
 	GraphTraceLen=size;
+	GraphBufferChanged();
 	RepaintGraphWindow();
 	return;
 }
+
+// The samples as unsigned bytes, GraphBuffer gets trimmed to -127..127 for it. The
+// detection functions only read it, except DetectST() (see GetAskClock()).
+static uint8_t *getGraphView(size_t *size)
+{
+	if (graphView.version != GraphVersion || graphView.size != GraphTraceLen) {
+		bool trimmed = false;
+		for (int i = 0; i < GraphTraceLen; ++i) {
+			int v = GraphBuffer[i];
+			if (v > 127) v = 127; //trim
+			if (v < -127) v = -127; //trim
+			trimmed |= v != GraphBuffer[i];
+			GraphBuffer[i] = v;
+			graphView.samples[i] = (uint8_t)(v + 128);
+		}
+		// trimming changes GraphBuffer, and a new length with the same version means it
+		// was written without GraphBufferChanged()
+		if (trimmed || (graphView.version == GraphVersion && graphView.size != GraphTraceLen))
+			GraphBufferChanged();
+		graphView.version = GraphVersion;
+		graphView.size = GraphTraceLen;
+	}
+	*size = graphView.size;
+	return graphView.samples;
+}
+
 size_t getFromGraphBuf(uint8_t *buff)
 {
 	if (buff == NULL ) return 0;
-	uint32_t i;
-	for (i=0;i<GraphTraceLen;++i){
-		if (GraphBuffer[i]>127) GraphBuffer[i]=127; //trim
-		if (GraphBuffer[i]<-127) GraphBuffer[i]=-127; //trim
-		buff[i]=(uint8_t)(GraphBuffer[i]+128);
-	}
-	return i;
+	size_t size;
+	const uint8_t *view = getGraphView(&size);
+	memcpy(buff, view, size);
+	return size;
 }
 
 // A simple test to see if there is any data inside Graphbuffer. 
@@ -132,6 +222,24 @@ void DetectHighLowInGraph(int *high, int *low, bool addFuzz) {
 	}
 }
 
+// Highest and lowest sample in GraphBuffer
+void GetGraphHighLow(int *high, int *low)
+{
+	if (graphHighLow.version != GraphVersion) {
+		int hi = GraphTraceLen > 0 ? GraphBuffer[0] : 0;
+		int lo = hi;
+		for (int i = 1; i < GraphTraceLen; ++i) {
+			hi = GraphBuffer[i] > hi ? GraphBuffer[i] : hi;
+			lo = GraphBuffer[i] < lo ? GraphBuffer[i] : lo;
+		}
+		graphHighLow.high = hi;
+		graphHighLow.low = lo;
+		graphHighLow.version = GraphVersion;
+	}
+	*high = graphHighLow.high;
+	*low = graphHighLow.low;
+}
+
 // Get or auto-detect ask clock rate
 int GetAskClock(const char str[], bool printAns, bool verbose)
 {
@@ -143,20 +251,30 @@ int GetAskClock(const char str[], bool printAns, bool verbose)
 	if (clock != 0) 
 		return clock;
 	// Auto-detect clock
-	uint8_t grph[MAX_GRAPH_TRACE_LEN]={0};
-	size_t size = getFromGraphBuf(grph);
-	if (size == 0) {
-		if (verbose)
-			PrintAndLog("Failed to copy from graphbuffer");
-		return -1;
-	}
-	//, size_t *ststart, size_t *stend
-	size_t ststart = 0, stend = 0;
-	bool st = DetectST(grph, &size, &clock, &ststart, &stend);
-	int start = stend;
-	if (st == false) {
-		start = DetectASKClock(grph, size, &clock, 20);
+	if (askClock.version != GraphVersion) {
+		size_t size;
+		uint8_t *grph = getGraphView(&size);
+		if (size == 0) {
+			if (verbose)
+				PrintAndLog("Failed to copy from graphbuffer");
+			return -1;
+		}
+		//, size_t *ststart, size_t *stend
+		size_t ststart = 0, stend = 0;
+		bool st = DetectST(grph, &size, &clock, &ststart, &stend);
+		int start = stend;
+		if (st == false) {
+			start = DetectASKClock(grph, size, &clock, 20);
+		} else {
+			// DetectST() cut the sequence terminators out of the view
+			graphView.version = 0;
+		}
+		askClock.clock = clock;
+		askClock.start = start;
+		askClock.version = GraphVersion;
 	}
+	clock = askClock.clock;
+	int start = askClock.start;
 	setClockGrid(clock, start);
 	// Only print this message if we're not looping something
 	if (printAns || g_debugMode) {
@@ -165,17 +283,29 @@ int GetAskClock(const char str[], bool printAns, bool verbose)
 	return clock;
 }
 
+// countFC() of the graph samples
+static uint16_t getFieldClocks(uint8_t fskAdj)
+{
+	if (fieldClocks[fskAdj].version != GraphVersion) {
+		size_t size;
+		uint8_t *grph = getGraphView(&size);
+		fieldClocks[fskAdj].fc = countFC(grph, size, fskAdj);
+		fieldClocks[fskAdj].version = GraphVersion;
+	}
+	return fieldClocks[fskAdj].fc;
+}
+
 uint8_t GetPskCarrier(const char str[], bool printAns, bool verbose)
 {
 	uint8_t carrier=0;
-	uint8_t grph[MAX_GRAPH_TRACE_LEN]={0};
-	size_t size = getFromGraphBuf(grph);
+	size_t size;
+	getGraphView(&size);
 	if ( size == 0 ) {
 		if (verbose) 
 			PrintAndLog("Failed to copy from graphbuffer");
 		return 0;
 	}
-	uint16_t fc = countFC(grph,size,0);
+	uint16_t fc = getFieldClocks(0);
 	carrier = fc & 0xFF;
 	if (carrier != 2 && carrier != 4 && carrier != 8) return 0;
 	if ((fc>>8) == 10 && carrier == 8) return 0;
@@ -196,17 +326,22 @@ int GetPskClock(const char str[], bool printAns, bool verbose)
 	if (clock!=0) 
 		return clock;
 	// Auto-detect clock
-	uint8_t grph[MAX_GRAPH_TRACE_LEN]={0};
-	size_t size = getFromGraphBuf(grph);
-	if ( size == 0 ) {
-		if (verbose) 
-			PrintAndLog("Failed to copy from graphbuffer");
-		return -1;
+	if (pskClock.version != GraphVersion) {
+		size_t size;
+		uint8_t *grph = getGraphView(&size);
+		if ( size == 0 ) {
+			if (verbose) 
+				PrintAndLog("Failed to copy from graphbuffer");
+			return -1;
+		}
+		size_t firstPhaseShiftLoc = 0;
+		uint8_t curPhase = 0, fc = 0;
+		pskClock.clock = DetectPSKClock(grph, size, 0, &firstPhaseShiftLoc, &curPhase, &fc);
+		pskClock.firstPhaseShift = firstPhaseShiftLoc;
+		pskClock.version = GraphVersion;
 	}
-	size_t firstPhaseShiftLoc = 0;
-	uint8_t curPhase = 0, fc = 0;
-	clock = DetectPSKClock(grph, size, 0, &firstPhaseShiftLoc, &curPhase, &fc);
-	setClockGrid(clock, firstPhaseShiftLoc);
+	clock = pskClock.clock;
+	setClockGrid(clock, pskClock.firstPhaseShift);
 	// Only print this message if we're not looping something
 	if (printAns){
 		PrintAndLog("Auto-detected clock rate: %d", clock);
@@ -224,16 +359,21 @@ uint8_t GetNrzClock(const char str[], bool printAns, bool verbose)
 	if (clock!=0) 
 		return clock;
 	// Auto-detect clock
-	uint8_t grph[MAX_GRAPH_TRACE_LEN]={0};
-	size_t size = getFromGraphBuf(grph);
-	if ( size == 0 ) {
-		if (verbose) 
-			PrintAndLog("Failed to copy from graphbuffer");
-		return -1;
+	if (nrzClock.version != GraphVersion) {
+		size_t size;
+		uint8_t *grph = getGraphView(&size);
+		if ( size == 0 ) {
+			if (verbose) 
+				PrintAndLog("Failed to copy from graphbuffer");
+			return -1;
+		}
+		size_t clkStartIdx = 0;
+		nrzClock.clock = DetectNRZClock(grph, size, 0, &clkStartIdx);
+		nrzClock.clockStart = clkStartIdx;
+		nrzClock.version = GraphVersion;
 	}
-	size_t clkStartIdx = 0;
-	clock = DetectNRZClock(grph, size, 0, &clkStartIdx);
-	setClockGrid(clock, clkStartIdx);
+	clock = nrzClock.clock;
+	setClockGrid(clock, nrzClock.clockStart);
 	// Only print this message if we're not looping something
 	if (printAns){
 		PrintAndLog("Auto-detected clock rate: %d", clock);
@@ -268,18 +408,24 @@ uint8_t GetFskClock(const char str[], bool printAns, bool verbose)
 }
 uint8_t fskClocks(uint8_t *fc1, uint8_t *fc2, uint8_t *rf1, bool verbose, int *firstClockEdge)
 {
-	uint8_t BitStream[MAX_GRAPH_TRACE_LEN]={0};
-	size_t size = getFromGraphBuf(BitStream);
+	size_t size;
+	getGraphView(&size);
 	if (size==0) return 0;
-	uint16_t ans = countFC(BitStream, size, 1); 
+	uint16_t ans = getFieldClocks(1);
 	if (ans==0) {
 		if (verbose || g_debugMode) PrintAndLog("DEBUG: No data found");
 		return 0;
 	}
 	*fc1 = (ans >> 8) & 0xFF;
 	*fc2 = ans & 0xFF;
-	//int firstClockEdge = 0;
-	*rf1 = detectFSKClk(BitStream, size, *fc1, *fc2, firstClockEdge);
+	if (fskClock.version != GraphVersion) {
+		uint8_t *BitStream = getGraphView(&size);
+		fskClock.firstClockEdge = 0;
+		fskClock.rf = detectFSKClk(BitStream, size, *fc1, *fc2, &fskClock.firstClockEdge);
+		fskClock.version = GraphVersion;
+	}
+	*rf1 = fskClock.rf;
+	*firstClockEdge = fskClock.firstClockEdge;
 	if (*rf1==0) {
 		if (verbose || g_debugMode) PrintAndLog("DEBUG: Clock detect error");
 		return 0;
@@ -26,9 +26,14 @@ uint8_t fskClocks(uint8_t *fc1, uint8_t *fc2, uint8_t *rf1, bool verbose, int *f
 bool graphJustNoise(int *BitStream, int size);
 void setGraphBuf(uint8_t *buff, size_t size);
 void save_restoreGB(uint8_t saveOpt);
+// call after writing GraphBuffer or GraphTraceLen, it drops the cached clock detection
+void GraphBufferChanged(void);
+// changes with every GraphBufferChanged(), never 0
+uint32_t GetGraphVersion(void);
 
 bool HasGraphData();
 void DetectHighLowInGraph(int *high, int *low, bool addFuzz); 
+void GetGraphHighLow(int *high, int *low);
 
 // Max graph trace len: 40000 (bigbuf) * 8 (at 1 bit per sample)
 #define MAX_GRAPH_TRACE_LEN (40000 * 8 )
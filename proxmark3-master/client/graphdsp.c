@@ -0,0 +1,442 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Transforms of the graph sample buffer for the data commands and the GUI sliders.
+//
+// The loops are in graphdsp_core.c, compiled for each instruction set, and run on
+// the best one of the CPU (or the one chosen for hardnested). The results are the
+// same as those of the scalar code they replace, which the self test checks.
+//-----------------------------------------------------------------------------
+
+#include "graphdsp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include "graphdsp_core.h"
+#include "ui.h"
+#include "util_posix.h"
+
+static const graphdsp_kernels_t *kernels(void)
+{
+	return graphdsp_kernels(GetSIMDInstrAuto());
+}
+
+
+static void samples_from_u8(const graphdsp_kernels_t *k, const uint8_t *in, int *out, int len)
+{
+	k->u8_to_samples(in, out, len);
+}
+
+
+static void hpf(const graphdsp_kernels_t *k, int *buf, int len)
+{
+	if (len <= 10) return;
+	// the sum in an int, as it always was
+	int accum = (int32_t)k->sum(buf + 10, len - 10);
+	accum /= (len - 10);
+	k->offset(buf, len, -accum);
+}
+
+
+static void norm(const graphdsp_kernels_t *k, int *buf, int len)
+{
+	int max = INT_MIN, min = INT_MAX;
+
+	if (len <= 10) return;
+	k->minmax(buf + 10, len - 10, &min, &max);
+	if (max == min) return;
+
+	int mid = (max + min) / 2;
+	// the first 10 samples can be way out of min..max, they get the exact integer formula
+	for (int i = 0; i < 10; i++) {
+		buf[i] = ((long)(buf[i] - mid) * 256) / (max - min);
+	}
+	k->scale(buf + 10, len - 10, mid, max - min);
+}
+
+
+static int decimate(const graphdsp_kernels_t *k, int *buf, int len)
+{
+	k->decimate(buf, len);
+	return len / 2;
+}
+
+
+static void shift_zero(const graphdsp_kernels_t *k, int *buf, int len, int shift)
+{
+	k->clip(buf, len, shift, -127, 127);
+	norm(k, buf, len);
+}
+
+
+void dsp_samples_from_u8(const uint8_t *in, int *out, int len)
+{
+	samples_from_u8(kernels(), in, out, len);
+}
+
+
+void dsp_hpf(int *buf, int len)
+{
+	hpf(kernels(), buf, len);
+}
+
+
+void dsp_norm(int *buf, int len)
+{
+	norm(kernels(), buf, len);
+}
+
+
+int dsp_decimate(int *buf, int len)
+{
+	return decimate(kernels(), buf, len);
+}
+
+
+void dsp_shift_zero(int *buf, int len, int shift)
+{
+	shift_zero(kernels(), buf, len, shift);
+}
+
+
+void dsp_ask_edge_detect(const int *in, int *out, int len, int threshold)
+{
+	kernels()->ask_edges(in, out, len, threshold);
+}
+
+
+void dsp_directional_threshold(const int *in, int *out, int len, int up, int down)
+{
+	kernels()->dir_threshold(in, out, len, up, down);
+}
+
+
+void dsp_zero_crossings(int *buf, int len)
+{
+	kernels()->zero_crossings(buf, len);
+}
+
+
+//-----------------------------------------------------------------------------
+// Self test: the scalar code of the data commands, as it was, against every
+// instruction set the CPU has
+//-----------------------------------------------------------------------------
+
+static void ref_samples_from_u8(const uint8_t *in, int *out, int len)
+{
+	for (int j = 0; j < len; j++) {
+		out[j] = ((int)in[j]) - 128;
+	}
+}
+
+
+static void ref_hpf(int *buf, int len)
+{
+	int i;
+	int accum = 0;
+
+	if (len <= 10) return;
+	for (i = 10; i < len; ++i)
+		accum += buf[i];
+	accum /= (len - 10);
+	for (i = 0; i < len; ++i)
+		buf[i] -= accum;
+}
+
+
+static void ref_norm(int *buf, int len)
+{
+	int i;
+	int max = INT_MIN, min = INT_MAX;
+
+	if (len <= 10) return;
+	for (i = 10; i < len; ++i) {
+		if (buf[i] > max)
+			max = buf[i];
+		if (buf[i] < min)
+			min = buf[i];
+	}
+
+	if (max != min) {
+		for (i = 0; i < len; ++i) {
+			buf[i] = ((long)(buf[i] - ((max + min) / 2)) * 256) / (max - min);
+		}
+	}
+}
+
+
+static int ref_decimate(int *buf, int len)
+{
+	for (int i = 0; i < (len / 2); ++i)
+		buf[i] = buf[i * 2];
+	return len / 2;
+}
+
+
+static void ref_shift_zero(int *buf, int len, int shift)
+{
+	int shiftedVal = 0;
+	for (int i = 0; i < len; i++) {
+		shiftedVal = buf[i] + shift;
+		if (shiftedVal > 127)
+			shiftedVal = 127;
+		else if (shiftedVal < -127)
+			shiftedVal = -127;
+		buf[i] = shiftedVal;
+	}
+	ref_norm(buf, len);
+}
+
+
+static void ref_ask_edge_detect(const int *in, int *out, int len, int threshold)
+{
+	int Last = 0;
+	for (int i = 1; i < len; i++) {
+		if (in[i] - in[i-1] >= threshold)
+			Last = 127;
+		else if (in[i] - in[i-1] <= -1 * threshold)
+			Last = -127;
+		out[i-1] = Last;
+	}
+}
+
+
+static void ref_directional_threshold(const int *in, int *out, int len, int up, int down)
+{
+	int lastValue = in[0];
+	out[0] = 0;
+
+	for (int i = 1; i < len; ++i) {
+		if (in[i] >= up && in[i] > lastValue) {
+			lastValue = out[i];
+			out[i] = 1;
+		} else if (in[i] <= down && in[i] < lastValue) {
+			lastValue = out[i];
+			out[i] = -1;
+		} else {
+			lastValue = out[i];
+			out[i] = out[i-1];
+		}
+	}
+	out[0] = out[1];
+}
+
+
+static void ref_zero_crossings(int *buf, int len)
+{
+	int sign = 1;
+	int zc = 0;
+	int lastZc = 0;
+
+	for (int i = 0; i < len; ++i) {
+		if (buf[i] * sign >= 0) {
+			zc++;
+			buf[i] = lastZc;
+		} else {
+			sign = -sign;
+			buf[i] = lastZc;
+			if (sign > 0) {
+				lastZc = zc;
+				zc = 0;
+			}
+		}
+	}
+}
+
+
+typedef enum {
+	OP_FROM_U8,
+	OP_HPF,
+	OP_NORM,
+	OP_DECIMATE,
+	OP_SHIFT_ZERO,
+	OP_ASK_EDGES,
+	OP_ASK_EDGES_IN_PLACE,
+	OP_DIR_THRESHOLD,
+	OP_DIR_THRESHOLD_IN_PLACE,
+	OP_ZERO_CROSSINGS,
+	OP_COUNT
+} dsp_op_t;
+
+static const char *op_names[OP_COUNT] = {
+	"samples from u8", "hpf", "norm", "dec", "shiftgraphzero", "askedgedetect", "askedgedetect in place",
+	"dirthreshold", "dirthreshold in place", "zerocrossings"
+};
+
+static const SIMDExecInstr instrs[] = {SIMD_NONE, SIMD_MMX, SIMD_SSE2, SIMD_AVX, SIMD_AVX2, SIMD_AVX512};
+static const char *instr_names[] = {"none", "mmx", "sse2", "avx", "avx2", "avx512"};
+#define INSTR_COUNT (sizeof(instrs) / sizeof(instrs[0]))
+
+
+// Runs op on buf (len samples, room for len + 2: directionalThreshold() reads out[1] even
+// for less samples), with out holding the old output samples for the ops that write to a
+// second buffer. k == NULL runs the scalar code.
+static void run_op(const graphdsp_kernels_t *k, dsp_op_t op, int *buf, int *out, const uint8_t *bytes, int len)
+{
+	switch (op) {
+		case OP_FROM_U8:
+			if (k) samples_from_u8(k, bytes, buf, len); else ref_samples_from_u8(bytes, buf, len);
+			break;
+		case OP_HPF:
+			if (k) hpf(k, buf, len); else ref_hpf(buf, len);
+			break;
+		case OP_NORM:
+			if (k) norm(k, buf, len); else ref_norm(buf, len);
+			break;
+		case OP_DECIMATE:
+			if (k) decimate(k, buf, len); else ref_decimate(buf, len);
+			break;
+		case OP_SHIFT_ZERO:
+			if (k) shift_zero(k, buf, len, 13); else ref_shift_zero(buf, len, 13);
+			break;
+		case OP_ASK_EDGES:
+			if (k) k->ask_edges(buf, out, len, 25); else ref_ask_edge_detect(buf, out, len, 25);
+			break;
+		case OP_ASK_EDGES_IN_PLACE:
+			if (k) k->ask_edges(buf, buf, len, 25); else ref_ask_edge_detect(buf, buf, len, 25);
+			break;
+		case OP_DIR_THRESHOLD:
+			if (k) k->dir_threshold(buf, out, len, 20, -20); else ref_directional_threshold(buf, out, len, 20, -20);
+			break;
+		case OP_DIR_THRESHOLD_IN_PLACE:
+			if (k) k->dir_threshold(buf, buf, len, 20, -20); else ref_directional_threshold(buf, buf, len, 20, -20);
+			break;
+		default:
+			if (k) k->zero_crossings(buf, len); else ref_zero_crossings(buf, len);
+			break;
+	}
+}
+
+
+static uint32_t lfsr_next(uint32_t *lfsr)
+{
+	*lfsr = *lfsr * 1103515245 + 12345;
+	return *lfsr >> 8;
+}
+
+
+// a carrier with ASK modulation and noise, amplitude amp, and some runs of zeros
+static void make_trace(int *trace, uint8_t *bytes, int len, int amp, uint32_t seed)
+{
+	uint32_t lfsr = seed;
+	for (int i = 0; i < len + 2; i++) {
+		int bit = ((i / 256) * 0x9E3779B1u >> 31) ^ ((i / 128) & 1);
+		int carrier = (i & 7) < 4 ? 1 : -1;
+		int noise = (int)(lfsr_next(&lfsr) % (amp / 4 + 1)) - amp / 8;
+		trace[i] = carrier * (bit ? amp : amp / 3) + noise;
+		if ((i / 64) % 7 == 3) trace[i] = 0;
+		bytes[i] = lfsr_next(&lfsr);
+	}
+	// the first samples don't count for hpf and norm, make them stick out
+	for (int i = 0; i < len && i < 10; i++) {
+		trace[i] = (int)(lfsr_next(&lfsr) % (8 * amp + 1)) - 4 * amp;
+	}
+}
+
+
+// microseconds per call of op on a fresh copy of trace, op < 0 times the copy alone.
+// The best of some batches, the others may have been interrupted.
+static double bench_op(const graphdsp_kernels_t *k, int op, const int *trace, int *buf, int *out, const uint8_t *bytes, int len)
+{
+	const int batches = 3;
+	const int rounds = 50;
+	uint64_t best = UINT64_MAX;
+
+	for (int b = 0; b < batches; b++) {
+		uint64_t t = msclock();
+		for (int r = 0; r < rounds; r++) {
+			memcpy(buf, trace, len * sizeof(int));
+			if (op >= 0) run_op(k, op, buf, out, bytes, len);
+		}
+		t = msclock() - t;
+		if (t < best) best = t;
+	}
+	return best * 1000.0 / rounds;
+}
+
+
+int graphdsp_selftest(void)
+{
+	const int lens[] = {0, 1, 2, 3, 10, 11, 12, 17, 1023, 1024, 1025, 2049, 40000, 320000};
+	const int amps[] = {127, 2000, 1 << 20};
+	const int bench_len = 320000;
+	int max_len = bench_len + 3;
+	SIMDExecInstr best = GetSIMDInstrAuto();
+	bool passed = true;
+
+	int *trace = malloc(max_len * sizeof(int));
+	int *a = malloc(max_len * sizeof(int));
+	int *b = malloc(max_len * sizeof(int));
+	int *out_a = malloc(max_len * sizeof(int));
+	int *out_b = malloc(max_len * sizeof(int));
+	int *old_out = malloc(max_len * sizeof(int));
+	uint8_t *bytes = malloc(max_len);
+	if (!trace || !a || !b || !out_a || !out_b || !old_out || !bytes) {
+		PrintAndLog("DSP test: out of memory");
+		free(trace); free(a); free(b); free(out_a); free(out_b); free(old_out); free(bytes);
+		return -1;
+	}
+
+	// same results as the scalar code, for every length, amplitude and instruction set
+	for (int l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+		for (int m = 0; m < sizeof(amps) / sizeof(amps[0]); m++) {
+			int len = lens[l];
+			make_trace(trace, bytes, len, amps[m], len * 31 + m);
+			make_trace(old_out, bytes, len, 127, len * 17 + m + 1);
+			for (int s = 0; s < INSTR_COUNT; s++) {
+				if (instrs[s] < best) continue;
+				const graphdsp_kernels_t *k = graphdsp_kernels(instrs[s]);
+				for (dsp_op_t op = 0; op < OP_COUNT; op++) {
+					memcpy(a, trace, (len + 2) * sizeof(int));
+					memcpy(b, trace, (len + 2) * sizeof(int));
+					memcpy(out_a, old_out, (len + 2) * sizeof(int));
+					memcpy(out_b, old_out, (len + 2) * sizeof(int));
+					run_op(NULL, op, a, out_a, bytes, len);
+					run_op(k, op, b, out_b, bytes, len);
+					if (memcmp(a, b, (len + 2) * sizeof(int)) || memcmp(out_a, out_b, (len + 2) * sizeof(int))) {
+						PrintAndLog("DSP test: %s on %s differs, %d samples of amplitude %d", op_names[op], instr_names[s], len, amps[m]);
+						passed = false;
+					}
+				}
+			}
+		}
+	}
+
+	// microseconds per call on a trace the size of the graph buffer, and the speedup over the
+// old code as the compiler optimizes it for the default instruction set
+	make_trace(trace, bytes, bench_len, 127, 42);
+	char line[160];
+	int pos = sprintf(line, "%-23s %9s", "us per call", "old code");
+	for (int s = 0; s < INSTR_COUNT; s++) {
+		if (instrs[s] >= best) pos += sprintf(line + pos, " %13s", instr_names[s]);
+	}
+	PrintAndLog("%s", line);
+
+	double copy_us = bench_op(NULL, -1, trace, a, out_a, bytes, bench_len);
+	for (dsp_op_t op = 0; op < OP_COUNT; op++) {
+		double ref_us = 0;
+		pos = sprintf(line, "%-23s", op_names[op]);
+		for (int s = -1; s < (int)INSTR_COUNT; s++) {
+			if (s >= 0 && instrs[s] < best) continue;
+			const graphdsp_kernels_t *k = s < 0 ? NULL : graphdsp_kernels(instrs[s]);
+			double us = bench_op(k, op, trace, a, out_a, bytes, bench_len) - copy_us;
+			if (us < 1) us = 1;
+			if (s < 0) {
+				ref_us = us;
+				pos += sprintf(line + pos, " %9.0f", us);
+			} else {
+				pos += sprintf(line + pos, " %7.0f %4.1fx", us, ref_us / us);
+			}
+		}
+		PrintAndLog("%s", line);
+	}
+
+	free(trace); free(a); free(b); free(out_a); free(out_b); free(old_out); free(bytes);
+	PrintAndLog("DSP test: %s", passed ? "passed" : "FAILED");
+	return passed ? 0 : -1;
+}
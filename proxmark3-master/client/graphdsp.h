@@ -0,0 +1,31 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Transforms of the graph sample buffer, on the best instruction set of the CPU
+//-----------------------------------------------------------------------------
+
+#ifndef GRAPHDSP_H__
+#define GRAPHDSP_H__
+
+#include <stdint.h>
+
+// device samples (unsigned bytes) to graph samples
+extern void dsp_samples_from_u8(const uint8_t *in, int *out, int len);
+// subtract the mean of the samples after the first 10
+extern void dsp_hpf(int *buf, int len);
+// scale to -128..128 by the min and max of the samples after the first 10
+extern void dsp_norm(int *buf, int len);
+// keep every other sample, returns the new length
+extern int dsp_decimate(int *buf, int len);
+// add shift, clip to -127..127 and normalize
+extern void dsp_shift_zero(int *buf, int len, int shift);
+extern void dsp_ask_edge_detect(const int *in, int *out, int len, int threshold);
+extern void dsp_directional_threshold(const int *in, int *out, int len, int up, int down);
+extern void dsp_zero_crossings(int *buf, int len);
+
+// check every instruction set against the scalar code and time them
+extern int graphdsp_selftest(void);
+
+#endif
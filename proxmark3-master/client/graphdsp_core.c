@@ -0,0 +1,319 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Sample buffer kernels for the graph transforms in graphdsp.c
+//
+// This file is compiled once for each instruction set (see MULTIARCHSRCS in the
+// Makefile). The plain loops are written for the auto vectorizer. The edge and
+// threshold kernels carry the last value to the following samples, which it can't
+// vectorize; they use GCC vector extensions (SSE2, AVX2, AVX512 or NEON) with a log
+// step scan in the vector. All kernels work in place as well.
+//-----------------------------------------------------------------------------
+
+#include "graphdsp_core.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// this needs to be compiled several times for each instruction set.
+// For each instruction set, define a dedicated name for the kernel table:
+#if defined (__AVX512F__)
+#define GRAPHDSP_KERNELS graphdsp_kernels_AVX512
+#elif defined (__AVX2__)
+#define GRAPHDSP_KERNELS graphdsp_kernels_AVX2
+#elif defined (__AVX__)
+#define GRAPHDSP_KERNELS graphdsp_kernels_AVX
+#elif defined (__SSE2__)
+#define GRAPHDSP_KERNELS graphdsp_kernels_SSE2
+#elif defined (__MMX__)
+#define GRAPHDSP_KERNELS graphdsp_kernels_MMX
+#else
+#define GRAPHDSP_KERNELS graphdsp_kernels_NOSIMD
+#endif
+
+// vectors for the kernels with a running state, which the auto vectorizer can't do
+#if defined (__AVX512F__)
+#define VECTOR_SIZE 64
+#elif defined (__AVX2__)
+#define VECTOR_SIZE 32
+#elif defined (__SSE2__) || defined (__ARM_NEON)
+#define VECTOR_SIZE 16
+#endif
+
+#ifdef VECTOR_SIZE
+#define LANES (VECTOR_SIZE / 4)
+typedef int32_t __attribute__((vector_size(VECTOR_SIZE))) sample_vector_t;
+
+// shuffle masks: lane i from lane i - n of the second vector, else lane 0 of the first
+#if defined(__clang__)
+#define SHUFFLE(a, b, mask)	__builtin_shufflevector(a, b, mask)
+#else
+#define SHUFFLE(a, b, mask)	__builtin_shuffle(a, b, (sample_vector_t){mask})
+#endif
+#if LANES == 4
+#define SHIFT1		0, 4, 5, 6
+#define SHIFT2		0, 0, 4, 5
+#define PREV_LANES	3, 4, 5, 6
+#define LAST_LANE	3, 3, 3, 3
+#elif LANES == 8
+#define SHIFT1		0, 8, 9, 10, 11, 12, 13, 14
+#define SHIFT2		0, 0, 8, 9, 10, 11, 12, 13
+#define SHIFT4		0, 0, 0, 0, 8, 9, 10, 11
+#define PREV_LANES	7, 8, 9, 10, 11, 12, 13, 14
+#define LAST_LANE	7, 7, 7, 7, 7, 7, 7, 7
+#else
+#define SHIFT1		0, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30
+#define SHIFT2		0, 0, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29
+#define SHIFT4		0, 0, 0, 0, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27
+#define SHIFT8		0, 0, 0, 0, 0, 0, 0, 0, 16, 17, 18, 19, 20, 21, 22, 23
+#define PREV_LANES	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30
+#define LAST_LANE	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15
+#endif
+
+static inline sample_vector_t select_nonzero(sample_vector_t v, sample_vector_t other)
+{
+	sample_vector_t m = v != 0;
+	return (v & m) | (other & ~m);
+}
+
+// Every lane takes the nearest non zero lane at or before it, or *carry (the last value of
+// the previous vector) where there is none, and *carry becomes the last lane. The scan
+// within the vector doesn't depend on *carry, only the final selects wait for the
+// previous vector.
+static inline sample_vector_t hold(sample_vector_t v, sample_vector_t *carry)
+{
+	const sample_vector_t zero = {0};
+	v = select_nonzero(v, SHUFFLE(zero, v, SHIFT1));
+	v = select_nonzero(v, SHUFFLE(zero, v, SHIFT2));
+#if LANES >= 8
+	v = select_nonzero(v, SHUFFLE(zero, v, SHIFT4));
+#endif
+#if LANES >= 16
+	v = select_nonzero(v, SHUFFLE(zero, v, SHIFT8));
+#endif
+	sample_vector_t last = SHUFFLE(v, v, LAST_LANE);
+	v = select_nonzero(v, *carry);
+	*carry = select_nonzero(last, *carry);
+	return v;
+}
+#endif
+
+
+static void u8_to_samples(const uint8_t *restrict in, int *restrict out, int len)
+{
+	for (int i = 0; i < len; i++) {
+		out[i] = in[i] - 128;
+	}
+}
+
+
+// the sum modulo 2^32 in the low 32 bits, as an int accumulator gives it
+static int64_t sum(const int *in, int len)
+{
+	uint32_t s = 0;
+	for (int i = 0; i < len; i++) {
+		s += in[i];
+	}
+	return (int32_t)s;
+}
+
+
+static void minmax(const int *in, int len, int *min, int *max)
+{
+	int lo = *min, hi = *max;
+	for (int i = 0; i < len; i++) {
+		lo = in[i] < lo ? in[i] : lo;
+		hi = in[i] > hi ? in[i] : hi;
+	}
+	*min = lo;
+	*max = hi;
+}
+
+
+static void offset(int *buf, int len, int offset)
+{
+	for (int i = 0; i < len; i++) {
+		buf[i] += offset;
+	}
+}
+
+
+// (buf[i] - mid) * 256 / range, truncated. The quotient of two doubles is exact to
+// far less than 1 / range for |buf[i] - mid| * 256 < 2^53, so truncating it gives
+// the same result as the integer division.
+static void scale(int *buf, int len, int mid, int range)
+{
+	double r = range;
+	for (int i = 0; i < len; i++) {
+		buf[i] = (int)((double)(buf[i] - mid) * 256.0 / r);
+	}
+}
+
+
+static void clip(int *buf, int len, int offset, int lo, int hi)
+{
+	for (int i = 0; i < len; i++) {
+		int v = buf[i] + offset;
+		v = v > hi ? hi : v;
+		buf[i] = v < lo ? lo : v;
+	}
+}
+
+
+static void decimate(int *buf, int len)
+{
+	for (int i = 0; i < len / 2; i++) {
+		buf[i] = buf[2 * i];
+	}
+}
+
+
+// out[i - 1] = +127 after a jump up of at least threshold, -127 after a jump down, else
+// out[i - 2]. In place a vector stores out[i - 1..] after the next one loaded in[i - 1..].
+// Only 16 lanes make up for the shuffles of the hold, with less the scalar loop is faster.
+static void ask_edges(const int *in, int *out, int len, int threshold)
+{
+	int last = 0;
+	int i = 1;
+
+#if defined(VECTOR_SIZE) && LANES >= 16
+	sample_vector_t carry = {0};
+	for (; i + LANES <= len; i += LANES) {
+		sample_vector_t cur, prev;
+		memcpy(&cur, in + i, sizeof(cur));
+		memcpy(&prev, in + i - 1, sizeof(prev));
+		sample_vector_t d = cur - prev;
+		sample_vector_t code = ((d >= threshold) & 127) | ((d <= -threshold) & -127);
+		code = hold(code, &carry);
+		memcpy(out + i - 1, &code, sizeof(code));
+	}
+	last = carry[0];
+#endif
+	for (; i < len; i++) {
+		int d = in[i] - in[i - 1];
+		last = d >= threshold ? 127 : (d <= -threshold ? -127 : last);
+		out[i - 1] = last;
+	}
+}
+
+
+// out[i] = 1 for a sample at or above up rising over the previous one, -1 for one at or
+// below down falling under it, else out[i - 1]. The previous sample is what out held at
+// i - 1 before it was overwritten, as the original directionalThreshold() compares. The
+// vectors keep the old out samples they overwrite for the next one.
+static void dir_threshold(const int *in, int *out, int len, int up, int down)
+{
+	int prev = in[0];
+	int last = 0;
+	int i = 1;
+
+	out[0] = 0;
+#ifdef VECTOR_SIZE
+	sample_vector_t carry = {0};
+	sample_vector_t old_prev = {0};
+	old_prev[LANES - 1] = prev;
+	for (; i + LANES <= len; i += LANES) {
+		sample_vector_t cur, old;
+		memcpy(&cur, in + i, sizeof(cur));
+		memcpy(&old, out + i, sizeof(old));
+		sample_vector_t p = SHUFFLE(old_prev, old, PREV_LANES);
+		sample_vector_t code = ((cur >= up) & (cur > p) & 1) | ((cur <= down) & (cur < p));
+		code = hold(code, &carry);
+		memcpy(out + i, &code, sizeof(code));
+		old_prev = old;
+	}
+	last = carry[0];
+	prev = old_prev[LANES - 1];
+#endif
+	for (; i < len; i++) {
+		int v = in[i];
+		int old = out[i];
+		last = v >= up && v > prev ? 1 : (v <= down && v < prev ? -1 : last);
+		out[i] = last;
+		prev = old;
+	}
+	out[0] = out[1];
+}
+
+
+// every sample becomes the length of the last full period, counted in samples that
+// don't change sign. A running count, this stays scalar.
+static void zero_crossings(int *buf, int len)
+{
+	int sign = 1;
+	int zc = 0;
+	int last_zc = 0;
+
+	for (int i = 0; i < len; i++) {
+		if (buf[i] * sign >= 0) {
+			zc++;
+			buf[i] = last_zc;
+		} else {
+			sign = -sign;
+			buf[i] = last_zc;
+			if (sign > 0) {
+				last_zc = zc;
+				zc = 0;
+			}
+		}
+	}
+}
+
+
+const graphdsp_kernels_t GRAPHDSP_KERNELS = {
+	u8_to_samples,
+	sum,
+	minmax,
+	offset,
+	scale,
+	clip,
+	decimate,
+	ask_edges,
+	dir_threshold,
+	zero_crossings,
+};
+
+
+#ifndef __MMX__
+
+// the kernel tables of the other instruction sets:
+#if defined (__i386__) || defined (__x86_64__)
+#if !defined(__APPLE__) || (defined(__APPLE__) && (__clang_major__ > 8 || __clang_major__ == 8 && __clang_minor__ >= 1))
+#if (__GNUC__ >= 5) && (__GNUC__ > 5 || __GNUC_MINOR__ > 2)
+extern const graphdsp_kernels_t graphdsp_kernels_AVX512;
+#endif
+extern const graphdsp_kernels_t graphdsp_kernels_AVX2;
+extern const graphdsp_kernels_t graphdsp_kernels_AVX;
+extern const graphdsp_kernels_t graphdsp_kernels_SSE2;
+extern const graphdsp_kernels_t graphdsp_kernels_MMX;
+#endif
+#endif
+
+const graphdsp_kernels_t *graphdsp_kernels(SIMDExecInstr instr)
+{
+	switch (instr) {
+#if defined (__i386__) || defined (__x86_64__)
+#if !defined(__APPLE__) || (defined(__APPLE__) && (__clang_major__ > 8 || __clang_major__ == 8 && __clang_minor__ >= 1))
+#if (__GNUC__ >= 5) && (__GNUC__ > 5 || __GNUC_MINOR__ > 2)
+		case SIMD_AVX512:
+			return &graphdsp_kernels_AVX512;
+#endif
+		case SIMD_AVX2:
+			return &graphdsp_kernels_AVX2;
+		case SIMD_AVX:
+			return &graphdsp_kernels_AVX;
+		case SIMD_SSE2:
+			return &graphdsp_kernels_SSE2;
+		case SIMD_MMX:
+			return &graphdsp_kernels_MMX;
+#endif
+#endif
+		default:
+			return &graphdsp_kernels_NOSIMD;
+	}
+}
+
+#endif
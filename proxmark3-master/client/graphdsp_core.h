@@ -0,0 +1,31 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Sample buffer kernels, compiled once for each instruction set
+//-----------------------------------------------------------------------------
+
+#ifndef GRAPHDSP_CORE_H__
+#define GRAPHDSP_CORE_H__
+
+#include <stdint.h>
+#include "hardnested/hardnested_bf_core.h"		// SIMDExecInstr
+
+typedef struct {
+	void (*u8_to_samples)(const uint8_t *in, int *out, int len);
+	int64_t (*sum)(const int *in, int len);
+	void (*minmax)(const int *in, int len, int *min, int *max);
+	void (*offset)(int *buf, int len, int offset);
+	void (*scale)(int *buf, int len, int mid, int range);
+	void (*clip)(int *buf, int len, int offset, int lo, int hi);
+	void (*decimate)(int *buf, int len);
+	void (*ask_edges)(const int *in, int *out, int len, int threshold);
+	void (*dir_threshold)(const int *in, int *out, int len, int up, int down);
+	void (*zero_crossings)(int *buf, int len);
+} graphdsp_kernels_t;
+
+// the kernels for instr, or for the best instruction set below it that was compiled in
+extern const graphdsp_kernels_t *graphdsp_kernels(SIMDExecInstr instr);
+
+#endif
@@ -0,0 +1,327 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Min/max envelope pyramid of a sample buffer, for plotting.
+//
+// The plot draws one vertical min..max line per pixel column when it is zoomed
+// out. With the pyramid the min/max of a column takes O(log n) instead of a scan
+// of all its samples, so a repaint costs O(pixels) whatever the trace length.
+// The Qt plot doesn't use it yet, that needs checking zoom, pan and the overlay
+// against a Qt build.
+//-----------------------------------------------------------------------------
+
+#include "graphenvelope.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include "ui.h"
+#include "util_posix.h"
+
+#define BLOCK_SIZE		(1 << ENVELOPE_BLOCK_SHIFT)
+
+static inline void node_add_sample(envelope_node_t *node, int v)
+{
+	if (v < node->min) node->min = v;
+	if (v > node->max) node->max = v;
+	node->sum += v;
+}
+
+static inline void node_add(envelope_node_t *node, const envelope_node_t *other)
+{
+	if (other->min < node->min) node->min = other->min;
+	if (other->max > node->max) node->max = other->max;
+	node->sum += other->sum;
+}
+
+static const envelope_node_t empty_node = {INT_MAX, INT_MIN, 0};
+
+void envelope_free(graph_envelope_t *env)
+{
+	for (int i = 0; i < ENVELOPE_MAX_LEVELS; i++)
+		free(env->level[i]);
+	free(env->samples);
+	memset(env, 0, sizeof(*env));
+}
+
+static bool envelope_alloc(graph_envelope_t *env, int len)
+{
+	envelope_free(env);
+
+	env->samples = malloc(len * sizeof(int));
+	if (env->samples == NULL)
+		return false;
+	env->size = len;
+
+	int blocks = (len + BLOCK_SIZE - 1) >> ENVELOPE_BLOCK_SHIFT;
+	for (int k = 0; blocks > 0 && k < ENVELOPE_MAX_LEVELS; k++) {
+		env->level[k] = malloc(blocks * sizeof(envelope_node_t));
+		if (env->level[k] == NULL) {
+			envelope_free(env);
+			return false;
+		}
+		env->level_len[k] = blocks;
+		env->levels = k + 1;
+		if (blocks == 1)
+			break;
+		blocks = (blocks + 1) / 2;
+	}
+
+	return true;
+}
+
+// Recompute the blocks [lo, hi] of the lowest level and their parents
+static void envelope_rebuild(graph_envelope_t *env, int lo, int hi)
+{
+	for (int b = lo; b <= hi; b++) {
+		envelope_node_t node = empty_node;
+		int end = (b + 1) * BLOCK_SIZE;
+		if (end > env->len)
+			end = env->len;
+		for (int i = b * BLOCK_SIZE; i < end; i++)
+			node_add_sample(&node, env->samples[i]);
+		env->level[0][b] = node;
+	}
+
+	for (int k = 1; k < env->levels; k++) {
+		lo >>= 1;
+		hi >>= 1;
+		for (int b = lo; b <= hi; b++) {
+			envelope_node_t node = env->level[k - 1][2 * b];
+			if (2 * b + 1 < env->level_len[k - 1])
+				node_add(&node, &env->level[k - 1][2 * b + 1]);
+			env->level[k][b] = node;
+		}
+	}
+}
+
+bool envelope_update(graph_envelope_t *env, const int *buffer, int len, uint32_t version)
+{
+	if (len <= 0) {
+		env->len = 0;
+		return true;
+	}
+
+	// nothing was written since the last update, this is the case on most repaints
+	if (version != 0 && version == env->version && len == env->len && env->samples != NULL)
+		return true;
+	env->version = version;
+
+	if (len != env->len || env->samples == NULL) {
+		if (len > env->size || env->level[0] == NULL || env->level_len[0] != (len + BLOCK_SIZE - 1) >> ENVELOPE_BLOCK_SHIFT) {
+			if (!envelope_alloc(env, len))
+				return false;
+			env->version = version;
+		}
+		env->len = len;
+		memcpy(env->samples, buffer, len * sizeof(int));
+		envelope_rebuild(env, 0, env->level_len[0] - 1);
+		return true;
+	}
+
+	// only the changed blocks, the compare runs at memory speed
+	int lo = -1, hi = -1;
+	for (int b = 0; b < env->level_len[0]; b++) {
+		int start = b * BLOCK_SIZE;
+		int n = (start + BLOCK_SIZE > len) ? len - start : BLOCK_SIZE;
+		if (memcmp(env->samples + start, buffer + start, n * sizeof(int))) {
+			memcpy(env->samples + start, buffer + start, n * sizeof(int));
+			if (lo < 0)
+				lo = b;
+			hi = b;
+		}
+	}
+	if (lo >= 0)
+		envelope_rebuild(env, lo, hi);
+
+	return true;
+}
+
+bool envelope_range(const graph_envelope_t *env, int start, int end, int *min, int *max, int64_t *sum)
+{
+	envelope_node_t acc = empty_node;
+
+	if (start < 0)
+		start = 0;
+	if (end > env->len)
+		end = env->len;
+	if (start >= end)
+		return false;
+
+	// loose samples up to the first and after the last whole block
+	int s = start;
+	while (s < end && (s & (BLOCK_SIZE - 1)))
+		node_add_sample(&acc, env->samples[s++]);
+	int e = end;
+	if (e != env->len) {
+		while (e > s && (e & (BLOCK_SIZE - 1)))
+			node_add_sample(&acc, env->samples[--e]);
+	}
+
+	// the whole blocks, bottom up through the levels. s is block aligned unless s == e.
+	int lo = s >> ENVELOPE_BLOCK_SHIFT;
+	int hi = (s == e) ? lo : (e + BLOCK_SIZE - 1) >> ENVELOPE_BLOCK_SHIFT;
+	for (int k = 0; lo < hi; k++) {
+		if (lo & 1)
+			node_add(&acc, &env->level[k][lo++]);
+		if (hi & 1)
+			node_add(&acc, &env->level[k][--hi]);
+		lo >>= 1;
+		hi >>= 1;
+	}
+
+	if (min) *min = acc.min;
+	if (max) *max = acc.max;
+	if (sum) *sum = acc.sum;
+	return true;
+}
+
+int envelope_columns(const graph_envelope_t *env, int start, double samples_per_column, int columns, int *min, int *max)
+{
+	int i;
+	for (i = 0; i < columns; i++) {
+		int s = start + (int)(i * samples_per_column);
+		int e = start + (int)((i + 1) * samples_per_column);
+		if (e <= s)
+			e = s + 1;
+		if (!envelope_range(env, s, e, &min[i], &max[i], NULL))
+			break;
+	}
+	return i;
+}
+
+//-----------------------------------------------------------------------------
+// Self test and benchmark
+//-----------------------------------------------------------------------------
+
+#define TEST_LEN		(40000 * 8)
+#define TEST_COLUMNS	1920
+#define TEST_LOOPS		100
+
+static int test_scan_columns(const int *buffer, int len, int start, double samples_per_column, int columns, int *min, int *max)
+{
+	int i;
+	for (i = 0; i < columns; i++) {
+		int s = start + (int)(i * samples_per_column);
+		int e = start + (int)((i + 1) * samples_per_column);
+		if (e <= s)
+			e = s + 1;
+		if (e > len)
+			e = len;
+		if (s >= e)
+			break;
+		min[i] = INT_MAX;
+		max[i] = INT_MIN;
+		for (int j = s; j < e; j++) {
+			if (buffer[j] < min[i]) min[i] = buffer[j];
+			if (buffer[j] > max[i]) max[i] = buffer[j];
+		}
+	}
+	return i;
+}
+
+static bool test_compare(const graph_envelope_t *env, const int *buffer, int len)
+{
+	static int min1[TEST_COLUMNS], max1[TEST_COLUMNS], min2[TEST_COLUMNS], max2[TEST_COLUMNS];
+	const double zoom[] = {1.0, 1.5, 7.0, 16.0, 100.3, (double)len / TEST_COLUMNS};
+	const int starts[] = {0, 1, 15, 17, 1000, len / 2, len - 100};
+
+	for (int z = 0; z < sizeof(zoom) / sizeof(zoom[0]); z++) {
+		for (int s = 0; s < sizeof(starts) / sizeof(starts[0]); s++) {
+			int n1 = envelope_columns(env, starts[s], zoom[z], TEST_COLUMNS, min1, max1);
+			int n2 = test_scan_columns(buffer, len, starts[s], zoom[z], TEST_COLUMNS, min2, max2);
+			if (n1 != n2 || memcmp(min1, min2, n1 * sizeof(int)) || memcmp(max1, max2, n1 * sizeof(int)))
+				return false;
+		}
+	}
+
+	int64_t sum = 0, envsum;
+	for (int i = 0; i < len; i++)
+		sum += buffer[i];
+	if (!envelope_range(env, 0, len, NULL, NULL, &envsum) || sum != envsum)
+		return false;
+
+	return true;
+}
+
+int envelope_selftest(void)
+{
+	static int buffer[TEST_LEN];
+	static int min[TEST_COLUMNS], max[TEST_COLUMNS];
+	graph_envelope_t env = {0};
+	uint32_t version = 1;
+	uint32_t x = 0x12345678;
+	int ret = 1;
+
+	// a noisy carrier with a slow modulation
+	for (int i = 0; i < TEST_LEN; i++) {
+		x = x * 1103515245 + 12345;
+		buffer[i] = ((i / 64) & 1 ? 100 : 40) * ((i & 7) < 4 ? 1 : -1) + (int)((x >> 16) & 0x0f) - 8;
+	}
+
+	uint64_t t = msclock();
+	if (!envelope_update(&env, buffer, TEST_LEN, version))
+		goto out;
+	uint64_t build_time = msclock() - t;
+
+	if (!test_compare(&env, buffer, TEST_LEN)) {
+		PrintAndLog("Envelope test: full build differs from the samples");
+		goto out;
+	}
+
+	// same version, the samples are not looked at
+	int saved = buffer[1];
+	buffer[1] = saved + 1;
+	envelope_update(&env, buffer, TEST_LEN, version);
+	bool skipped = env.samples[1] == saved;
+	buffer[1] = saved;
+	if (!skipped) {
+		PrintAndLog("Envelope test: update with an unchanged version compared the samples");
+		goto out;
+	}
+
+	// a few changes, as done by the sliders or the trim commands
+	buffer[0] = 1000;
+	buffer[TEST_LEN / 3] = -1000;
+	for (int i = 5000; i < 5100; i++)
+		buffer[i] = 0;
+	t = msclock();
+	envelope_update(&env, buffer, TEST_LEN, ++version);
+	uint64_t update_time = msclock() - t;
+	if (!test_compare(&env, buffer, TEST_LEN)) {
+		PrintAndLog("Envelope test: incremental update differs from the samples");
+		goto out;
+	}
+
+	// shorter trace, odd length
+	if (!envelope_update(&env, buffer, TEST_LEN / 7 + 3, ++version) || !test_compare(&env, buffer, TEST_LEN / 7 + 3)) {
+		PrintAndLog("Envelope test: resized envelope differs from the samples");
+		goto out;
+	}
+	envelope_update(&env, buffer, TEST_LEN, ++version);
+
+	// render the whole trace in TEST_COLUMNS pixel columns
+	double spc = (double)TEST_LEN / TEST_COLUMNS;
+	t = msclock();
+	for (int i = 0; i < TEST_LOOPS; i++)
+		test_scan_columns(buffer, TEST_LEN, 0, spc, TEST_COLUMNS, min, max);
+	uint64_t scan_time = msclock() - t;
+	t = msclock();
+	for (int i = 0; i < TEST_LOOPS; i++)
+		envelope_columns(&env, 0, spc, TEST_COLUMNS, min, max);
+	uint64_t envelope_time = msclock() - t;
+
+	PrintAndLog("Envelope test: passed");
+	PrintAndLog("%d samples: build %"PRIu64" ms, update %"PRIu64" ms", TEST_LEN, build_time, update_time);
+	PrintAndLog("%d columns: scan %.2f ms, envelope %.3f ms per frame", TEST_COLUMNS,
+		(double)scan_time / TEST_LOOPS, (double)envelope_time / TEST_LOOPS);
+	ret = 0;
+
+out:
+	envelope_free(&env);
+	return ret;
+}
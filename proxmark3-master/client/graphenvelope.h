@@ -0,0 +1,62 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Min/max envelope pyramid of a sample buffer, for plotting
+//-----------------------------------------------------------------------------
+
+#ifndef GRAPHENVELOPE_H__
+#define GRAPHENVELOPE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The lowest level holds the min/max of blocks of 2^ENVELOPE_BLOCK_SHIFT samples, every level
+// above halves the number of blocks.
+#define ENVELOPE_BLOCK_SHIFT	4
+#define ENVELOPE_MAX_LEVELS		28
+
+typedef struct {
+	int min;
+	int max;
+	int64_t sum;
+} envelope_node_t;
+
+typedef struct {
+	int len;										// number of samples
+	int levels;
+	int level_len[ENVELOPE_MAX_LEVELS];
+	envelope_node_t *level[ENVELOPE_MAX_LEVELS];
+	int *samples;									// copy of the samples the pyramid was built from
+	int size;										// allocated samples
+	uint32_t version;								// version of the buffer the samples were copied from
+} graph_envelope_t;
+
+// Bring the envelope up to date with buffer. version is bumped by the owner of the buffer on
+// every write (GetGraphVersion() for GraphBuffer), an unchanged version and length returns at
+// once. Otherwise only the blocks that changed since the last update are recomputed. Version 0
+// means unknown and always compares the samples. A zero initialized graph_envelope_t is an
+// empty envelope.
+bool envelope_update(graph_envelope_t *env, const int *buffer, int len, uint32_t version);
+void envelope_free(graph_envelope_t *env);
+
+// Min, max and sum of the samples [start, end). Returns false for an empty range.
+bool envelope_range(const graph_envelope_t *env, int start, int end, int *min, int *max, int64_t *sum);
+
+// Min and max for each of the columns of a plot, column i covers the samples from
+// start + i * samples_per_column. Returns the number of columns with samples.
+int envelope_columns(const graph_envelope_t *env, int start, double samples_per_column, int columns, int *min, int *max);
+
+// Check the envelope against a plain scan of the samples and measure the render time
+int envelope_selftest(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -436,6 +436,12 @@ const uint64_t CRACK_STATES_BITSLICED(uint32_t cuid, uint8_t *best_first_bytes,
 #if MAX_BITSLICES > 128
                            && results.bytes64[2] == 0
                            && results.bytes64[3] == 0
+#endif
+#if MAX_BITSLICES > 256
+                           && results.bytes64[4] == 0
+                           && results.bytes64[5] == 0
+                           && results.bytes64[6] == 0
+                           && results.bytes64[7] == 0
 #endif
                           ) {
 #if defined (DEBUG_BRUTE_FORCE)						  
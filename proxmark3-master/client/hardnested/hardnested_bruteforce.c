@@ -118,8 +118,8 @@ bool verify_key(uint32_t cuid, noncelist_t *nonces, uint8_t *best_first_bytes, u
 {
 	struct Crypto1State pcs;
 	for (uint16_t test_first_byte = 1; test_first_byte < 256; test_first_byte++) {
-		noncelistentry_t *test_nonce = nonces[best_first_bytes[test_first_byte]].first;
-		while (test_nonce != NULL) {
+		noncelist_t *test_list = &nonces[best_first_bytes[test_first_byte]];
+		for (noncelistentry_t *test_nonce = first_nonce(test_list); test_nonce != NULL; test_nonce = next_nonce(test_list, test_nonce)) {
 			pcs.odd = odd;
 			pcs.even = even;
 			lfsr_rollback_byte(&pcs, (cuid >> 24) ^ best_first_bytes[0], true);
@@ -133,7 +133,6 @@ bool verify_key(uint32_t cuid, noncelist_t *nonces, uint8_t *best_first_bytes, u
 					return false;
 				}
 			}
-			test_nonce = test_nonce->next;
 		}
 	}
 	return true;
@@ -194,13 +193,12 @@ void prepare_bf_test_nonces(noncelist_t *nonces, uint8_t best_first_byte)
 {
 	// we do bitsliced brute forcing with best_first_bytes[0] only.
 	// Extract the corresponding 2nd bytes
-	noncelistentry_t *test_nonce = nonces[best_first_byte].first;
+	noncelist_t *test_list = &nonces[best_first_byte];
 	uint32_t i = 0;
-	while (test_nonce != NULL) {
+	for (noncelistentry_t *test_nonce = first_nonce(test_list); test_nonce != NULL; test_nonce = next_nonce(test_list, test_nonce)) {
 		bf_test_nonce[i] = test_nonce->nonce_enc;
 		bf_test_nonce_par[i] = test_nonce->par_enc;
 		bf_test_nonce_2nd_byte[i] = (test_nonce->nonce_enc >> 16) & 0xff;
-		test_nonce = test_nonce->next;
 		i++;
 	}
 	nonces_to_bruteforce = i;
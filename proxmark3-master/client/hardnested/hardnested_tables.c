@@ -10,27 +10,68 @@
 // attacks this doesn't rely on implementation errors but only on the
 // inherent weaknesses of the crypto1 cypher. Described in
 //   Carlo Meijer, Roel Verdult, "Ciphertext-only Cryptanalysis on Hardened
-//   Mifare Classic Cards" in Proceedings of the 22nd ACM SIGSAC Conference on 
+//   Mifare Classic Cards" in Proceedings of the 22nd ACM SIGSAC Conference on
 //   Computer and Communications Security, 2015
 //-----------------------------------------------------------------------------
 //
 // This program calculates tables with possible states for a given
 // bitflip property.
 //
+// An even state is possible if there is an odd state which, together with it,
+// yields the bitflip property, and vice versa. The even states are handed out
+// in chunks to one worker thread per core. A worker evaluates 128 consecutive
+// odd states at once, bitsliced in a vector of 64 bit words, or 256 with AVX.
+// The bitflip and the !bitflip (bitflip | 0x100) tables are found in the same
+// pass: the 9th bit of the nonce doesn't change the 9 bits of keystream.
+//
+// The finished chunks and the states found so far are saved to a checkpoint
+// file every few minutes, an interrupted run continues from there. The tables
+// are written compressed, ready to be copied to client/hardnested/tables.
+//
+// Build with 'make hardnested_tables' in the client directory. Add
+// -march=native to CFLAGS to use the widest vector unit of the machine.
+//
+// 'hardnested_tables -v' checks the shipped tables instead: the 2nd byte
+// tables are derived from the 1st byte tables and compared, and a sample of
+// the states of a few tables is recalculated.
+//
 //-----------------------------------------------------------------------------
 
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE	200112L			// need getopt() and sysconf()
+#include <unistd.h>
+#else
+#include <windows.h>
+#include <getopt.h>
+#endif
+
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
+#include <pthread.h>
 #include "crapto1/crapto1.h"
 #include "parity.h"
+#include "util_posix.h"
+#include "zlib.h"
 
 
 #define NUM_PART_SUMS 		9
 #define BITFLIP_2ND_BYTE	0x0200
+#define NOT_BITFLIP			0x0100
+
+#define STATE_FILE_TEMPLATE		"bitflip_%d_%03" PRIx16 "_states.bin.z"
+#define STATE_FILE_TEMPLATE_SUM	"bitflip_%d_%03" PRIx16 "_sum%d_states.bin.z"
+#define CHECKPOINT_TEMPLATE		"bitflip_%03" PRIx16 "_sum%d_checkpoint.bin"
+#define CHECKPOINT_MAGIC		"HNTBLCP1"
+#define TABLES_DIRECTORY		"hardnested/tables/"
+
+#define NUM_EVEN_STATES		(1<<23)		// the highest bit of the even state isn't used in the first 9 steps
+#define CHUNK_SIZE			(1<<13)		// even states per chunk
+#define NUM_CHUNKS			(NUM_EVEN_STATES / CHUNK_SIZE)
+#define MAX_THREADS			64
 
 typedef enum {
 	EVEN_STATE = 0,
@@ -39,7 +80,7 @@ typedef enum {
 
 
 static uint16_t PartialSumProperty(uint32_t state, odd_even_t odd_even)
-{ 
+{
 	uint16_t sum = 0;
 	for (uint16_t j = 0; j < 16; j++) {
 		uint32_t st = state;
@@ -64,93 +105,57 @@ static uint16_t PartialSumProperty(uint32_t state, odd_even_t odd_even)
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // bitarray functions
+//
+// The tables use 32 bit words, the state i is bit 0x80000000 >> (i & 31) of word i >> 5. The search uses
+// "lane arrays" instead: 64 bit words, the state i is bit 1 << (i & 63) of word i >> 6.
 
-#define malloc_bitarray(x) __builtin_assume_aligned(_aligned_malloc(x, __BIGGEST_ALIGNMENT__), __BIGGEST_ALIGNMENT__)
-#define free_bitarray(x) _aligned_free(x)
+static void *malloc_bitarray(size_t size)
+{
+#if defined (_WIN32)
+	return _aligned_malloc(size, 64);
+#else
+	void *p;
+	return posix_memalign(&p, 64, size) ? NULL : p;
+#endif
+}
 
-static inline void clear_bitarray24(uint32_t *bitarray)
+
+static void free_bitarray(void *x)
 {
-	memset(bitarray, 0x00, sizeof(uint32_t) * (1<<19));
+#if defined (_WIN32)
+	_aligned_free(x);
+#else
+	free(x);
+#endif
 }
 
 
-static inline uint32_t test_bit24(uint32_t *bitarray, uint32_t index)
+static void *malloc_bitarray_or_exit(size_t size)
 {
-	return 	bitarray[index>>5] & (0x80000000>>(index&0x0000001f));
+	void *p = malloc_bitarray(size);
+	if (p == NULL) {
+		printf("Out of memory error. Aborting...\n");
+		exit(4);
+	}
+	return p;
 }
 
 
-static inline void set_bit24(uint32_t *bitarray, uint32_t index)
+static inline void clear_bitarray24(uint32_t *bitarray)
 {
-	bitarray[index>>5] |= 0x80000000>>(index&0x0000001f);
+	memset(bitarray, 0x00, sizeof(uint32_t) * (1<<19));
 }
 
 
-static inline uint32_t next_state(uint32_t *bitset, uint32_t state)
+static inline uint32_t test_bit24(uint32_t *bitarray, uint32_t index)
 {
-	if (++state == 1<<24) return 1<<24;
-	uint32_t index = state >> 5;
-	uint_fast8_t bit = state & 0x1f;
-	uint32_t line = bitset[index] << bit;
-	while (bit <= 0x1f) {
-		if (line & 0x80000000) return state;
-		state++;
-		bit++;
-		line <<= 1;
-	}
-	index++;
-	while (bitset[index] == 0x00000000 && state < 1<<24) {
-		index++;
-		state += 0x20;
-	}
-	if (state >= 1<<24) return 1<<24;
-#if defined __GNUC__
-	return state + __builtin_clz(bitset[index]);
-#else
-	bit = 0x00;
-	line = bitset[index];
-	while (bit <= 0x1f) {
-		if (line & 0x80000000) return state;
-		state++;
-		bit++;
-		line <<= 1;
-	}
-	return 1<<24;
-#endif
+	return 	bitarray[index>>5] & (0x80000000>>(index&0x0000001f));
 }
 
 
-static inline uint32_t next_not_state(uint32_t *bitset, uint32_t state)
+static inline void set_bit24(uint32_t *bitarray, uint32_t index)
 {
-	if (++state == 1<<24) return 1<<24;
-	uint32_t index = state >> 5;
-	uint_fast8_t bit = state & 0x1f;
-	uint32_t line = bitset[index] << bit;
-	while (bit <= 0x1f) {
-		if ((line & 0x80000000) == 0) return state;
-		state++;
-		bit++;
-		line <<= 1;
-	}
-	index++;
-	while (bitset[index] == 0xffffffff && state < 1<<24) {
-		index++;
-		state += 0x20;
-	}
-	if (state >= 1<<24) return 1<<24;
-#if defined __GNUC__
-	return state + __builtin_clz(~bitset[index]);
-#else
-	bit = 0x00;
-	line = bitset[index];
-	while (bit <= 0x1f) {
-		if ((line & 0x80000000) == 0) return state;
-		state++;
-		bit++;
-		line <<= 1;
-	}
-	return 1<<24;
-#endif
+	bitarray[index>>5] |= 0x80000000>>(index&0x0000001f);
 }
 
 
@@ -176,17 +181,249 @@ static inline uint32_t count_states(uint32_t *bitset)
 }
 
 
-static void write_bitflips_file(odd_even_t odd_even, uint16_t bitflip, int sum_a0, uint32_t *bitset, uint32_t count)
+static inline uint32_t reverse32(uint32_t x)
 {
-	char filename[80];
-	sprintf(filename, "bitflip_%d_%03" PRIx16 "_sum%d_states.bin", odd_even, bitflip, sum_a0);
-	FILE *outfile = fopen(filename, "wb");
-	fwrite(&count, 1, sizeof(count), outfile);
-	fwrite(bitset, 1, sizeof(uint32_t)*(1<<19), outfile);
-	fclose(outfile);
+	x = (x & 0x55555555) << 1 | (x >> 1 & 0x55555555);
+	x = (x & 0x33333333) << 2 | (x >> 2 & 0x33333333);
+	x = (x & 0x0f0f0f0f) << 4 | (x >> 4 & 0x0f0f0f0f);
+	x = (x & 0x00ff00ff) << 8 | (x >> 8 & 0x00ff00ff);
+	return x << 16 | x >> 16;
+}
+
+
+static void bitarray_to_lanes(uint32_t *bitarray, uint64_t *lanes)
+{
+	for (uint32_t i = 0; i < (1<<18); i++) {
+		lanes[i] = (uint64_t)reverse32(bitarray[2*i+1]) << 32 | reverse32(bitarray[2*i]);
+	}
+}
+
+
+static void lanes_to_bitarray(uint64_t *lanes, uint32_t *bitarray)
+{
+	for (uint32_t i = 0; i < (1<<18); i++) {
+		bitarray[2*i] = reverse32(lanes[i]);
+		bitarray[2*i+1] = reverse32(lanes[i] >> 32);
+	}
+}
+
+
+static inline bool test_lane_bit(uint64_t *lanes, uint32_t index)
+{
+	return lanes[index>>6] >> (index & 0x3f) & 1;
+}
+
+
+static inline void set_lane_bit(uint64_t *lanes, uint32_t index)
+{
+	__sync_fetch_and_or(&lanes[index>>6], (uint64_t)1 << (index & 0x3f));
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// bitsliced evaluation of LANES odd states
+
+// The lanes must differ in the 8 low bits of the odd state only
+#if defined(__AVX__)
+#define LANE_BITS			8
+#else
+#define LANE_BITS			7
+#endif
+#define LANES				(1<<LANE_BITS)
+#define LANE_WORDS			(LANES/64)
+#define NUM_BLOCKS			((1<<24) / LANES)
+
+typedef uint64_t __attribute__((vector_size(LANE_WORDS * sizeof(uint64_t)))) lanes_t;
+
+#define ALWAYS_INLINE		inline __attribute__((always_inline))
+
+static lanes_t odd_lane_bits[LANE_BITS];		// bit j of the odd state in each lane
+
+
+static void init_odd_lane_bits(void)
+{
+	for (int j = 0; j < LANE_BITS; j++) {
+		for (int lane = 0; lane < LANES; lane++) {
+			if (lane >> j & 1) {
+				odd_lane_bits[j][lane / 64] |= (uint64_t)1 << (lane % 64);
+			} else {
+				odd_lane_bits[j][lane / 64] &= ~((uint64_t)1 << (lane % 64));
+			}
+		}
+	}
+}
+
+
+static ALWAYS_INLINE lanes_t broadcast(uint32_t bit)
+{
+	lanes_t zero = {0};
+	return zero - (uint64_t)(bit & 1);
 }
 
 
+static ALWAYS_INLINE bool lanes_any(lanes_t x)
+{
+	uint64_t r = 0;
+	for (int i = 0; i < LANE_WORDS; i++) {
+		r |= x[i];
+	}
+	return r != 0;
+}
+
+
+static ALWAYS_INLINE lanes_t load_lanes(uint64_t *lanes, uint32_t block)
+{
+	return *(lanes_t *)&lanes[block * LANE_WORDS];
+}
+
+
+static ALWAYS_INLINE void or_lanes(uint64_t *lanes, uint32_t block, lanes_t x)
+{
+	for (int i = 0; i < LANE_WORDS; i++) {
+		if (x[i]) {
+			__sync_fetch_and_or(&lanes[block * LANE_WORDS + i], x[i]);
+		}
+	}
+}
+
+
+// s ? b : a
+static ALWAYS_INLINE lanes_t mux(lanes_t s, lanes_t a, lanes_t b)
+{
+	return a ^ (s & (a ^ b));
+}
+
+
+// 4 input function with truth table t. Folds to a few operations for a constant t.
+static ALWAYS_INLINE lanes_t lut4(uint16_t t, const lanes_t *x)
+{
+	lanes_t r[4];
+	for (int i = 0; i < 4; i++) {
+		uint16_t q = t >> (4*i);
+		r[i] = mux(x[1], mux(x[0], broadcast(q), broadcast(q>>1)), mux(x[0], broadcast(q>>2), broadcast(q>>3)));
+	}
+	return mux(x[3], mux(x[2], r[0], r[1]), mux(x[2], r[2], r[3]));
+}
+
+
+// the part of filter() from the upper three nibbles, as bits 2..0 of the index to 0xEC57E80A
+static inline uint32_t filter_hi(uint32_t x)
+{
+	return (0x3c8b0 >> (x >> 8 & 0xf) & 4) | (0x1e458 >> (x >> 12 & 0xf) & 2) | (0x0d938 >> (x >> 16 & 0xf) & 1);
+}
+
+
+// One of the 9 steps of keystream_parity(). n[i] is the bit shifted into the delta state in step i.
+static ALWAYS_INLINE lanes_t keystream_step(int step, uint32_t even_state, uint32_t odd_base, lanes_t *n)
+{
+	lanes_t a[8], x[8];
+	uint32_t window;
+
+	// the filter input is the odd half of the state, starting with odd_state >> 4 and then
+	// alternating with even_state >> 3, odd_state >> 3, ... The delta touches its 5 low bits only.
+	if (step & 1) {
+		uint32_t shift = 3 - step/2;
+		window = even_state >> shift;
+		for (int j = 0; j < 8; j++) {
+			a[j] = broadcast(window >> j);
+		}
+	} else {
+		uint32_t shift = 4 - step/2;
+		window = odd_base >> shift;
+		for (int j = 0; j < 8; j++) {
+			a[j] = (j + shift < LANE_BITS) ? odd_lane_bits[j + shift] : broadcast(window >> j);
+		}
+	}
+	for (int j = 0; j < 8; j++) {
+		x[j] = a[j];
+		if (j < 5 && step - 1 - 2*j >= 0) {
+			x[j] ^= n[step - 1 - 2*j];
+		}
+	}
+
+	// filter(a) ^ filter(x). The upper nibbles are the same for all lanes and for both.
+	uint32_t hi = filter_hi(window);
+	lanes_t c1 = broadcast((0xEC57E80A >> hi) ^ (0xEC57E80A >> (hi + 8)));
+	lanes_t c0 = broadcast((0xEC57E80A >> hi) ^ (0xEC57E80A >> (hi + 16)));
+	lanes_t c01 = broadcast((0xEC57E80A >> hi) ^ (0xEC57E80A >> (hi + 8)) ^ (0xEC57E80A >> (hi + 16)) ^ (0xEC57E80A >> (hi + 24)));
+	lanes_t t0a = lut4((0xf22c0 >> 4) & 0xffff, &a[0]);
+	lanes_t t1a = lut4((0x6c9c0 >> 3) & 0xffff, &a[4]);
+	lanes_t t0x = lut4((0xf22c0 >> 4) & 0xffff, &x[0]);
+	lanes_t t1x = lut4((0x6c9c0 >> 3) & 0xffff, &x[4]);
+	return ((t1a ^ t1x) & c1) ^ ((t0a ^ t0x) & c0) ^ (((t0a & t1a) ^ (t0x & t1x)) & c01);
+}
+
+
+// The lanes where the 9 bits of keystream for the states (even_state, odd_base + lane) have
+// the parity of the bitflip property
+static lanes_t keystream_parity(uint32_t even_state, uint32_t odd_base, uint8_t bitflip)
+{
+	lanes_t n[8];
+	lanes_t parity = broadcast(evenparity32(bitflip) ^ 1);
+
+#define KEYSTREAM_STEP(i) { \
+		lanes_t keystream_bit = keystream_step(i, even_state, odd_base, n); \
+		parity ^= keystream_bit; \
+		if (i < 8) { \
+			n[i] = keystream_bit ^ broadcast(bitflip >> i); \
+			if (i >= 5) n[i] ^= n[i-5]; \
+			if (i >= 6) n[i] ^= n[i-6]; \
+			if (i >= 7) n[i] ^= n[i-7]; \
+		} \
+	}
+	KEYSTREAM_STEP(0) KEYSTREAM_STEP(1) KEYSTREAM_STEP(2) KEYSTREAM_STEP(3) KEYSTREAM_STEP(4)
+	KEYSTREAM_STEP(5) KEYSTREAM_STEP(6) KEYSTREAM_STEP(7) KEYSTREAM_STEP(8)
+#undef KEYSTREAM_STEP
+
+	return parity;
+}
+
+
+// The original one state at a time calculation, for the self test
+static bool keystream_parity_scalar(uint32_t even_state, uint32_t odd_state, uint16_t bitflip)
+{
+	// load crypto1 state
+	struct Crypto1State cs;
+	cs.odd = odd_state >> 4;
+	cs.even = even_state >> 4;
+
+	// track flipping bits in state
+	struct Crypto1DeltaState {
+		uint_fast8_t odd;
+		uint_fast8_t even;
+	} cs_delta;
+	cs_delta.odd = 0;
+	cs_delta.even = 0;
+
+	uint_fast16_t keystream = 0;
+
+	// decrypt 9 bits
+	for (int i = 0; i < 9; i++) {
+		uint_fast8_t keystream_bit = filter(cs.odd & 0x000fffff) ^ filter((cs.odd & 0x000fffff) ^ cs_delta.odd);
+		keystream = keystream << 1 | keystream_bit;
+		uint_fast8_t nt_bit = BIT(bitflip, i) ^ keystream_bit;
+		uint_fast8_t LSFR_feedback = BIT(cs_delta.odd, 2) ^ BIT(cs_delta.even, 2) ^ BIT(cs_delta.odd, 3);
+
+		cs_delta.even = cs_delta.even << 1 | (LSFR_feedback ^ nt_bit);
+		uint_fast8_t tmp = cs_delta.odd;
+		cs_delta.odd = cs_delta.even;
+		cs_delta.even = tmp;
+
+		cs.even = cs.odd;
+		if (i & 1) {
+			cs.odd = odd_state >> (7 - i) / 2;
+		} else {
+			cs.odd = even_state >> (7 - i) / 2;
+		}
+	}
+
+	return evenparity32(keystream) == evenparity32(bitflip & 0xff);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// sum property
+
 uint32_t *restrict part_sum_a0_bitarrays[2][NUM_PART_SUMS];
 
 static void init_part_sum_bitarrays(void)
@@ -194,16 +431,12 @@ static void init_part_sum_bitarrays(void)
 	printf("init_part_sum_bitarrays()...");
 	for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
 		for (uint16_t part_sum_a0 = 0; part_sum_a0 < NUM_PART_SUMS; part_sum_a0++) {
-			part_sum_a0_bitarrays[odd_even][part_sum_a0] = (uint32_t *)malloc_bitarray(sizeof(uint32_t) * (1<<19));
-			if (part_sum_a0_bitarrays[odd_even][part_sum_a0] == NULL) {
-				printf("Out of memory error in init_part_suma0_statelists(). Aborting...\n");
-				exit(4);
-			}
+			part_sum_a0_bitarrays[odd_even][part_sum_a0] = malloc_bitarray_or_exit(sizeof(uint32_t) * (1<<19));
 			clear_bitarray24(part_sum_a0_bitarrays[odd_even][part_sum_a0]);
 		}
 	}
 	for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
-		//printf("(%d, %" PRIu16 ")...", odd_even, part_sum_a0);			
+		//printf("(%d, %" PRIu16 ")...", odd_even, part_sum_a0);
 		for (uint32_t state = 0; state < (1<<20); state++) {
 			uint16_t part_sum_a0 = PartialSumProperty(state, odd_even) / 2;
 			for (uint16_t low_bits = 0; low_bits < 1<<4; low_bits++) {
@@ -215,7 +448,7 @@ static void init_part_sum_bitarrays(void)
 }
 
 
-static void free_part_sum_bitarrays(void) 
+static void free_part_sum_bitarrays(void)
 {
 	printf("free_part_sum_bitarrays()...");
 	for (int16_t part_sum_a0 = (NUM_PART_SUMS-1); part_sum_a0 >= 0; part_sum_a0--) {
@@ -227,366 +460,795 @@ static void free_part_sum_bitarrays(void)
 	printf("done.\n");
 }
 
-uint32_t *restrict sum_a0_bitarray[2];
 
-void init_sum_bitarray(uint16_t sum_a0)
+uint64_t *restrict sum_a0_lanes[2];
+
+// The states to search, in lane arrays. All states without a sum property (sum_a0 < 0).
+static void init_sum_lanes(int sum_a0)
 {
 	printf("init_sum_bitarray()...\n");
+	uint32_t *sum_a0_bitarray = malloc_bitarray_or_exit(sizeof(uint32_t) * (1<<19));
 	for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
-		sum_a0_bitarray[odd_even] = (uint32_t *)malloc_bitarray(sizeof(uint32_t) * (1<<19));
-		if (sum_a0_bitarray[odd_even] == NULL) {
-			printf("Out of memory error in init_sum_bitarrays(). Aborting...\n");
-			exit(4);
-		}
-		clear_bitarray24(sum_a0_bitarray[odd_even]);
-	}
-	for (uint8_t p = 0; p < NUM_PART_SUMS; p++) {
-		for (uint8_t q = 0; q < NUM_PART_SUMS; q++) {
-			if (sum_a0 == 2*p*(16-2*q) + (16-2*p)*2*q) {
-				for (uint32_t i = 0; i < (1<<19); i++) {
-					sum_a0_bitarray[EVEN_STATE][i] |= part_sum_a0_bitarrays[EVEN_STATE][q][i];
-					sum_a0_bitarray[ODD_STATE][i] |= part_sum_a0_bitarrays[ODD_STATE][p][i];
+		sum_a0_lanes[odd_even] = malloc_bitarray_or_exit(sizeof(uint64_t) * (1<<18));
+		if (sum_a0 < 0) {
+			memset(sum_a0_lanes[odd_even], 0xff, sizeof(uint64_t) * (1<<18));
+			continue;
+		}
+		clear_bitarray24(sum_a0_bitarray);
+		for (uint8_t p = 0; p < NUM_PART_SUMS; p++) {
+			for (uint8_t q = 0; q < NUM_PART_SUMS; q++) {
+				if (sum_a0 == 2*p*(16-2*q) + (16-2*p)*2*q) {
+					uint32_t *part_sum = part_sum_a0_bitarrays[odd_even][odd_even == EVEN_STATE ? q : p];
+					for (uint32_t i = 0; i < (1<<19); i++) {
+						sum_a0_bitarray[i] |= part_sum[i];
+					}
 				}
 			}
 		}
-	}
-	for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
-		uint32_t count = count_states(sum_a0_bitarray[odd_even]);
+		uint32_t count = count_states(sum_a0_bitarray);
 		printf("sum_a0_bitarray[%s] has %d states (%5.2f%%)\n", odd_even==EVEN_STATE?"even":"odd ", count, (float)count/(1<<24)*100.0);
+		bitarray_to_lanes(sum_a0_bitarray, sum_a0_lanes[odd_even]);
 	}
+	free_bitarray(sum_a0_bitarray);
 	printf("done.\n");
 }
 
-	
-static void free_sum_bitarray(void)
+
+static void free_sum_lanes(void)
 {
-	printf("free_sum_bitarray()...");
-	free_bitarray(sum_a0_bitarray[ODD_STATE]);
-	free_bitarray(sum_a0_bitarray[EVEN_STATE]);
-	printf("done.\n");
+	free_bitarray(sum_a0_lanes[ODD_STATE]);
+	free_bitarray(sum_a0_lanes[EVEN_STATE]);
 }
 
 
-static void precalculate_bit0_bitflip_bitarrays(uint8_t const bitflip, uint16_t const sum_a0)
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// worker threads
+
+static int num_threads;
+static void (*chunk_function)(uint32_t chunk);
+static uint8_t *chunk_done;						// optional, chunks to skip
+static uint32_t num_work_chunks;
+static volatile uint32_t next_chunk;
+static volatile uint32_t chunks_finished;
+static volatile bool stop_work;
+
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+worker_thread(void *arg)
 {
-	// #define TEST_RUN
-	#ifdef TEST_RUN
-	#define NUM_TEST_STATES	(1<<10)
-	#else
-	#define NUM_TEST_STATES (1<<23)
-	#endif
-	
-	time_t start_time = time(NULL);
-	time_t last_check_time = start_time;
-	
-	uint32_t *restrict test_bitarray[2];
-	uint32_t *restrict test_not_bitarray[2];
-
-	test_bitarray[EVEN_STATE] = malloc_bitarray(sizeof(uint32_t) * (1<<19));
-	clear_bitarray24(test_bitarray[EVEN_STATE]);
-	test_bitarray[ODD_STATE] = malloc_bitarray(sizeof(uint32_t) * (1<<19));
-	clear_bitarray24(test_bitarray[ODD_STATE]);
-
-	test_not_bitarray[EVEN_STATE] = malloc_bitarray(sizeof(uint32_t) * (1<<19));
-	clear_bitarray24(test_not_bitarray[EVEN_STATE]);
-	test_not_bitarray[ODD_STATE] = malloc_bitarray(sizeof(uint32_t) * (1<<19));
-	clear_bitarray24(test_not_bitarray[ODD_STATE]);
-	
-	uint32_t count[2];
-	bool all_odd_states_are_possible_for_notbitflip = false;
-
-	printf("\n\nStarting search for crypto1 states resulting in bitflip property 0x%03x...\n", bitflip);
-	for (uint32_t even_state = next_state(sum_a0_bitarray[EVEN_STATE], -1); even_state < NUM_TEST_STATES; even_state = next_state(sum_a0_bitarray[EVEN_STATE], even_state)) {
-		bool even_state_is_possible = false;
-		time_t time_now = time(NULL);
-		if (difftime(time_now, last_check_time) > 5*60) {	// print status every 5 minutes
-			float runtime = difftime(time_now, start_time);
-			float remaining_time = runtime * ((1<<23) - even_state) / even_state;
-			printf("\n%1.1f hours elapsed, expected completion in %1.1f hours (%1.1f days)", runtime/3600, remaining_time/3600, remaining_time/3600/24); 
-			last_check_time = time_now;
-		}
-		for (uint32_t odd_state = next_state(sum_a0_bitarray[ODD_STATE], -1); odd_state < (1<<24); odd_state = next_state(test_bitarray[ODD_STATE], odd_state)) {
-			if (even_state_is_possible && test_bit24(test_bitarray[ODD_STATE], odd_state)) continue;
-			// load crypto1 state
-			struct Crypto1State cs;
-			cs.odd = odd_state >> 4;
-			cs.even = even_state >> 4;
-
-			// track flipping bits in state
-			struct Crypto1DeltaState {
-				uint_fast8_t odd;
-				uint_fast8_t even;
-			} cs_delta;
-			cs_delta.odd = 0;
-			cs_delta.even = 0;
-			
-			uint_fast16_t keystream = 0;
-			
-			// decrypt 9 bits
-			for (int i = 0; i < 9; i++) {
-				uint_fast8_t keystream_bit = filter(cs.odd & 0x000fffff) ^ filter((cs.odd & 0x000fffff) ^ cs_delta.odd); 
-				keystream = keystream << 1 | keystream_bit;
-				uint_fast8_t nt_bit = BIT(bitflip, i) ^ keystream_bit;
-				uint_fast8_t LSFR_feedback = BIT(cs_delta.odd, 2) ^ BIT(cs_delta.even, 2) ^ BIT(cs_delta.odd, 3); 
-
-				cs_delta.even = cs_delta.even << 1 | (LSFR_feedback ^ nt_bit);
-				uint_fast8_t tmp = cs_delta.odd;
-				cs_delta.odd = cs_delta.even;
-				cs_delta.even = tmp;
-
-				cs.even = cs.odd;
-				if (i & 1) {
-					cs.odd = odd_state >> (7 - i) / 2;
-				} else {
-					cs.odd = even_state >> (7 - i) / 2;
-				}
+	while (!stop_work) {
+		uint32_t chunk = __sync_fetch_and_add(&next_chunk, 1);
+		if (chunk >= num_work_chunks) {
+			break;
+		}
+		if (chunk_done == NULL || !chunk_done[chunk]) {
+			chunk_function(chunk);
+			__sync_synchronize();
+			if (chunk_done != NULL) {
+				chunk_done[chunk] = 1;
 			}
-			
-			if (evenparity32(keystream) == evenparity32(bitflip)) {
-				// found valid bitflip state
-				even_state_is_possible = true;
-				set_bit24(test_bitarray[EVEN_STATE], even_state);
-				set_bit24(test_bitarray[EVEN_STATE], 1 << 23 | even_state);
-				set_bit24(test_bitarray[ODD_STATE], odd_state);
-			} else {
-				// found valid !bitflip state
-				set_bit24(test_not_bitarray[EVEN_STATE], even_state);
-				set_bit24(test_not_bitarray[EVEN_STATE], 1 << 23 | even_state);
-				set_bit24(test_not_bitarray[ODD_STATE], odd_state);
-			}				
 		}
-		if (!even_state_is_possible) {
-			all_odd_states_are_possible_for_notbitflip = true;
+		__sync_fetch_and_add(&chunks_finished, 1);
+	}
+	return NULL;
+}
+
+
+// Run fn for the chunks 0..num_chunks-1 on all threads. monitor is called about once a second
+// while they run.
+static void run_parallel(void (*fn)(uint32_t chunk), uint32_t num_chunks, uint8_t *done, void (*monitor)(void))
+{
+	pthread_t threads[MAX_THREADS];
+
+	chunk_function = fn;
+	chunk_done = done;
+	num_work_chunks = num_chunks;
+	next_chunk = 0;
+	chunks_finished = 0;
+	stop_work = false;
+	for (int i = 0; i < num_threads; i++) {
+		pthread_create(&threads[i], NULL, worker_thread, NULL);
+	}
+	while (monitor != NULL && chunks_finished < num_chunks) {
+		for (int i = 0; i < 10 && chunks_finished < num_chunks; i++) {
+			msleep(100);
 		}
+		monitor();
+	}
+	for (int i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
 	}
+}
 
-	printf("\nAnalysis completed. Checking for effective bitflip properties...\n");
-	for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
-		count[odd_even] = count_states(test_bitarray[odd_even]);
-		if (count[odd_even] != 1<<24) {
-			printf("Writing %d possible %s states for bitflip property %03x (%d (%1.2f%%) states eliminated)\n", 
-				count[odd_even], 
-				odd_even==EVEN_STATE?"even":"odd", 
-				bitflip, (1<<24) - count[odd_even],
-				(float)((1<<24) - count[odd_even]) / (1<<24) * 100.0);
-			#ifndef TEST_RUN
-			write_bitflips_file(odd_even, bitflip, sum_a0, test_bitarray[odd_even], count[odd_even]);
-			#endif
-		} else {
-			printf("All %s states for bitflip property %03x are possible. No file written.\n", odd_even==EVEN_STATE?"even":"odd", bitflip);
+
+static int default_num_threads(void)
+{
+#if defined (_WIN32)
+	SYSTEM_INFO sysinfo;
+	GetSystemInfo(&sysinfo);
+	int n = sysinfo.dwNumberOfProcessors;
+#else
+	int n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return n < 1 ? 1 : n > MAX_THREADS ? MAX_THREADS : n;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// table files
+
+static voidpf zlib_malloc(voidpf opaque, uInt items, uInt size)
+{
+	return malloc(items*size);
+}
+
+
+static void zlib_free(voidpf opaque, voidpf address)
+{
+	free(address);
+}
+
+
+static void state_file_name(char *filename, odd_even_t odd_even, uint16_t bitflip, int sum_a0)
+{
+	if (sum_a0 < 0) {
+		sprintf(filename, STATE_FILE_TEMPLATE, odd_even, bitflip);
+	} else {
+		sprintf(filename, STATE_FILE_TEMPLATE_SUM, odd_even, bitflip, sum_a0);
+	}
+}
+
+
+// Write count and bitset, deflated in the zlib format the client reads
+static bool write_bitflips_file(odd_even_t odd_even, uint16_t bitflip, int sum_a0, uint32_t *bitset, uint32_t count)
+{
+	char filename[80];
+	uint8_t output_buffer[65536];
+	z_stream compressed_stream;
+
+	state_file_name(filename, odd_even, bitflip, sum_a0);
+	FILE *outfile = fopen(filename, "wb");
+	if (outfile == NULL) {
+		printf("Can't create %s\n", filename);
+		return false;
+	}
+
+	memset(&compressed_stream, 0, sizeof(compressed_stream));
+	compressed_stream.zalloc = zlib_malloc;
+	compressed_stream.zfree = zlib_free;
+	deflateInit2(&compressed_stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15, 9, Z_DEFAULT_STRATEGY);
+
+	int ret = Z_OK;
+	for (int part = 0; part < 2 && ret == Z_OK; part++) {
+		compressed_stream.next_in = part == 0 ? (uint8_t *)&count : (uint8_t *)bitset;
+		compressed_stream.avail_in = part == 0 ? sizeof(count) : sizeof(uint32_t) * (1<<19);
+		do {
+			compressed_stream.next_out = output_buffer;
+			compressed_stream.avail_out = sizeof(output_buffer);
+			ret = deflate(&compressed_stream, part == 0 ? Z_NO_FLUSH : Z_FINISH);
+			fwrite(output_buffer, 1, sizeof(output_buffer) - compressed_stream.avail_out, outfile);
+		} while (compressed_stream.avail_out == 0 && ret == Z_OK);
+	}
+	deflateEnd(&compressed_stream);
+
+	if (fclose(outfile) != 0 || ret != Z_STREAM_END) {
+		printf("Error writing %s\n", filename);
+		return false;
+	}
+	return true;
+}
+
+
+// Read a table. Returns false if there is no file (all states are possible).
+static bool read_bitflips_file(const char *directory, odd_even_t odd_even, uint16_t bitflip, uint32_t *bitset, uint32_t *count)
+{
+	char filename[strlen(directory) + 80];
+	z_stream compressed_stream;
+
+	strcpy(filename, directory);
+	state_file_name(filename + strlen(filename), odd_even, bitflip, -1);
+	FILE *statesfile = fopen(filename, "rb");
+	if (statesfile == NULL) {
+		return false;
+	}
+	fseek(statesfile, 0, SEEK_END);
+	uint32_t filesize = (uint32_t)ftell(statesfile);
+	rewind(statesfile);
+	uint8_t *input_buffer = malloc(filesize);
+	if (input_buffer == NULL || fread(input_buffer, 1, filesize, statesfile) != filesize) {
+		printf("File read error with %s. Aborting...\n", filename);
+		exit(5);
+	}
+	fclose(statesfile);
+
+	memset(&compressed_stream, 0, sizeof(compressed_stream));
+	compressed_stream.zalloc = zlib_malloc;
+	compressed_stream.zfree = zlib_free;
+	compressed_stream.next_in = input_buffer;
+	compressed_stream.avail_in = filesize;
+	inflateInit2(&compressed_stream, 0);
+	compressed_stream.next_out = (uint8_t *)count;
+	compressed_stream.avail_out = sizeof(*count);
+	inflate(&compressed_stream, Z_SYNC_FLUSH);
+	compressed_stream.next_out = (uint8_t *)bitset;
+	compressed_stream.avail_out = sizeof(uint32_t) * (1<<19);
+	int ret = inflate(&compressed_stream, Z_FINISH);
+	inflateEnd(&compressed_stream);
+	free(input_buffer);
+	if (ret != Z_STREAM_END || compressed_stream.avail_out != 0) {
+		printf("%s is corrupted. Aborting...\n", filename);
+		exit(5);
+	}
+	return true;
+}
+
+
+// The table for the 2nd byte: a state is possible if any of the 16 states it can have been one step
+// earlier was possible for the 1st byte
+static void derive_2nd_byte_bitarray(uint32_t *bitset, uint32_t *bitset_2nd)
+{
+	clear_bitarray24(bitset_2nd);
+	for (uint32_t state = 0; state < (1<<24); state += 1<<4) {
+		uint32_t line = bitset[state>>5];
+		uint16_t half_line = state&0x000000010 ? line&0x0000ffff : line>>16;
+		if (half_line != 0) {
+			for (uint32_t low_bits = 0; low_bits < (1<<4); low_bits++) {
+				set_bit24(bitset_2nd, low_bits << 20 | state >> 4);
+			}
 		}
 	}
-	uint32_t *restrict test_bitarray_2nd = malloc_bitarray(sizeof(uint32_t) * (1<<19));
-	clear_bitarray24(test_bitarray_2nd);
+}
+
+
+static void write_tables(uint16_t bitflip, int sum_a0, uint64_t **lanes)
+{
+	uint32_t *bitset = malloc_bitarray_or_exit(sizeof(uint32_t) * (1<<19));
+	uint32_t *bitset_2nd = malloc_bitarray_or_exit(sizeof(uint32_t) * (1<<19));
+
 	for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
-		if (count[odd_even] != 1<<24) {
-			for (uint32_t state = 0; state < (1<<24); state += 1<<4) {
-				uint32_t line = test_bitarray[odd_even][state>>5];
-				uint16_t half_line = state&0x000000010 ? line&0x0000ffff : line>>16;
-				if (half_line != 0) {
-					for (uint32_t low_bits = 0; low_bits < (1<<4); low_bits++) {
-						set_bit24(test_bitarray_2nd, low_bits << 20 | state >> 4);
-					}
-				}
-			}
-			count[odd_even] = count_states(test_bitarray_2nd);
-			if (count[odd_even] != 1<<24) {
-				printf("Writing %d possible %s states for bitflip property %03x (%d (%1.2f%%) states eliminated)\n", 
-					count[odd_even], 
-					odd_even==EVEN_STATE?"even":"odd", 
-					bitflip | BITFLIP_2ND_BYTE, (1<<24) - count[odd_even],
-					(float)((1<<24) - count[odd_even]) / (1<<24) * 100.0);
+		lanes_to_bitarray(lanes[odd_even], bitset);
+		derive_2nd_byte_bitarray(bitset, bitset_2nd);
+		uint32_t *tables[2] = {bitset, bitset_2nd};
+		for (int i = 0; i < 2; i++) {
+			uint16_t property = bitflip | (i ? BITFLIP_2ND_BYTE : 0);
+			uint32_t count = count_states(tables[i]);
+			if (count != 1<<24) {
+				printf("Writing %d possible %s states for bitflip property %03x (%d (%1.2f%%) states eliminated)\n",
+					count,
+					odd_even==EVEN_STATE?"even":"odd",
+					property, (1<<24) - count,
+					(float)((1<<24) - count) / (1<<24) * 100.0);
 				#ifndef TEST_RUN
-				write_bitflips_file(odd_even, bitflip | BITFLIP_2ND_BYTE, sum_a0, test_bitarray_2nd, count[odd_even]);
+				if (!write_bitflips_file(odd_even, property, sum_a0, tables[i], count)) {
+					exit(2);
+				}
 				#endif
 			} else {
-				printf("All %s states for bitflip property %03x are possible. No file written.\n", odd_even==EVEN_STATE?"even":"odd", bitflip | BITFLIP_2ND_BYTE);
-			}
-		} else {
-			printf("All %s states for bitflip property %03x are possible. No file written.\n", odd_even==EVEN_STATE?"even":"odd", bitflip | BITFLIP_2ND_BYTE);
-		}
-	}
-
-	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	// second run for the remaining "not bitflip" states
-	printf("\n\nStarting search for crypto1 states resulting in bitflip property 0x%03x...", bitflip | 0x100);
-	start_time = time(NULL);
-	last_check_time = start_time;
-	for (uint32_t even_state = next_state(sum_a0_bitarray[EVEN_STATE], -1); even_state < NUM_TEST_STATES; even_state = next_state(sum_a0_bitarray[EVEN_STATE], even_state)) {
-		bool even_state_is_possible = test_bit24(test_not_bitarray[EVEN_STATE], even_state);
-		time_t time_now = time(NULL);
-		if (difftime(time_now, last_check_time) > 5*60) {	// print status every 5 minutes
-			float runtime = difftime(time_now, start_time);
-			float remaining_time = runtime * ((1<<23) - even_state) / even_state;
-			printf("\n%1.1f hours elapsed, expected completion in %1.1f hours (%1.1f days)", runtime/3600, remaining_time/3600, remaining_time/3600/24); 
-			last_check_time = time_now;
-		}
-		for (uint32_t odd_state = next_state(sum_a0_bitarray[ODD_STATE], -1); odd_state < (1<<24); odd_state = next_state(sum_a0_bitarray[ODD_STATE], odd_state)) {
-			if (even_state_is_possible) {
-				if (all_odd_states_are_possible_for_notbitflip) break;
-				if (test_bit24(test_not_bitarray[ODD_STATE], odd_state)) continue;
+				printf("All %s states for bitflip property %03x are possible. No file written.\n", odd_even==EVEN_STATE?"even":"odd", property);
 			}
-			// load crypto1 state
-			struct Crypto1State cs;
-			cs.odd = odd_state >> 4;
-			cs.even = even_state >> 4;
-
-			// track flipping bits in state
-			struct Crypto1DeltaState {
-				uint_fast8_t odd;
-				uint_fast8_t even;
-			} cs_delta;
-			cs_delta.odd = 0;
-			cs_delta.even = 0;
-			
-			uint_fast16_t keystream = 0;
-			// uint_fast16_t nt = 0;
-			
-			// decrypt 9 bits
-			for (int i = 0; i < 9; i++) {
-				uint_fast8_t keystream_bit = filter(cs.odd & 0x000fffff) ^ filter((cs.odd & 0x000fffff) ^ cs_delta.odd); 
-				keystream = keystream << 1 | keystream_bit;
-				uint_fast8_t nt_bit = BIT(bitflip|0x100, i) ^ keystream_bit;
-				uint_fast8_t LSFR_feedback = BIT(cs_delta.odd, 2) ^ BIT(cs_delta.even, 2) ^ BIT(cs_delta.odd, 3); 
-
-				cs_delta.even = cs_delta.even << 1 | (LSFR_feedback ^ nt_bit);
-				uint_fast8_t tmp = cs_delta.odd;
-				cs_delta.odd = cs_delta.even;
-				cs_delta.even = tmp;
-
-				cs.even = cs.odd;
-				if (i & 1) {
-					cs.odd = odd_state >> (7 - i) / 2;
-				} else {
-					cs.odd = even_state >> (7 - i) / 2;
-				}
+		}
+	}
+
+	free_bitarray(bitset_2nd);
+	free_bitarray(bitset);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// table calculation
+
+static uint8_t search_bitflip;
+static int search_sum_a0;
+static uint64_t *possible_lanes[2];				// states which can result in the bitflip property
+static uint64_t *not_possible_lanes[2];			// states which can result in the !bitflip property
+static uint8_t chunks_done[NUM_CHUNKS];
+static char checkpoint_file[80];
+static uint64_t start_time;
+static uint64_t last_status_time;
+static uint64_t last_checkpoint_time;
+static uint32_t checkpoint_interval;			// ms
+static uint32_t chunks_done_at_start;
+
+
+static void search_chunk(uint32_t chunk)
+{
+	for (uint32_t even_state = chunk * CHUNK_SIZE; even_state < (chunk + 1) * CHUNK_SIZE; even_state++) {
+		if (!test_lane_bit(sum_a0_lanes[EVEN_STATE], even_state)) continue;
+		bool even_state_is_possible = false;
+		bool even_state_is_not_possible = false;
+		for (uint32_t block = 0; block < NUM_BLOCKS; block++) {
+			lanes_t todo = load_lanes(sum_a0_lanes[ODD_STATE], block);
+			// once the even state is settled both ways, only the odd states not settled yet are of interest
+			if (even_state_is_possible && even_state_is_not_possible) {
+				todo &= ~(load_lanes(possible_lanes[ODD_STATE], block) & load_lanes(not_possible_lanes[ODD_STATE], block));
 			}
-			
-			if (evenparity32(keystream) != evenparity32(bitflip)) {
-				// found valid !bitflip state
+			if (!lanes_any(todo)) continue;
+			lanes_t match = keystream_parity(even_state, block * LANES, search_bitflip);
+			lanes_t found = todo & match;
+			if (lanes_any(found)) {
 				even_state_is_possible = true;
-				set_bit24(test_not_bitarray[EVEN_STATE], even_state);
-				set_bit24(test_not_bitarray[EVEN_STATE], 1 << 23 | even_state);
-				set_bit24(test_not_bitarray[ODD_STATE], odd_state);
+				or_lanes(possible_lanes[ODD_STATE], block, found);
+			}
+			found = todo & ~match;
+			if (lanes_any(found)) {
+				even_state_is_not_possible = true;
+				or_lanes(not_possible_lanes[ODD_STATE], block, found);
 			}
 		}
+		if (even_state_is_possible) {
+			set_lane_bit(possible_lanes[EVEN_STATE], even_state);
+			set_lane_bit(possible_lanes[EVEN_STATE], 1 << 23 | even_state);
+		}
+		if (even_state_is_not_possible) {
+			set_lane_bit(not_possible_lanes[EVEN_STATE], even_state);
+			set_lane_bit(not_possible_lanes[EVEN_STATE], 1 << 23 | even_state);
+		}
 	}
-	
-	printf("\nAnalysis completed. Checking for effective !bitflip properties...\n");
+}
+
+
+// header, the done flags of the chunks, then the four lane arrays
+typedef struct {
+	char magic[8];
+	uint32_t bitflip;
+	int32_t sum_a0;
+	uint32_t num_chunks;
+	uint32_t chunk_size;
+} checkpoint_header_t;
+
+
+static void write_checkpoint(uint16_t bitflip, int sum_a0)
+{
+	static uint8_t done[NUM_CHUNKS];
+	char tmp_file[sizeof(checkpoint_file) + 4];
+	checkpoint_header_t header;
+
+	// take the done flags first. The results of a finished chunk are in the arrays by then, results of
+	// chunks still running are saved as well but the chunks will be calculated again.
+	memcpy(done, chunks_done, sizeof(done));
+	__sync_synchronize();
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.bitflip = bitflip;
+	header.sum_a0 = sum_a0;
+	header.num_chunks = NUM_CHUNKS;
+	header.chunk_size = CHUNK_SIZE;
+
+	sprintf(tmp_file, "%s.tmp", checkpoint_file);
+	FILE *f = fopen(tmp_file, "wb");
+	if (f == NULL) {
+		printf("\nCan't write checkpoint file %s\n", tmp_file);
+		return;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(done, sizeof(done), 1, f) == 1;
 	for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
-		count[odd_even] = count_states(test_not_bitarray[odd_even]);
-		if (count[odd_even] != 1<<24) {
-			printf("Writing %d possible %s states for bitflip property %03x (%d (%1.2f%%) states eliminated)\n", 
-				count[odd_even], 
-				odd_even==EVEN_STATE?"even":"odd", 
-				bitflip|0x100, (1<<24) - count[odd_even],
-				(float)((1<<24) - count[odd_even]) / (1<<24) * 100.0);
-			#ifndef TEST_RUN
-			write_bitflips_file(odd_even, bitflip|0x100, sum_a0, test_not_bitarray[odd_even], count[odd_even]);
-			#endif
-		} else {
-			printf("All %s states for bitflip property %03x are possible. No file written.\n", odd_even==EVEN_STATE?"even":"odd", bitflip|0x100);
+		ok = ok && fwrite(possible_lanes[odd_even], sizeof(uint64_t) * (1<<18), 1, f) == 1;
+		ok = ok && fwrite(not_possible_lanes[odd_even], sizeof(uint64_t) * (1<<18), 1, f) == 1;
+	}
+	if (fclose(f) != 0 || !ok) {
+		printf("\nError writing checkpoint file %s\n", tmp_file);
+		return;
+	}
+	remove(checkpoint_file);
+	rename(tmp_file, checkpoint_file);
+}
+
+
+static bool read_checkpoint(uint16_t bitflip, int sum_a0)
+{
+	checkpoint_header_t header;
+
+	FILE *f = fopen(checkpoint_file, "rb");
+	if (f == NULL) {
+		return false;
+	}
+	bool ok = fread(&header, sizeof(header), 1, f) == 1
+		&& !memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic))
+		&& header.bitflip == bitflip && header.sum_a0 == sum_a0
+		&& header.num_chunks == NUM_CHUNKS && header.chunk_size == CHUNK_SIZE
+		&& fread(chunks_done, sizeof(chunks_done), 1, f) == 1;
+	for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+		ok = ok && fread(possible_lanes[odd_even], sizeof(uint64_t) * (1<<18), 1, f) == 1;
+		ok = ok && fread(not_possible_lanes[odd_even], sizeof(uint64_t) * (1<<18), 1, f) == 1;
+	}
+	fclose(f);
+	if (!ok) {
+		printf("%s doesn't match, starting from scratch.\n", checkpoint_file);
+		memset(chunks_done, 0, sizeof(chunks_done));
+		for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+			memset(possible_lanes[odd_even], 0, sizeof(uint64_t) * (1<<18));
+			memset(not_possible_lanes[odd_even], 0, sizeof(uint64_t) * (1<<18));
 		}
 	}
+	return ok;
+}
+
 
-	clear_bitarray24(test_bitarray_2nd);
+static void search_monitor(void)
+{
+	uint64_t now = msclock();
+	if (now - last_status_time > 5*60*1000) {	// print status every 5 minutes
+		uint32_t done = chunks_finished;
+		float runtime = (now - start_time) / 1000.0;
+		float remaining_time = done > chunks_done_at_start ? runtime * (NUM_CHUNKS - done) / (done - chunks_done_at_start) : 0;
+		printf("\n%1.1f hours elapsed, %d of %d chunks done, expected completion in %1.1f hours (%1.1f days)",
+			runtime/3600, done, NUM_CHUNKS, remaining_time/3600, remaining_time/3600/24);
+		fflush(stdout);
+		last_status_time = now;
+	}
+	if (now - last_checkpoint_time > checkpoint_interval) {
+		write_checkpoint(search_bitflip, search_sum_a0);
+		last_checkpoint_time = now;
+	}
+}
+
+
+static void precalculate_bitflip_bitarrays(uint8_t const bitflip, int const sum_a0, uint32_t checkpoint_minutes)
+{
+	// #define TEST_RUN
+	#ifdef TEST_RUN
+	#define NUM_SEARCH_CHUNKS	1
+	#else
+	#define NUM_SEARCH_CHUNKS	NUM_CHUNKS
+	#endif
+
+	search_bitflip = bitflip;
+	search_sum_a0 = sum_a0;
 	for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
-		if (count[odd_even] != 1<<24) {
-			for (uint32_t state = 0; state < (1<<24); state += 1<<4) {
-				uint32_t line = test_not_bitarray[odd_even][state>>5];
-				uint16_t half_line = state&0x000000010 ? line&0x0000ffff : line>>16;
-				if (half_line != 0) {
-					for (uint32_t low_bits = 0; low_bits < (1<<4); low_bits++) {
-						set_bit24(test_bitarray_2nd, low_bits << 20 | state >> 4);
-					}
+		possible_lanes[odd_even] = malloc_bitarray_or_exit(sizeof(uint64_t) * (1<<18));
+		memset(possible_lanes[odd_even], 0, sizeof(uint64_t) * (1<<18));
+		not_possible_lanes[odd_even] = malloc_bitarray_or_exit(sizeof(uint64_t) * (1<<18));
+		memset(not_possible_lanes[odd_even], 0, sizeof(uint64_t) * (1<<18));
+	}
+
+	sprintf(checkpoint_file, CHECKPOINT_TEMPLATE, (uint16_t)bitflip, sum_a0);
+	memset(chunks_done, 0, sizeof(chunks_done));
+	chunks_done_at_start = 0;
+	if (read_checkpoint(bitflip, sum_a0)) {
+		for (uint32_t i = 0; i < NUM_CHUNKS; i++) {
+			chunks_done_at_start += chunks_done[i];
+		}
+		printf("Continuing from %s, %d of %d chunks are done.\n", checkpoint_file, chunks_done_at_start, NUM_CHUNKS);
+	}
+
+	start_time = last_status_time = last_checkpoint_time = msclock();
+	checkpoint_interval = checkpoint_minutes * 60 * 1000;
+	printf("\n\nStarting search for crypto1 states resulting in bitflip properties 0x%03x and 0x%03x with %d threads...\n",
+		bitflip, bitflip | NOT_BITFLIP, num_threads);
+	fflush(stdout);
+	run_parallel(search_chunk, NUM_SEARCH_CHUNKS, chunks_done, search_monitor);
+	float runtime = (msclock() - start_time) / 1000.0;
+
+	printf("\nAnalysis completed in %1.1f hours. Checking for effective bitflip properties...\n", runtime/3600);
+	write_tables(bitflip, sum_a0, possible_lanes);
+	write_tables(bitflip | NOT_BITFLIP, sum_a0, not_possible_lanes);
+	remove(checkpoint_file);
+
+	for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+		free_bitarray(not_possible_lanes[odd_even]);
+		free_bitarray(possible_lanes[odd_even]);
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// verification of the shipped tables
+
+#define SAMPLE_EVEN_STATES	64
+#define SAMPLE_ODD_BLOCKS	1
+
+static uint8_t verify_bitflip;
+static bool verify_not_bitflip;
+static uint32_t sample_even_state[SAMPLE_EVEN_STATES];
+static bool sample_even_result[SAMPLE_EVEN_STATES];
+static uint32_t sample_odd_block;
+static uint64_t sample_odd_found[LANE_WORDS] __attribute__((aligned(64)));
+
+
+static inline lanes_t verify_match(uint32_t even_state, uint32_t block)
+{
+	lanes_t match = keystream_parity(even_state, block * LANES, verify_bitflip);
+	return verify_not_bitflip ? ~match : match;
+}
+
+
+static void verify_even_sample(uint32_t sample)
+{
+	sample_even_result[sample] = false;
+	for (uint32_t block = 0; block < NUM_BLOCKS; block++) {
+		if (lanes_any(verify_match(sample_even_state[sample], block))) {
+			sample_even_result[sample] = true;
+			break;
+		}
+	}
+}
+
+
+static void verify_odd_sample(uint32_t chunk)
+{
+	lanes_t all = ~(lanes_t){0};
+	for (uint32_t even_state = chunk * CHUNK_SIZE; even_state < (chunk + 1) * CHUNK_SIZE; even_state++) {
+		lanes_t found = load_lanes(sample_odd_found, 0);
+		if (!lanes_any(~found & all)) {
+			break;
+		}
+		lanes_t match = verify_match(even_state, sample_odd_block) & ~found;
+		if (lanes_any(match)) {
+			or_lanes(sample_odd_found, 0, match);
+		}
+	}
+}
+
+
+static uint32_t verify_random(uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+
+// Compare the bitsliced calculation with the original one for some random states
+static bool verify_keystream_parity(void)
+{
+	uint32_t seed = 0x5eed;
+	for (int i = 0; i < 256; i++) {
+		uint32_t even_state = verify_random(&seed) & 0xffffff;
+		uint32_t block = verify_random(&seed) % NUM_BLOCKS;
+		uint16_t bitflip = verify_random(&seed) & 0x1ff;
+		lanes_t match = keystream_parity(even_state, block * LANES, bitflip);
+		for (uint32_t lane = 0; lane < LANES; lane++) {
+			bool bitsliced = match[lane / 64] >> (lane % 64) & 1;
+			if (bitsliced != keystream_parity_scalar(even_state, block * LANES + lane, bitflip)) {
+				printf("Bitsliced keystream differs for even state %06x, odd state %06x, bitflip %03x\n",
+					even_state, block * LANES + lane, bitflip);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+// the 2nd byte tables must be the ones derived from the 1st byte tables
+static uint32_t verify_2nd_byte_tables(const char *directory, uint32_t *bitset, uint32_t *bitset_2nd, uint32_t *bitset_shipped)
+{
+	uint32_t errors = 0;
+	uint32_t checked = 0;
+
+	for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+		for (uint16_t bitflip = 0x001; bitflip < BITFLIP_2ND_BYTE; bitflip++) {
+			uint32_t count, count_2nd;
+			bool have_1st = read_bitflips_file(directory, odd_even, bitflip, bitset, &count);
+			bool have_2nd = read_bitflips_file(directory, odd_even, bitflip | BITFLIP_2ND_BYTE, bitset_shipped, &count_2nd);
+			if (!have_1st) {
+				if (have_2nd) {
+					printf("%s table %03x is missing, but %03x is there\n", odd_even==EVEN_STATE?"even":"odd", bitflip, bitflip | BITFLIP_2ND_BYTE);
+					errors++;
 				}
+				continue;
 			}
-			count[odd_even] = count_states(test_bitarray_2nd);
-			if (count[odd_even] != 1<<24) {
-				printf("Writing %d possible %s states for bitflip property %03x (%d (%1.2f%%) states eliminated)\n", 
-					count[odd_even], 
-					odd_even==EVEN_STATE?"even":"odd", 
-					bitflip | 0x100| BITFLIP_2ND_BYTE, (1<<24) - count[odd_even],
-					(float)((1<<24) - count[odd_even]) / (1<<24) * 100.0);
-				#ifndef TEST_RUN
-				write_bitflips_file(odd_even, bitflip | 0x100 | BITFLIP_2ND_BYTE, sum_a0, test_bitarray_2nd, count[odd_even]);
-				#endif
-			} else {
-				printf("All %s states for bitflip property %03x are possible. No file written.\n", odd_even==EVEN_STATE?"even":"odd", bitflip | 0x100 | BITFLIP_2ND_BYTE);
+			checked++;
+			if (count != count_states(bitset)) {
+				printf("%s table %03x: count is %d, but the table has %d states\n", odd_even==EVEN_STATE?"even":"odd", bitflip, count, count_states(bitset));
+				errors++;
+			}
+			if (odd_even == EVEN_STATE && memcmp(bitset, bitset + (1<<18), sizeof(uint32_t) * (1<<18))) {
+				printf("even table %03x depends on the highest bit of the state\n", bitflip);
+				errors++;
+			}
+			derive_2nd_byte_bitarray(bitset, bitset_2nd);
+			if (!have_2nd) {
+				memset(bitset_shipped, 0xff, sizeof(uint32_t) * (1<<19));
+			}
+			if (memcmp(bitset_2nd, bitset_shipped, sizeof(uint32_t) * (1<<19))) {
+				printf("%s table %03x differs from the one derived from %03x\n", odd_even==EVEN_STATE?"even":"odd", bitflip | BITFLIP_2ND_BYTE, bitflip);
+				errors++;
 			}
-		} else {
-			printf("All %s states for bitflip property %03x are possible. No file written.\n", odd_even==EVEN_STATE?"even":"odd", bitflip | 0x100 | BITFLIP_2ND_BYTE);
 		}
 	}
+	printf("%d tables for the 1st byte, their 2nd byte tables: %s\n", checked, errors ? "FAILED" : "ok");
+	return errors;
+}
 
-	free_bitarray(test_bitarray_2nd);
-	free_bitarray(test_not_bitarray[ODD_STATE]);
-	free_bitarray(test_not_bitarray[EVEN_STATE]);
-	free_bitarray(test_bitarray[ODD_STATE]);
-	free_bitarray(test_bitarray[EVEN_STATE]);
-	
-	exit(0);
+
+// Recalculate some states of a table
+static uint32_t verify_samples(const char *directory, uint16_t bitflip, uint32_t **bitset)
+{
+	uint32_t errors = 0;
+	uint32_t seed = bitflip;
+	uint32_t count;
+	uint64_t start = msclock();
+
+	for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+		if (!read_bitflips_file(directory, odd_even, bitflip, bitset[odd_even], &count)) {
+			memset(bitset[odd_even], 0xff, sizeof(uint32_t) * (1<<19));
+		}
+	}
+	verify_bitflip = bitflip & 0xff;
+	verify_not_bitflip = (bitflip & NOT_BITFLIP) != 0;
+
+	// even states: half of them possible according to the table, if there are any
+	for (uint32_t i = 0; i < SAMPLE_EVEN_STATES; i++) {
+		uint32_t even_state;
+		for (int tries = 0; tries < 1000; tries++) {
+			even_state = verify_random(&seed) % NUM_EVEN_STATES;
+			if ((test_bit24(bitset[EVEN_STATE], even_state) != 0) == (i & 1)) break;
+		}
+		sample_even_state[i] = even_state;
+	}
+	run_parallel(verify_even_sample, SAMPLE_EVEN_STATES, NULL, NULL);
+	for (uint32_t i = 0; i < SAMPLE_EVEN_STATES; i++) {
+		if (sample_even_result[i] != (test_bit24(bitset[EVEN_STATE], sample_even_state[i]) != 0)) {
+			printf("even state %06x of table %03x should be %s\n", sample_even_state[i], bitflip, sample_even_result[i] ? "possible" : "impossible");
+			errors++;
+		}
+	}
+
+	// odd states: all 256 states of a block, preferably one with states which are not possible
+	for (uint32_t i = 0; i < SAMPLE_ODD_BLOCKS; i++) {
+		for (int tries = 0; tries < 1000; tries++) {
+			sample_odd_block = verify_random(&seed) % NUM_BLOCKS;
+			uint32_t line = 0xffffffff;
+			for (int j = 0; j < LANES / 32; j++) {
+				line &= bitset[ODD_STATE][sample_odd_block * LANES / 32 + j];
+			}
+			if (line != 0xffffffff) break;
+		}
+		memset(sample_odd_found, 0, sizeof(sample_odd_found));
+		run_parallel(verify_odd_sample, NUM_CHUNKS, NULL, NULL);
+		for (uint32_t lane = 0; lane < LANES; lane++) {
+			uint32_t odd_state = sample_odd_block * LANES + lane;
+			bool found = sample_odd_found[lane / 64] >> (lane % 64) & 1;
+			if (found != (test_bit24(bitset[ODD_STATE], odd_state) != 0)) {
+				printf("odd state %06x of table %03x should be %s\n", odd_state, bitflip, found ? "possible" : "impossible");
+				errors++;
+			}
+		}
+	}
+
+	printf("table %03x: %d even and %d odd states recalculated in %1.1f seconds: %s\n", bitflip,
+		SAMPLE_EVEN_STATES, SAMPLE_ODD_BLOCKS * LANES, (msclock() - start) / 1000.0, errors ? "FAILED" : "ok");
+	return errors;
+}
+
+
+static int verify_tables(const char *directory, int num_tables)
+{
+	uint32_t errors = 0;
+	uint32_t *bitset[3];
+	uint16_t tables[NOT_BITFLIP * 2];
+	int num_shipped = 0;
+
+	for (int i = 0; i < 3; i++) {
+		bitset[i] = malloc_bitarray_or_exit(sizeof(uint32_t) * (1<<19));
+	}
+
+	printf("Checking the tables in %s with %d threads\n", directory, num_threads);
+	if (!verify_keystream_parity()) {
+		return 1;
+	}
+	printf("Bitsliced keystream calculation: ok\n");
+
+	errors += verify_2nd_byte_tables(directory, bitset[0], bitset[1], bitset[2]);
+
+	// spread the samples over the 1st byte tables
+	for (uint16_t bitflip = 0x001; bitflip < BITFLIP_2ND_BYTE; bitflip++) {
+		uint32_t count;
+		if (read_bitflips_file(directory, EVEN_STATE, bitflip, bitset[0], &count)
+			|| read_bitflips_file(directory, ODD_STATE, bitflip, bitset[0], &count)) {
+			tables[num_shipped++] = bitflip;
+		}
+	}
+	if (num_tables > num_shipped) {
+		num_tables = num_shipped;
+	}
+	for (int i = 0; i < num_tables; i++) {
+		errors += verify_samples(directory, tables[i * num_shipped / num_tables + num_shipped / num_tables / 2], bitset);
+	}
+
+	for (int i = 0; i < 3; i++) {
+		free_bitarray(bitset[i]);
+	}
+	printf("%s\n", errors ? "Tables differ." : "Tables verified.");
+	return errors ? 1 : 0;
 }
 
 
 int main (int argc, char *argv[]) {
 
 	unsigned int bitflip_in;
-	int sum_a0;
-	
+	int sum_a0 = -1;
+	bool verify = false;
+	int num_tables = 2;
+	uint32_t checkpoint_minutes = 10;
+	int opt;
+
+	num_threads = default_num_threads();
+	while ((opt = getopt(argc, argv, "vt:c:n:")) != -1) {
+		switch (opt) {
+			case 'v': verify = true; break;
+			case 't': num_threads = atoi(optarg); break;
+			case 'c': checkpoint_minutes = atoi(optarg); break;
+			case 'n': num_tables = atoi(optarg); break;
+			default: argc = 0; break;
+		}
+	}
+	if (num_threads < 1 || num_threads > MAX_THREADS) {
+		printf("Number of threads must be between 1 and %d\n\n", MAX_THREADS);
+		return 1;
+	}
+
+	init_odd_lane_bits();
+
+	if (verify && argc - optind <= 1) {
+		return verify_tables(argc - optind == 1 ? argv[optind] : TABLES_DIRECTORY, num_tables);
+	}
+
 	printf("Create tables required by hardnested attack.\n");
-	printf("Expect a runtime in the range of days or weeks.\n");
-	printf("Single thread only. If you want to use several threads, start it multiple times :-)\n\n");
+	printf("Expect a runtime in the range of days or weeks, divided by the number of cores.\n\n");
 
-	if (argc != 2 && argc != 3) {
-		printf(" syntax: %s <bitflip property> [<Sum_a0>]\n\n", argv[0]);
+	if (verify || (argc - optind != 1 && argc - optind != 2)) {
+		printf(" syntax: %s [-t <threads>] [-c <checkpoint minutes>] <bitflip property> [<Sum_a0>]\n", argv[0]);
+		printf("         %s -v [-t <threads>] [-n <tables to sample>] [<tables directory>]\n\n", argv[0]);
 		printf(" example: %s 1f\n", argv[0]);
+		printf("          %s -v %s\n", argv[0], TABLES_DIRECTORY);
 		return 1;
 	}
 
-	sscanf(argv[1],"%x", &bitflip_in);
+	sscanf(argv[optind],"%x", &bitflip_in);
 
 	if (bitflip_in > 255) {
 		printf("Bitflip property must be less than or equal to 0xff\n\n");
 		return 1;
 	}
-	
-	if(argc == 3) {
-		sscanf(argv[2], "%d", &sum_a0);
-	}
-
-	switch (sum_a0) {
-		case 0:
-		case  32:
-		case  56:
-		case  64:
-		case  80:
-		case  96:
-		case  104:
-		case  112:
-		case  120:
-		case  128:
-		case  136:
-		case  144:
-		case  152:
-		case  160:
-		case  176:
-		case  192:
-		case  200:
-		case  224:
-		case  256: break;
-		default: sum_a0 = -1;
-	}
-	
+
+	if (argc - optind == 2) {
+		sscanf(argv[optind + 1], "%d", &sum_a0);
+		switch (sum_a0) {
+			case 0:
+			case  32:
+			case  56:
+			case  64:
+			case  80:
+			case  96:
+			case  104:
+			case  112:
+			case  120:
+			case  128:
+			case  136:
+			case  144:
+			case  152:
+			case  160:
+			case  176:
+			case  192:
+			case  200:
+			case  224:
+			case  256: break;
+			default:
+				printf("%d is not a possible Sum_a0\n\n", sum_a0);
+				return 1;
+		}
+	}
+
 	printf("Calculating for bitflip = %02x, sum_a0 = %d\n", bitflip_in, sum_a0);
-	
-	init_part_sum_bitarrays();
-	init_sum_bitarray(sum_a0);
-	
-	precalculate_bit0_bitflip_bitarrays(bitflip_in, sum_a0);
-
-	free_sum_bitarray();
-	free_part_sum_bitarrays();
-	
+
+	if (sum_a0 >= 0) {
+		init_part_sum_bitarrays();
+	}
+	init_sum_lanes(sum_a0);
+	if (sum_a0 >= 0) {
+		free_part_sum_bitarrays();
+	}
+
+	precalculate_bitflip_bitarrays(bitflip_in, sum_a0, checkpoint_minutes);
+
+	free_sum_lanes();
+
 	return 0;
-}
\ No newline at end of file
+}
@@ -30,7 +30,13 @@ Command = {
 		o.arg3 = o.arg3 or 0 
 		local data = o.data or "0"
 
-		if(type(data) == 'string') then
+		if bytes.isbytes(data) then
+			-- A buffer is sent as it is, zero padded
+			if(#data > 512) then
+				print( ( "WARNING: data size too large, was %s bytes, will be truncated "):format(#data) )
+				data = data:slice(1,512)
+			end
+		elseif(type(data) == 'string') then
 			-- We need to check if it is correct length, otherwise pad it
 			local len = string.len(data)
 			if(len < 1024) then  
@@ -44,17 +50,26 @@ Command = {
 				data = data:sub(1,1024)
 			end
 		else 
-			print(("WARNING; data was NOT a (hex-) string, but was %s"):format(type(data)))
+			print(("WARNING; data was NOT a (hex-) string or a bytes buffer, but was %s"):format(type(data)))
 		end
 		o.data = data
 		
 		return o
 	end,
+	-- packet is a string or a bytes buffer, the data is parsed into a hex-string
 	parse = function (packet)
 		local count,cmd,arg1,arg2,arg3,data = bin.unpack('LLLLH512',packet)
 		return Command:new{cmd = cmd, arg1 = arg1, arg2 = arg2, arg3 = arg3, data = data}
 	end,
 }
+-- Position of the data in a packet, after the header as packed by getBytes()
+Command.DATA_POS = #bin.pack('LLLL', 0, 0, 0, 0) + 1
+-- Size of a UsbCommand: the header and 512 bytes of data
+Command.SIZE = Command.DATA_POS - 1 + 512
+-- A buffer to receive responses in, see core.WaitForResponseTimeout()
+function Command.newResponse()
+	return bytes.new(Command.SIZE)
+end
 function Command:__tostring()
 	local output = ("%s\r\nargs : (%s, %s, %s)\r\ndata:\r\n%s\r\n"):format(
 		_commands.tostring(self.cmd),
@@ -64,11 +79,19 @@ function Command:__tostring()
 	 	tostring(self.data))
 	return output
 end
+-- The packet as a bytes buffer, for core.SendCommand() and core.session_send()
 function Command:getBytes()
-	--If a hex-string has been used
 	local data  = self.data
 	local cmd = self.cmd 
 	local arg1, arg2, arg3 = self.arg1, self.arg2, self.arg3
-	return bin.pack("LLLLH",cmd, arg1, arg2, arg3, data);
+	local packet = bytes.new(Command.SIZE)
+	local pos = packet:pack("LLLL", 1, cmd, arg1, arg2, arg3)
+	if bytes.isbytes(data) then
+		packet:write(pos, data)
+	else
+		--If a hex-string has been used
+		packet:pack("H", pos, data)
+	end
+	return packet
 end
 return _commands
@@ -67,11 +67,15 @@ local function save_BIN(data, filename)
 		return oops(string.format("Could not write to file %s",tostring(filename)))
 	end
 	
-	-- Write the data into it
-	local i = 1
-	while data[i] do
-		outfile:write(data[i])
-		i = i+1
+	-- Write the data into it, a table of characters or a bytes buffer
+	if bytes.isbytes(data) then
+		outfile:write(data:raw())
+	else
+		local i = 1
+		while data[i] do
+			outfile:write(data[i])
+			i = i+1
+		end
 	end
 	
 	io.close(outfile)
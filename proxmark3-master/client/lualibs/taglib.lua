@@ -69,8 +69,11 @@ manufacturer[0x43]='Top TroniQ Asia Limited Hong [Kong]'
 manufacturer[0x44]='Gentag Inc (USA) [USA]'
 
 return {
+	-- value is the manufacturer code, or a bytes buffer with the UID, which starts with it
 	lookupManufacturer = function (value)
-		if type(value) == 'string' then
+		if bytes.isbytes(value) then
+			value = value[1]
+		elseif type(value) == 'string' then
 			local v = tonumber(value, 16)
 			print(string.format("WARNING: lookupManufacturer expects numeric value, converted %s into %x", value,v))
 			value = v
@@ -49,10 +49,8 @@ local Utils =
 			return nil, string.format("Could not read file %s",filename)
 		end
 		local t = infile:read("*all")
-		len = string.len(t)
-		local  _,hex = bin.unpack(("H%d"):format(len),t)
 		io.close(infile)
-		return hex
+		return bytes.fromstring(t):hex()
 	end,
 	
 	------------ string split function
@@ -73,10 +71,13 @@ local Utils =
 	
 	
 	------------ CRC-16 ccitt checksums
-	-- Takes a hex string and calculates a crc16
+	-- Takes a hex string or a bytes buffer and calculates a crc16
 	Crc16 = function(s)
 		if s == nil then return nil end
 		if #s == 0 then return nil end
+		if bytes.isbytes(s) then
+			return s:crc16()
+		end
 		if  type(s) == 'string' then
 			local utils = require('utils')
 			local asc = utils.ConvertHexToAscii(s)
@@ -87,10 +88,13 @@ local Utils =
 	end,
 	
 	------------ CRC-64 ecma checksums
-	-- Takes a hex string and calculates a crc64 ecma
+	-- Takes a hex string or a bytes buffer and calculates a crc64 ecma
 	Crc64 = function(s)
 		if s == nil then return nil end
 		if #s == 0 then return nil end
+		if bytes.isbytes(s) then
+			return core.crc64(s:raw())
+		end
 		if  type(s) == 'string' then
 			local utils = require('utils')
 			local asc = utils.ConvertHexToAscii(s)
@@ -181,28 +185,39 @@ local Utils =
 		return OUT
 	end,
 	---
-	-- Convert Byte array to string of hex
-	ConvertBytesToHex = function(bytes)
-		if #bytes == 0 then
+	-- Convert Byte array or bytes buffer to string of hex
+	ConvertBytesToHex = function(t)
+		if bytes.isbytes(t) then
+			return t:hex()
+		end
+		if #t == 0 then
 			return ''
 		end
 		local s={}
-		for i = 1, #(bytes) do
-			s[i] = string.format("%02X",bytes[i]) 
+		for i = 1, #(t) do
+			s[i] = string.format("%02X",t[i]) 
 		end
 		return table.concat(s)
 	end,	
-	-- Convert byte array to string with ascii
-    ConvertBytesToAscii = function(bytes)
-		if #bytes == 0 then
+	-- Convert byte array or bytes buffer to string with ascii
+    ConvertBytesToAscii = function(t)
+		if bytes.isbytes(t) then
+			return t:raw()
+		end
+		if #t == 0 then
 			return ''
 		end
 		local s={}
-		for i = 1, #(bytes) do
-			s[i] = string.char(bytes[i]) 
+		for i = 1, #(t) do
+			s[i] = string.char(t[i]) 
 		end
 		return table.concat(s)		
 	end,	 
+	-- Convert a hex string to a bytes buffer, the non hex characters are skipped
+	ConvertHexToBuffer = function(s)
+		if s == nil then return bytes.new(0) end
+		return bytes.fromhex((s:gsub('%X', '')))
+	end,
 	ConvertHexToBytes = function(s)
 		local t={}
 		if s == nil then return t end
@@ -238,6 +253,8 @@ local Utils =
 		local t={}
 		if s == nil then return t end
 		if #s == 0 then return t end
+		local ok, b = pcall(bytes.fromhex, s)
+		if ok then return b:raw() end
 		for k in s:gmatch"(%x%x)" do
 			table.insert(t, string.char(tonumber(k,16)))
 		end
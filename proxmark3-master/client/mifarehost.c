@@ -23,6 +23,7 @@
 #include "parity.h"
 #include "util.h"
 #include "iso14443crc.h"
+#include "crc16.h"
 
 #include "mifare.h"
 
@@ -113,15 +114,86 @@ static uint32_t nonce2key(uint32_t uid, uint32_t nt, uint32_t nr, uint32_t ar, u
 }
 
 
+// The reader responses are processed by a pool of worker threads while the next response is acquired from the Proxmark
+typedef struct {
+	uint32_t uid, nt, nr, ar;
+	uint64_t par_list, ks_list;
+	uint64_t *keylist;
+	uint32_t keycount;
+	volatile bool completed;
+	pthread_t thread_id;
+} darkside_work_t;
+
+
+static void *darkside_worker_thread(void *arg)
+{
+	darkside_work_t *work = (darkside_work_t *)arg;
+
+	work->keycount = nonce2key(work->uid, work->nt, work->nr, work->ar, work->par_list, work->ks_list, &work->keylist);
+	if (work->par_list == 0 && work->keycount > 0) {
+		// candidate lists of NACK-less cards will be intersected. Sort them while we still run in parallel.
+		qsort(work->keylist, work->keycount, sizeof(*work->keylist), compare_uint64);
+	}
+	__sync_synchronize();
+	work->completed = true;
+	return NULL;
+}
+
+
+static void darkside_free_work(darkside_work_t *work, uint16_t first, uint16_t count, uint16_t num_workers)
+{
+	for (uint16_t i = 0; i < count; i++) {
+		darkside_work_t *w = &work[(first + i) % num_workers];
+		pthread_join(w->thread_id, NULL);
+		free(w->keylist);
+	}
+	free(work);
+}
+
+
+static bool darkside_check_keys(uint64_t *keylist, uint32_t keycount, uint64_t *key)
+{
+	if (keycount > 1) {
+		PrintAndLog("Found %u possible keys. Trying to authenticate with each of them ...\n", keycount);
+	} else {
+		PrintAndLog("Found a possible key. Trying to authenticate...\n");
+	}
+
+	*key = -1;
+	uint8_t keyBlock[USB_CMD_DATA_SIZE];
+	int max_keys = USB_CMD_DATA_SIZE/6;
+	for (int i = 0; i < keycount; i += max_keys) {
+		int size = keycount - i > max_keys ? max_keys : keycount - i;
+		for (int j = 0; j < size; j++) {
+			num_to_bytes(keylist[i + j], 6, keyBlock+(j*6));
+		}
+		if (!mfCheckKeys(0, 0, false, size, keyBlock, key)) {
+			break;
+		}
+	}
+
+	return (*key != -1);
+}
+
+
 int mfDarkside(uint64_t *key)
 {
 	uint32_t uid = 0;
 	uint32_t nt = 0, nr = 0, ar = 0;
 	uint64_t par_list = 0, ks_list = 0;
-	uint64_t *keylist = NULL, *last_keylist = NULL;
-	uint32_t keycount = 0;
+	uint64_t *candidates = NULL;
+	uint32_t num_candidates = 0;
 	int16_t isOK = 0;
 
+	uint16_t num_workers = num_CPUs();
+	uint16_t first_work = 0, num_work = 0;
+	darkside_work_t *work = calloc(num_workers, sizeof(darkside_work_t));
+	if (work == NULL) {
+		PrintAndLog("Out of memory error in mfDarkside()");
+		return -6;
+	}
+
+	*key = -1;
 	UsbCommand c = {CMD_READER_MIFARE, {true, 0, 0}};
 
 	// message
@@ -145,6 +217,8 @@ int mfDarkside(uint64_t *key)
 			printf(".");
 			fflush(stdout);
 			if (ukbhit()) {
+				darkside_free_work(work, first_work, num_work, num_workers);
+				free(candidates);
 				return -5;
 				break;
 			}
@@ -153,6 +227,8 @@ int mfDarkside(uint64_t *key)
 			if (WaitForResponseTimeout(CMD_ACK, &resp, 1000)) {
 				isOK  = resp.arg[0];
 				if (isOK < 0) {
+					darkside_free_work(work, first_work, num_work, num_workers);
+					free(candidates);
 					return isOK;
 				}
 				uid = (uint32_t)bytes_to_num(resp.d.asBytes +  0, 4);
@@ -170,55 +246,66 @@ int mfDarkside(uint64_t *key)
 		}
 		c.arg[0] = false;
 
-		keycount = nonce2key(uid, nt, nr, ar, par_list, ks_list, &keylist);
-
-		if (keycount == 0) {
-			PrintAndLog("Key not found (lfsr_common_prefix list is null). Nt=%08x", nt);
-			PrintAndLog("This is expected to happen in 25%% of all cases. Trying again with a different reader nonce...");
-			continue;
-		}
+		// hand the response over to a worker thread
+		darkside_work_t *w = &work[(first_work + num_work) % num_workers];
+		w->uid = uid;
+		w->nt = nt;
+		w->nr = nr;
+		w->ar = ar;
+		w->par_list = par_list;
+		w->ks_list = ks_list;
+		w->keylist = NULL;
+		w->keycount = 0;
+		w->completed = false;
+		pthread_create(&w->thread_id, NULL, darkside_worker_thread, w);
+		num_work++;
+
+		// evaluate the results in order of acquisition. Don't wait for a worker unless all of them are busy.
+		// The Proxmark is idle now, therefore we can check the keys before starting the next acquisition.
+		while (num_work > 0 && (work[first_work].completed || num_work == num_workers)) {
+			w = &work[first_work];
+			pthread_join(w->thread_id, NULL);
+			first_work = (first_work + 1) % num_workers;
+			num_work--;
+
+			uint64_t *keylist = w->keylist;
+			uint32_t keycount = w->keycount;
+			w->keylist = NULL;
 
-		if (par_list == 0) {
-			qsort(keylist, keycount, sizeof(*keylist), compare_uint64);
-			keycount = intersection(last_keylist, keylist);
 			if (keycount == 0) {
-				free(last_keylist);
-				last_keylist = keylist;
+				PrintAndLog("Key not found (lfsr_common_prefix list is null). Nt=%08x", w->nt);
+				PrintAndLog("This is expected to happen in 25%% of all cases. Trying again with a different reader nonce...");
 				continue;
 			}
-		}
-
-		if (keycount > 1) {
-			PrintAndLog("Found %u possible keys. Trying to authenticate with each of them ...\n", keycount);
-		} else {
-			PrintAndLog("Found a possible key. Trying to authenticate...\n");
-		}
 
-		*key = -1;
-		uint8_t keyBlock[USB_CMD_DATA_SIZE];
-		int max_keys = USB_CMD_DATA_SIZE/6;
-		for (int i = 0; i < keycount; i += max_keys) {
-			int size = keycount - i > max_keys ? max_keys : keycount - i;
-			for (int j = 0; j < size; j++) {
-				if (par_list == 0) {
-					num_to_bytes(last_keylist[i*max_keys + j], 6, keyBlock+(j*6));
-				} else {
-					num_to_bytes(keylist[i*max_keys + j], 6, keyBlock+(j*6));
+			if (w->par_list == 0) {
+				// NACK-less cards: the key must be in the (sorted) intersection of all candidate lists since the last restart
+				num_candidates = intersection(candidates, keylist);
+				if (num_candidates == 0) {
+					free(candidates);
+					candidates = keylist;
+					continue;
+				}
+				if (darkside_check_keys(candidates, num_candidates, key)) {
+					free(keylist);
+					break;
+				}
+			} else {
+				if (darkside_check_keys(keylist, keycount, key)) {
+					free(keylist);
+					break;
 				}
 			}
-			if (!mfCheckKeys(0, 0, false, size, keyBlock, key)) {
-				break;
-			}
+
+			PrintAndLog("Authentication failed. Trying again...");
+			free(candidates);
+			candidates = keylist;
 		}
 
 		if (*key != -1) {
-			free(last_keylist);
-			free(keylist);
+			darkside_free_work(work, first_work, num_work, num_workers);
+			free(candidates);
 			break;
-		} else {
-			PrintAndLog("Authentication failed. Trying again...");
-			free(last_keylist);
-			last_keylist = keylist;
 		}
 	}
 
@@ -429,18 +516,73 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo,
 	return 0;
 }
 
+// CARD
+
+// C1C2C3 access bits of a data area (0..2, blocks 0..4, 5..9 and 10..14 in the 16 block sectors
+// of a 4K card) or the sector trailer (3)
+uint8_t mfAccessConditions(uint8_t *trailer, uint8_t area) {
+	return ((trailer[7] >> (4 + area)) & 0x01) << 2 | ((trailer[8] >> area) & 0x01) << 1 | ((trailer[8] >> (4 + area)) & 0x01);
+}
+
+// Read a whole sector with one authentication, every block with the key its access bits allow.
+// blocksRead gets a bit per block read, 0xffff if older firmware read all of them with key A.
+int mfReadSector(uint8_t sectorNo, uint8_t *keyA, uint8_t *keyB, uint8_t *data, uint16_t *blocksRead) {
+	UsbCommand c = {CMD_MIFARE_READSC, {sectorNo, 0, MF_SECTOR_KEY_AB}};
+	memcpy(c.d.asBytes, keyA, 6);
+	memcpy(c.d.asBytes + 6, keyB, 6);
+	SendCommand(&c);
+
+	UsbCommand resp;
+	if (!WaitForResponseTimeout(CMD_ACK, &resp, 1500)) return 1;
+	if (!(resp.arg[0] & 0xff)) return 2;
+	*blocksRead = (resp.arg[2] & MF_SECTOR_KEY_AB) ? resp.arg[1] & 0xffff : 0xffff;
+	memcpy(data, resp.d.asBytes, 16 * 16);
+	return 0;
+}
+
+// Write up to 16 consecutive blocks of a sector with one authentication. Returns the number of
+// blocks written, older firmware writes the first one only, or -1 on errors.
+int mfWriteBlocks(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t *data, int blocksCount) {
+	UsbCommand c = {CMD_MIFARE_WRITEBL, {blockNo, keyType, blocksCount}};
+	memcpy(c.d.asBytes, key, 6);
+	memcpy(c.d.asBytes + 10, data, blocksCount * 16);
+	SendCommand(&c);
+
+	UsbCommand resp;
+	if (!WaitForResponseTimeout(CMD_ACK, &resp, 1500)) {
+		PrintAndLog("Command execute timeout");
+		return -1;
+	}
+	if (!(resp.arg[0] & 0xff))
+		return -1;
+	return resp.arg[1] ? (int)resp.arg[1] : 1;
+}
+
 // EMULATOR
 
+// any number of blocks, a full USB frame per round-trip
 int mfEmlGetMem(uint8_t *data, int blockNum, int blocksCount) {
-	UsbCommand c = {CMD_MIFARE_EML_MEMGET, {blockNum, blocksCount, 0}};
- 	SendCommand(&c);
+	while (blocksCount > 0) {
+		int n = blocksCount < MF_FRAME_BLOCKS ? blocksCount : MF_FRAME_BLOCKS;
+		UsbCommand c = {CMD_MIFARE_EML_MEMGET, {blockNum, n, 0}};
+		SendCommand(&c);
 
-  UsbCommand resp;
-	if (!WaitForResponseTimeout(CMD_ACK,&resp,1500)) return 1;
-	memcpy(data, resp.d.asBytes, blocksCount * 16);
+		UsbCommand resp;
+		if (!WaitForResponseTimeout(CMD_ACK,&resp,1500)) return 1;
+		// older firmware doesn't send the checksum
+		if ((resp.arg[2] & EML_MEM_CHECKSUM) && (resp.arg[2] & 0xffff) != update_crc16_bytes(0xffff, resp.d.asBytes, n * 16)) {
+			PrintAndLog("Checksum error in emulator memory block %d..%d", blockNum, blockNum + n - 1);
+			return 2;
+		}
+		memcpy(data, resp.d.asBytes, n * 16);
+		data += n * 16;
+		blockNum += n;
+		blocksCount -= n;
+	}
 	return 0;
 }
 
+// at most MF_FRAME_BLOCKS blocks, not acknowledged
 int mfEmlSetMem(uint8_t *data, int blockNum, int blocksCount) {
 	UsbCommand c = {CMD_MIFARE_EML_MEMSET, {blockNum, blocksCount, 0}};
 	memcpy(c.d.asBytes, data, blocksCount * 16);
@@ -448,6 +590,32 @@ int mfEmlSetMem(uint8_t *data, int blockNum, int blocksCount) {
 	return 0;
 }
 
+// any number of blocks, a full USB frame per round-trip. Every frame is acknowledged with the
+// checksum of the emulator memory it was written to.
+int mfEmlSetMemChecked(uint8_t *data, int blockNum, int blocksCount) {
+	while (blocksCount > 0) {
+		int n = blocksCount < MF_FRAME_BLOCKS ? blocksCount : MF_FRAME_BLOCKS;
+		uint16_t crc = update_crc16_bytes(0xffff, data, n * 16);
+		UsbCommand c = {CMD_MIFARE_EML_MEMSET, {blockNum, n, EML_MEM_CHECKSUM | crc}};
+		memcpy(c.d.asBytes, data, n * 16);
+		SendCommand(&c);
+
+		UsbCommand resp;
+		if (!WaitForResponseTimeout(CMD_ACK,&resp,1500)) {
+			PrintAndLog("No answer to the emulator write. Is the firmware older than the client?");
+			return 1;
+		}
+		if (!(resp.arg[0] & 0xff) || (resp.arg[1] & 0xffff) != crc) {
+			PrintAndLog("Checksum error in emulator memory block %d..%d", blockNum, blockNum + n - 1);
+			return 2;
+		}
+		data += n * 16;
+		blockNum += n;
+		blocksCount -= n;
+	}
+	return 0;
+}
+
 // "MAGIC" CARD
 
 int mfCGetBlock(uint8_t blockNo, uint8_t *data, uint8_t params) {
@@ -490,6 +658,23 @@ int mfCSetBlock(uint8_t blockNo, uint8_t *data, uint8_t *uid, bool wantWipe, uin
 	return 0;
 }
 
+// Write up to MF_FRAME_BLOCKS consecutive blocks with one command. Returns the number of blocks
+// written, older firmware writes the first one only, or -1 on errors.
+int mfCSetBlocks(uint8_t blockNo, uint8_t *data, int blocksCount, uint8_t params) {
+	UsbCommand c = {CMD_MIFARE_CSETBLOCK, {0, params & 0xFE, blockNo | blocksCount << CSETBLOCK_COUNT_SHIFT}};
+	memcpy(c.d.asBytes, data, blocksCount * 16);
+	SendCommand(&c);
+
+	UsbCommand resp;
+	if (!WaitForResponseTimeout(CMD_ACK, &resp, 1500 + blocksCount * 20)) {
+		PrintAndLog("Command execute timeout");
+		return -1;
+	}
+	if (!(resp.arg[0] & 0xff))
+		return -1;
+	return resp.arg[1] ? (int)resp.arg[1] : 1;
+}
+
 int mfCWipe(uint32_t numSectors, bool gen1b, bool wantWipe, bool wantFill) {
 	uint8_t isOK = 0;
 	uint8_t cmdParams = wantWipe + wantFill * 0x02 + gen1b * 0x04;
@@ -15,6 +15,7 @@
 #include <stdbool.h>
 #include "data.h"
 #include "crapto1/crapto1.h"
+#include "usb_cmd.h"
 
 // defaults
 // timeout in units. (ms * 106)/10 or us*0.0106
@@ -30,6 +31,9 @@
 #define CSETBLOCK_SINGLE_OPER			0x1F
 #define CSETBLOCK_MAGIC_1B 			0x40
 
+// blocks in one USB frame
+#define MF_FRAME_BLOCKS				(USB_CMD_DATA_SIZE / 16)
+
 typedef struct {
 	uint64_t Key[2];
 	int foundKey[2];
@@ -42,12 +46,18 @@ extern int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgB
 extern int mfCheckKeys (uint8_t blockNo, uint8_t keyType, bool clear_trace, uint8_t keycnt, uint8_t *keyBlock, uint64_t *key);
 extern int mfCheckKeysSec(uint8_t sectorCnt, uint8_t keyType, uint8_t timeout14a, bool clear_trace, uint8_t keycnt, uint8_t * keyBlock, sector_t * e_sector);
 
+extern uint8_t mfAccessConditions(uint8_t *trailer, uint8_t area);
+extern int mfReadSector(uint8_t sectorNo, uint8_t *keyA, uint8_t *keyB, uint8_t *data, uint16_t *blocksRead);
+extern int mfWriteBlocks(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t *data, int blocksCount);
+
 extern int mfEmlGetMem(uint8_t *data, int blockNum, int blocksCount);
 extern int mfEmlSetMem(uint8_t *data, int blockNum, int blocksCount);
+extern int mfEmlSetMemChecked(uint8_t *data, int blockNum, int blocksCount);
 
 extern int mfCWipe(uint32_t numSectors, bool gen1b, bool wantWipe, bool wantFill);
 extern int mfCSetUID(uint8_t *uid, uint8_t *atqa, uint8_t *sak, uint8_t *oldUID);
 extern int mfCSetBlock(uint8_t blockNo, uint8_t *data, uint8_t *uid, bool wantWipe, uint8_t params);
+extern int mfCSetBlocks(uint8_t blockNo, uint8_t *data, int blocksCount, uint8_t params);
 extern int mfCGetBlock(uint8_t blockNo, uint8_t *data, uint8_t params);
 
 extern int mfTraceInit(uint8_t *tuid, uint8_t *atqa, uint8_t sak, bool wantSaveToEmlFile);
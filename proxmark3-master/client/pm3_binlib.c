@@ -37,6 +37,7 @@
 #include <lauxlib.h>
 #include <stdint.h>
 #include "pm3_binlib.h"
+#include "pm3_bytelib.h"
 
 
 static void badcode(lua_State *L, int c)
@@ -105,7 +106,13 @@ static void doswap(int swap, void *p, size_t n)
 static int l_unpack(lua_State *L) 		/** unpack(f,s, [init]) */
 {
  size_t len;
- const char *s=luaL_checklstring(L,2,&len); /* switched s and f */
+ const char *s;
+ pm3_bytes *b=pm3_bytes_test(L,2);	/* s can be a bytes buffer too */
+ if (b) {
+  s=(const char *)b->data;
+  len=b->len;
+ } else
+  s=luaL_checklstring(L,2,&len); /* switched s and f */
  const char *f=luaL_checkstring(L,1);
  int i_read = luaL_optinteger(L,3,1)-1;
  // int i_read = luaL_optint(L,3,1)-1;
@@ -153,7 +160,8 @@ static int l_unpack(lua_State *L) 		/** unpack(f,s, [init]) */
    {
     size_t l;
     if (i>=len) {done = 1; break; }
-    l=strlen(s+i);
+    const char *z=memchr(s+i,0,len-i);	/* buffers are not zero terminated */
+    l=z ? (size_t)(z-(s+i)) : len-i;
     lua_pushlstring(L,s+i,l);
     i+=l+1;
     ++n;
@@ -328,6 +336,16 @@ static int l_pack(lua_State *L) 		/** pack(f,...) */
  return 1;
 }
 
+int bin_pack(lua_State *L)
+{
+ return l_pack(L);
+}
+
+int bin_unpack(lua_State *L)
+{
+ return l_unpack(L);
+}
+
 static const luaL_Reg binlib[] =
 {
 	{"pack",	l_pack},
@@ -4,4 +4,8 @@
 #include <lua.h>
 int set_bin_library (lua_State *L);
 
+// bin.pack() and bin.unpack(), for other libraries
+int bin_pack(lua_State *L);
+int bin_unpack(lua_State *L);
+
 #endif /* PM3_BINLIB */
@@ -0,0 +1,439 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Mutable byte buffers for lua scripts.
+//
+// A buffer is a userdata holding its bytes, or a view into the bytes of
+// another buffer (see slice()). core.SendCommand() sends a buffer,
+// core.WaitForResponseTimeout() copies the response into one, and
+// bin.unpack() accepts a buffer in place of a string. The library is
+// registered with the core functions, in every lua state of the client.
+//
+//   local b = bytes.new(4)            -- 00000000
+//   local h = bytes.fromhex('a0b1')   -- A0B1
+//   b[1] = 0x30; b:pack('<S', 3, 0x1234)
+//   print(b, #b, b:hex(2, 3), b:crc14443a())
+//-----------------------------------------------------------------------------
+
+#include <ctype.h>
+#include <string.h>
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+#include "pm3_bytelib.h"
+#include "pm3_binlib.h"
+#include "iso14443crc.h"
+#include "../common/iso15693tools.h"
+#include "../common/crc16.h"
+
+#define BYTES_METATABLE		"pm3.bytes"
+
+static const char hexdigits[] = "0123456789ABCDEF";
+
+pm3_bytes *pm3_bytes_test(lua_State *L, int idx)
+{
+	return luaL_testudata(L, idx, BYTES_METATABLE);
+}
+
+static pm3_bytes *check_bytes(lua_State *L, int idx)
+{
+	return luaL_checkudata(L, idx, BYTES_METATABLE);
+}
+
+pm3_bytes *pm3_bytes_push(lua_State *L, size_t len)
+{
+	pm3_bytes *b = lua_newuserdata(L, sizeof(pm3_bytes) + len);
+	b->len = len;
+	b->data = (uint8_t *)(b + 1);
+	memset(b->data, 0x00, len);
+	luaL_setmetatable(L, BYTES_METATABLE);
+	return b;
+}
+
+// Relative string position, negative values count from the end, as in string.sub()
+static size_t posrelat(lua_Integer pos, size_t len)
+{
+	if (pos >= 0)
+		return (size_t)pos;
+	if ((size_t)-pos > len)
+		return 0;
+	return len + (size_t)pos + 1;
+}
+
+// Translate the optional range arguments [i [, j]] at idx into a zero based offset and length
+static uint8_t *get_range(lua_State *L, pm3_bytes *b, int idx, size_t *len)
+{
+	size_t start = posrelat(luaL_optinteger(L, idx, 1), b->len);
+	size_t end = posrelat(luaL_optinteger(L, idx + 1, -1), b->len);
+
+	if (start < 1)
+		start = 1;
+	if (end > b->len)
+		end = b->len;
+
+	if (start > end) {
+		*len = 0;
+		return b->data;
+	}
+	*len = end - start + 1;
+	return b->data + start - 1;
+}
+
+// Offset argument for writing n bytes, an error when they don't fit
+static uint8_t *get_offset(lua_State *L, pm3_bytes *b, int idx, size_t n)
+{
+	lua_Integer pos = luaL_checkinteger(L, idx);
+
+	luaL_argcheck(L, pos >= 1 && (size_t)pos - 1 + n <= b->len, idx, "out of range");
+	return b->data + pos - 1;
+}
+
+static int bytes_new(lua_State *L)
+{
+	lua_Integer len = luaL_checkinteger(L, 1);
+	int value = luaL_optinteger(L, 2, 0);
+
+	luaL_argcheck(L, len >= 0, 1, "negative size");
+	pm3_bytes *b = pm3_bytes_push(L, len);
+	memset(b->data, value, len);
+	return 1;
+}
+
+static int bytes_fromstring(lua_State *L)
+{
+	size_t len;
+	const char *s = luaL_checklstring(L, 1, &len);
+
+	pm3_bytes *b = pm3_bytes_push(L, len);
+	memcpy(b->data, s, len);
+	return 1;
+}
+
+static int hexvalue(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+// Whitespace between the digits is ignored, like the 'H' format of bin.pack()
+static int bytes_fromhex(lua_State *L)
+{
+	size_t len, n = 0;
+	const char *s = luaL_checklstring(L, 1, &len);
+
+	for (size_t i = 0; i < len; i++) {
+		if (hexvalue((unsigned char)s[i]) >= 0)
+			n++;
+		else if (!isspace((unsigned char)s[i]))
+			return luaL_argerror(L, 1, "not a hex string");
+	}
+	if (n & 1)
+		return luaL_argerror(L, 1, "odd number of hex digits");
+
+	pm3_bytes *b = pm3_bytes_push(L, n / 2);
+	n = 0;
+	for (size_t i = 0; i < len; i++) {
+		int v = hexvalue((unsigned char)s[i]);
+		if (v < 0)
+			continue;
+		if (n & 1)
+			b->data[n / 2] |= v;
+		else
+			b->data[n / 2] = v << 4;
+		n++;
+	}
+	return 1;
+}
+
+static int bytes_isbytes(lua_State *L)
+{
+	lua_pushboolean(L, pm3_bytes_test(L, 1) != NULL);
+	return 1;
+}
+
+static int bytes_len(lua_State *L)
+{
+	lua_pushinteger(L, check_bytes(L, 1)->len);
+	return 1;
+}
+
+static int bytes_get(lua_State *L)
+{
+	pm3_bytes *b = check_bytes(L, 1);
+	lua_Integer i = luaL_checkinteger(L, 2);
+
+	if (i < 1 || (size_t)i > b->len)
+		lua_pushnil(L);
+	else
+		lua_pushinteger(L, b->data[i - 1]);
+	return 1;
+}
+
+static int bytes_set(lua_State *L)
+{
+	pm3_bytes *b = check_bytes(L, 1);
+	uint8_t *p = get_offset(L, b, 2, 1);
+	lua_Integer value = luaL_checkinteger(L, 3);
+
+	luaL_argcheck(L, value >= 0 && value <= 0xff, 3, "not a byte value");
+	*p = value;
+	return 0;
+}
+
+// Bytes i..j as a buffer sharing the memory of b. The view keeps b alive.
+static int bytes_slice(lua_State *L)
+{
+	pm3_bytes *b = check_bytes(L, 1);
+	size_t len;
+	uint8_t *data = get_range(L, b, 2, &len);
+
+	pm3_bytes *view = lua_newuserdata(L, sizeof(pm3_bytes));
+	view->len = len;
+	view->data = data;
+	luaL_setmetatable(L, BYTES_METATABLE);
+
+	lua_createtable(L, 1, 0);
+	lua_pushvalue(L, 1);
+	lua_rawseti(L, -2, 1);
+	lua_setuservalue(L, -2);
+	return 1;
+}
+
+static int bytes_copy(lua_State *L)
+{
+	pm3_bytes *b = check_bytes(L, 1);
+	size_t len;
+	uint8_t *data = get_range(L, b, 2, &len);
+
+	memcpy(pm3_bytes_push(L, len)->data, data, len);
+	return 1;
+}
+
+static int bytes_raw(lua_State *L)
+{
+	pm3_bytes *b = check_bytes(L, 1);
+	size_t len;
+	uint8_t *data = get_range(L, b, 2, &len);
+
+	lua_pushlstring(L, (const char *)data, len);
+	return 1;
+}
+
+static int bytes_hex(lua_State *L)
+{
+	pm3_bytes *b = check_bytes(L, 1);
+	size_t len;
+	uint8_t *data = get_range(L, b, 2, &len);
+	luaL_Buffer buf;
+
+	char *s = luaL_buffinitsize(L, &buf, len * 2);
+	for (size_t i = 0; i < len; i++) {
+		s[i * 2] = hexdigits[data[i] >> 4];
+		s[i * 2 + 1] = hexdigits[data[i] & 0x0f];
+	}
+	luaL_pushresultsize(&buf, len * 2);
+	return 1;
+}
+
+// fill(value [, i [, j]])
+static int bytes_fill(lua_State *L)
+{
+	pm3_bytes *b = check_bytes(L, 1);
+	int value = luaL_checkinteger(L, 2);
+	size_t len;
+	uint8_t *data = get_range(L, b, 3, &len);
+
+	memset(data, value, len);
+	lua_settop(L, 1);
+	return 1;
+}
+
+// write(init, src), src is a string or a buffer. Returns the position after the written bytes.
+static int bytes_write(lua_State *L)
+{
+	pm3_bytes *b = check_bytes(L, 1);
+	pm3_bytes *src = pm3_bytes_test(L, 3);
+	const uint8_t *data;
+	size_t len;
+
+	if (src) {
+		data = src->data;
+		len = src->len;
+	} else {
+		data = (const uint8_t *)luaL_checklstring(L, 3, &len);
+	}
+
+	uint8_t *p = get_offset(L, b, 2, len);
+	memmove(p, data, len);
+	lua_pushinteger(L, p - b->data + len + 1);
+	return 1;
+}
+
+// pack(fmt, init, ...) writes the values in the bin.pack() format at init.
+// Returns the position after the packed data.
+static int bytes_pack(lua_State *L)
+{
+	pm3_bytes *b = check_bytes(L, 1);
+	int n = lua_gettop(L);
+	size_t len;
+
+	luaL_checkstring(L, 2);
+	luaL_checkinteger(L, 3);
+
+	lua_pushcfunction(L, bin_pack);
+	lua_pushvalue(L, 2);
+	for (int i = 4; i <= n; i++)
+		lua_pushvalue(L, i);
+	lua_call(L, n - 2, 1);
+
+	const char *s = lua_tolstring(L, -1, &len);
+	uint8_t *p = get_offset(L, b, 3, len);
+	memcpy(p, s, len);
+	lua_pushinteger(L, p - b->data + len + 1);
+	return 1;
+}
+
+// unpack(fmt [, init]), same as bin.unpack(fmt, b, init)
+static int bytes_unpack(lua_State *L)
+{
+	check_bytes(L, 1);
+	luaL_checkstring(L, 2);
+	lua_settop(L, 3);
+
+	lua_pushcfunction(L, bin_unpack);
+	lua_pushvalue(L, 2);
+	lua_pushvalue(L, 1);
+	lua_pushvalue(L, 3);
+	lua_call(L, 3, LUA_MULTRET);
+	return lua_gettop(L) - 3;
+}
+
+static int bytes_crc16(lua_State *L)
+{
+	pm3_bytes *b = check_bytes(L, 1);
+	size_t len;
+	uint8_t *data = get_range(L, b, 2, &len);
+
+	lua_pushinteger(L, crc16_ccitt(data, len));
+	return 1;
+}
+
+static int bytes_crc14443(lua_State *L, int type)
+{
+	pm3_bytes *b = check_bytes(L, 1);
+	size_t len;
+	uint8_t *data = get_range(L, b, 2, &len);
+	uint8_t first, second;
+
+	ComputeCrc14443(type, data, len, &first, &second);
+	// same byte order as the CRC is sent
+	lua_pushinteger(L, first | (second << 8));
+	return 1;
+}
+
+static int bytes_crc14443a(lua_State *L)
+{
+	return bytes_crc14443(L, CRC_14443_A);
+}
+
+static int bytes_crc14443b(lua_State *L)
+{
+	return bytes_crc14443(L, CRC_14443_B);
+}
+
+static int bytes_crc15693(lua_State *L)
+{
+	pm3_bytes *b = check_bytes(L, 1);
+	size_t len;
+	uint8_t *data = get_range(L, b, 2, &len);
+
+	lua_pushinteger(L, Iso15693Crc(data, len));
+	return 1;
+}
+
+static const luaL_Reg bytes_methods[] = {
+	{"len",			bytes_len},
+	{"get",			bytes_get},
+	{"set",			bytes_set},
+	{"slice",		bytes_slice},
+	{"copy",		bytes_copy},
+	{"raw",			bytes_raw},
+	{"hex",			bytes_hex},
+	{"fill",		bytes_fill},
+	{"write",		bytes_write},
+	{"pack",		bytes_pack},
+	{"unpack",		bytes_unpack},
+	{"crc16",		bytes_crc16},
+	{"crc14443a",	bytes_crc14443a},
+	{"crc14443b",	bytes_crc14443b},
+	{"crc15693",	bytes_crc15693},
+	{NULL, NULL}
+};
+
+// b[i] reads a byte, b:name() calls a method
+static int bytes_index(lua_State *L)
+{
+	if (lua_type(L, 2) == LUA_TNUMBER)
+		return bytes_get(L);
+
+	lua_getmetatable(L, 1);
+	lua_getfield(L, -1, "methods");
+	lua_pushvalue(L, 2);
+	lua_rawget(L, -2);
+	return 1;
+}
+
+static int bytes_eq(lua_State *L)
+{
+	pm3_bytes *a = check_bytes(L, 1);
+	pm3_bytes *b = check_bytes(L, 2);
+
+	lua_pushboolean(L, a->len == b->len && !memcmp(a->data, b->data, a->len));
+	return 1;
+}
+
+static const luaL_Reg bytes_meta[] = {
+	{"__index",		bytes_index},
+	{"__newindex",	bytes_set},
+	{"__len",		bytes_len},
+	{"__tostring",	bytes_hex},
+	{"__eq",		bytes_eq},
+	{NULL, NULL}
+};
+
+static const luaL_Reg byteslib[] = {
+	{"new",			bytes_new},
+	{"fromstring",	bytes_fromstring},
+	{"fromhex",		bytes_fromhex},
+	{"isbytes",		bytes_isbytes},
+	{NULL, NULL}
+};
+
+LUALIB_API int luaopen_bytes(lua_State *L)
+{
+	luaL_newmetatable(L, BYTES_METATABLE);
+	luaL_setfuncs(L, bytes_meta, 0);
+	luaL_newlib(L, bytes_methods);
+	lua_setfield(L, -2, "methods");
+	lua_pop(L, 1);
+
+	luaL_newlib(L, byteslib);
+	return 1;
+}
+
+/*
+** Open bytes library
+*/
+int set_bytes_library(lua_State *L)
+{
+	luaL_requiref(L, "bytes", luaopen_bytes, 1);
+	lua_pop(L, 1);
+	return 1;
+}
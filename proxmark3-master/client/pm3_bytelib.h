@@ -0,0 +1,28 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Mutable byte buffers for lua scripts
+//-----------------------------------------------------------------------------
+
+#ifndef PM3_BYTELIB
+#define PM3_BYTELIB
+
+#include <stddef.h>
+#include <stdint.h>
+#include <lua.h>
+
+typedef struct {
+	size_t len;
+	uint8_t *data;		// own storage after the header, or the storage of another buffer
+} pm3_bytes;
+
+int set_bytes_library(lua_State *L);
+
+// The buffer at idx, NULL if it's not a buffer
+pm3_bytes *pm3_bytes_test(lua_State *L, int idx);
+// Push a new zero filled buffer of len bytes
+pm3_bytes *pm3_bytes_push(lua_State *L, size_t len);
+
+#endif /* PM3_BYTELIB */
@@ -39,6 +39,8 @@ extern int AskEdgeDetect(const int *in, int *out, int len, int threshold);
 extern int AutoCorrelate(const int *in, int *out, size_t len, int window, bool SaveGrph, bool verbose);
 extern int directionalThreshold(const int* in, int *out, size_t len, int8_t up, int8_t down);
 extern void save_restoreGB(uint8_t saveOpt);
+extern void GraphBufferChanged(void);
+extern uint32_t GetGraphVersion(void);
 
 #define GRAPH_SAVE 1
 #define GRAPH_RESTORE 0
@@ -136,6 +136,7 @@ void ProxWidget::applyOperation()
 	//printf("ApplyOperation()");
 	save_restoreGB(GRAPH_SAVE);
 	memcpy(GraphBuffer, s_Buff, sizeof(int) * GraphTraceLen);
+	GraphBufferChanged();
 	RepaintGraphWindow();
 }
 void ProxWidget::stickOperation()
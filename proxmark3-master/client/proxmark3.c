@@ -27,6 +27,8 @@
 #include "cmdparser.h"
 #include "cmdhw.h"
 #include "whereami.h"
+#include "session.h"
+#include "cmdscript.h"
 
 #ifdef _WIN32
 #define SERIAL_PORT_H	"com3"
@@ -37,10 +39,6 @@
 // a global mutex to prevent interlaced printing from different threads
 pthread_mutex_t print_lock;
 
-static serial_port sp;
-static UsbCommand txcmd;
-volatile static bool txcmd_pending = false;
-
 void SendCommand(UsbCommand *c) {
 	#if 0
 		printf("Sending %d bytes\n", sizeof(UsbCommand));
@@ -50,55 +48,7 @@ void SendCommand(UsbCommand *c) {
       PrintAndLog("Sending bytes to proxmark failed - offline");
       return;
     }
-  /**
-	The while-loop below causes hangups at times, when the pm3 unit is unresponsive
-	or disconnected. The main console thread is alive, but comm thread just spins here.
-	Not good.../holiman
-	**/
-	while(txcmd_pending);
-	txcmd = *c;
-	txcmd_pending = true;
-}
-
-struct receiver_arg {
-	int run;
-};
-
-byte_t rx[sizeof(UsbCommand)];
-byte_t* prx = rx;
-
-
-static void
-#ifdef __has_attribute
-#if __has_attribute(force_align_arg_pointer)
-__attribute__((force_align_arg_pointer)) 
-#endif
-#endif
-*uart_receiver(void *targ) {
-	struct receiver_arg *arg = (struct receiver_arg*)targ;
-	size_t rxlen;
-
-	while (arg->run) {
-		rxlen = 0;
-		if (uart_receive(sp, prx, sizeof(UsbCommand) - (prx-rx), &rxlen) && rxlen) {
-			prx += rxlen;
-			if (prx-rx < sizeof(UsbCommand)) {
-				continue;
-			}
-			UsbCommandReceived((UsbCommand*)rx);
-		}
-		prx = rx;
-
-		if(txcmd_pending) {
-			if (!uart_send(sp, (byte_t*) &txcmd, sizeof(UsbCommand))) {
-				PrintAndLog("Sending bytes to proxmark failed");
-			}
-			txcmd_pending = false;
-		}
-	}
-
-	pthread_exit(NULL);
-	return NULL;
+	session_send(session_current(), c);
 }
 
 
@@ -109,15 +59,11 @@ __attribute__((force_align_arg_pointer))
 #endif
 #endif
 main_loop(char *script_cmds_file, char *script_cmd, bool usb_present) {
-	struct receiver_arg rarg;
 	char *cmd = NULL;
-	pthread_t reader_thread;
 	bool execCommand = (script_cmd != NULL);
 	bool stdinOnPipe = !isatty(STDIN_FILENO);
 	
 	if (usb_present) {
-		rarg.run = 1;
-		pthread_create(&reader_thread, NULL, &uart_receiver, &rarg);
 		// cache Version information now:
 		CmdVersion(NULL);
 	}
@@ -205,12 +151,7 @@ main_loop(char *script_cmds_file, char *script_cmd, bool usb_present) {
 	}
 
 	write_history(".history");
-  
-	if (usb_present) {
-		rarg.run = 0;
-		pthread_join(reader_thread, NULL);
-	}
-	
+
 	if (script_file) {
 		fclose(script_file);
 		script_file = NULL;
@@ -287,6 +228,7 @@ int main(int argc, char* argv[]) {
 	bool addLuaExec = false;
 	char *script_cmds_file = NULL;
 	char *script_cmd = NULL;
+	serial_port sp;
   
 	if (argc < 2) {
 		show_help(true, argv[0]);
@@ -363,6 +305,10 @@ int main(int argc, char* argv[]) {
 	// set global variables
 	set_my_executable_path();
 	
+	// create a mutex to avoid interlacing print commands from our different threads,
+	// the receiver thread of the session prints as soon as it is started
+	pthread_mutex_init(&print_lock, NULL);
+
 	// open uart
 	if (!waitCOMPort) {
 		sp = uart_open(argv[1]);
@@ -389,12 +335,9 @@ int main(int argc, char* argv[]) {
 		usb_present = false;
 		offline = 1;
 	} else {
-		usb_present = true;
-		offline = 0;
+		usb_present = session_attach(argv[1], sp) >= 0;
+		offline = !usb_present;
 	}
-	
-	// create a mutex to avoid interlacing print commands from our different threads
-	pthread_mutex_init(&print_lock, NULL);
 
 #ifdef HAVE_GUI
 #ifdef _WIN32
@@ -417,10 +360,10 @@ int main(int argc, char* argv[]) {
 	main_loop(script_cmds_file, script_cmd, usb_present);
 #endif	
 
-	// Clean up the port
-	if (usb_present) {
-		uart_close(sp);
-	}
+	// Clean up the ports
+	session_close_all();
+
+	ScriptCleanup();
 
 	// clean up mutex
 	pthread_mutex_destroy(&print_lock);
@@ -11,6 +11,7 @@
 #include "scripting.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
@@ -18,7 +19,10 @@
 #include "usb_cmd.h"
 #include "cmdmain.h"
 #include "util.h"
+#include "util_posix.h"
 #include "mifarehost.h"
+#include "pm3_bytelib.h"
+#include "session.h"
 #include "../common/iso15693tools.h"
 #include "iso14443crc.h"
 #include "../common/crc16.h"
@@ -26,9 +30,30 @@
 #include "../common/polarssl/sha1.h"
 #include "../common/polarssl/aes.h"
 
+/**
+ * Copy the UsbCommand in the string or bytes buffer at idx to c. The memory of a
+ * buffer is not used as a UsbCommand directly, a slice may start at any offset.
+ * Returns the size of the data, c is only set if it's sizeof(UsbCommand).
+ */
+static size_t get_usb_command(lua_State *L, int idx, UsbCommand *c)
+{
+	size_t size;
+	const char *data;
+	pm3_bytes *b = pm3_bytes_test(L, idx);
+	if (b) {
+		data = (const char *)b->data;
+		size = b->len;
+	} else {
+		data = luaL_checklstring(L, idx, &size);
+	}
+	if (size == sizeof(UsbCommand))
+		memcpy(c, data, sizeof(UsbCommand));
+	return size;
+}
+
 /**
  * The following params expected:
- *  UsbCommand c
+ *  UsbCommand c, as a string or a bytes buffer
  *@brief l_SendCommand
  * @param L
  * @return
@@ -51,8 +76,8 @@ static int l_SendCommand(lua_State *L){
 	==> A 544 byte buffer will do.
 	**/
 	//Pop cmd
-	size_t size;
-	const char *data = luaL_checklstring(L, 1, &size);
+	UsbCommand c;
+	size_t size = get_usb_command(L, 1, &c);
 	if(size != sizeof(UsbCommand))
 	{
 		printf("Got data size %d, expected %d" , (int) size,(int) sizeof(UsbCommand));
@@ -60,14 +85,14 @@ static int l_SendCommand(lua_State *L){
 		return 1;
 	}
 
-//    UsbCommand c = (*data);
-	SendCommand((UsbCommand* )data);
+	SendCommand(&c);
 	return 0; // no return values
 }
 /**
  * @brief The following params expected:
  * uint32_t cmd
  * size_t ms_timeout
+ * bytes response (optional), a buffer the response is copied to in place of a new string
  * @param L
  * @return
  */
@@ -98,10 +123,24 @@ static int l_WaitForResponseTimeout(lua_State *L){
 		//printf("Timeout set to %dms\n" , (int) ms_timeout);
 	}
 
+	pm3_bytes *b = NULL;
+	if(!lua_isnoneornil(L, 3))
+	{
+		b = pm3_bytes_test(L, 3);
+		if(!b || b->len != sizeof(UsbCommand))
+			return luaL_argerror(L, 3, "expected a bytes buffer of the size of UsbCommand");
+	}
+
 	UsbCommand response;
 
 	if(WaitForResponseTimeout(cmd, &response, ms_timeout))
 	{
+		if(b)
+		{
+			memcpy(b->data, &response, sizeof(UsbCommand));
+			lua_settop(L, 3);
+			return 1;
+		}
 		//Push it as a string
 		lua_pushlstring(L,(const char *)&response,sizeof(UsbCommand));
 
@@ -151,6 +190,120 @@ static int l_clearCommandBuffer(lua_State *L){
 	clearCommandBuffer();
 	return 0;
 }
+/**
+ * Sessions, to drive several devices from one script. The ids are the ones of 'session list'.
+ * A script fans a command out by sending it to all the devices before it waits for the responses.
+ */
+static int l_session_open(lua_State *L){
+	int id = session_open(luaL_checkstring(L, 1));
+	if (id < 0) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't open the port");
+		return 2;
+	}
+	lua_pushinteger(L, id);
+	return 1;
+}
+
+static int l_session_close(lua_State *L){
+	session_close(luaL_checkint(L, 1));
+	return 0;
+}
+
+static int l_session_use(lua_State *L){
+	lua_pushboolean(L, session_select(luaL_checkint(L, 1)));
+	return 1;
+}
+
+static int l_session_current(lua_State *L){
+	if (session_current() < 0)
+		lua_pushnil(L);
+	else
+		lua_pushinteger(L, session_current());
+	return 1;
+}
+
+// returns a table id -> port of the open sessions
+static int l_session_list(lua_State *L){
+	lua_newtable(L);
+	for (int id = 0; id < SESSION_MAX; id++) {
+		if (session_valid(id)) {
+			lua_pushstring(L, session_port(id));
+			lua_rawseti(L, -2, id);
+		}
+	}
+	return 1;
+}
+
+static int l_session_send(lua_State *L){
+	int id = luaL_checkint(L, 1);
+	UsbCommand c;
+	if (get_usb_command(L, 2, &c) != sizeof(UsbCommand))
+		return luaL_argerror(L, 2, "wrong data size");
+	lua_pushboolean(L, session_send(id, &c));
+	return 1;
+}
+
+static int l_session_clear(lua_State *L){
+	session_clear(luaL_checkint(L, 1));
+	return 0;
+}
+
+/**
+ * @brief The following params expected:
+ * int session id
+ * uint32_t cmd
+ * size_t ms_timeout
+ * bytes response (optional), as for WaitForResponseTimeout
+ */
+static int l_session_wait(lua_State *L){
+	int id = luaL_checkint(L, 1);
+	uint32_t cmd = luaL_checkunsigned(L, 2);
+	size_t ms_timeout = luaL_optunsigned(L, 3, -1);
+
+	pm3_bytes *b = NULL;
+	if (!lua_isnoneornil(L, 4)) {
+		b = pm3_bytes_test(L, 4);
+		if (!b || b->len != sizeof(UsbCommand))
+			return luaL_argerror(L, 4, "expected a bytes buffer of the size of UsbCommand");
+	}
+
+	UsbCommand response;
+	if (!session_wait(id, cmd, &response, ms_timeout, false)) {
+		lua_pushnil(L);
+		return 1;
+	}
+	if (b) {
+		memcpy(b->data, &response, sizeof(UsbCommand));
+		lua_settop(L, 4);
+		return 1;
+	}
+	lua_pushlstring(L, (const char *)&response, sizeof(UsbCommand));
+	return 1;
+}
+
+static int l_session_stats(lua_State *L){
+	session_stats_t stats;
+	if (!session_get_stats(luaL_checkint(L, 1), &stats)) {
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_createtable(L, 0, 6);
+	lua_pushnumber(L, (lua_Number)stats.tx_cmds);
+	lua_setfield(L, -2, "tx_cmds");
+	lua_pushnumber(L, (lua_Number)stats.rx_cmds);
+	lua_setfield(L, -2, "rx_cmds");
+	lua_pushnumber(L, (lua_Number)stats.tx_bytes);
+	lua_setfield(L, -2, "tx_bytes");
+	lua_pushnumber(L, (lua_Number)stats.rx_bytes);
+	lua_setfield(L, -2, "rx_bytes");
+	lua_pushnumber(L, (lua_Number)stats.overflows);
+	lua_setfield(L, -2, "overflows");
+	lua_pushnumber(L, (lua_Number)(msclock() - stats.start_time));
+	lua_setfield(L, -2, "ms");
+	return 1;
+}
+
 /**
  * @brief l_foobar is a dummy function to test lua-integration with
  * @param L
@@ -185,7 +338,8 @@ static int l_foobar(lua_State *L)
  */
 static int l_ukbhit(lua_State *L)
 {
-	lua_pushboolean(L,ukbhit() ? true : false);
+	//ukbhit() is -1 when stdin is not a terminal, that is no key press
+	lua_pushboolean(L,ukbhit() > 0);
 	return 1;
 }
 /**
@@ -427,6 +581,15 @@ int set_pm3_libraries(lua_State *L)
 		{"foobar",                      l_foobar},
 		{"ukbhit",                      l_ukbhit},
 		{"clearCommandBuffer",          l_clearCommandBuffer},
+		{"session_open",                l_session_open},
+		{"session_close",               l_session_close},
+		{"session_use",                 l_session_use},
+		{"session_current",             l_session_current},
+		{"session_list",                l_session_list},
+		{"session_send",                l_session_send},
+		{"session_clear",               l_session_clear},
+		{"session_wait",                l_session_wait},
+		{"session_stats",               l_session_stats},
 		{"console",                     l_CmdConsole},
 		{"iso15693_crc",                l_iso15693_crc},
 		{"iso14443b_crc",               l_iso14443b_crc},
@@ -456,6 +619,9 @@ int set_pm3_libraries(lua_State *L)
 	//-- remove the global environment table from the stack
 	lua_pop(L, 1);
 
+	//The 'bytes' library, every state with the core functions can pass buffers to them
+	set_bytes_library(L);
+
 	//-- Last but not least, add to the LUA_PATH (package.path in lua)
 	// so we can load libraries from the ./lualib/ - directory
 	char libraries_path[strlen(get_my_executable_directory()) + strlen(LUA_LIBRARIES_DIRECTORY) + strlen(LUA_LIBRARIES_WILDCARD) + 1];
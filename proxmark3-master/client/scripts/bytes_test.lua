@@ -0,0 +1,162 @@
+local cmds = require('commands')
+local utils = require('utils')
+local taglib = require('taglib')
+
+example = "script run bytes_test"
+author = "Proxmark3 contributors"
+usage = "script run bytes_test"
+desc = [[
+Self test of the bytes library and of the libraries which use it, runs without a device.
+
+Checks the buffers, their slices, pack/unpack and CRCs, the packets built by commands.lua,
+the conversions in utils.lua and the buffer arguments of the core functions.
+Prints 'Bytes test: passed' or the failed checks.
+
+Arguments:
+	-h             : this help
+]]
+
+local failed = 0
+
+local function check(ok, what)
+	if not ok then
+		print("FAILED: " .. what)
+		failed = failed + 1
+	end
+end
+
+local function check_error(f, what)
+	check(not pcall(f), what .. " raises an error")
+end
+
+local function test_buffers()
+	local b = bytes.new(4)
+	check(#b == 4 and b:len() == 4, "new() length")
+	check(b:hex() == "00000000", "new() is zero filled")
+	check(bytes.new(3, 0xa5):hex() == "A5A5A5", "new() fill value")
+
+	b[1] = 0x30
+	b:set(4, 0xff)
+	check(b[1] == 0x30 and b:get(4) == 0xff and b[5] == nil and b[0] == nil, "indexing")
+	check_error(function() b[5] = 1 end, "writing after the end")
+	check_error(function() b[1] = 0x100 end, "writing a value above 0xff")
+	check(tostring(b) == "300000FF", "tostring()")
+
+	local h = bytes.fromhex("a0 b1\nC2")
+	check(h:hex() == "A0B1C2" and h:raw() == "\160\177\194", "fromhex() and raw()")
+	check_error(function() bytes.fromhex("a0b") end, "fromhex() of an odd number of digits")
+	check_error(function() bytes.fromhex("a0x1") end, "fromhex() of a non hex character")
+	check(bytes.fromstring("\0\1\2") == bytes.fromhex("000102"), "fromstring() and ==")
+	check(bytes.isbytes(b) and not bytes.isbytes("00") and not bytes.isbytes(nil), "isbytes()")
+
+	local s = bytes.fromhex("00112233445566")
+	check(s:hex(2, 3) == "1122" and s:hex(-2) == "5566" and s:hex(5, 2) == "", "ranges")
+
+	-- a slice shares the memory, a copy doesn't
+	local view = s:slice(3, 5)
+	local copy = s:copy(3, 5)
+	view[1] = 0xaa
+	copy[2] = 0xbb
+	check(s:hex() == "0011AA33445566" and view:hex() == "AA3344" and copy:hex() == "22BB44", "slice() and copy()")
+	check_error(function() view[4] = 0 end, "writing after the end of a slice")
+	view = nil
+	collectgarbage()
+	check(s:slice(2):slice(2, 3):hex() == "AA33", "slice of a slice")
+
+	s:fill(0xee, 6)
+	check(s:hex() == "0011AA3344EEEE", "fill()")
+	check(s:write(2, "\1\2") == 4 and s:write(4, bytes.fromhex("0304")) == 6, "write() returns the next position")
+	check(s:hex() == "0001020304EEEE", "write()")
+	check_error(function() s:write(7, "\1\2") end, "write() after the end")
+	-- overlapping write through a slice of the same buffer
+	s:write(2, s:slice(1, 4))
+	check(s:hex() == "0000010203EEEE", "overlapping write()")
+end
+
+local function test_pack()
+	local b = bytes.new(8)
+	check(b:pack("<SI", 1, 0x1234, 0xdeadbeef) == 7, "pack() returns the next position")
+	check(b:hex() == "3412EFBEADDE0000", "pack() little endian")
+	b:pack(">S", 7, 0xcafe)
+	local pos, s, i, s2 = b:unpack("<SI>S")
+	check(pos == 9 and s == 0x1234 and i == 0xdeadbeef and s2 == 0xcafe, "unpack()")
+	check(select(2, b:unpack("H2", 3)) == "EFBE", "unpack() at a position")
+	check(select(2, bin.unpack("<S", b)) == 0x1234, "bin.unpack() of a buffer")
+	check_error(function() b:pack("I", 6, 0) end, "pack() after the end")
+end
+
+local function test_crc()
+	-- the CRCs are appended to the frames in this order
+	local read = bytes.fromhex("3000")
+	check(read:crc14443a() == 0xa802, "crc14443a() of READ 0")
+	check(bytes.fromhex("500057CD"):crc14443a(1, 2) == 0xcd57, "crc14443a() of HLTA")
+	check(bytes.fromhex("050008"):crc14443b() == 0x7339, "crc14443b() of REQB")
+
+	local data = bytes.fromstring("123456789")
+	check(data:crc16() == core.crc16("123456789"), "crc16() as core.crc16()")
+	check(data:crc15693() == core.iso15693_crc("123456789"), "crc15693() as core.iso15693_crc()")
+	check(data:crc16(2, 4) == core.crc16("234"), "crc16() of a range")
+end
+
+local function test_commands()
+	local c = Command:new{cmd = cmds.CMD_READER_ISO_14443a, arg1 = 0x0a, arg2 = 4, arg3 = 0x1234, data = "30002A"}
+	local packet = c:getBytes()
+	check(bytes.isbytes(packet) and #packet == Command.SIZE, "getBytes() is a buffer of a packet")
+	local pos, cmd, arg1, arg2, arg3 = packet:unpack("LLLL")
+	check(pos == Command.DATA_POS and cmd == cmds.CMD_READER_ISO_14443a and arg1 == 0x0a and arg2 == 4 and arg3 == 0x1234,
+		"getBytes() header")
+	check(packet:hex(pos, pos + 3) == "30002A00" and packet:hex(pos + 3):match("^0+$") ~= nil, "getBytes() data")
+
+	local b = Command:new{cmd = cmds.CMD_READER_ISO_14443a, arg1 = 0x0a, arg2 = 4, arg3 = 0x1234, data = bytes.fromhex("30002A")}
+	check(b:getBytes() == packet, "getBytes() of a buffer as of a hex-string")
+
+	local parsed = Command.parse(packet)
+	check(parsed.cmd == cmd and parsed.arg3 == 0x1234 and parsed.data:sub(1, 6) == "30002A", "parse() of a buffer")
+	check(Command.parse(packet:raw()).data == parsed.data, "parse() of a string")
+	check(#Command.newResponse() == Command.SIZE, "newResponse()")
+end
+
+local function test_utils()
+	local b = utils.ConvertHexToBuffer("04 a1:B2")
+	check(b:hex() == "04A1B2", "ConvertHexToBuffer()")
+	check(utils.ConvertBytesToHex(b) == "04A1B2" and utils.ConvertBytesToHex({4, 0xa1}) == "04A1", "ConvertBytesToHex()")
+	check(utils.ConvertBytesToAscii(b) == "\4\161\178" and utils.ConvertBytesToAscii({0x41}) == "A", "ConvertBytesToAscii()")
+	check(utils.ConvertHexToAscii("4142") == "AB" and utils.ConvertHexToAscii("41x42") == "AB", "ConvertHexToAscii()")
+	check(utils.Crc16(b) == utils.Crc16("04A1B2"), "Crc16() of a buffer")
+	check(utils.Crc64(b) == utils.Crc64("04A1B2"), "Crc64() of a buffer")
+	check(taglib.lookupManufacturer(b) == taglib.lookupManufacturer(4), "lookupManufacturer() of a UID")
+end
+
+local function test_core()
+	-- the answers are copied, a slice at an odd position works as well
+	local big = bytes.new(Command.SIZE + 1)
+	local response = big:slice(2)
+	check(core.WaitForResponseTimeout(cmds.CMD_ACK, 1, response) == nil, "WaitForResponseTimeout() without an answer")
+	check(pcall(core.WaitForResponseTimeout, cmds.CMD_ACK, 1, nil), "WaitForResponseTimeout() with a nil response buffer")
+	check(pcall(core.session_wait, 0, cmds.CMD_ACK, 1, nil), "session_wait() with a nil response buffer")
+	check(core.SendCommand(bytes.new(3)) == "Wrong data size", "SendCommand() of a wrong size")
+	print()
+	check_error(function() core.WaitForResponseTimeout(cmds.CMD_ACK, 1, bytes.new(3)) end,
+		"WaitForResponseTimeout() into a buffer of a wrong size")
+	check_error(function() core.session_send(0, bytes.new(3)) end, "session_send() of a wrong size")
+end
+
+local function main(args)
+	if args == '-h' then
+		print(desc)
+		return
+	end
+	test_buffers()
+	test_pack()
+	test_crc()
+	test_commands()
+	test_utils()
+	test_core()
+	if failed == 0 then
+		print("Bytes test: passed")
+	else
+		print(("Bytes test: %d checks FAILED"):format(failed))
+	end
+end
+
+main(args)
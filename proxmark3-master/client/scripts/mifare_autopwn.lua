@@ -134,11 +134,10 @@ generating polynomial with 16 effective bits only, but shows unexpected behaviou
 			elseif err == -5 then return oops("Aborted via keyboard.")
 			end
 			-- The key is actually 8 bytes, so a 
-			-- 6-byte key is sent as 00XXXXXX
-			-- This means we unpack it as first
+			-- 6-byte key is sent as 0000XXXXXXXXXXXX
+			-- This means we skip the first
 			-- two bytes, then six bytes actual key data
-			-- We can discard first and second return values
-			_,_,key = bin.unpack("H2H6",res)
+			key = bytes.fromstring(res):hex(3, 8)
 			print("Key ", key)
 
 			-- Use nested attack
@@ -0,0 +1,79 @@
+local cmds = require('commands')
+local getopt = require('getopt')
+
+example = [[
+	1. script run session_ping
+	2. script run session_ping -n 500
+	3. script run session_ping -p /dev/ttyACM1 -p /dev/ttyACM2
+]]
+author = "Proxmark3 contributors"
+usage = "script run session_ping [-n rounds] [-p port]..."
+desc = [[
+Fan a ping out to all the connected devices and collect the answers.
+
+Every round sends the ping to each device before it waits for the first answer,
+so the devices work at the same time. Prints the round trip time of the rounds
+and the traffic counters of each session.
+
+Arguments:
+	-h             : this help
+	-n <rounds>    : number of rounds, default 100
+	-p <port>      : connect one more device first, can be repeated
+]]
+
+local TIMEOUT = 1000
+
+function oops(err)
+	print("ERROR: ", err)
+end
+
+function help()
+	print(desc)
+	print("Example usage")
+	print(example)
+end
+
+local function main(args)
+	local rounds = 100
+
+	for o, a in getopt.getopt(args, 'hn:p:') do
+		if o == "h" then return help() end
+		if o == "n" then rounds = tonumber(a) end
+		if o == "p" then
+			local id, err = core.session_open(a)
+			if not id then return oops(err .. ' ' .. a) end
+			print(("session %d: %s"):format(id, a))
+		end
+	end
+
+	local ids = {}
+	for id, port in pairs(core.session_list()) do
+		table.insert(ids, id)
+	end
+	table.sort(ids)
+	if #ids == 0 then return oops('no device connected') end
+
+	local ping = Command:new{cmd = cmds.CMD_PING}:getBytes()
+	local response = bytes.new(#ping)
+	local missing = 0
+
+	for r = 1, rounds do
+		for _, id in ipairs(ids) do
+			core.session_clear(id)
+			core.session_send(id, ping)
+		end
+		for _, id in ipairs(ids) do
+			if not core.session_wait(id, cmds.CMD_ACK, TIMEOUT, response) then
+				missing = missing + 1
+			end
+		end
+	end
+
+	print(("%d devices, %d rounds, %d pings unanswered"):format(#ids, rounds, missing))
+	for _, id in ipairs(ids) do
+		local s = core.session_stats(id)
+		print(("%2d %-20s tx %d rx %d commands, %d bytes received"):format(id, core.session_list()[id], s.tx_cmds, s.rx_cmds, s.rx_bytes))
+	end
+end
+
+main(args)
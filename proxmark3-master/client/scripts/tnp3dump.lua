@@ -1,6 +1,5 @@
 local cmds = require('commands')
 local getopt = require('getopt')
-local bin = require('bin')
 local lib14a = require('read14a')
 local utils = require('utils')
 local md5 = require('md5')
@@ -75,18 +74,18 @@ end
 
 local function readdumpkeys(infile)
 	 t = infile:read("*all")
-	 len = string.len(t)
-	 local len,hex = bin.unpack(("H%d"):format(len),t)
-	 return hex
+	 return bytes.fromstring(t):hex()
 end
 
+-- Every answer is received in this buffer
+local response = Command.newResponse()
+
 local function waitCmd()
-	local response = core.WaitForResponseTimeout(cmds.CMD_ACK,TIMEOUT)
-	if response then
-		local count,cmd,arg0 = bin.unpack('LL',response)
+	if core.WaitForResponseTimeout(cmds.CMD_ACK,TIMEOUT,response) then
+		local count,cmd,arg0,arg1,arg2 = response:unpack('LLLL')
 		if(arg0==1) then
-			local count,arg1,arg2,data = bin.unpack('LLH511',response,count)
-			return data:sub(1,32)
+			-- the 16 bytes of the block
+			return response:hex(count, count + 15)
 		else
 			return nil, "Couldn't read block.." 
 		end
@@ -214,8 +213,7 @@ local function main(args)
 					local baseStr = utils.ConvertHexToAscii(tmpHash:format(blockNo))
 					local key = md5.sumhexa(baseStr)
 					local aestest = core.aes128_decrypt(key, blockdata)
-					local hex = utils.ConvertAsciiToBytes(aestest)
-					hex = utils.ConvertBytesToHex(hex)
+					local hex = bytes.fromstring(aestest):hex()
 					blocks[blockNo+1] = ('%02d  :: %s'):format(blockNo,hex)
 					io.write(blockNo..',')
 				end		
@@ -230,18 +228,14 @@ local function main(args)
 	core.clearCommandBuffer()
 		
 	-- Print results
-	local bindata = {}
+	local bindata = bytes.new(16 * #blocks)
 	local emldata = ''
+	local pos = 1
 
-	for _,s in pairs(blocks) do
+	for _,s in ipairs(blocks) do
 		local slice = s:sub(8,#s)
-		local str = utils.ConvertBytesToAscii(
-				 utils.ConvertHexToBytes(slice)
-				)
+		pos = bindata:write(pos, utils.ConvertHexToBuffer(slice))
 		emldata = emldata..slice..'\n'
-		for c in (str):gmatch('.') do
-			bindata[#bindata+1] = c
-		end		
 	end 
 
 	print( string.rep('--',20) )
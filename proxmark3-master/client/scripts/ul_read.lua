@@ -0,0 +1,87 @@
+local cmds = require('commands')
+local getopt = require('getopt')
+local lib14a = require('read14a')
+
+example = [[
+	1. script run ul_read
+	2. script run ul_read -p 45
+]]
+author = "Proxmark3 contributors"
+usage = "script run ul_read [-p pages]"
+desc = [[
+Read the pages of a MIFARE Ultralight or NTAG with raw READ commands.
+
+An example of the bytes library: the packet with the READ is built once, every
+READ only changes the page number and the CRC in its data. The answers are
+received in one buffer and the CRC is checked in place, without hex-strings.
+
+Arguments:
+	-h             : this help
+	-p <pages>     : number of pages to read, default 16
+]]
+
+local TIMEOUT = 2000
+
+function oops(err)
+	print("ERROR: ", err)
+end
+
+function help()
+	print(desc)
+	print("Example usage")
+	print(example)
+end
+
+-- Switch the field off, the device doesn't answer this
+local function disconnect()
+	core.SendCommand(Command:new{cmd = cmds.CMD_READER_ISO_14443a, arg1 = 0}:getBytes())
+end
+
+local function main(args)
+	local pages = 16
+
+	for o, a in getopt.getopt(args, 'hp:') do
+		if o == "h" then return help() end
+		if o == "p" then pages = tonumber(a) end
+	end
+
+	local card, err
+	repeat
+		card, err = lib14a.read14443a(true, true)
+	until card or core.ukbhit()
+	if not card then return oops(err) end
+	print(("Found %s, UID %s"):format(card.name, card.uid))
+
+	-- READ <page> <CRC> as a raw frame, the CRC is computed here
+	local flags = lib14a.ISO14A_COMMAND.ISO14A_NO_DISCONNECT + lib14a.ISO14A_COMMAND.ISO14A_RAW
+	local packet = Command:new{cmd = cmds.CMD_READER_ISO_14443a, arg1 = flags, arg2 = 4}:getBytes()
+	local frame = packet:slice(Command.DATA_POS, Command.DATA_POS + 3)
+	frame[1] = 0x30
+
+	-- the answer to a READ is four pages and their CRC
+	local response = Command.newResponse()
+	local answer = response:slice(Command.DATA_POS, Command.DATA_POS + 17)
+
+	core.clearCommandBuffer()
+	for page = 0, pages - 1, 4 do
+		frame[2] = page
+		frame:pack("<S", 3, frame:crc14443a(1, 2))
+		core.SendCommand(packet)
+		if not core.WaitForResponseTimeout(cmds.CMD_ACK, TIMEOUT, response) then
+			disconnect()
+			return oops("no answer from the device")
+		end
+		local _, cmd, len = response:unpack("LL")
+		local _, crc = answer:unpack("<S", 17)
+		if len ~= #answer or crc ~= answer:crc14443a(1, 16) then
+			disconnect()
+			return oops(("no valid answer to READ %d"):format(page))
+		end
+		for i = 0, math.min(3, pages - 1 - page) do
+			print(("%3d  %s"):format(page + i, answer:hex(i * 4 + 1, i * 4 + 4)))
+		end
+	end
+	disconnect()
+end
+
+main(args)
@@ -0,0 +1,466 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Device sessions: one serial port, receiver thread and response buffer per
+// connected Proxmark
+//
+// Every session has its own receiver thread, which also sends the pending
+// command (the serial port handle is not shared between threads on Windows),
+// and its own response buffer. Several devices can therefore work at the same
+// time, driven from one thread per device or from a single thread that sends to
+// all of them before it waits for the responses.
+//-----------------------------------------------------------------------------
+
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE	200112L			// need clock_gettime()
+#endif
+
+#include "session.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "cmdmain.h"
+#include "ui.h"
+#include "util.h"
+#include "util_posix.h"
+
+//For storing command that are received from the device
+#define CMD_BUFFER_SIZE 50
+
+typedef struct {
+	char *port;
+	serial_port sp;
+	pthread_t thread;
+	volatile bool run;
+	UsbCommand txcmd;
+	bool txcmd_pending;
+	UsbCommand cmdBuffer[CMD_BUFFER_SIZE];
+	//Points to the next empty position to write to
+	int cmd_head;
+	//Points to the position of the last unread command
+	int cmd_tail;
+	// to lock cmdBuffer and stats operations from different threads
+	pthread_mutex_t lock;
+	// signaled when a response is stored
+	pthread_cond_t received;
+	// signaled when txcmd was sent
+	pthread_cond_t sent;
+	// destination of the downloaded samples
+	uint8_t *download_buf;
+	size_t download_len;
+	session_stats_t stats;
+	// references held by the table and by the calls using the session, guarded by sessions_lock
+	int refs;
+} session_t;
+
+static session_t *sessions[SESSION_MAX];
+static int current_session = -1;
+// guards sessions[] and the reference counts
+static pthread_mutex_t sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+// UsbCommandReceived() isn't reentrant, the receivers of all sessions take turns
+static pthread_mutex_t handler_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void session_free(session_t *s)
+{
+	pthread_cond_destroy(&s->sent);
+	pthread_cond_destroy(&s->received);
+	pthread_mutex_destroy(&s->lock);
+	free(s->port);
+	free(s);
+}
+
+// Returns the session with a reference held, which session_put() releases,
+// so a concurrent session_close() doesn't free it. NULL if id isn't open.
+static session_t *session_get(int id)
+{
+	if (id < 0 || id >= SESSION_MAX)
+		return NULL;
+	pthread_mutex_lock(&sessions_lock);
+	session_t *s = sessions[id];
+	if (s)
+		s->refs++;
+	pthread_mutex_unlock(&sessions_lock);
+	return s;
+}
+
+static void session_put(session_t *s)
+{
+	pthread_mutex_lock(&sessions_lock);
+	bool last = --s->refs == 0;
+	pthread_mutex_unlock(&sessions_lock);
+	if (last)
+		session_free(s);
+}
+
+static void session_store(session_t *s, UsbCommand *command)
+{
+	pthread_mutex_lock(&s->lock);
+	if ((s->cmd_head + 1) % CMD_BUFFER_SIZE == s->cmd_tail) {
+		//If these two are equal, we're about to overwrite in the
+		// circular buffer.
+		PrintAndLog("WARNING: Command buffer about to overwrite command! This needs to be fixed!");
+		s->stats.overflows++;
+	}
+	memcpy(&s->cmdBuffer[s->cmd_head], command, sizeof(UsbCommand));
+	s->cmd_head = (s->cmd_head + 1) % CMD_BUFFER_SIZE;
+	pthread_cond_broadcast(&s->received);
+	pthread_mutex_unlock(&s->lock);
+}
+
+static void session_store_samples(session_t *s, UsbCommand *c)
+{
+	pthread_mutex_lock(&s->lock);
+	if (s->download_buf && c->arg[0] < s->download_len) {
+		size_t len = MIN(c->arg[1], USB_CMD_DATA_SIZE);
+		len = MIN(len, s->download_len - c->arg[0]);
+		memcpy(s->download_buf + c->arg[0], c->d.asBytes, len);
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+// must be called with s->lock held
+static bool session_get_locked(session_t *s, UsbCommand *response)
+{
+	if (s->cmd_head == s->cmd_tail)
+		return false;
+	memcpy(response, &s->cmdBuffer[s->cmd_tail], sizeof(UsbCommand));
+	s->cmd_tail = (s->cmd_tail + 1) % CMD_BUFFER_SIZE;
+	return true;
+}
+
+static void
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+*session_receiver(void *targ) {
+	session_t *s = (session_t *)targ;
+	UsbCommand rx;
+	byte_t *prx = (byte_t *)&rx;
+	size_t rxlen;
+
+	while (s->run) {
+		rxlen = 0;
+		if (uart_receive(s->sp, prx, sizeof(UsbCommand) - (prx - (byte_t *)&rx), &rxlen) && rxlen) {
+			prx += rxlen;
+			if (prx - (byte_t *)&rx < sizeof(UsbCommand)) {
+				continue;
+			}
+			pthread_mutex_lock(&s->lock);
+			s->stats.rx_cmds++;
+			s->stats.rx_bytes += sizeof(UsbCommand);
+			pthread_mutex_unlock(&s->lock);
+			if (rx.cmd == CMD_DOWNLOADED_RAW_ADC_SAMPLES_125K) {
+				session_store_samples(s, &rx);
+			} else {
+				pthread_mutex_lock(&handler_lock);
+				bool handled = UsbCommandReceived(&rx);
+				pthread_mutex_unlock(&handler_lock);
+				if (!handled)
+					session_store(s, &rx);
+			}
+		}
+		prx = (byte_t *)&rx;
+
+		// txcmd is left alone by session_send() until txcmd_pending is cleared
+		pthread_mutex_lock(&s->lock);
+		bool pending = s->txcmd_pending;
+		pthread_mutex_unlock(&s->lock);
+		if (pending) {
+			bool sent = uart_send(s->sp, (byte_t *)&s->txcmd, sizeof(UsbCommand));
+			if (!sent)
+				PrintAndLog("Sending bytes to proxmark on %s failed", s->port);
+			pthread_mutex_lock(&s->lock);
+			if (sent) {
+				s->stats.tx_cmds++;
+				s->stats.tx_bytes += sizeof(UsbCommand);
+			}
+			s->txcmd_pending = false;
+			pthread_cond_broadcast(&s->sent);
+			pthread_mutex_unlock(&s->lock);
+		}
+	}
+
+	// nothing is sent any more, release a waiting session_send()
+	pthread_mutex_lock(&s->lock);
+	s->txcmd_pending = false;
+	pthread_cond_broadcast(&s->sent);
+	pthread_mutex_unlock(&s->lock);
+
+	pthread_exit(NULL);
+	return NULL;
+}
+
+int session_attach(const char *port, serial_port sp)
+{
+	session_t *s = calloc(1, sizeof(session_t));
+	if (s == NULL)
+		return -1;
+	s->port = malloc(strlen(port) + 1);
+	if (s->port == NULL) {
+		free(s);
+		return -1;
+	}
+	strcpy(s->port, port);
+	s->sp = sp;
+	s->stats.start_time = msclock();
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->received, NULL);
+	pthread_cond_init(&s->sent, NULL);
+	s->refs = 1;
+	s->run = true;
+
+	pthread_mutex_lock(&sessions_lock);
+	int id;
+	for (id = 0; id < SESSION_MAX; id++) {
+		if (sessions[id] == NULL)
+			break;
+	}
+	if (id < SESSION_MAX)
+		sessions[id] = s;
+	pthread_mutex_unlock(&sessions_lock);
+	if (id == SESSION_MAX) {
+		PrintAndLog("ERROR: too many sessions, at most %d devices can be connected", SESSION_MAX);
+		session_free(s);
+		return -1;
+	}
+
+	if (pthread_create(&s->thread, NULL, &session_receiver, s)) {
+		PrintAndLog("ERROR: can't start the receiver thread for %s", port);
+		pthread_mutex_lock(&sessions_lock);
+		sessions[id] = NULL;
+		pthread_mutex_unlock(&sessions_lock);
+		session_free(s);
+		return -1;
+	}
+
+	if (current_session < 0)
+		session_select(id);
+	return id;
+}
+
+int session_open(const char *port)
+{
+	for (int id = 0; id < SESSION_MAX; id++) {
+		session_t *s = session_get(id);
+		bool open = s && !strcmp(s->port, port);
+		if (s)
+			session_put(s);
+		if (open) {
+			PrintAndLog("ERROR: %s is already open as session %d", port, id);
+			return -1;
+		}
+	}
+
+	serial_port sp = uart_open(port);
+	if (sp == INVALID_SERIAL_PORT) {
+		PrintAndLog("ERROR: invalid serial port %s", port);
+		return -1;
+	} else if (sp == CLAIMED_SERIAL_PORT) {
+		PrintAndLog("ERROR: serial port %s is claimed by another process", port);
+		return -1;
+	}
+
+	int id = session_attach(port, sp);
+	if (id < 0)
+		uart_close(sp);
+	return id;
+}
+
+void session_close(int id)
+{
+	if (id < 0 || id >= SESSION_MAX)
+		return;
+	pthread_mutex_lock(&sessions_lock);
+	session_t *s = sessions[id];
+	sessions[id] = NULL;
+	pthread_mutex_unlock(&sessions_lock);
+	if (s == NULL)
+		return;
+
+	// wake the callers waiting in session_wait() and session_send(), they give up when run is cleared
+	pthread_mutex_lock(&s->lock);
+	s->run = false;
+	pthread_cond_broadcast(&s->received);
+	pthread_cond_broadcast(&s->sent);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->thread, NULL);
+	uart_close(s->sp);
+	// the last caller still using the session frees it
+	session_put(s);
+
+	// continue with the first of the remaining devices
+	if (id == current_session) {
+		current_session = -1;
+		for (int i = 0; i < SESSION_MAX; i++) {
+			if (session_valid(i)) {
+				session_select(i);
+				break;
+			}
+		}
+		if (current_session < 0)
+			offline = 1;
+	}
+}
+
+void session_close_all(void)
+{
+	for (int id = 0; id < SESSION_MAX; id++)
+		session_close(id);
+}
+
+int session_current(void)
+{
+	return current_session;
+}
+
+bool session_select(int id)
+{
+	if (!session_valid(id))
+		return false;
+	current_session = id;
+	offline = 0;
+	return true;
+}
+
+bool session_valid(int id)
+{
+	if (id < 0 || id >= SESSION_MAX)
+		return false;
+	pthread_mutex_lock(&sessions_lock);
+	bool valid = sessions[id] != NULL;
+	pthread_mutex_unlock(&sessions_lock);
+	return valid;
+}
+
+int session_count(void)
+{
+	int n = 0;
+	pthread_mutex_lock(&sessions_lock);
+	for (int id = 0; id < SESSION_MAX; id++) {
+		if (sessions[id])
+			n++;
+	}
+	pthread_mutex_unlock(&sessions_lock);
+	return n;
+}
+
+const char *session_port(int id)
+{
+	if (id < 0 || id >= SESSION_MAX)
+		return NULL;
+	pthread_mutex_lock(&sessions_lock);
+	const char *port = sessions[id] ? sessions[id]->port : NULL;
+	pthread_mutex_unlock(&sessions_lock);
+	return port;
+}
+
+bool session_get_stats(int id, session_stats_t *stats)
+{
+	session_t *s = session_get(id);
+	if (s == NULL)
+		return false;
+	pthread_mutex_lock(&s->lock);
+	*stats = s->stats;
+	pthread_mutex_unlock(&s->lock);
+	session_put(s);
+	return true;
+}
+
+bool session_send(int id, UsbCommand *c)
+{
+	session_t *s = session_get(id);
+	if (s == NULL)
+		return false;
+	bool queued = false;
+
+	pthread_mutex_lock(&s->lock);
+	while (s->txcmd_pending)
+		pthread_cond_wait(&s->sent, &s->lock);
+	if (s->run) {
+		s->txcmd = *c;
+		s->txcmd_pending = true;
+		queued = true;
+	}
+	pthread_mutex_unlock(&s->lock);
+	session_put(s);
+	return queued;
+}
+
+void session_set_download(int id, uint8_t *dest, size_t len)
+{
+	session_t *s = session_get(id);
+	if (s == NULL)
+		return;
+	pthread_mutex_lock(&s->lock);
+	s->download_buf = dest;
+	s->download_len = dest ? len : 0;
+	pthread_mutex_unlock(&s->lock);
+	session_put(s);
+}
+
+void session_clear(int id)
+{
+	session_t *s = session_get(id);
+	if (s == NULL)
+		return;
+	pthread_mutex_lock(&s->lock);
+	s->cmd_tail = s->cmd_head;
+	pthread_mutex_unlock(&s->lock);
+	session_put(s);
+}
+
+bool session_wait(int id, uint32_t cmd, UsbCommand *response, size_t ms_timeout, bool show_warning)
+{
+	session_t *s = session_get(id);
+	if (s == NULL)
+		return false;
+	uint64_t start_time = msclock();
+	bool found = false;
+
+	pthread_mutex_lock(&s->lock);
+	while (true) {
+		while (session_get_locked(s, response)) {
+			if (response->cmd == cmd) {
+				found = true;
+				break;
+			}
+		}
+		// the session was closed, no more responses come
+		if (found || !s->run)
+			break;
+
+		uint64_t elapsed = msclock() - start_time;
+		if (elapsed > ms_timeout)
+			break;
+		if (elapsed > 2000 && show_warning) {
+			pthread_mutex_unlock(&s->lock);
+			PrintAndLog("Waiting for a response from the proxmark...");
+			PrintAndLog("You can cancel this operation by pressing the pm3 button");
+			show_warning = false;
+			pthread_mutex_lock(&s->lock);
+			continue;
+		}
+
+		// sleep until the receiver stores a response, at most 100ms at a time to check the timeout
+		uint64_t slice = ms_timeout - elapsed;
+		if (slice > 100)
+			slice = 100;
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += (slice + 1) * 1000000;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000;
+		deadline.tv_nsec %= 1000000000;
+		pthread_cond_timedwait(&s->received, &s->lock, &deadline);
+	}
+	pthread_mutex_unlock(&s->lock);
+	session_put(s);
+
+	return found;
+}
@@ -0,0 +1,56 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Device sessions: one serial port, receiver thread and response buffer per
+// connected Proxmark
+//-----------------------------------------------------------------------------
+
+#ifndef SESSION_H__
+#define SESSION_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "usb_cmd.h"
+#include "uart.h"
+
+#define SESSION_MAX			16
+
+typedef struct {
+	uint64_t tx_cmds;
+	uint64_t rx_cmds;
+	uint64_t tx_bytes;
+	uint64_t rx_bytes;
+	uint64_t overflows;				// responses dropped because nobody read them
+	uint64_t start_time;			// msclock() when the session was opened
+} session_stats_t;
+
+// Open a port and start its receiver. Returns the session id or -1.
+extern int session_open(const char *port);
+// Start a session on an already opened port. Returns the session id or -1.
+extern int session_attach(const char *port, serial_port sp);
+extern void session_close(int id);
+extern void session_close_all(void);
+
+// The current session is the one the commands of the client talk to
+extern int session_current(void);
+extern bool session_select(int id);
+extern bool session_valid(int id);
+extern int session_count(void);
+// The name stays valid until the session is closed
+extern const char *session_port(int id);
+extern bool session_get_stats(int id, session_stats_t *stats);
+
+// Queue a command for the device, blocks while the previous one is not sent yet
+extern bool session_send(int id, UsbCommand *c);
+// Where the receiver of the session puts the samples of CMD_DOWNLOADED_RAW_ADC_SAMPLES_125K,
+// len bytes at dest. NULL drops them.
+extern void session_set_download(int id, uint8_t *dest, size_t len);
+// Drop all buffered responses
+extern void session_clear(int id);
+// Wait up to ms_timeout for the response cmd, other responses are dropped
+extern bool session_wait(int id, uint32_t cmd, UsbCommand *response, size_t ms_timeout, bool show_warning);
+
+#endif
@@ -0,0 +1,686 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Sample trace files for data load and data save
+//
+// Text traces (one decimal sample per line) stay the default. Binary traces are
+// .raw (one signed byte per sample), .wav (8 bit mono PCM, playable and readable
+// by audio tools, sampling config in a "pm3 " chunk) and .pm3z (zlib compressed,
+// int8 or int32 samples, sampling config in the header).
+//
+// Files are memory mapped when loaded, so loading a range of a large .raw or
+// .wav archive reads only the pages of that range.
+//-----------------------------------------------------------------------------
+
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE	200112L			// need mmap()
+#endif
+
+#include "tracefile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "zlib.h"
+#include "ui.h"
+#include "util_posix.h"
+
+#define LF_ADC_CLOCK		12000000	// the LF carrier is LF_ADC_CLOCK / (divisor + 1)
+#define CONFIG_LEN			12			// serialized sample_config
+#define PM3Z_MAGIC			"PM3Z"
+#define PM3Z_VERSION		1
+#define PM3Z_HEADER_LEN		(12 + CONFIG_LEN)
+#define WAV_HEADER_LEN		(12 + 8 + 16 + 8 + CONFIG_LEN + 8)
+#define CHUNK_SAMPLES		8192
+
+// the default of the device, until samples are read from it or a file brings its own
+static sample_config trace_config = {1, 8, 1, 95, 0};
+// the file has more samples than max_len allowed to load
+static bool truncated;
+
+typedef struct {
+	const uint8_t *data;
+	size_t size;
+#if defined(_WIN32)
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+} mapped_file_t;
+
+
+void trace_set_sample_config(const sample_config *config)
+{
+	trace_config = *config;
+}
+
+
+const sample_config *trace_get_sample_config(void)
+{
+	return &trace_config;
+}
+
+
+trace_format_t trace_format(const char *filename)
+{
+	const char *ext = strrchr(filename, '.');
+	if (ext == NULL || strpbrk(ext, "/\\") != NULL) return TRACE_FORMAT_TEXT;
+
+	char lower[8] = {0};
+	for (int i = 0; i < sizeof(lower) - 1 && ext[i + 1]; i++) {
+		lower[i] = tolower((unsigned char)ext[i + 1]);
+	}
+	if (!strcmp(lower, "raw")) return TRACE_FORMAT_RAW;
+	if (!strcmp(lower, "wav")) return TRACE_FORMAT_WAV;
+	if (!strcmp(lower, "pm3z")) return TRACE_FORMAT_PM3Z;
+	return TRACE_FORMAT_TEXT;
+}
+
+
+const char *trace_format_name(trace_format_t format)
+{
+	switch (format) {
+		case TRACE_FORMAT_RAW: return "raw";
+		case TRACE_FORMAT_WAV: return "wav";
+		case TRACE_FORMAT_PM3Z: return "pm3z";
+		default: return "text";
+	}
+}
+
+
+static bool map_file(const char *filename, mapped_file_t *m)
+{
+	memset(m, 0, sizeof(*m));
+#if defined(_WIN32)
+	m->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m->file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m->file, &size)) {
+		CloseHandle(m->file);
+		return false;
+	}
+	m->size = size.QuadPart;
+	if (m->size == 0) return true;
+	m->mapping = CreateFileMapping(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m->mapping != NULL) {
+		m->data = MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (m->data == NULL) {
+		if (m->mapping != NULL) CloseHandle(m->mapping);
+		CloseHandle(m->file);
+		return false;
+	}
+#else
+	struct stat st;
+	m->fd = open(filename, O_RDONLY);
+	if (m->fd < 0) return false;
+	if (fstat(m->fd, &st) < 0) {
+		close(m->fd);
+		return false;
+	}
+	m->size = st.st_size;
+	if (m->size == 0) return true;
+	void *data = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, m->fd, 0);
+	if (data == MAP_FAILED) {
+		close(m->fd);
+		return false;
+	}
+	m->data = data;
+#endif
+	return true;
+}
+
+
+static void unmap_file(mapped_file_t *m)
+{
+#if defined(_WIN32)
+	if (m->data != NULL) UnmapViewOfFile(m->data);
+	if (m->mapping != NULL) CloseHandle(m->mapping);
+	CloseHandle(m->file);
+#else
+	if (m->data != NULL) munmap((void *)m->data, m->size);
+	close(m->fd);
+#endif
+}
+
+
+static uint16_t get_le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+
+static void put_config(uint8_t *p, const sample_config *config)
+{
+	p[0] = config->decimation;
+	p[1] = config->bits_per_sample;
+	p[2] = config->averaging;
+	p[3] = 0;
+	put_le32(p + 4, config->divisor);
+	put_le32(p + 8, config->trigger_threshold);
+}
+
+
+static void get_config(const uint8_t *p, sample_config *config)
+{
+	config->decimation = p[0];
+	config->bits_per_sample = p[1];
+	config->averaging = p[2];
+	config->divisor = (int32_t)get_le32(p + 4);
+	config->trigger_threshold = (int32_t)get_le32(p + 8);
+}
+
+
+// the sample range [start, start + count) of total samples, clipped to max_len
+static size_t sample_range(size_t total, int max_len, int start, int count)
+{
+	if (start >= total) return 0;
+	size_t n = total - start;
+	if (count >= 0 && n > count) n = count;
+	if (n > max_len) {
+		n = max_len;
+		truncated = true;
+	}
+	return n;
+}
+
+
+// Same samples as atoi() of every line, as data load always did
+static int load_text(const uint8_t *p, size_t size, int *buffer, int max_len, int start, int count)
+{
+	size_t i = 0;
+	int line = 0;
+	int n = 0;
+
+	while (i < size && n < max_len && (count < 0 || n < count)) {
+		if (line++ < start) {
+			const uint8_t *eol = memchr(p + i, '\n', size - i);
+			i = eol ? eol - p + 1 : size;
+			continue;
+		}
+		while (i < size && (p[i] == ' ' || p[i] == '\t')) i++;
+		bool negative = false;
+		if (i < size && (p[i] == '-' || p[i] == '+')) {
+			negative = p[i++] == '-';
+		}
+		int v = 0;
+		while (i < size && p[i] >= '0' && p[i] <= '9') {
+			v = v * 10 + (p[i++] - '0');
+		}
+		while (i < size && p[i] != '\n') i++;
+		i++;
+		buffer[n++] = negative ? -v : v;
+	}
+	if (n == max_len && (count < 0 || n < count) && i < size) {
+		truncated = true;
+	}
+	return n;
+}
+
+
+static int load_raw(const uint8_t *p, size_t size, int *buffer, int max_len, int start, int count)
+{
+	size_t n = sample_range(size, max_len, start, count);
+	p += start;
+	for (size_t i = 0; i < n; i++) {
+		buffer[i] = (int8_t)p[i];
+	}
+	return n;
+}
+
+
+static int load_wav(const uint8_t *p, size_t size, int *buffer, int max_len, int start, int count, sample_config *config, bool *has_config)
+{
+	const uint8_t *samples = NULL;
+	size_t samples_len = 0;
+	bool format_ok = false;
+
+	if (size < 12 || memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4)) {
+		PrintAndLog("Not a WAV file");
+		return -1;
+	}
+	size_t pos = 12;
+	while (pos + 8 <= size) {
+		const uint8_t *chunk = p + pos + 8;
+		size_t len = get_le32(p + pos + 4);
+		if (len > size - pos - 8) len = size - pos - 8;
+		if (!memcmp(p + pos, "fmt ", 4) && len >= 16) {
+			// PCM, mono, 8 bit
+			format_ok = get_le16(chunk) == 1 && get_le16(chunk + 2) == 1 && get_le16(chunk + 14) == 8;
+		} else if (!memcmp(p + pos, "pm3 ", 4) && len >= CONFIG_LEN) {
+			get_config(chunk, config);
+			*has_config = true;
+		} else if (!memcmp(p + pos, "data", 4)) {
+			samples = chunk;
+			samples_len = len;
+		}
+		pos += 8 + len + (len & 1);
+	}
+	if (!format_ok || samples == NULL) {
+		PrintAndLog("Only 8 bit mono PCM WAV files can be loaded");
+		return -1;
+	}
+
+	size_t n = sample_range(samples_len, max_len, start, count);
+	samples += start;
+	for (size_t i = 0; i < n; i++) {
+		buffer[i] = samples[i] - 128;
+	}
+	return n;
+}
+
+
+static voidpf trace_zalloc(voidpf opaque, uInt items, uInt size)
+{
+	return malloc(items * size);
+}
+
+
+static void trace_zfree(voidpf opaque, voidpf address)
+{
+	free(address);
+}
+
+
+static int load_pm3z(const uint8_t *p, size_t size, int *buffer, int max_len, int start, int count, sample_config *config, bool *has_config)
+{
+	if (size < PM3Z_HEADER_LEN || memcmp(p, PM3Z_MAGIC, 4) || p[4] != PM3Z_VERSION || (p[5] != 1 && p[5] != 4)) {
+		PrintAndLog("Not a pm3z file, or a newer version of it");
+		return -1;
+	}
+	uint8_t sample_size = p[5];
+	size_t total = get_le32(p + 8);
+	get_config(p + 12, config);
+	*has_config = true;
+
+	size_t n = sample_range(total, max_len, start, count);
+	if (n == 0) return 0;
+
+	// inflate chunks up to the last sample wanted, skipping the ones before start
+	uint8_t *chunk = malloc(CHUNK_SAMPLES * sample_size);
+	if (chunk == NULL) return -1;
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	stream.zalloc = &trace_zalloc;
+	stream.zfree = &trace_zfree;
+	stream.next_in = (Bytef *)p + PM3Z_HEADER_LEN;
+	stream.avail_in = size - PM3Z_HEADER_LEN;
+	if (inflateInit(&stream) != Z_OK) {
+		free(chunk);
+		return -1;
+	}
+
+	size_t sample = 0;
+	size_t end = start + n;
+	int res = Z_OK;
+	while (sample < end && res == Z_OK) {
+		size_t want = end - sample < CHUNK_SAMPLES ? end - sample : CHUNK_SAMPLES;
+		stream.next_out = chunk;
+		stream.avail_out = want * sample_size;
+		res = inflate(&stream, Z_SYNC_FLUSH);
+		if (res != Z_OK && res != Z_STREAM_END) break;
+		size_t got = (want * sample_size - stream.avail_out) / sample_size;
+		for (size_t i = 0; i < got; i++, sample++) {
+			if (sample < start) continue;
+			buffer[sample - start] = sample_size == 1 ? (int8_t)chunk[i] : (int32_t)get_le32(chunk + i * 4);
+		}
+		if (got == 0 && res == Z_OK) break;
+	}
+	inflateEnd(&stream);
+	free(chunk);
+
+	if (sample < end) {
+		PrintAndLog("pm3z file is truncated or damaged, got %zu of %zu samples", sample > start ? sample - start : 0, n);
+		return sample > start ? sample - start : -1;
+	}
+	return n;
+}
+
+
+int trace_load(const char *filename, int *buffer, int max_len, int start, int count, sample_config *config, bool *has_config)
+{
+	mapped_file_t m;
+	int res = -1;
+
+	*has_config = false;
+	truncated = false;
+	if (start < 0) start = 0;
+	if (!map_file(filename, &m)) {
+		PrintAndLog("couldn't open '%s'", filename);
+		return -1;
+	}
+
+	switch (trace_format(filename)) {
+		case TRACE_FORMAT_RAW:
+			res = load_raw(m.data, m.size, buffer, max_len, start, count);
+			break;
+		case TRACE_FORMAT_WAV:
+			res = load_wav(m.data, m.size, buffer, max_len, start, count, config, has_config);
+			break;
+		case TRACE_FORMAT_PM3Z:
+			res = load_pm3z(m.data, m.size, buffer, max_len, start, count, config, has_config);
+			break;
+		default:
+			res = load_text(m.data, m.size, buffer, max_len, start, count);
+			break;
+	}
+
+	unmap_file(&m);
+	if (truncated) {
+		PrintAndLog("'%s' has more than %d samples, use start and count to load the rest", filename, max_len);
+	}
+	return res;
+}
+
+
+static int8_t clip_int8(int v, int *clipped)
+{
+	if (v < -128) {
+		(*clipped)++;
+		return -128;
+	}
+	if (v > 127) {
+		(*clipped)++;
+		return 127;
+	}
+	return v;
+}
+
+
+static int save_text(FILE *f, const int *buffer, int len)
+{
+	char line[16];
+	for (int i = 0; i < len; i++) {
+		int n = sprintf(line, "%d\n", buffer[i]);
+		if (fwrite(line, 1, n, f) != n) return -1;
+	}
+	return 0;
+}
+
+
+static int save_raw(FILE *f, const int *buffer, int len, int *clipped)
+{
+	int8_t chunk[CHUNK_SAMPLES];
+	for (int i = 0; i < len; i += CHUNK_SAMPLES) {
+		int n = len - i < CHUNK_SAMPLES ? len - i : CHUNK_SAMPLES;
+		for (int j = 0; j < n; j++) {
+			chunk[j] = clip_int8(buffer[i + j], clipped);
+		}
+		if (fwrite(chunk, 1, n, f) != n) return -1;
+	}
+	return 0;
+}
+
+
+static int save_wav(FILE *f, const int *buffer, int len, const sample_config *config, int *clipped)
+{
+	uint8_t header[WAV_HEADER_LEN];
+	uint32_t rate = LF_ADC_CLOCK / (config->divisor + 1) / (config->decimation ? config->decimation : 1);
+
+	memcpy(header, "RIFF", 4);
+	put_le32(header + 4, WAV_HEADER_LEN - 8 + len + (len & 1));
+	memcpy(header + 8, "WAVE", 4);
+	memcpy(header + 12, "fmt ", 4);
+	put_le32(header + 16, 16);
+	put_le16(header + 20, 1);			// PCM
+	put_le16(header + 22, 1);			// mono
+	put_le32(header + 24, rate);
+	put_le32(header + 28, rate);		// bytes per second
+	put_le16(header + 32, 1);			// block align
+	put_le16(header + 34, 8);			// bits per sample
+	memcpy(header + 36, "pm3 ", 4);
+	put_le32(header + 40, CONFIG_LEN);
+	put_config(header + 44, config);
+	memcpy(header + 44 + CONFIG_LEN, "data", 4);
+	put_le32(header + 48 + CONFIG_LEN, len);
+	if (fwrite(header, 1, sizeof(header), f) != sizeof(header)) return -1;
+
+	uint8_t chunk[CHUNK_SAMPLES];
+	for (int i = 0; i < len; i += CHUNK_SAMPLES) {
+		int n = len - i < CHUNK_SAMPLES ? len - i : CHUNK_SAMPLES;
+		for (int j = 0; j < n; j++) {
+			chunk[j] = clip_int8(buffer[i + j], clipped) + 128;
+		}
+		if (fwrite(chunk, 1, n, f) != n) return -1;
+	}
+	if ((len & 1) && fputc(0, f) == EOF) return -1;
+	return 0;
+}
+
+
+static int save_pm3z(FILE *f, const int *buffer, int len, const sample_config *config)
+{
+	uint8_t header[PM3Z_HEADER_LEN] = {0};
+	uint8_t sample_size = 1;
+
+	// int8 unless the samples don't fit
+	for (int i = 0; i < len; i++) {
+		if (buffer[i] < -128 || buffer[i] > 127) {
+			sample_size = 4;
+			break;
+		}
+	}
+	memcpy(header, PM3Z_MAGIC, 4);
+	header[4] = PM3Z_VERSION;
+	header[5] = sample_size;
+	put_le32(header + 8, len);
+	put_config(header + 12, config);
+	if (fwrite(header, 1, sizeof(header), f) != sizeof(header)) return -1;
+
+	uint8_t *chunk = malloc(CHUNK_SAMPLES * sample_size);
+	uint8_t *out = malloc(CHUNK_SAMPLES * 4);
+	if (chunk == NULL || out == NULL) {
+		free(chunk);
+		free(out);
+		return -1;
+	}
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	stream.zalloc = &trace_zalloc;
+	stream.zfree = &trace_zfree;
+	if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+		free(chunk);
+		free(out);
+		return -1;
+	}
+
+	int res = 0;
+	int i = 0;
+	int flush;
+	do {
+		int n = len - i < CHUNK_SAMPLES ? len - i : CHUNK_SAMPLES;
+		for (int j = 0; j < n; j++) {
+			if (sample_size == 1) {
+				chunk[j] = buffer[i + j];
+			} else {
+				put_le32(chunk + j * 4, buffer[i + j]);
+			}
+		}
+		i += n;
+		flush = i == len ? Z_FINISH : Z_NO_FLUSH;
+		stream.next_in = chunk;
+		stream.avail_in = n * sample_size;
+		do {
+			stream.next_out = out;
+			stream.avail_out = CHUNK_SAMPLES * 4;
+			deflate(&stream, flush);
+			size_t have = CHUNK_SAMPLES * 4 - stream.avail_out;
+			if (fwrite(out, 1, have, f) != have) res = -1;
+		} while (stream.avail_out == 0 && res == 0);
+	} while (flush != Z_FINISH && res == 0);
+
+	deflateEnd(&stream);
+	free(chunk);
+	free(out);
+	return res;
+}
+
+
+int trace_save(const char *filename, const int *buffer, int len, const sample_config *config)
+{
+	trace_format_t format = trace_format(filename);
+	int clipped = 0;
+	int res;
+
+	FILE *f = fopen(filename, format == TRACE_FORMAT_TEXT ? "w" : "wb");
+	if (!f) {
+		PrintAndLog("couldn't open '%s'", filename);
+		return -1;
+	}
+
+	switch (format) {
+		case TRACE_FORMAT_RAW:
+			res = save_raw(f, buffer, len, &clipped);
+			break;
+		case TRACE_FORMAT_WAV:
+			res = save_wav(f, buffer, len, config, &clipped);
+			break;
+		case TRACE_FORMAT_PM3Z:
+			res = save_pm3z(f, buffer, len, config);
+			break;
+		default:
+			res = save_text(f, buffer, len);
+			break;
+	}
+
+	if (fclose(f) != 0) res = -1;
+	if (res < 0) {
+		PrintAndLog("couldn't write '%s'", filename);
+		return -1;
+	}
+	if (clipped) {
+		PrintAndLog("%d samples out of range -128..127 were clipped, use text or .pm3z to keep them", clipped);
+	}
+	return 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Self test: all formats round trip a synthetic trace, whole and a range of it
+//-----------------------------------------------------------------------------
+
+static long file_size(const char *filename)
+{
+	FILE *f = fopen(filename, "rb");
+	if (!f) return -1;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fclose(f);
+	return size;
+}
+
+
+static bool same_config(const sample_config *a, const sample_config *b)
+{
+	return a->decimation == b->decimation && a->bits_per_sample == b->bits_per_sample && a->averaging == b->averaging
+		&& a->divisor == b->divisor && a->trigger_threshold == b->trigger_threshold;
+}
+
+
+int trace_selftest(void)
+{
+	const int len = 320000;
+	const int range_start = 123457;
+	const int range_count = 4000;
+	const sample_config config = {2, 8, 0, 88, 17};
+	const trace_format_t formats[] = {TRACE_FORMAT_TEXT, TRACE_FORMAT_RAW, TRACE_FORMAT_WAV, TRACE_FORMAT_PM3Z};
+	const char *filenames[] = {"trace_selftest.pm3", "trace_selftest.raw", "trace_selftest.wav", "trace_selftest.pm3z"};
+	bool passed = true;
+
+	int *trace = malloc(len * sizeof(int));
+	int *loaded = malloc(len * sizeof(int));
+	if (trace == NULL || loaded == NULL) {
+		free(trace);
+		free(loaded);
+		return -1;
+	}
+
+	// a noisy EM4102 like trace: Manchester at rf/64 on a 8 samples per cycle carrier
+	uint32_t lfsr = 0xACE1;
+	for (int i = 0; i < len; i++) {
+		lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xB400);
+		int bit = ((i / 256) * 0x9E3779B1u >> 31) ^ ((i / 128) & 1);
+		int carrier = (i & 7) < 4 ? 1 : -1;
+		trace[i] = carrier * (bit ? 100 : 40) + (int)(lfsr & 15) - 8;
+	}
+
+	PrintAndLog("format   size kB   save ms   load ms   range load ms");
+	for (int f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+		sample_config loaded_config = {0};
+		bool has_config;
+
+		uint64_t t0 = msclock();
+		int res = trace_save(filenames[f], trace, len, &config);
+		uint64_t t1 = msclock();
+		int n = trace_load(filenames[f], loaded, len, 0, -1, &loaded_config, &has_config);
+		uint64_t t2 = msclock();
+		bool ok = res == 0 && n == len && !memcmp(trace, loaded, len * sizeof(int));
+		if (formats[f] == TRACE_FORMAT_WAV || formats[f] == TRACE_FORMAT_PM3Z) {
+			ok = ok && has_config && same_config(&loaded_config, &config);
+		}
+
+		uint64_t t3 = msclock();
+		n = trace_load(filenames[f], loaded, len, range_start, range_count, &loaded_config, &has_config);
+		uint64_t t4 = msclock();
+		ok = ok && n == range_count && !memcmp(trace + range_start, loaded, range_count * sizeof(int));
+
+		PrintAndLog("%-6s %9.1f %9" PRIu64 " %9" PRIu64 " %15" PRIu64 "   %s", trace_format_name(formats[f]),
+			file_size(filenames[f]) / 1024.0, t1 - t0, t2 - t1, t4 - t3, ok ? "ok" : "FAILED");
+		passed = passed && ok;
+		remove(filenames[f]);
+	}
+
+	// samples out of the int8 range are kept by .pm3z
+	trace[42] = 100000;
+	trace[43] = -100000;
+	sample_config loaded_config;
+	bool has_config;
+	int n = -1;
+	if (trace_save(filenames[3], trace, len, &config) == 0) {
+		n = trace_load(filenames[3], loaded, len, 0, -1, &loaded_config, &has_config);
+	}
+	remove(filenames[3]);
+	bool ok = n == len && !memcmp(trace, loaded, len * sizeof(int));
+	PrintAndLog("pm3z with int32 samples: %s", ok ? "ok" : "FAILED");
+	passed = passed && ok;
+
+	free(trace);
+	free(loaded);
+	PrintAndLog("Trace file test: %s", passed ? "passed" : "FAILED");
+	return passed ? 0 : -1;
+}
@@ -0,0 +1,38 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Sample trace files for data load and data save
+//-----------------------------------------------------------------------------
+
+#ifndef TRACEFILE_H__
+#define TRACEFILE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "usb_cmd.h"
+
+typedef enum {
+	TRACE_FORMAT_TEXT,			// one decimal sample per line
+	TRACE_FORMAT_RAW,			// .raw, one signed byte per sample
+	TRACE_FORMAT_WAV,			// .wav, 8 bit mono PCM with the sampling config
+	TRACE_FORMAT_PM3Z,			// .pm3z, zlib compressed with the sampling config
+} trace_format_t;
+
+// The format is chosen by the extension of the file name
+extern trace_format_t trace_format(const char *filename);
+extern const char *trace_format_name(trace_format_t format);
+
+// Load count samples (all if count < 0) from sample start on into buffer. Returns the number
+// of samples loaded, at most max_len, or -1. config gets the sampling config if the file has one.
+extern int trace_load(const char *filename, int *buffer, int max_len, int start, int count, sample_config *config, bool *has_config);
+extern int trace_save(const char *filename, const int *buffer, int len, const sample_config *config);
+
+// The sampling config of the samples in the graph, saved with them
+extern void trace_set_sample_config(const sample_config *config);
+extern const sample_config *trace_get_sample_config(void);
+
+extern int trace_selftest(void);
+
+#endif
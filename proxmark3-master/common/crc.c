@@ -42,6 +42,61 @@ uint32_t crc_finish(crc_t *crc)
 	return ( crc->state ^ crc->final_xor ) & crc->mask;
 }
 
+#ifndef ON_DEVICE
+void crc_table_init(crc_table_t *table, const crc_t *crc)
+{
+	// entry[0][b] is the state after processing byte b, starting with a zero state.
+	// entry[k][b] is the same, followed by k zero bytes.
+	for (uint16_t i = 0; i < 256; i++) {
+		crc_t c = *crc;
+		c.state = 0;
+		crc_update(&c, i, 8);
+		table->entry[0][i] = c.state;
+	}
+	for (uint16_t i = 0; i < 256; i++) {
+		for (uint8_t k = 1; k < 8; k++) {
+			uint32_t prev = table->entry[k-1][i];
+			table->entry[k][i] = (prev >> 8) ^ table->entry[0][prev & 0xff];
+		}
+	}
+}
+
+void crc_update_bytes(crc_t *crc, const crc_table_t *table, const uint8_t *data, size_t len)
+{
+	uint32_t state = crc->state;
+
+	// 8 bytes per step
+	while (len >= 8) {
+		uint32_t first = state ^ (data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24);
+		state = table->entry[7][first & 0xff] ^ table->entry[6][(first >> 8) & 0xff]
+			  ^ table->entry[5][(first >> 16) & 0xff] ^ table->entry[4][first >> 24]
+			  ^ table->entry[3][data[4]] ^ table->entry[2][data[5]]
+			  ^ table->entry[1][data[6]] ^ table->entry[0][data[7]];
+		data += 8;
+		len -= 8;
+	}
+
+	// remaining bytes
+	while (len--) {
+		state = (state >> 8) ^ table->entry[0][(state ^ *data++) & 0xff];
+	}
+
+	crc->state = state;
+}
+#endif
+
+#ifndef ON_DEVICE
+// built at startup, before any thread can use it
+static crc_table_t crc8_maxim_table;
+
+static void __attribute__((constructor)) crc8_maxim_init_table(void)
+{
+	crc_t crc;
+	crc_init(&crc, 9, 0x8c, 0x00, 0x00);
+	crc_table_init(&crc8_maxim_table, &crc);
+}
+#endif
+
 //credits to iceman
 uint32_t CRC8Maxim(uint8_t *buff, size_t size) 
 {
@@ -49,8 +104,12 @@ uint32_t CRC8Maxim(uint8_t *buff, size_t size)
 	crc_init(&crc, 9, 0x8c, 0x00, 0x00);
 	crc_clear(&crc);
 
+#ifndef ON_DEVICE
+	crc_update_bytes(&crc, &crc8_maxim_table, buff, size);
+#else
 	for (size_t i=0; i < size; ++i){
 		crc_update(&crc, buff[i], 8);
 	}
+#endif
 	return crc_finish(&crc);
 }
@@ -37,6 +37,20 @@ extern void crc_clear(crc_t *crc);
 /* Get the result of the crc calculation */
 extern uint32_t crc_finish(crc_t *crc);
 
+#ifndef ON_DEVICE
+/* Lookup tables for a table driven (slicing-by-8) crc calculation. Only crcs of order <= 32 which are
+ * processed LSB first (as crc_update() does) are supported. Not used on the device, the tables need 8kBytes. */
+typedef struct crc_table {
+	uint32_t entry[8][256];
+} crc_table_t;
+
+/* Generate the lookup tables for the polynom of crc, which must have been initialized with crc_init() */
+extern void crc_table_init(crc_table_t *table, const crc_t *crc);
+
+/* Update the crc state with len bytes. Same result as calling crc_update(crc, data[i], 8) for each byte. */
+extern void crc_update_bytes(crc_t *crc, const crc_table_t *table, const uint8_t *data, size_t len);
+#endif
+
 // Calculate CRC-8/Maxim checksum
 uint32_t CRC8Maxim(uint8_t *buff, size_t size  );
 /* Static initialization of a crc structure */
@@ -7,6 +7,28 @@
 //-----------------------------------------------------------------------------
 
 #include "crc16.h"
+#ifndef ON_DEVICE
+#include "crc.h"
+
+// Lookup tables, built at startup before any thread can use them. crc16() only has a table for
+// polynom 0x1021 (CCITT), the only one used in the client, other polynoms are calculated bitwise.
+static crc_table_t crc16_reflected_table;		// update_crc16_bytes(), polynom 0x8408
+static uint16_t crc16_ccitt_table[256];			// crc16(), MSB first, polynom 0x1021
+
+static void __attribute__((constructor)) crc16_init_tables(void)
+{
+	crc_t crc_state = CRC_INITIALIZER(16, 0x8408, 0, 0);
+	crc_table_init(&crc16_reflected_table, &crc_state);
+
+	for (uint16_t i = 0; i < 256; i++) {
+		uint16_t entry = i << 8;
+		for (uint8_t bit = 8; bit > 0; --bit) {
+			entry = (entry & 0x8000) ? (entry << 1) ^ 0x1021 : (entry << 1);
+		}
+		crc16_ccitt_table[i] = entry;
+	}
+}
+#endif
 
 unsigned short update_crc16( unsigned short crc, unsigned char c )
 {
@@ -21,10 +43,37 @@ unsigned short update_crc16( unsigned short crc, unsigned char c )
 	return ((crc >> 8) ^ tcrc)&0xffff;
 }
 
+// Same as calling update_crc16() for each byte (reflected CCITT polynom 0x8408, as used by
+// ISO14443A/B, ISO15693 and iCLASS). Table driven on the client.
+uint16_t update_crc16_bytes(uint16_t crc, const uint8_t *data, size_t len)
+{
+#ifndef ON_DEVICE
+	crc_t crc_state = CRC_INITIALIZER(16, 0x8408, 0, 0);
+	crc_state.state = crc;
+	crc_update_bytes(&crc_state, &crc16_reflected_table, data, len);
+	return crc_state.state;
+#else
+	for (size_t i = 0; i < len; i++) {
+		uint8_t ch = data[i] ^ (uint8_t)(crc & 0x00ff);
+		ch = ch ^ (ch << 4);
+		crc = (crc >> 8) ^ ((uint16_t)ch << 8) ^ ((uint16_t)ch << 3) ^ ((uint16_t)ch >> 4);
+	}
+	return crc;
+#endif
+}
+
 uint16_t crc16(uint8_t const *message, int length, uint16_t remainder, uint16_t polynomial) {
 
 	if (length == 0) return (~remainder);
 
+#ifndef ON_DEVICE
+	if (polynomial == 0x1021) {
+		for (int byte = 0; byte < length; ++byte) {
+			remainder = (remainder << 8) ^ crc16_ccitt_table[(remainder >> 8) ^ message[byte]];
+		}
+		return remainder;
+	}
+#endif
 	for (int byte = 0; byte < length; ++byte) {
 		remainder ^= (message[byte] << 8);
 		for (uint8_t bit = 8; bit > 0; --bit) {
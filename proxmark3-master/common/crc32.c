@@ -3,7 +3,6 @@
 #include "crc32.h"
 
 #define htole32(x) (x)
-#define CRC32_PRESET 0xFFFFFFFF
 
 
 static void crc32_byte (uint32_t *crc, const uint8_t value);
@@ -21,11 +20,35 @@ static void crc32_byte (uint32_t *crc, const uint8_t value) {
     }
 }
 
-void crc32 (const uint8_t *data, const size_t len, uint8_t *crc) {
-    uint32_t desfire_crc = CRC32_PRESET;
+#ifndef ON_DEVICE
+/* Byte wise lookup table on the client, built at startup before any thread can use it. The
+ * firmware and the bootrom keep the bitwise calculation, the table would need 1kByte. */
+static uint32_t crc32_table[256];
+
+static void __attribute__((constructor)) crc32_init_table (void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = 0;
+        crc32_byte (&crc, i);
+        crc32_table[i] = crc;
+    }
+}
+#endif
+
+uint32_t crc32_update (uint32_t crc, const uint8_t *data, const size_t len) {
+#ifndef ON_DEVICE
     for (size_t i = 0; i < len; i++) {
-        crc32_byte (&desfire_crc, data[i]);
+        crc = (crc >> 8) ^ crc32_table[(crc ^ data[i]) & 0xff];
     }
+#else
+    for (size_t i = 0; i < len; i++) {
+        crc32_byte (&crc, data[i]);
+    }
+#endif
+    return crc;
+}
+
+void crc32 (const uint8_t *data, const size_t len, uint8_t *crc) {
+    uint32_t desfire_crc = crc32_update (CRC32_PRESET, data, len);
 
     *((uint32_t *)(crc)) = htole32 (desfire_crc);
 }
@@ -9,6 +9,13 @@
 #ifndef __CRC32_H
 #define __CRC32_H
 
+#include <stdint.h>
+#include <stddef.h>
+
+#define CRC32_PRESET 0xFFFFFFFF
+
+// continue a CRC over more data, start with CRC32_PRESET. No final inversion.
+uint32_t         	crc32_update (uint32_t crc, const uint8_t *data, const size_t len);
 void             	crc32 (const uint8_t *data, const size_t len, uint8_t *crc);
 void             	crc32_append (uint8_t *data, const size_t len);
 
@@ -0,0 +1,150 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Hitag2 stream cipher, shared by the firmware and the client
+//-----------------------------------------------------------------------------
+
+#include "hitag2_crypto.h"
+
+/* Following is a modified version of cryptolib.com/ciphers/hitag2/ */
+// Software optimized 48-bit Philips/NXP Mifare Hitag2 PCF7936/46/47/52 stream cipher algorithm by I.C. Wiener 2006-2007.
+// For educational purposes only.
+// No warranties or guarantees of any kind.
+// This code is released into the public domain by its author.
+
+// Single bit Hitag2 functions:
+
+#define i4(x,a,b,c,d)	((uint32_t)((((x)>>(a))&1)+(((x)>>(b))&1)*2+(((x)>>(c))&1)*4+(((x)>>(d))&1)*8))
+
+static const uint32_t ht2_f4a = 0x2C79;		// 0010 1100 0111 1001
+static const uint32_t ht2_f4b = 0x6671;		// 0110 0110 0111 0001
+static const uint32_t ht2_f5c = 0x7907287B;	// 0111 1001 0000 0111 0010 1000 0111 1011
+
+uint32_t _f20 (const uint64_t x)
+{
+	uint32_t			i5;
+
+	i5 = ((ht2_f4a >> i4 (x, 1, 2, 4, 5)) & 1)* 1
+		+ ((ht2_f4b >> i4 (x, 7,11,13,14)) & 1)* 2
+		+ ((ht2_f4b >> i4 (x,16,20,22,25)) & 1)* 4
+		+ ((ht2_f4b >> i4 (x,27,28,30,32)) & 1)* 8
+		+ ((ht2_f4a >> i4 (x,33,42,43,45)) & 1)*16;
+
+	return (ht2_f5c >> i5) & 1;
+}
+
+uint64_t _hitag2_init (const uint64_t key, const uint32_t serial, const uint32_t IV)
+{
+	uint32_t			i;
+	uint64_t			x = ((key & 0xFFFF) << 32) + serial;
+
+	for (i = 0; i < 32; i++)
+	{
+		x >>= 1;
+		x += (uint64_t) (_f20 (x) ^ (((IV >> i) ^ (key >> (i+16))) & 1)) << 47;
+	}
+	return x;
+}
+
+uint64_t _hitag2_round (uint64_t *state)
+{
+	uint64_t			x = *state;
+
+	x = (x >>  1) +
+		((((x >>  0) ^ (x >>  2) ^ (x >>  3) ^ (x >>  6)
+		   ^ (x >>  7) ^ (x >>  8) ^ (x >> 16) ^ (x >> 22)
+		   ^ (x >> 23) ^ (x >> 26) ^ (x >> 30) ^ (x >> 41)
+		   ^ (x >> 42) ^ (x >> 43) ^ (x >> 46) ^ (x >> 47)) & 1) << 47);
+
+	*state = x;
+	return _f20 (x);
+}
+
+uint32_t _hitag2_byte (uint64_t * x)
+{
+	uint32_t			i, c;
+
+	for (i = 0, c = 0; i < 8; i++) c += (uint32_t) _hitag2_round (x) << (i^7);
+	return c;
+}
+
+
+#ifndef ON_DEVICE
+
+// Bitsliced versions of the filter functions, from the same source. The arguments are
+// given in the order of the i4() indices above.
+#define ht2bs_4a(a,b,c,d)	(~(((a|b)&c)^(a|d)^b))
+#define ht2bs_4b(a,b,c,d)	(~(((d|c)&(a^b))^(d|a|b)))
+#define ht2bs_5c(a,b,c,d,e)	(~((((((c^e)|d)&a)^b)&(c^b))^(((d^e)|a)&((d^b)|c))))
+
+// The bitsliced state is a window into a longer array: shifting the register by one bit
+// just advances the window, no data has to be moved.
+#define HT2BS_MAX_ROUNDS	(32 + 32)
+
+static inline ht2_bitslice_t bs_f20(const ht2_bitslice_t *x)
+{
+	return ht2bs_5c(ht2bs_4a(x[ 1], x[ 2], x[ 4], x[ 5]),
+					ht2bs_4b(x[ 7], x[11], x[13], x[14]),
+					ht2bs_4b(x[16], x[20], x[22], x[25]),
+					ht2bs_4b(x[27], x[28], x[30], x[32]),
+					ht2bs_4a(x[33], x[42], x[43], x[45]));
+}
+
+static inline ht2_bitslice_t bs_feedback(const ht2_bitslice_t *x)
+{
+	return x[ 0] ^ x[ 2] ^ x[ 3] ^ x[ 6] ^ x[ 7] ^ x[ 8] ^ x[16] ^ x[22]
+		 ^ x[23] ^ x[26] ^ x[30] ^ x[41] ^ x[42] ^ x[43] ^ x[46] ^ x[47];
+}
+
+static inline ht2_bitslice_t bs_expand(uint32_t value, int bit)
+{
+	return -(ht2_bitslice_t)((value >> bit) & 1);
+}
+
+static ht2_bitslice_t *bs_init(ht2_bitslice_t *x, const ht2_bitslice_t key[48], const uint32_t serial, const uint32_t IV)
+{
+	for (int i = 0; i < 32; i++) {
+		x[i] = bs_expand(serial, i);
+	}
+	for (int i = 0; i < 16; i++) {
+		x[32+i] = key[i];
+	}
+	for (int i = 0; i < 32; i++) {
+		x++;
+		x[47] = bs_f20(x) ^ bs_expand(IV, i) ^ key[i+16];
+	}
+	return x;
+}
+
+void hitag2_bs_keystream(ht2_bitslice_t *keystream, int len, const ht2_bitslice_t key[48], const uint32_t serial, const uint32_t IV)
+{
+	ht2_bitslice_t state[48 + HT2BS_MAX_ROUNDS];
+	ht2_bitslice_t *x = bs_init(state, key, serial, IV);
+
+	for (int i = 0; i < len && i < 32; i++) {
+		ht2_bitslice_t fb = bs_feedback(x);
+		x++;
+		x[47] = fb;
+		keystream[i] = bs_f20(x);
+	}
+}
+
+uint64_t hitag2_bs_match(const ht2_bitslice_t key[48], const uint32_t serial, const uint32_t IV, const uint32_t keystream)
+{
+	ht2_bitslice_t state[48 + HT2BS_MAX_ROUNDS];
+	ht2_bitslice_t *x = bs_init(state, key, serial, IV);
+	uint64_t candidates = ~0ULL;
+
+	// on average half of the instances are dropped per keystream bit
+	for (int i = 0; i < 32 && candidates; i++) {
+		ht2_bitslice_t fb = bs_feedback(x);
+		x++;
+		x[47] = fb;
+		candidates &= ~(bs_f20(x) ^ bs_expand(keystream, i));
+	}
+	return candidates;
+}
+
+#endif
@@ -0,0 +1,38 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Hitag2 stream cipher, shared by the firmware and the client
+//-----------------------------------------------------------------------------
+
+#ifndef __HITAG2_CRYPTO_H
+#define __HITAG2_CRYPTO_H
+
+#include <stdint.h>
+
+// Reverse the bit order within each byte, keeping the byte order. Keys, serials and nonces are
+// fed to the cipher with the first transmitted bit in bit 0.
+#define rev8(x)			((((x)>>7)&1)+((((x)>>6)&1)<<1)+((((x)>>5)&1)<<2)+((((x)>>4)&1)<<3)+((((x)>>3)&1)<<4)+((((x)>>2)&1)<<5)+((((x)>>1)&1)<<6)+(((x)&1)<<7))
+#define rev16(x)		(rev8 (x)+(rev8 (x>> 8)<< 8))
+#define rev32(x)		(rev16(x)+(rev16(x>>16)<<16))
+#define rev64(x)		(rev32(x)+(rev32(x>>32)<<32))
+
+extern uint32_t _f20(const uint64_t x);
+extern uint64_t _hitag2_init(const uint64_t key, const uint32_t serial, const uint32_t IV);
+extern uint64_t _hitag2_round(uint64_t *state);
+extern uint32_t _hitag2_byte(uint64_t *x);
+
+#ifndef ON_DEVICE
+// Bitsliced Hitag2: 64 instances of the cipher run in parallel, bit i of each slice belongs to
+// instance i. The key differs per instance, serial and IV are the same for all of them.
+typedef uint64_t ht2_bitslice_t;
+
+// Generate len (<= 32) keystream bits per instance after initialisation with serial and IV.
+extern void hitag2_bs_keystream(ht2_bitslice_t *keystream, int len, const ht2_bitslice_t key[48], const uint32_t serial, const uint32_t IV);
+
+// Return the mask of instances whose first 32 keystream bits (first bit in bit 0) match keystream.
+extern uint64_t hitag2_bs_match(const ht2_bitslice_t key[48], const uint32_t serial, const uint32_t IV, const uint32_t keystream);
+#endif
+
+#endif
@@ -7,28 +7,16 @@
 //-----------------------------------------------------------------------------
 
 #include "iso14443crc.h"
-
-static unsigned short UpdateCrc14443(unsigned char ch, unsigned short *lpwCrc)
-{
-    ch = (ch ^ (unsigned char) ((*lpwCrc) & 0x00FF));
-    ch = (ch ^ (ch << 4));
-    *lpwCrc = (*lpwCrc >> 8) ^ ((unsigned short) ch << 8) ^
-              ((unsigned short) ch << 3) ^ ((unsigned short) ch >> 4);
-    return (*lpwCrc);
-}
+#include "crc16.h"
 
 void ComputeCrc14443(int CrcType,
                      const unsigned char *Data, int Length,
                      unsigned char *TransmitFirst,
                      unsigned char *TransmitSecond)
 {
-    unsigned char chBlock;
     unsigned short wCrc=CrcType;
 
-  do {
-        chBlock = *Data++;
-        UpdateCrc14443(chBlock, &wCrc);
-    } while (--Length);
+    wCrc = update_crc16_bytes(wCrc, Data, Length);
 
     if (CrcType == CRC_14443_B)
         wCrc = ~wCrc;                /* ISO/IEC 13239 (formerly ISO/IEC 3309) */
@@ -194,6 +194,55 @@ uint8_t preambleSearch(uint8_t *BitStream, uint8_t *preamble, size_t pLen, size_
 	return (preambleSearchEx(BitStream, preamble, pLen, size, startIdx, false)) ? 1 : 0;
 }
 
+// The loops looking for wave tops or transitions below work on blocks of SCAN_BLOCK samples.
+// A branch-free pass marks the samples of interest in a block, which the compiler vectorizes
+// where the target has SIMD (SSE/AVX/NEON on the client), then the unmarked samples are
+// skipped a word at a time. Only the marked samples go through the data dependent branches.
+#define SCAN_BLOCK 256
+
+// marks[j] = 1 for i = start+j when samples[i] + rise < samples[i+1] >= samples[i+2]
+static void markWaveTops(const uint8_t samples[], size_t start, size_t n, uint8_t rise, uint8_t marks[]) {
+	const uint8_t *s = samples + start;
+	for (size_t j = 0; j < n; j++)
+		marks[j] = (s[j+1] > s[j]) & ((uint8_t)(s[j+1] - s[j]) > rise) & (s[j+1] >= s[j+2]);
+}
+
+// threshold samples[start..start+n-1] to 0 or 1 in place and mark those above the sample
+// before them, the 0->1 transitions when that one was thresholded too
+static void markThresholdRises(uint8_t samples[], size_t start, size_t n, uint8_t marks[]) {
+	uint8_t *s = samples + start;
+	const uint8_t *prev = samples + start - 1;
+	for (size_t j = 0; j < n; j++)
+		s[j] = s[j] >= FSK_PSK_THRESHOLD;
+	for (size_t j = 0; j < n; j++)
+		marks[j] = s[j] > prev[j];
+}
+
+// index of the first mark at or after j, n if there is none
+static size_t nextMark(const uint8_t marks[], size_t j, size_t n) {
+	size_t word;
+	for (; j + sizeof(word) <= n; j += sizeof(word)) {
+		memcpy(&word, marks + j, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		if (word) return j + __builtin_ctzll(word) / 8;
+#else
+		if (word) break;
+#endif
+	}
+	while (j < n && !marks[j]) j++;
+	return j;
+}
+
+// the samples to mark at once from start up to end. A demod writing its bits to the front of
+// the sample buffer (at most one per mark) must not reach the marked samples: written is the
+// number of bits already there.
+static size_t scanBlockLen(size_t start, size_t end, size_t written) {
+	size_t n = end - start;
+	if (n > SCAN_BLOCK) n = SCAN_BLOCK;
+	if (written + n > start) n = (start > written) ? start - written : 1;
+	return n;
+}
+
 // find start of modulating data (for fsk and psk) in case of beginning noise or slow chip startup.
 size_t findModStart(uint8_t dest[], size_t size, uint8_t expWaveSize) {
 	size_t i = 0;
@@ -405,10 +454,51 @@ int DetectStrongAskClock(uint8_t dest[], size_t size, int high, int low, int *cl
 	return shortestWaveIdx;
 }
 
+// a clock bit at sample j has no peak when none of j-tol, j and j+tol is a peak
+static inline uint8_t askClockBitMissed(uint8_t dest[], size_t j, uint8_t tol, int peak, int low) {
+	uint8_t before = dest[j-tol], bit = dest[j], after = dest[j+tol];
+	return (bit < peak) & (bit > low) & (before < peak) & (before > low) & (after < peak) & (after > low);
+}
+
+// count the clock bits without a peak for every phase of clk in one pass: errs[r] gets
+// the missed bits at samples r, r+clk, r+2*clk, ... below end. Sample 0 isn't counted
+// with a tolerance, it has no sample before it.
+static void askClockPhaseErrors(uint8_t dest[], size_t end, uint8_t clk, uint8_t tol, int peak, int low, uint32_t errs[]) {
+	size_t j = tol;
+	uint8_t r;
+	memset(errs, 0, clk * sizeof(uint32_t));
+	if (end <= j) return;
+	for (r = j; r < clk && j < end; ++r, ++j)
+		errs[r] += askClockBitMissed(dest, j, tol, peak, low);
+	for (; j + clk <= end; j += clk)
+		for (r = 0; r < clk; ++r)
+			errs[r] += askClockBitMissed(dest, j + r, tol, peak, low);
+	for (r = 0; j < end; ++r, ++j)
+		errs[r] += askClockBitMissed(dest, j, tol, peak, low);
+}
+
+// the clock bits without a peak of the start at ii, a peak itself
+static size_t askStartErrors(uint8_t dest[], size_t ii, uint8_t clk, uint8_t tol, int peak, int low, size_t bitsEnd) {
+	size_t errCnt = 0;
+	for (size_t arrLoc = ii + clk; arrLoc < bitsEnd; arrLoc += clk) {
+		if (dest[arrLoc] >= peak || dest[arrLoc] <= low){
+		}else if (dest[arrLoc-tol] >= peak || dest[arrLoc-tol] <= low){
+		}else if (dest[arrLoc+tol] >= peak || dest[arrLoc+tol] <= low){
+		}else{  //error no peak detected
+			errCnt++;
+		}
+	}
+	return errCnt;
+}
+
 // by marshmellow
 // not perfect especially with lower clocks or VERY good antennas (heavy wave clipping)
 // maybe somehow adjust peak trimming value based on samples to fix?
 // return start index of best starting position for that clock and return clock (by reference)
+//
+// A start position ii tests the clock bits ii, ii+clk, ... up to size-tol-2*clk, which
+// are the bits of phase ii % clk from ii on. So the errors of every start are the missed
+// bits of its phase, counted once for the whole buffer, less those before ii.
 int DetectASKClock(uint8_t dest[], size_t size, int *clock, int maxErr) {
 	size_t i=1;
 	uint8_t clk[] = {255,8,16,32,40,50,64,100,128,255};
@@ -440,8 +530,10 @@ int DetectASKClock(uint8_t dest[], size_t size, int *clock, int maxErr) {
 	uint8_t clkCnt, tol = 0;
 	uint16_t bestErr[]={1000,1000,1000,1000,1000,1000,1000,1000,1000};
 	uint8_t bestStart[]={0,0,0,0,0,0,0,0,0};
+	uint32_t phaseErr[128];
 	size_t errCnt = 0;
-	size_t arrLoc, loopEnd;
+	size_t loopEnd, bitsEnd, starts;
+	bool byPhase;
 
 	if (clockFnd>0) {
 		clkCnt = clockFnd;
@@ -459,25 +551,34 @@ int DetectASKClock(uint8_t dest[], size_t size, int *clock, int maxErr) {
 		//if no errors allowed - keep start within the first clock
 		if (!maxErr && size > clk[clkCnt]*2 + tol && clk[clkCnt]<128) loopCnt=clk[clkCnt]*2;
 		bestErr[clkCnt]=1000;
+		// the clock bits tested by any start are below bitsEnd
+		bitsEnd = (size > tol + 2*clk[clkCnt]) ? size - tol - 2*clk[clkCnt] + 1 : 0;
+		// count the errors of all phases at once, unless there are only a few starts to test
+		starts = 0;
+		for (ii=0; ii < loopCnt; ii++)
+			if (dest[ii] >= peak || dest[ii] <= low) starts++;
+		byPhase = starts * 2 >= clk[clkCnt];
+		if (byPhase)
+			askClockPhaseErrors(dest, bitsEnd, clk[clkCnt], tol, peak, low, phaseErr);
 		//try lining up the peaks by moving starting point (try first few clocks)
 		for (ii=0; ii < loopCnt; ii++){
+			errCnt = 0;
+			if (byPhase) {
+				// drop the bit at ii from the errors of the later starts of its phase
+				uint32_t *err = &phaseErr[ii % clk[clkCnt]];
+				errCnt = *err;
+				if (ii < bitsEnd && ii >= tol) *err -= askClockBitMissed(dest, ii, tol, peak, low);
+			}
 			if (dest[ii] < peak && dest[ii] > low) continue;
+			// less than one clock left, there is nothing to test
+			if (size-ii-tol < clk[clkCnt]) continue;
 
-			errCnt=0;
 			// now that we have the first one lined up test rest of wave array
 			loopEnd = ((size-ii-tol) / clk[clkCnt]) - 1;
-			for (i=0; i < loopEnd; ++i){
-				arrLoc = ii + (i * clk[clkCnt]);
-				if (dest[arrLoc] >= peak || dest[arrLoc] <= low){
-				}else if (dest[arrLoc-tol] >= peak || dest[arrLoc-tol] <= low){
-				}else if (dest[arrLoc+tol] >= peak || dest[arrLoc+tol] <= low){
-				}else{  //error no peak detected
-					errCnt++;
-				}
-			}
+			if (!byPhase) errCnt = askStartErrors(dest, ii, clk[clkCnt], tol, peak, low, bitsEnd);
 			//if we found no errors then we can stop here and a low clock (common clocks)
 			//  this is correct one - return this clock
-			if (g_debugMode == 2) prnt("DEBUG ASK: clk %d, err %d, startpos %d, endpos %d",clk[clkCnt],errCnt,ii,i);
+			if (g_debugMode == 2) prnt("DEBUG ASK: clk %d, err %d, startpos %d, endpos %d",clk[clkCnt],errCnt,ii,loopEnd);
 			if(errCnt==0 && clkCnt<7) { 
 				if (!clockFnd) *clock = clk[clkCnt];
 				return ii;
@@ -670,18 +771,29 @@ uint16_t countFC(uint8_t *BitStream, size_t size, uint8_t fskAdj) {
 	uint8_t fcLensFnd = 0;
 	uint8_t lastFCcnt = 0;
 	uint8_t fcCounter = 0;
-	size_t i;
+	uint8_t marks[SCAN_BLOCK];
+	size_t i, n, j, lastUp;
 	if (size < 180) return 0;
 
 	// prime i to first up transition
-	for (i = 160; i < size-20; i++)
-		if (BitStream[i] > BitStream[i-1] && BitStream[i] >= BitStream[i+1])
+	for (i = 160; i < size-20; i += n) {
+		n = scanBlockLen(i, size-20, 0);
+		markWaveTops(BitStream, i-1, n, 0, marks);
+		j = nextMark(marks, 0, n);
+		if (j < n) {
+			i += j;
 			break;
+		}
+	}
 
-	for (; i < size-20; i++){
-		if (BitStream[i] > BitStream[i-1] && BitStream[i] >= BitStream[i+1]){
-			// new up transition
-			fcCounter++;
+	lastUp = i-1;
+	for (; i < size-20; i += n) {
+		n = scanBlockLen(i, size-20, 0);
+		markWaveTops(BitStream, i-1, n, 0, marks);
+		for (j = nextMark(marks, 0, n); j < n; j = nextMark(marks, j+1, n)) {
+			// new up transition, count the samples since the last one
+			fcCounter = i + j - lastUp;
+			lastUp = i + j;
 			if (fskAdj){
 				//if we had 5 and now have 9 then go back to 8 (for when we get a fc 9 instead of an 8)
 				if (lastFCcnt==5 && fcCounter==9) fcCounter--;
@@ -703,10 +815,6 @@ uint16_t countFC(uint8_t *BitStream, size_t size, uint8_t fskAdj) {
 				fcCnts[fcLensFnd]++;
 				fcLens[fcLensFnd++]=fcCounter;
 			}
-			fcCounter=0;
-		} else {
-			// count sample
-			fcCounter++;
 		}
 	}
 	
@@ -770,6 +878,8 @@ int DetectPSKClock(uint8_t dest[], size_t size, int clock, size_t *firstPhaseShi
 		if (clk[i] == clock) return clock;
 
 	size_t waveStart=0, waveEnd=0, firstFullWave=0, lastClkBit=0;
+	uint8_t marks[SCAN_BLOCK];
+	size_t blk, n, j;
 
 	uint8_t clkCnt, tol=1;
 	uint16_t peakcnt=0, errCnt=0, waveLenCnt=0, fullWaveLen=0;
@@ -798,9 +908,12 @@ int DetectPSKClock(uint8_t dest[], size_t size, int clock, size_t *firstPhaseShi
 		peakcnt=0;
 		if (g_debugMode == 2) prnt("DEBUG PSK: clk: %d, lastClkBit: %d",clk[clkCnt],lastClkBit);
 
-		for (i = firstFullWave+fullWaveLen-1; i < loopCnt-2; i++){
-			//top edge of wave = start of new wave 
-			if (dest[i] < dest[i+1] && dest[i+1] >= dest[i+2]){
+		for (blk = firstFullWave+fullWaveLen-1; blk < loopCnt-2; blk += n) {
+			n = scanBlockLen(blk, loopCnt-2, 0);
+			markWaveTops(dest, blk, n, 0, marks);
+			for (j = nextMark(marks, 0, n); j < n; j = nextMark(marks, j+1, n)) {
+				//top edge of wave = start of new wave 
+				i = blk + j;
 				if (waveStart == 0) {
 					waveStart = i+1;
 					waveLenCnt=0;
@@ -854,7 +967,8 @@ uint8_t detectFSKClk(uint8_t *BitStream, size_t size, uint8_t fcHigh, uint8_t fc
 	uint16_t fcCounter = 0;
 	uint16_t rfCounter = 0;
 	uint8_t firstBitFnd = 0;
-	size_t i;
+	uint8_t marks[SCAN_BLOCK];
+	size_t i, n, j, lastPeak;
 	if (size == 0) return 0;
 
 	uint8_t fcTol = ((fcHigh*100 - fcLow*100)/2 + 50)/100; //(uint8_t)(0.5+(float)(fcHigh-fcLow)/2);
@@ -864,50 +978,59 @@ uint8_t detectFSKClk(uint8_t *BitStream, size_t size, uint8_t fcHigh, uint8_t fc
 	firstBitFnd=0;
 	//PrintAndLog("DEBUG: fcTol: %d",fcTol);
 	// prime i to first peak / up transition
-	for (i = 160; i < size-20; i++)
-		if (BitStream[i] > BitStream[i-1] && BitStream[i]>=BitStream[i+1])
+	for (i = 160; i < size-20; i += n) {
+		n = scanBlockLen(i, size-20, 0);
+		markWaveTops(BitStream, i-1, n, 0, marks);
+		j = nextMark(marks, 0, n);
+		if (j < n) {
+			i += j;
 			break;
+		}
+	}
 
-	for (; i < size-20; i++){
-		fcCounter++;
-		rfCounter++;
-
-		if (BitStream[i] <= BitStream[i-1] || BitStream[i] < BitStream[i+1]) 
-			continue;		
-		// else new peak 
-		// if we got less than the small fc + tolerance then set it to the small fc
-		// if it is inbetween set it to the last counter
-		if (fcCounter < fcHigh && fcCounter > fcLow)
-			fcCounter = lastFCcnt;
-		else if (fcCounter < fcLow+fcTol) 
-			fcCounter = fcLow;
-		else //set it to the large fc
-			fcCounter = fcHigh;
-
-		//look for bit clock  (rf/xx)
-		if ((fcCounter < lastFCcnt || fcCounter > lastFCcnt)){
-			//not the same size as the last wave - start of new bit sequence
-			if (firstBitFnd > 1){ //skip first wave change - probably not a complete bit
-				for (int ii=0; ii<15; ii++){
-					if (rfLens[ii] >= (rfCounter-4) && rfLens[ii] <= (rfCounter+4)){
-						rfCnts[ii]++;
-						rfCounter = 0;
-						break;
+	lastPeak = i-1;
+	for (; i < size-20; i += n) {
+		n = scanBlockLen(i, size-20, 0);
+		markWaveTops(BitStream, i-1, n, 0, marks);
+		for (j = nextMark(marks, 0, n); j < n; j = nextMark(marks, j+1, n)) {
+			// new peak, count the samples since the last one
+			fcCounter += i + j - lastPeak;
+			rfCounter += i + j - lastPeak;
+			lastPeak = i + j;
+			// if we got less than the small fc + tolerance then set it to the small fc
+			// if it is inbetween set it to the last counter
+			if (fcCounter < fcHigh && fcCounter > fcLow)
+				fcCounter = lastFCcnt;
+			else if (fcCounter < fcLow+fcTol) 
+				fcCounter = fcLow;
+			else //set it to the large fc
+				fcCounter = fcHigh;
+
+			//look for bit clock  (rf/xx)
+			if ((fcCounter < lastFCcnt || fcCounter > lastFCcnt)){
+				//not the same size as the last wave - start of new bit sequence
+				if (firstBitFnd > 1){ //skip first wave change - probably not a complete bit
+					for (int ii=0; ii<15; ii++){
+						if (rfLens[ii] >= (rfCounter-4) && rfLens[ii] <= (rfCounter+4)){
+							rfCnts[ii]++;
+							rfCounter = 0;
+							break;
+						}
 					}
+					if (rfCounter > 0 && rfLensFnd < 15){
+						//PrintAndLog("DEBUG: rfCntr %d, fcCntr %d",rfCounter,fcCounter);
+						rfCnts[rfLensFnd]++;
+						rfLens[rfLensFnd++] = rfCounter;
+					}
+				} else {
+					*firstClockEdge = i + j;
+					firstBitFnd++;
 				}
-				if (rfCounter > 0 && rfLensFnd < 15){
-					//PrintAndLog("DEBUG: rfCntr %d, fcCntr %d",rfCounter,fcCounter);
-					rfCnts[rfLensFnd]++;
-					rfLens[rfLensFnd++] = rfCounter;
-				}
-			} else {
-				*firstClockEdge = i;
-				firstBitFnd++;
+				rfCounter=0;
+				lastFCcnt=fcCounter;
 			}
-			rfCounter=0;
-			lastFCcnt=fcCounter;
+			fcCounter=0;
 		}
-		fcCounter=0;
 	}
 	uint8_t rfHighest=15, rfHighest2=15, rfHighest3=15;
 
@@ -1397,6 +1520,8 @@ size_t fsk_wave_demod(uint8_t * dest, size_t size, uint8_t fchigh, uint8_t fclow
 	size_t preLastSample = 0;
 	size_t LastSample = 0;
 	size_t currSample = 0;
+	uint8_t marks[SCAN_BLOCK];
+	size_t blk, n, j;
 	if ( size < 1024 ) return 0; // not enough samples
 
 	//find start of modulating data in trace 
@@ -1412,13 +1537,12 @@ size_t fsk_wave_demod(uint8_t * dest, size_t size, uint8_t fchigh, uint8_t fclow
 	// or 10 (fc/10) cycles but in practice due to noise etc we may end up with anywhere
 	// between 7 to 11 cycles so fuzz it by treat anything <9 as 8 and anything else as 10
 	//  (could also be fc/5 && fc/7 for fsk1 = 4-9)
-	for(; idx < size; idx++) {
-		// threshold current value
-		if (dest[idx] < FSK_PSK_THRESHOLD) dest[idx] = 0;
-		else dest[idx] = 1;
-
-		// Check for 0->1 transition
-		if (dest[idx-1] < dest[idx]) {
+	for (blk = idx; blk < size; blk += n) {
+		// threshold the values and find the 0->1 transitions
+		n = scanBlockLen(blk, size, numBits);
+		markThresholdRises(dest, blk, n, marks);
+		for (j = nextMark(marks, 0, n); j < n; j = nextMark(marks, j+1, n)) {
+			idx = blk + j;
 			preLastSample = LastSample;
 			LastSample = currSample;
 			currSample = idx-last_transition;
@@ -1548,8 +1672,10 @@ int pskRawDemod_ext(uint8_t dest[], size_t *size, int *clock, int *invert, int *
 	uint8_t curPhase = *invert;
 	uint8_t fc=0;
 	size_t i=0, numBits=0, waveStart=1, waveEnd=0, firstFullWave=0, lastClkBit=0;
-	uint16_t fullWaveLen=0, waveLenCnt=0, avgWaveVal;
+	uint16_t fullWaveLen=0, waveLenCnt=0;
 	uint16_t errCnt=0, errCnt2=0;
+	uint8_t marks[SCAN_BLOCK];
+	size_t blk, n, j;
 	
 	*clock = DetectPSKClock(dest, *size, *clock, &firstFullWave, &curPhase, &fc);
 	if (*clock <= 0) return -1;
@@ -1580,13 +1706,15 @@ int pskRawDemod_ext(uint8_t dest[], size_t *size, int *clock, int *invert, int *
 	if (g_debugMode==2) prnt("DEBUG PSK: clk: %d, lastClkBit: %u, fc: %u", *clock, lastClkBit,(unsigned int) fc);
 	waveStart = 0;
 	dest[numBits++] = curPhase; //set first read bit
-	for (i = firstFullWave + fullWaveLen - 1; i < *size-3; i++) {
-		//top edge of wave = start of new wave 
-		if (dest[i]+fc < dest[i+1] && dest[i+1] >= dest[i+2]) {
+	for (blk = firstFullWave + fullWaveLen - 1; blk < *size-3; blk += n) {
+		n = scanBlockLen(blk, *size-3, numBits);
+		markWaveTops(dest, blk, n, fc, marks);
+		for (j = nextMark(marks, 0, n); j < n; j = nextMark(marks, j+1, n)) {
+			//top edge of wave = start of new wave 
+			i = blk + j;
 			if (waveStart == 0) {
 				waveStart = i+1;
 				waveLenCnt = 0;
-				avgWaveVal = dest[i+1];
 			} else { //waveEnd
 				waveEnd = i+1;
 				waveLenCnt = waveEnd-waveStart;
@@ -1609,14 +1737,11 @@ int pskRawDemod_ext(uint8_t dest[], size_t *size, int *clock, int *invert, int *
 				} else if (waveLenCnt < fc - 1) { //wave is smaller than field clock (shouldn't happen often)
 					errCnt2++;
 					if(errCnt2 > 101) return errCnt2;
-					avgWaveVal += dest[i+1];
 					continue;
 				}
-				avgWaveVal = 0;
 				waveStart = i+1;
 			}
 		}
-		avgWaveVal += dest[i+1];
 	}
 	*size = numBits;
 	return errCnt;
@@ -0,0 +1,90 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Encoding of the samples uploaded for simulation (CMD_DOWNLOADED_SIM_SAMPLES_125K)
+//
+// The samples are 0 or 1. Packed they need an eighth of the USB frames. Long
+// runs, as in the Manchester or biphase encoded bits of most tags, are shorter
+// run length encoded. The client picks the shorter encoding per frame, the
+// device only decodes.
+//-----------------------------------------------------------------------------
+
+#include "lfsimpack.h"
+#include <string.h>  // for memcpy and memset
+
+int lfsim_decode(uint8_t encoding, const uint8_t *src, size_t len, uint8_t *dest, size_t max_samples)
+{
+	size_t n = 0;
+
+	switch (encoding) {
+		case LFSIM_ENC_RAW:
+			if (len > max_samples)
+				return -1;
+			memcpy(dest, src, len);
+			return len;
+
+		case LFSIM_ENC_PACKED:
+			// the padding of the last byte may not fit
+			if (len > 0 && (len - 1) * 8 >= max_samples)
+				return -1;
+			for (size_t i = 0; i < len; i++) {
+				uint8_t b = src[i];
+				for (int j = 0; j < 8 && n < max_samples; j++, b >>= 1)
+					dest[n++] = b & 1;
+			}
+			return n;
+
+		case LFSIM_ENC_RLE:
+			for (size_t i = 0; i < len; i++) {
+				size_t run = (src[i] & 0x7f) + 1;
+				if (n + run > max_samples)
+					return -1;
+				memset(dest + n, src[i] >> 7, run);
+				n += run;
+			}
+			return n;
+	}
+
+	return -1;
+}
+
+#ifndef ON_DEVICE
+size_t lfsim_encode(uint8_t encoding, const uint8_t *samples, size_t count, uint8_t *dest, size_t max_len, size_t *consumed)
+{
+	size_t i = 0, len = 0;
+
+	switch (encoding) {
+		case LFSIM_ENC_RAW:
+			len = count < max_len ? count : max_len;
+			for (i = 0; i < len; i++)
+				dest[i] = samples[i] ? 1 : 0;
+			break;
+
+		case LFSIM_ENC_PACKED:
+			// the last byte is padded with zeros
+			for (len = 0; len < max_len && i < count; len++) {
+				uint8_t b = 0;
+				for (int j = 0; j < 8 && i < count; j++, i++)
+					b |= (samples[i] ? 1 : 0) << j;
+				dest[len] = b;
+			}
+			break;
+
+		case LFSIM_ENC_RLE:
+			for (len = 0; len < max_len && i < count; len++) {
+				uint8_t v = samples[i] ? 1 : 0;
+				size_t run = 1;
+				while (run < 128 && i + run < count && (samples[i + run] ? 1 : 0) == v)
+					run++;
+				dest[len] = v << 7 | (run - 1);
+				i += run;
+			}
+			break;
+	}
+
+	*consumed = i;
+	return len;
+}
+#endif
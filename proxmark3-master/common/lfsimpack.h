@@ -0,0 +1,32 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Encoding of the samples uploaded for simulation (CMD_DOWNLOADED_SIM_SAMPLES_125K)
+//-----------------------------------------------------------------------------
+
+#ifndef LFSIMPACK_H__
+#define LFSIMPACK_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// one byte per sample
+#define LFSIM_ENC_RAW			0
+// one bit per sample, the first sample in the lowest bit
+#define LFSIM_ENC_PACKED		1
+// one byte per run of 1..128 equal samples: sample << 7 | (run length - 1)
+#define LFSIM_ENC_RLE			2
+
+// Decode len bytes into at most max_samples samples. Returns the number of samples, -1 for an
+// unknown encoding or if they don't fit.
+extern int lfsim_decode(uint8_t encoding, const uint8_t *src, size_t len, uint8_t *dest, size_t max_samples);
+
+#ifndef ON_DEVICE
+// Encode as many of the count samples as fit into max_len bytes. Returns the number of bytes,
+// *consumed gets the number of samples encoded.
+extern size_t lfsim_encode(uint8_t encoding, const uint8_t *samples, size_t count, uint8_t *dest, size_t max_len, size_t *consumed);
+#endif
+
+#endif
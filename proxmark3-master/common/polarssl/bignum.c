@@ -1592,6 +1592,92 @@ cleanup:
     return( ret );
 }
 
+/*
+ * Exponentiation with a small odd exponent: X = A^e mod N
+ *
+ * Plain left-to-right square-and-multiply on Montgomery products. The last
+ * multiplication takes A in normal form, which also brings the result out of
+ * the Montgomery domain: e = 3 costs three products, e = 65537 eighteen.
+ */
+int mpi_exp_mod_small( mpi *X, const mpi *A, t_uint e, const mpi *N, mpi *_RR )
+{
+    int ret, i;
+    size_t j;
+    t_uint mm;
+    mpi RR, T, W, Acopy;
+
+    if( mpi_cmp_int( N, 0 ) < 0 || ( N->p[0] & 1 ) == 0 )
+        return( POLARSSL_ERR_MPI_BAD_INPUT_DATA );
+
+    if( ( e & 1 ) == 0 || A->s < 0 || mpi_cmp_mpi( A, N ) >= 0 )
+        return( POLARSSL_ERR_MPI_BAD_INPUT_DATA );
+
+    if( e == 1 )
+        return( mpi_copy( X, A ) );
+
+    mpi_montg_init( &mm, N );
+    mpi_init( &RR ); mpi_init( &T ); mpi_init( &W ); mpi_init( &Acopy );
+
+    j = N->n + 1;
+    MPI_CHK( mpi_grow( &W, j ) );
+    MPI_CHK( mpi_grow( &T, j * 2 ) );
+
+    /*
+     * X may be the same as A
+     */
+    MPI_CHK( mpi_copy( &Acopy, A ) );
+
+    /*
+     * If 1st call, pre-compute R^2 mod N
+     */
+    if( _RR == NULL || _RR->p == NULL )
+    {
+        MPI_CHK( mpi_lset( &RR, 1 ) );
+        MPI_CHK( mpi_shift_l( &RR, N->n * 2 * biL ) );
+        MPI_CHK( mpi_mod_mpi( &RR, &RR, N ) );
+
+        if( _RR != NULL )
+            memcpy( _RR, &RR, sizeof( mpi ) );
+    }
+    else
+        memcpy( &RR, _RR, sizeof( mpi ) );
+
+    /*
+     * W = A * R^2 * R^-1 mod N = A * R mod N
+     */
+    MPI_CHK( mpi_copy( &W, A ) );
+    mpi_montmul( &W, &RR, N, mm, &T );
+
+    MPI_CHK( mpi_grow( X, j ) );
+    MPI_CHK( mpi_copy( X, &W ) );
+
+    for( i = biL - 1; i > 0 && ( ( e >> i ) & 1 ) == 0; i-- )
+        ;
+
+    while( --i > 0 )
+    {
+        mpi_montmul( X, X, N, mm, &T );
+
+        if( ( e >> i ) & 1 )
+            mpi_montmul( X, &W, N, mm, &T );
+    }
+
+    /*
+     * lowest bit is set, X = X^2 * A * R^-1 mod N
+     */
+    mpi_montmul( X, X, N, mm, &T );
+    mpi_montmul( X, &Acopy, N, mm, &T );
+
+cleanup:
+
+    mpi_free( &W ); mpi_free( &T ); mpi_free( &Acopy );
+
+    if( _RR == NULL )
+        mpi_free( &RR );
+
+    return( ret );
+}
+
 /*
  * Greatest common divisor: G = gcd(A, B)  (HAC 14.54)
  */
@@ -598,6 +598,25 @@ int mpi_mod_int( t_uint *r, const mpi *A, t_sint b );
  */
 int mpi_exp_mod( mpi *X, const mpi *A, const mpi *E, const mpi *N, mpi *_RR );
 
+/**
+ * \brief          Exponentiation with a small public exponent: X = A^e mod N
+ *
+ * \param X        Destination MPI
+ * \param A        Left-hand MPI, 0 <= A < N
+ * \param e        Odd exponent, typically 3 or 65537
+ * \param N        Modular MPI
+ * \param _RR      Speed-up MPI used for recalculations
+ *
+ * \return         0 if successful,
+ *                 POLARSSL_ERR_MPI_MALLOC_FAILED if memory allocation failed,
+ *                 POLARSSL_ERR_MPI_BAD_INPUT_DATA if N is negative or even,
+ *                 if e is even or if A is out of range
+ *
+ * \note           Not constant time, only meant for public key operations.
+ *                 _RR is the same value as for mpi_exp_mod().
+ */
+int mpi_exp_mod_small( mpi *X, const mpi *A, t_uint e, const mpi *N, mpi *_RR );
+
 /**
  * \brief          Fill an MPI X with size bytes of random
  *
@@ -36,7 +36,8 @@ typedef enum ISO14A_COMMAND {
 	ISO14A_NO_SELECT =			(1 << 7),
 	ISO14A_TOPAZMODE =			(1 << 8),
 	ISO14A_NO_RATS =			(1 << 9),
-	ISO14A_CLEAR_TRACE =		(1 << 10)
+	ISO14A_CLEAR_TRACE =		(1 << 10),
+	ISO14A_COLLECT_UIDS =		(1 << 11)
 } iso14a_command_t;
 
 typedef struct {
@@ -48,6 +48,8 @@ typedef struct{
 #define CMD_FINISH_WRITE                                                  0x0003
 #define CMD_HARDWARE_RESET                                                0x0004
 #define CMD_START_FLASH                                                   0x0005
+#define CMD_FLASH_BLOCK_CRCS                                              0x0006
+#define CMD_FINISH_WRITE_WINDOWED                                         0x0007
 #define CMD_NACK                                                          0x00fe
 #define CMD_ACK                                                           0x00ff
 
@@ -255,6 +257,66 @@ typedef struct{
 /* Set if this device understands the extend start flash command */
 #define DEVICE_INFO_FLAG_UNDERSTANDS_START_FLASH 	(1<<4)
 
+/* Set if this device understands CMD_FINISH_WRITE_WINDOWED and CMD_FLASH_BLOCK_CRCS.
+   The bootrom doesn't implement them yet, the flasher falls back to CMD_FINISH_WRITE. */
+#define DEVICE_INFO_FLAG_UNDERSTANDS_WINDOWED_WRITE	(1<<5)
+
+/* CMD_FINISH_WRITE_WINDOWED writes a block like CMD_FINISH_WRITE, with flags in arg[1]
+   (older clients don't initialize arg[1] of CMD_FINISH_WRITE). A windowed write is only
+   acknowledged when it has the sync flag. The ACK has the block address in arg[0], the
+   CRC32 (crc32_update from CRC32_PRESET) of the flash contents of all the windowed writes
+   since CMD_START_FLASH in arg[1] and their number in arg[2]. After a failed write the
+   following windowed writes are ignored and the next sync is answered with a NACK,
+   with the address of the failed write in arg[0]. */
+#define FINISH_WRITE_FLAG_SYNC		(1<<1)
+
+/* CMD_FLASH_BLOCK_CRCS takes the address of the first 512 byte block in arg[0] and
+   the number of blocks, at most USB_CMD_DATA_SIZE/4, in arg[1]. The ACK has the
+   CRC32 of every block in d.asDwords. */
+
+/* CMD_MIFARE_EML_MEMSET and CMD_MIFARE_EML_MEMGET move up to USB_CMD_DATA_SIZE/16 blocks.
+   The checksum is update_crc16_bytes(0xffff, data, length). A MEMSET with EML_MEM_CHECKSUM
+   and the checksum of the data in arg[2] only writes data with the right checksum and is
+   answered with an ACK, isOK in arg[0] and the checksum of the written emulator memory in
+   arg[1]. The ACK of MEMGET has EML_MEM_CHECKSUM and the checksum of the blocks in arg[2]. */
+#define EML_MEM_CHECKSUM			(1<<16)
+
+/* CMD_MIFARE_CSETBLOCK writes (arg[2] >> CSETBLOCK_COUNT_SHIFT) blocks, one if 0, from block
+   arg[2] & 0xff on. The ACK has the number of blocks written in arg[1]. */
+#define CSETBLOCK_COUNT_SHIFT		8
+
+/* CMD_DOWNLOADED_SIM_SAMPLES_125K with SIM_SAMPLES_ENCODED in arg[2] has (arg[2] >> 16) bytes
+   of samples from sample arg[0] on, encoded as in common/lfsimpack.h with the encoding in
+   arg[2] & SIM_SAMPLES_ENCODING. Only frames with SIM_SAMPLES_SYNC are answered, with an ACK
+   with SIM_SAMPLES_ENCODED in arg[0], isOK for all frames since the one for sample 0 in arg[1]
+   and the end of the samples of the last frame in arg[2]. */
+#define SIM_SAMPLES_ENCODING		0x03
+#define SIM_SAMPLES_ENCODED			(1<<2)
+#define SIM_SAMPLES_SYNC			(1<<3)
+
+/* CMD_MIFARE_READSC with MF_SECTOR_KEY_AB in arg[2] gets key A and key B in d.asBytes and
+   reads every block with the key the access bits of the sector trailer allow. The ACK has
+   the blocks read as a bit mask in arg[1] and MF_SECTOR_KEY_AB in arg[2]. */
+#define MF_SECTOR_KEY_AB			(1<<0)
+
+/* CMD_MIFARE_WRITEBL writes arg[2] blocks of the same sector, one if 0, from block arg[0] on,
+   with one authentication. The ACK has the number of blocks written in arg[1]. */
+
+/* CMD_READER_ISO_14443a with ISO14A_COLLECT_UIDS and CMD_EPA_PACE_COLLECT_NONCE with
+   COLLECT_RECORDS in arg[2] repeat the anticollision or the nonce request, with the field
+   switched off for (arg[2] >> 16) ms in between, until arg[1] were collected (without end if
+   0), the button is pressed or a command arrives. The results are sent in batches, in ACKs
+   with COLLECT_RECORDS in arg[2] (and COLLECT_LAST in the last one), the number of records
+   in arg[0] and the number of tries since the previous ACK in arg[1]. A record is a length
+   byte followed by the UID or the nonce. */
+#define COLLECT_RECORDS				(1<<0)
+#define COLLECT_LAST				(1<<1)
+
+/* CMD_T55XX_READ_BLOCK acquires (arg[0] >> T55XX_READ_SAMPLES_SHIFT) samples, at most and
+   by default (0) T55XX_READ_SAMPLES. Older firmware always acquires T55XX_READ_SAMPLES. */
+#define T55XX_READ_SAMPLES_SHIFT	16
+#define T55XX_READ_SAMPLES			12000
+
 /* CMD_START_FLASH may have three arguments: start of area to flash,
    end of area to flash, optional magic.
    The bootrom will not allow to overwrite itself unless this magic
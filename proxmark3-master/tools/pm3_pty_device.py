@@ -0,0 +1,605 @@
+#!/usr/bin/python
+
+#  pm3_pty_device.py - emulate Proxmark3 devices on pseudo terminals
+#
+#  Creates one pty per emulated device and prints the port names, to be
+#  opened with 'proxmark3 <port>', 'session open <port>' or 'flasher <port>'.
+#  The devices answer CMD_PING, CMD_VERSION and CMD_STATUS like the firmware
+#  does, or run the bootloader protocol with -b, enough to test the client
+#  transport, the multi device sessions and the flasher without hardware.
+#  The OS devices also have a MIFARE emulator memory and a magic card, for
+#  'hf mf eload', 'esave' and 'cload', and a MIFARE Classic 4K card for
+#  'hf mf dump' and 'restore'. 'lf sim' uploads are kept and logged with
+#  their CRC32 when the simulation starts, 'data samples' downloads them. 'hf 14a cuids' sees cards with random
+#  UIDs and 'hf epa cnonces' a card with random nonces, raw ISO14443-A READs
+#  are answered like a MIFARE Ultralight. With -t a password protected T55x7
+#  is in the field, for 'lf t55xx bruteforce'.
+#
+#  usage: pm3_pty_device.py [-b] [-W] [-o] [-f flash.bin] [-c card.bin] [-d ms] [-w ms] [-m ms]
+#                            [-u ms] [-r n] [-t password] [number of devices]
+#
+#    -b          emulate the bootloader instead of the OS
+#    -W          bootloader with the windowed writes of the flasher, which the
+#                bootrom in this tree doesn't have yet
+#    -f file     flash contents, loaded at start and saved at every reset
+#    -d ms       delay before every answer, to emulate the USB round trip
+#    -w ms       time to program one 512 byte block
+#    -m ms       time to read or write one card block
+#    -c file     MIFARE Classic card image, loaded at start and saved after every
+#                write. A blank card with the transport configuration without it.
+#    -o          OS without the bulk MIFARE transfers and without streaming UIDs and
+#                nonces, as in older firmware
+#    -u ms       time of one anticollision or nonce request
+#    -r n        number of different random UIDs, 100000 by default. One in 20
+#                anticollisions finds no card.
+#    -t password a T55x7 with the password (8 hex digits) and T55XX_CONFIG in block 0.
+#                It only answers reads with the password.
+#
+#    This code is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+
+import getopt
+import os
+import pty
+import random
+import select
+import struct
+import sys
+import time
+import tty
+import zlib
+
+CMD_DEVICE_INFO = 0x0000
+CMD_FINISH_WRITE = 0x0003
+CMD_HARDWARE_RESET = 0x0004
+CMD_START_FLASH = 0x0005
+CMD_FLASH_BLOCK_CRCS = 0x0006
+CMD_FINISH_WRITE_WINDOWED = 0x0007
+CMD_NACK = 0x00fe
+CMD_ACK = 0x00ff
+CMD_DEBUG_PRINT_STRING = 0x0100
+CMD_VERSION = 0x0107
+CMD_STATUS = 0x0108
+CMD_PING = 0x0109
+CMD_DOWNLOAD_RAW_ADC_SAMPLES_125K = 0x0207
+CMD_DOWNLOADED_RAW_ADC_SAMPLES_125K = 0x0208
+CMD_DOWNLOADED_SIM_SAMPLES_125K = 0x0209
+CMD_SIMULATE_TAG_125K = 0x020A
+CMD_T55XX_READ_BLOCK = 0x0214
+CMD_READER_ISO_14443a = 0x0385
+CMD_EPA_PACE_COLLECT_NONCE = 0x038A
+CMD_MIFARE_EML_MEMSET = 0x0602
+CMD_MIFARE_EML_MEMGET = 0x0603
+CMD_MIFARE_CSETBLOCK = 0x0605
+CMD_MIFARE_CGETBLOCK = 0x0606
+CMD_MIFARE_CIDENT = 0x0607
+CMD_MIFARE_READBL = 0x0620
+CMD_MIFARE_READSC = 0x0621
+CMD_MIFARE_WRITEBL = 0x0622
+
+DEVICE_INFO_FLAG_BOOTROM_PRESENT = 1 << 0
+DEVICE_INFO_FLAG_OSIMAGE_PRESENT = 1 << 1
+DEVICE_INFO_FLAG_CURRENT_MODE_BOOTROM = 1 << 2
+DEVICE_INFO_FLAG_UNDERSTANDS_START_FLASH = 1 << 4
+DEVICE_INFO_FLAG_UNDERSTANDS_WINDOWED_WRITE = 1 << 5
+FINISH_WRITE_FLAG_SYNC = 1 << 1
+START_FLASH_MAGIC = 0x54494f44
+EML_MEM_CHECKSUM = 1 << 16
+CSETBLOCK_COUNT_SHIFT = 8
+MF_SECTOR_KEY_AB = 1 << 0
+SIM_SAMPLES_ENCODING = 0x03
+SIM_SAMPLES_ENCODED = 1 << 2
+SIM_SAMPLES_SYNC = 1 << 3
+LFSIM_ENC_RAW = 0
+LFSIM_ENC_PACKED = 1
+LFSIM_ENC_RLE = 2
+BIGBUF_SIZE = 40000
+ISO14A_RAW = 1 << 3
+ISO14A_COLLECT_UIDS = 1 << 11
+ISO14443A_CRC_PRESET = 0x6363
+ULTRALIGHT_READ = 0x30
+ULTRALIGHT_PAGES = 16
+COLLECT_RECORDS = 1 << 0
+COLLECT_LAST = 1 << 1
+COLLECT_BATCH_TIME = 0.25
+# ASK/Manchester, RF/32, 2 blocks
+T55XX_CONFIG = 0x00088040
+T55XX_READ_SAMPLES_SHIFT = 16
+T55XX_READ_SAMPLES = 12000
+
+FLASH_START = 0x100000
+FLASH_SIZE = 256 * 1024
+BOOTLOADER_END = FLASH_START + 0x2000
+BLOCK_SIZE = 0x200
+
+USB_CMD_DATA_SIZE = 512
+USB_CMD_SIZE = 8 + 3 * 8 + USB_CMD_DATA_SIZE
+
+CRC32_PRESET = 0xffffffff
+CARD_MEMORY_SIZE = 4096
+
+def crc32_update(crc, data):
+	# same as common/crc32.c: zlib's CRC32 without the final inversion
+	return ~zlib.crc32(bytes(data), ~crc & 0xffffffff) & 0xffffffff
+
+def crc16_update(crc, data):
+	# same as update_crc16_bytes() in common/crc16.c
+	for b in bytearray(data):
+		b ^= crc & 0xff
+		b = (b ^ (b << 4)) & 0xff
+		crc = (crc >> 8) ^ (b << 8) ^ (b << 3) ^ (b >> 4)
+	return crc
+
+def lfsim_decode(encoding, data, max_samples):
+	# same as common/lfsimpack.c, None if the samples don't fit
+	if encoding == LFSIM_ENC_RAW:
+		out = bytearray(data)
+	elif encoding == LFSIM_ENC_PACKED:
+		if data and (len(data) - 1) * 8 >= max_samples:
+			return None
+		out = bytearray((b >> j) & 1 for b in bytearray(data) for j in range(8))[:max_samples]
+	elif encoding == LFSIM_ENC_RLE:
+		out = bytearray()
+		for b in bytearray(data):
+			out += bytearray([b >> 7]) * ((b & 0x7f) + 1)
+	else:
+		return None
+	return out if len(out) <= max_samples else None
+
+def t55xx_samples(block, count, rnd):
+	# what T55xxReadBlock() acquires: the block repeated, ASK/Manchester at RF/32,
+	# or only noise without an answer
+	if block is None:
+		return bytearray(rnd.randrange(124, 132) for i in range(count))
+	out = bytearray()
+	while len(out) < count:
+		for i in range(31, -1, -1):
+			high, low = bytearray([200]) * 16, bytearray([56]) * 16
+			out += high + low if block >> i & 1 else low + high
+	return out[:count]
+
+def first_block_of_sector(sector):
+	return sector * 4 if sector < 32 else 128 + (sector - 32) * 16
+
+def blocks_per_sector(sector):
+	return 4 if sector < 32 else 16
+
+def sector_of_block(block):
+	return block // 4 if block < 128 else 32 + (block - 128) // 16
+
+class ClassicCard:
+	# MIFARE Classic 4K, access conditions as in the datasheet, trailer writes simplified
+	def __init__(self, filename):
+		self.filename = filename
+		self.memory = bytearray(CARD_MEMORY_SIZE)
+		for sector in range(40):
+			trailer = first_block_of_sector(sector) + blocks_per_sector(sector) - 1
+			self.memory[trailer * 16:trailer * 16 + 16] = b'\xff' * 6 + b'\xff\x07\x80\x69' + b'\xff' * 6
+		if filename and os.path.exists(filename):
+			with open(filename, 'rb') as f:
+				data = f.read(CARD_MEMORY_SIZE)
+			self.memory[:len(data)] = data
+
+	def trailer(self, sector):
+		block = first_block_of_sector(sector) + blocks_per_sector(sector) - 1
+		return self.memory[block * 16:block * 16 + 16]
+
+	def rights(self, block):
+		sector = sector_of_block(block)
+		index = block - first_block_of_sector(sector)
+		if index == blocks_per_sector(sector) - 1:
+			area = 3
+		else:
+			area = index if sector < 32 else index // 5
+		t = self.trailer(sector)
+		return ((t[7] >> (4 + area)) & 1) << 2 | ((t[8] >> area) & 1) << 1 | ((t[8] >> (4 + area)) & 1)
+
+	def auth(self, block, key_type, key):
+		t = self.trailer(sector_of_block(block))
+		return bytes(t[10:16] if key_type else t[0:6]) == bytes(key)
+
+	def read(self, block, key_type):
+		rights = self.rights(block)
+		data = bytearray(self.memory[block * 16:block * 16 + 16])
+		if block == first_block_of_sector(sector_of_block(block)) + blocks_per_sector(sector_of_block(block)) - 1:
+			# key A is never readable, key B is not when it is used as a key
+			data[0:6] = b'\0' * 6
+			if rights not in (0, 2, 1):
+				data[10:16] = b'\0' * 6
+			return data
+		if rights == 7 or (rights in (3, 5) and not key_type):
+			return None
+		return data
+
+	def write(self, block, key_type, data):
+		rights = self.rights(block)
+		sector = sector_of_block(block)
+		if block == first_block_of_sector(sector) + blocks_per_sector(sector) - 1:
+			allowed = key_type == 0 and rights in (0, 1) or key_type == 1 and rights in (3, 4, 5)
+		else:
+			allowed = rights == 0 or key_type == 1 and rights in (3, 4, 6)
+		if not allowed:
+			return False
+		self.memory[block * 16:block * 16 + 16] = data
+		return True
+
+	def save(self):
+		if self.filename:
+			with open(self.filename, 'wb') as f:
+				f.write(self.memory)
+
+def usb_cmd(cmd, arg0=0, arg1=0, arg2=0, data=b''):
+	return struct.pack('<4Q', cmd, arg0, arg1, arg2) + data.ljust(USB_CMD_DATA_SIZE, b'\0')
+
+class OsDevice:
+	def __init__(self, index, options):
+		self.index = index
+		self.bulk = '-o' not in options
+		self.magic_write_time = float(options.get('-m', 0)) / 1000
+		self.emulator = bytearray(CARD_MEMORY_SIZE)
+		self.magic_card = bytearray(CARD_MEMORY_SIZE)
+		self.magic_writes = 0
+		self.card = ClassicCard(options.get('-c'))
+		# a different sawtooth on every device, 'data samples' shows which one answered
+		self.bigbuf = bytearray((i * (index + 1)) & 0xff for i in range(BIGBUF_SIZE))
+		self.sim_ok = True
+		self.try_time = float(options.get('-u', 0)) / 1000
+		self.uids = int(options.get('-r', 100000))
+		self.random = random.Random(index)
+		self.collection = None
+		self.t55xx_password = int(options['-t'], 16) if '-t' in options else None
+
+	def next_record(self, kind, size):
+		# one anticollision or nonce request, None if it failed
+		time.sleep(self.try_time)
+		if kind == 'uid':
+			if self.random.random() < 0.05:
+				return None
+			return b'\x08' + struct.pack('<I', self.random.randrange(self.uids) * 2654435761 & 0xffffffff)[:3]
+		return bytes(bytearray(self.random.randrange(256) for i in range(size)))
+
+	def stream(self):
+		# the next batch of a running collection, as CollectAdd() and CollectTried()
+		# in armsrc/iso14443a.c send them
+		c = self.collection
+		if c is None:
+			return None
+		batch = b''
+		records = tries = 0
+		start = time.time()
+		while True:
+			if c['pending'] is not None:
+				batch += struct.pack('B', len(c['pending'])) + c['pending']
+				records += 1
+				c['pending'] = None
+			if c['count'] and c['collected'] >= c['count']:
+				self.collection = None
+				return usb_cmd(CMD_ACK, records, tries, COLLECT_RECORDS | COLLECT_LAST, batch)
+			if time.time() - start >= COLLECT_BATCH_TIME:
+				return usb_cmd(CMD_ACK, records, tries, COLLECT_RECORDS, batch)
+			record = self.next_record(c['kind'], c['size'])
+			tries += 1
+			if record is None:
+				continue
+			c['collected'] += 1
+			c['pending'] = record
+			if len(batch) + 1 + len(record) > USB_CMD_DATA_SIZE:
+				return usb_cmd(CMD_ACK, records, tries, COLLECT_RECORDS, batch)
+
+	def ultralight(self, frame):
+		# READ with a valid CRC, page n holds the bytes 4n to 4n+3, answered with the CRC
+		frame = bytearray(frame)
+		if (len(frame) != 4 or frame[0] != ULTRALIGHT_READ or
+			struct.unpack('<H', bytes(frame[2:4]))[0] != crc16_update(ISO14443A_CRC_PRESET, frame[:2])):
+			return usb_cmd(CMD_ACK, 0)
+		pages = bytes(bytearray((((frame[1] + i // 4) % ULTRALIGHT_PAGES) * 4 + i % 4) for i in range(16)))
+		answer = pages + struct.pack('<H', crc16_update(ISO14443A_CRC_PRESET, pages))
+		return usb_cmd(CMD_ACK, len(answer), 0, 0, answer)
+
+	def answer(self, cmd, arg0, arg1, arg2, data):
+		if self.collection is not None:
+			# any command stops a collection
+			self.collection = None
+			return usb_cmd(CMD_ACK, 0, 0, COLLECT_RECORDS | COLLECT_LAST) + (self.answer(cmd, arg0, arg1, arg2, data) or b'')
+
+		if cmd == CMD_PING:
+			return usb_cmd(CMD_ACK)
+		if cmd == CMD_VERSION:
+			version = ('emulated device %d on a pty' % self.index).encode()
+			return usb_cmd(CMD_ACK, 0x270B0A40, 0, len(version), version)
+		if cmd == CMD_STATUS:
+			return usb_cmd(CMD_DEBUG_PRINT_STRING, 15, data=b'emulated device') + usb_cmd(CMD_ACK)
+
+		if cmd == CMD_DOWNLOAD_RAW_ADC_SAMPLES_125K:
+			# as the firmware, without the sample configuration in the ACK
+			end = min(arg0 + arg1, BIGBUF_SIZE)
+			out = b''
+			for i in range(arg0, end, USB_CMD_DATA_SIZE):
+				chunk = bytes(self.bigbuf[i:min(i + USB_CMD_DATA_SIZE, end)])
+				out += usb_cmd(CMD_DOWNLOADED_RAW_ADC_SAMPLES_125K, i - arg0, len(chunk), 0, chunk)
+			return out + usb_cmd(CMD_ACK)
+
+		if cmd == CMD_DOWNLOADED_SIM_SAMPLES_125K:
+			if not (self.bulk and arg2 & SIM_SAMPLES_ENCODED):
+				chunk = data[:max(0, min(USB_CMD_DATA_SIZE, BIGBUF_SIZE - arg0))]
+				self.bigbuf[arg0:arg0 + len(chunk)] = chunk
+				return usb_cmd(CMD_ACK)
+			if arg0 == 0:
+				self.sim_ok = True
+			samples = None
+			if arg0 < BIGBUF_SIZE:
+				samples = lfsim_decode(arg2 & SIM_SAMPLES_ENCODING, data[:min(arg2 >> 16, USB_CMD_DATA_SIZE)], BIGBUF_SIZE - arg0)
+			end = arg0
+			if samples is None:
+				self.sim_ok = False
+			else:
+				self.bigbuf[arg0:arg0 + len(samples)] = samples
+				end = arg0 + len(samples)
+			if arg2 & SIM_SAMPLES_SYNC:
+				return usb_cmd(CMD_ACK, SIM_SAMPLES_ENCODED, 1 if self.sim_ok else 0, end)
+			return None
+
+		if cmd == CMD_READER_ISO_14443a:
+			if arg0 == 0:
+				# field off, no answer
+				return None
+			if arg0 & ISO14A_RAW:
+				return self.ultralight(data[:arg1 & 0xffff])
+			if self.bulk and arg0 & ISO14A_COLLECT_UIDS:
+				self.collection = {'kind': 'uid', 'count': arg1, 'size': 0, 'collected': 0, 'pending': None}
+				return None
+			uid = self.next_record('uid', 0)
+			if uid is None:
+				return usb_cmd(CMD_ACK, 0)
+			# iso14a_card_select_t: uid[10], uidlen, atqa[2], sak, ats_len
+			card = uid.ljust(10, b'\0') + struct.pack('<BHBB', len(uid), 0x0004, 0x08, 0)
+			return usb_cmd(CMD_ACK, 2, len(uid), 0, card)
+
+		if cmd == CMD_EPA_PACE_COLLECT_NONCE:
+			size = arg0 & 0xff
+			if self.bulk and arg2 & COLLECT_RECORDS:
+				self.collection = {'kind': 'nonce', 'count': arg1, 'size': size, 'collected': 0, 'pending': None}
+				return None
+			nonce = self.next_record('nonce', size)
+			return usb_cmd(CMD_ACK, 0, len(nonce), 0, nonce)
+
+		if cmd == CMD_T55XX_READ_BLOCK:
+			# arg0: bit 0 password mode, bit 1 page, the number of samples from bit 16 on;
+			# arg1 block, arg2 password. The sample buffer is cleared before the acquisition.
+			block = None
+			if self.t55xx_password is not None and arg0 & 1 and arg2 == self.t55xx_password:
+				block = T55XX_CONFIG if arg1 == 0 and not arg0 & 2 else 0
+			count = arg0 >> T55XX_READ_SAMPLES_SHIFT
+			if count == 0 or count > T55XX_READ_SAMPLES:
+				count = T55XX_READ_SAMPLES
+			sys.stderr.write('t55xx read, %d samples\n' % count)
+			self.bigbuf[0:T55XX_READ_SAMPLES] = t55xx_samples(block, count, self.random).ljust(T55XX_READ_SAMPLES, b'\0')
+			return usb_cmd(CMD_ACK)
+
+		if cmd == CMD_SIMULATE_TAG_125K:
+			n = min(arg0, BIGBUF_SIZE)
+			sys.stderr.write('simulating %d samples, crc32 %08x\n' % (n, zlib.crc32(bytes(self.bigbuf[:n])) & 0xffffffff))
+			return None
+
+		if cmd == CMD_MIFARE_EML_MEMSET:
+			count = arg1 if self.bulk else min(arg1, 4)
+			if not (self.bulk and arg2 & EML_MEM_CHECKSUM):
+				self.emulator[arg0 * 16:(arg0 + count) * 16] = data[:count * 16]
+				return None
+			if count > USB_CMD_DATA_SIZE // 16 or (arg0 + count) * 16 > CARD_MEMORY_SIZE or \
+				crc16_update(0xffff, data[:count * 16]) != arg2 & 0xffff:
+				return usb_cmd(CMD_ACK, 0)
+			self.emulator[arg0 * 16:(arg0 + count) * 16] = data[:count * 16]
+			return usb_cmd(CMD_ACK, 1, crc16_update(0xffff, self.emulator[arg0 * 16:(arg0 + count) * 16]))
+
+		if cmd == CMD_MIFARE_EML_MEMGET:
+			count = min(arg1, USB_CMD_DATA_SIZE // 16)
+			block = bytes(self.emulator[arg0 * 16:(arg0 + count) * 16])
+			if not self.bulk:
+				return usb_cmd(CMD_ACK, arg0, arg1, 0, block)
+			return usb_cmd(CMD_ACK, arg0, arg1, EML_MEM_CHECKSUM | crc16_update(0xffff, block), block)
+
+		if cmd == CMD_MIFARE_CIDENT:
+			return usb_cmd(CMD_ACK, 1)
+
+		if cmd == CMD_MIFARE_CSETBLOCK:
+			block = arg2 & 0xff
+			count = (arg2 >> CSETBLOCK_COUNT_SHIFT) if self.bulk else 1
+			count = min(max(count, 1), USB_CMD_DATA_SIZE // 16, 256 - block)
+			time.sleep(self.magic_write_time * count)
+			self.magic_card[block * 16:(block + count) * 16] = data[:count * 16]
+			self.magic_writes += count
+			return usb_cmd(CMD_ACK, 1, count if self.bulk else 0, 0, bytes(self.magic_card[:4]))
+
+		if cmd == CMD_MIFARE_READBL:
+			block = arg0 & 0xff
+			time.sleep(self.magic_write_time)
+			if not self.card.auth(block, arg1 & 1, data[:6]):
+				return usb_cmd(CMD_ACK, 0)
+			block_data = self.card.read(block, arg1 & 1)
+			if block_data is None:
+				return usb_cmd(CMD_ACK, 0)
+			return usb_cmd(CMD_ACK, 1, 0, 0, bytes(block_data))
+
+		if cmd == CMD_MIFARE_READSC:
+			sector = arg0 & 0xff
+			first = first_block_of_sector(sector)
+			count = blocks_per_sector(sector)
+			out = bytearray(count * 16)
+			key_ab = self.bulk and arg2 & MF_SECTOR_KEY_AB
+			key_type = 0 if key_ab else arg1 & 1
+			if not self.card.auth(first, key_type, data[:6]):
+				return usb_cmd(CMD_ACK, 0, 0, MF_SECTOR_KEY_AB if key_ab else 0, bytes(out))
+			blocks_read = 0
+			authenticated_b = False
+			for i in list(range(count - 1, count)) + list(range(count - 1)) if key_ab else range(count):
+				time.sleep(self.magic_write_time)
+				block_data = self.card.read(first + i, key_type)
+				if block_data is None and key_ab and self.card.rights(first + i) in (3, 5):
+					# nested authentication with key B
+					if not authenticated_b and not self.card.auth(first, 1, data[6:12]):
+						return usb_cmd(CMD_ACK, 0, blocks_read, MF_SECTOR_KEY_AB, bytes(out))
+					authenticated_b = True
+					block_data = self.card.read(first + i, 1)
+				if block_data is None:
+					if key_ab and self.card.rights(first + i) == 7:
+						continue
+					return usb_cmd(CMD_ACK, 0, blocks_read, MF_SECTOR_KEY_AB if key_ab else 0, bytes(out))
+				out[i * 16:i * 16 + 16] = block_data
+				blocks_read |= 1 << i
+			if not key_ab:
+				blocks_read = 0
+			return usb_cmd(CMD_ACK, 1, blocks_read, MF_SECTOR_KEY_AB if key_ab else 0, bytes(out))
+
+		if cmd == CMD_MIFARE_WRITEBL:
+			block = arg0 & 0xff
+			sector = sector_of_block(block)
+			count = max(arg2 & 0xff, 1) if self.bulk else 1
+			count = min(count, first_block_of_sector(sector) + blocks_per_sector(sector) - block)
+			if not self.card.auth(block, arg1 & 1, data[:6]):
+				return usb_cmd(CMD_ACK, 0)
+			written = 0
+			while written < count:
+				time.sleep(self.magic_write_time)
+				if not self.card.write(block + written, arg1 & 1, data[10 + written * 16:26 + written * 16]):
+					break
+				written += 1
+			self.card.save()
+			return usb_cmd(CMD_ACK, 1 if written == count else 0, written if self.bulk else 0)
+
+		if cmd == CMD_MIFARE_CGETBLOCK:
+			block = arg2 & 0xff
+			return usb_cmd(CMD_ACK, 1, 0, 0, bytes(self.magic_card[block * 16:(block + 1) * 16]))
+		return None
+
+class BootloaderDevice:
+	def __init__(self, index, options):
+		self.windowed = '-W' in options
+		self.flash_file = options.get('-f')
+		self.write_time = float(options.get('-w', 0)) / 1000
+		self.flash = bytearray(b'\xff' * FLASH_SIZE)
+		if self.flash_file and os.path.exists(self.flash_file):
+			with open(self.flash_file, 'rb') as f:
+				data = f.read(FLASH_SIZE)
+			self.flash[:len(data)] = data
+		self.start_addr = self.end_addr = 0
+		self.window_crc = CRC32_PRESET
+		self.window_blocks = 0
+		self.window_error = 0
+		self.writes = 0
+
+	def stream(self):
+		return None
+
+	def answer(self, cmd, arg0, arg1, arg2, data):
+		if cmd == CMD_DEVICE_INFO:
+			flags = DEVICE_INFO_FLAG_BOOTROM_PRESENT | DEVICE_INFO_FLAG_CURRENT_MODE_BOOTROM | \
+				DEVICE_INFO_FLAG_UNDERSTANDS_START_FLASH
+			if self.windowed:
+				flags |= DEVICE_INFO_FLAG_UNDERSTANDS_WINDOWED_WRITE
+			return usb_cmd(CMD_DEVICE_INFO, flags, 1, 2)
+
+		if cmd == CMD_START_FLASH:
+			self.window_crc = CRC32_PRESET
+			self.window_blocks = 0
+			self.window_error = 0
+			if (arg2 == START_FLASH_MAGIC or arg0 >= BOOTLOADER_END) and \
+				arg0 >= FLASH_START and arg1 <= FLASH_START + FLASH_SIZE:
+				self.start_addr, self.end_addr = arg0, arg1
+				return usb_cmd(CMD_ACK, arg0)
+			self.start_addr = self.end_addr = 0
+			return usb_cmd(CMD_NACK)
+
+		if cmd == CMD_FINISH_WRITE or (cmd == CMD_FINISH_WRITE_WINDOWED and self.windowed):
+			windowed = cmd == CMD_FINISH_WRITE_WINDOWED
+			failed = False
+			if not (windowed and self.window_error):
+				if arg0 < self.start_addr or arg0 + BLOCK_SIZE > self.end_addr:
+					failed = True
+				else:
+					time.sleep(self.write_time)
+					offset = arg0 - FLASH_START
+					self.flash[offset:offset + BLOCK_SIZE] = data
+					self.writes += 1
+			if not windowed:
+				return usb_cmd(CMD_NACK if failed else CMD_ACK, arg0)
+			if self.window_error:
+				pass
+			elif failed:
+				self.window_error = arg0
+			else:
+				offset = arg0 - FLASH_START
+				self.window_crc = crc32_update(self.window_crc, self.flash[offset:offset + BLOCK_SIZE])
+				self.window_blocks += 1
+			if arg1 & FINISH_WRITE_FLAG_SYNC:
+				if self.window_error:
+					return usb_cmd(CMD_NACK, self.window_error)
+				return usb_cmd(CMD_ACK, arg0, self.window_crc, self.window_blocks)
+			return None
+
+		if cmd == CMD_FLASH_BLOCK_CRCS and self.windowed:
+			if arg1 > USB_CMD_DATA_SIZE // 4 or arg0 < FLASH_START or arg0 + arg1 * BLOCK_SIZE > FLASH_START + FLASH_SIZE:
+				return usb_cmd(CMD_NACK)
+			offset = arg0 - FLASH_START
+			crcs = [crc32_update(CRC32_PRESET, self.flash[offset + i * BLOCK_SIZE:offset + (i + 1) * BLOCK_SIZE])
+				for i in range(arg1)]
+			return usb_cmd(CMD_ACK, arg0, arg1, 0, struct.pack('<%dI' % arg1, *crcs))
+
+		if cmd == CMD_HARDWARE_RESET:
+			sys.stderr.write('reset after %d block writes\n' % self.writes)
+			self.writes = 0
+			if self.flash_file:
+				with open(self.flash_file, 'wb') as f:
+					f.write(self.flash)
+			return None
+
+		# the bootrom hangs on anything else
+		sys.stderr.write('unexpected command 0x%04x\n' % cmd)
+		return None
+
+def main():
+	opts, args = getopt.getopt(sys.argv[1:], 'bWf:d:w:m:oc:u:r:t:')
+	options = dict(opts)
+	count = int(args[0]) if args else 1
+	delay = float(options.get('-d', 0)) / 1000
+	device_class = BootloaderDevice if '-b' in options else OsDevice
+
+	devices = []
+	for i in range(count):
+		master, slave = pty.openpty()
+		tty.setraw(slave)
+		devices.append([master, slave, b'', device_class(i, options)])
+		print(os.ttyname(slave))
+	sys.stdout.flush()
+
+	try:
+		while True:
+			streaming = [d for d in devices if d[3].collection is not None] if device_class == OsDevice else []
+			ready, _, _ = select.select([d[0] for d in devices], [], [], 0 if streaming else None)
+			for device in streaming:
+				if device[0] not in ready:
+					os.write(device[0], device[3].stream())
+			for device in devices:
+				if device[0] not in ready:
+					continue
+				try:
+					device[2] += os.read(device[0], 4096)
+				except OSError:
+					# the client closed the port, wait for the next open
+					continue
+				while len(device[2]) >= USB_CMD_SIZE:
+					packet = device[2][:USB_CMD_SIZE]
+					device[2] = device[2][USB_CMD_SIZE:]
+					cmd, arg0, arg1, arg2 = struct.unpack('<4Q', packet[:32])
+					response = device[3].answer(cmd, arg0, arg1, arg2, packet[32:])
+					if response:
+						time.sleep(delay)
+						os.write(device[0], response)
+	except KeyboardInterrupt:
+		pass
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,285 @@
+#!/usr/bin/python3
+
+#  pm3_pty_device_test.py - drive the client against emulated devices
+#
+#  Starts pm3_pty_device.py, runs command scripts in client/proxmark3 on the
+#  emulated ports and checks the output: several sessions in one client, the
+#  streamed 'hf 14a cuids' and 'hf epa cnonces', their fallback for firmware
+#  that doesn't stream (-o), a collection stopped with a key press,
+#  'lf t55xx bruteforce' against a password protected T55x7 (-t) and the raw
+#  ISO14443-A frames of the ul_read script, built in lua byte buffers.
+#  The flasher writes an image to the emulated bootloader (-b), acknowledging
+#  every block as the bootrom does, or in windows with -W.
+#
+#  usage: pm3_pty_device_test.py [unittest options]
+
+import os
+import pty
+import random
+import re
+import select
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+import unittest
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+EMULATOR = os.path.join(TOOLS_DIR, 'pm3_pty_device.py')
+CLIENT_DIR = os.path.join(TOOLS_DIR, '..', 'client')
+CLIENT = os.path.join(CLIENT_DIR, 'proxmark3')
+FLASHER = os.path.join(CLIENT_DIR, 'flasher')
+
+CLIENT_TIMEOUT = 60
+
+FLASH_START = 0x100000
+BLOCK_SIZE = 0x200
+
+class Emulator:
+	# pm3_pty_device.py in the background, ports holds the names of its ptys
+	def __init__(self, count=1, options=()):
+		self.process = subprocess.Popen([sys.executable, EMULATOR] + list(options) + [str(count)],
+			stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+		self.ports = [self.process.stdout.readline().decode().strip() for i in range(count)]
+
+	def __enter__(self):
+		return self
+
+	def __exit__(self, *args):
+		self.process.terminate()
+		self.process.wait()
+		# what the emulator logged, on stderr
+		self.log = self.process.stderr.read().decode()
+		self.process.stdout.close()
+		self.process.stderr.close()
+
+class TestPtyDevice(unittest.TestCase):
+	def setUp(self):
+		self.dir = tempfile.mkdtemp()
+
+	def tearDown(self):
+		shutil.rmtree(self.dir)
+
+	def write_script(self, commands):
+		script = os.path.join(self.dir, 'commands.scr')
+		with open(script, 'w') as f:
+			f.write('\n'.join(commands + ['exit']) + '\n')
+		return script
+
+	def run_client(self, port, commands):
+		# stdin is not a terminal, so nothing looks like a key press
+		with open(os.devnull) as devnull:
+			return subprocess.check_output([CLIENT, port, self.write_script(commands)], stdin=devnull,
+				stderr=subprocess.STDOUT, cwd=CLIENT_DIR, timeout=CLIENT_TIMEOUT).decode(errors='replace')
+
+	def run_client_with_key(self, port, commands, prompt, key_delay):
+		# the client on a pty, a key is pressed key_delay seconds after prompt was printed
+		master, slave = pty.openpty()
+		process = subprocess.Popen([CLIENT, port, self.write_script(commands)], stdin=slave, stdout=slave,
+			stderr=slave, cwd=CLIENT_DIR)
+		os.close(slave)
+		output = b''
+		pressed_at = None
+		deadline = time.time() + CLIENT_TIMEOUT
+		try:
+			while time.time() < deadline:
+				if pressed_at is None and prompt.encode() in output:
+					pressed_at = time.time() + key_delay
+				if pressed_at is not None and pressed_at > 0 and time.time() >= pressed_at:
+					os.write(master, b'x')
+					pressed_at = 0
+				ready, _, _ = select.select([master], [], [], 0.1)
+				if not ready:
+					continue
+				try:
+					data = os.read(master, 4096)
+				except OSError:
+					break
+				if not data:
+					break
+				output += data
+			process.wait(timeout=max(deadline - time.time(), 1))
+		finally:
+			if process.poll() is None:
+				process.kill()
+				process.wait()
+			os.close(master)
+		return output.decode(errors='replace')
+
+	def read_records(self, filename):
+		records = []
+		with open(filename, 'rb') as f:
+			data = f.read()
+		pos = 0
+		while pos < len(data):
+			records.append(data[pos + 1:pos + 1 + ord(data[pos:pos + 1])])
+			pos += 1 + ord(data[pos:pos + 1])
+		self.assertEqual(pos, len(data))
+		return records
+
+	def test_sessions(self):
+		with Emulator(2) as emulator:
+			s0 = os.path.join(self.dir, 's0.txt')
+			s1 = os.path.join(self.dir, 's1.txt')
+			output = self.run_client(emulator.ports[0], [
+				'session open ' + emulator.ports[1],
+				'session ping 20',
+				'data samples 2000',
+				'data save ' + s0,
+				'session use 1',
+				'data samples 2000',
+				'data save ' + s1,
+				'session list',
+				'session close 1',
+				'session list'])
+		self.assertIn('Session 1: ' + emulator.ports[1], output)
+		self.assertIn('2 devices, 40 pings', output)
+		self.assertIn('Current device: 1 ' + emulator.ports[1], output)
+		# every device has its own sawtooth in the sample memory
+		for filename, step in ((s0, 1), (s1, 2)):
+			with open(filename) as f:
+				samples = [int(line) for line in f]
+			self.assertEqual(samples, [(i * step & 0xff) - 128 for i in range(2000)])
+		# the last list is after the close
+		last_list = output.split('session list')[-1]
+		self.assertIn(emulator.ports[0], last_list)
+		self.assertNotIn(emulator.ports[1], last_list)
+
+	def test_cuids(self):
+		uids = os.path.join(self.dir, 'uids.bin')
+		with Emulator(1, ['-r', '300']) as emulator:
+			output = self.run_client(emulator.ports[0], ['hf 14a cuids 2000 ' + uids])
+		records = self.read_records(uids)
+		self.assertIn('Wrote %d unique UIDs to %s' % (len(records), uids), output)
+		self.assertIn('%d duplicates' % (2000 - len(records)), output)
+		self.assertEqual(len(records), len(set(records)))
+		self.assertTrue(0 < len(records) <= 300)
+		self.assertTrue(all(len(r) == 4 and r[0:1] == b'\x08' for r in records))
+
+	def test_cnonces(self):
+		nonces = os.path.join(self.dir, 'nonces.bin')
+		with Emulator(1) as emulator:
+			output = self.run_client(emulator.ports[0], ['hf epa cnonces 8 500 0 ' + nonces, 'hf epa cnonces 4 10 0'])
+		records = self.read_records(nonces)
+		self.assertEqual(len(records), 500)
+		self.assertTrue(all(len(r) == 8 for r in records))
+		self.assertIn('Wrote 500 unique nonces to ' + nonces, output)
+		# without a file the nonces are printed
+		self.assertIn('10 nonces', output)
+		self.assertEqual(len([line for line in output.splitlines() if len(line.strip()) == 8 and
+			all(c in '0123456789ABCDEFabcdef' for c in line.strip())]), 10)
+
+	def test_fallback(self):
+		with Emulator(1, ['-o']) as emulator:
+			output = self.run_client(emulator.ports[0], ['hf 14a cuids 5', 'hf epa cnonces 8 3 0'])
+		self.assertIn("The firmware doesn't stream UIDs, collecting one per command", output)
+		self.assertIn("The firmware doesn't stream nonces, collecting one per command", output)
+		self.assertEqual(output.count('Length: 8, Nonce: '), 3)
+		lines = output.splitlines()
+		start = [i for i, line in enumerate(lines) if line.startswith('Start: ')][0]
+		end = [i for i, line in enumerate(lines) if line.startswith('End: ')][0]
+		self.assertEqual(end - start - 1, 5)
+
+	def test_stop(self):
+		uids = os.path.join(self.dir, 'uids.bin')
+		with Emulator(1, ['-u', '1']) as emulator:
+			started = time.time()
+			output = self.run_client_with_key(emulator.ports[0],
+				['hf 14a cuids 1000000 ' + uids, 'hw ping'], 'Press any key to stop', 2)
+		self.assertLess(time.time() - started, CLIENT_TIMEOUT)
+		records = self.read_records(uids)
+		self.assertTrue(0 < len(records) < 1000000)
+		self.assertIn('Wrote %d unique UIDs' % len(records), output)
+		# the device is back to normal after the stop
+		self.assertIn('Ping successful', output)
+
+	def test_t55xx_bruteforce(self):
+		dictionary = os.path.join(self.dir, 'passwords.dic')
+		with open(dictionary, 'w') as f:
+			f.write('# comment\n11223300\n1122330a\n11223301\n')
+		with Emulator(1, ['-t', '1122330a']) as emulator:
+			output = self.run_client(emulator.ports[0], [
+				'lf t55xx bruteforce 11223300 11223310',
+				'lf t55xx bruteforce 11223300 11223304',
+				'lf t55xx config d ASK b 32',
+				'lf t55xx bruteforce c 11223300 11223310',
+				'lf t55xx bruteforce i ' + dictionary])
+		results = re.findall(r'(?:Found valid password|Password NOT found).*\]', output)
+		self.assertEqual(results, [
+			'Found valid password: [1122330a]',
+			'Password NOT found. Last tried: [11223304]',
+			'Found valid password: [1122330a]',
+			'Found valid password: [1122330A]'])
+		self.assertIn('11 passwords tested', output)
+		self.assertIn('5 passwords tested', output)
+		self.assertIn('2 passwords tested', output)
+		self.assertIn('Block0     : 0x00088040', output)
+		# with the configuration (c) only the samples for three repetitions of the block
+		# at RF/32 are acquired, else the full 12000. A found password leaves the read of
+		# the next one pending.
+		reads = [int(n) for n in re.findall(r't55xx read, (\d+) samples', emulator.log)]
+		self.assertEqual(reads, [12000] * (12 + 5) + [1024 + 3 * 32 * 32] * 12 + [12000] * 3)
+
+	def test_t55xx_abort(self):
+		with Emulator(1, ['-t', '1122330a', '-d', '20']) as emulator:
+			output = self.run_client_with_key(emulator.ports[0],
+				['lf t55xx bruteforce 00000000 00100000', 'hw ping'], 'Search password range', 2)
+		self.assertIn('aborted via keyboard!', output)
+		tested = int(re.search(r'(\d+) passwords tested in', output).group(1))
+		last = int(re.search(r'Password NOT found\. Last tried: \[([0-9a-f]{8})\]', output).group(1), 16)
+		self.assertTrue(0 < tested < 0x100000)
+		self.assertEqual(last, tested - 1)
+		# the read started before the abort doesn't disturb the next command
+		self.assertIn('Ping successful', output)
+
+	def test_ultralight_read(self):
+		with Emulator(1) as emulator:
+			output = self.run_client(emulator.ports[0], ['script run ul_read -p 18', 'hw ping'])
+		pages = re.findall(r'^ *(\d+)  ([0-9A-F]{8})$', output, re.MULTILINE)
+		# the emulated Ultralight has 16 pages, the READ wraps around
+		self.assertEqual(pages, [(str(p), '%02X%02X%02X%02X' % tuple((p % 16) * 4 + i for i in range(4)))
+			for p in range(18)])
+		# no answer to the field off at the end
+		self.assertIn('Ping successful', output)
+
+	def write_elf(self, address, data):
+		# an ARM executable with one read only segment, as the flasher loads it
+		elf = os.path.join(self.dir, 'image.elf')
+		phoff = 52
+		offset = phoff + 32
+		header = b'\x7fELF\x01\x01\x01' + b'\0' * 9 + struct.pack('<HHIIIIIHHHHHH',
+			2, 40, 1, address, phoff, 0, 0, 52, 32, 1, 40, 0, 0)
+		phdr = struct.pack('<IIIIIIII', 1, offset, address, address, len(data), len(data), 5, 4)
+		with open(elf, 'wb') as f:
+			f.write(header + phdr + data)
+		return elf
+
+	def flash(self, options, image, flash_file):
+		with Emulator(1, ['-b', '-f', flash_file] + options) as emulator:
+			output = subprocess.check_output([FLASHER, emulator.ports[0], image], stderr=subprocess.STDOUT,
+				timeout=CLIENT_TIMEOUT).decode(errors='replace')
+		self.assertIn('All done.', output)
+		return emulator.log
+
+	def test_flash(self):
+		address = 0x110000
+		rnd = random.Random(40)
+		data = bytes(rnd.getrandbits(8) for i in range(20 * BLOCK_SIZE + 100))
+		image = self.write_elf(address, data)
+		for options in ([], ['-W']):
+			flash_file = os.path.join(self.dir, 'flash%s.bin' % ''.join(options))
+			log = self.flash(options, image, flash_file)
+			self.assertIn('reset after 21 block writes', log)
+			with open(flash_file, 'rb') as f:
+				flash = f.read()
+			offset = address - FLASH_START
+			# the last block is padded
+			self.assertEqual(flash[offset:offset + 21 * BLOCK_SIZE], data + b'\xff' * (BLOCK_SIZE - 100))
+			self.assertNotIn('unexpected command', log)
+		# the windowed flasher skips the blocks which already have the contents
+		self.assertIn('reset after 0 block writes', self.flash(['-W'], image, flash_file))
+
+if __name__ == '__main__':
+	unittest.main()